@@ -0,0 +1,578 @@
+#include "audiofeatures.h"
+#include "virtualtrack.h"
+#include <QProcess>
+#include <QStandardPaths>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define AUDIOFEATURES_SSE
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define AUDIOFEATURES_NEON
+#endif
+
+static const int frameSize = 1024;
+static const int hopSize = 512;
+static const int excerptSeconds = 30;
+static const int pollIntervalMs = 100;
+static const float pi = 3.14159265f;
+
+// Для тональности нужно разрешение лучше полутона на низких нотах: окно 4096 (5.4 Гц на бин)
+// раз в восемь шагов - около пяти спектров в секунду
+static const int chromaFrameSize = 4096;
+static const int chromaEvery = 8;
+static const float chromaLowHz = 80.0f;
+static const float chromaHighHz = 2000.0f;
+
+// Границы полос в Гц: бас, низкая середина, середина, присутствие, яркость, воздух
+static const float bandEdges[] = {50, 150, 400, 1000, 2500, 6000, AudioFeatures::SampleRate / 2.0f};
+static const int bandCount = 6;
+
+// Профили тональностей Крумхансла-Кесслера, от тоники
+static const double majorProfile[12] = {6.35, 2.23, 3.48, 2.33, 4.38, 4.09, 2.52, 5.19, 2.39, 3.66, 2.29, 2.88};
+static const double minorProfile[12] = {6.33, 2.68, 3.52, 5.38, 2.60, 3.53, 2.54, 4.75, 3.98, 2.69, 3.34, 3.17};
+
+namespace {
+
+const QList<float> &hannWindow(int size)
+{
+    auto build = [](int length) {
+        QList<float> result(length);
+        for (int i = 0; i < length; ++i) {
+            result[i] = 0.5f - 0.5f * std::cos(2.0f * pi * i / length);
+        }
+        return result;
+    };
+    static const QList<float> frameWindow = build(frameSize);
+    static const QList<float> chromaWindow = build(chromaFrameSize);
+    return size == chromaFrameSize ? chromaWindow : frameWindow;
+}
+
+struct SpectrumSums {
+    float flux = 0;
+    float power = 0;
+    float magnitude = 0;
+    float weighted = 0;                 // сумма k * |X[k]| для центроида
+};
+
+// Один проход по спектру кадра: мощность по бинам, суммы для центроида и спектральный поток
+// по сжатой амплитуде (корень четвёртой степени из мощности) - огибающая атак для темпа.
+// По четыре бина за итерацию на SSE/NEON, хвост - скалярно
+SpectrumSums spectrumFrame(const float *re, const float *im, float *power, float *previous, int bins)
+{
+    SpectrumSums sums;
+    int k = 0;
+#if defined(AUDIOFEATURES_SSE)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 four = _mm_set1_ps(4.0f);
+    __m128 index = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    __m128 flux = zero, total = zero, magnitude = zero, weighted = zero;
+    for (; k + 4 <= bins; k += 4) {
+        const __m128 r = _mm_loadu_ps(re + k);
+        const __m128 i = _mm_loadu_ps(im + k);
+        const __m128 p = _mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(i, i));
+        _mm_storeu_ps(power + k, p);
+        const __m128 m = _mm_sqrt_ps(p);
+        const __m128 c = _mm_sqrt_ps(m);
+        flux = _mm_add_ps(flux, _mm_max_ps(_mm_sub_ps(c, _mm_loadu_ps(previous + k)), zero));
+        _mm_storeu_ps(previous + k, c);
+        total = _mm_add_ps(total, p);
+        magnitude = _mm_add_ps(magnitude, m);
+        weighted = _mm_add_ps(weighted, _mm_mul_ps(m, index));
+        index = _mm_add_ps(index, four);
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, flux);
+    sums.flux = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    _mm_storeu_ps(lanes, total);
+    sums.power = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    _mm_storeu_ps(lanes, magnitude);
+    sums.magnitude = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    _mm_storeu_ps(lanes, weighted);
+    sums.weighted = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(AUDIOFEATURES_NEON)
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t four = vdupq_n_f32(4.0f);
+    const float initial[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+    float32x4_t index = vld1q_f32(initial);
+    float32x4_t flux = zero, total = zero, magnitude = zero, weighted = zero;
+    for (; k + 4 <= bins; k += 4) {
+        const float32x4_t r = vld1q_f32(re + k);
+        const float32x4_t i = vld1q_f32(im + k);
+        const float32x4_t p = vmlaq_f32(vmulq_f32(r, r), i, i);
+        vst1q_f32(power + k, p);
+        const float32x4_t m = vsqrtq_f32(p);
+        const float32x4_t c = vsqrtq_f32(m);
+        flux = vaddq_f32(flux, vmaxq_f32(vsubq_f32(c, vld1q_f32(previous + k)), zero));
+        vst1q_f32(previous + k, c);
+        total = vaddq_f32(total, p);
+        magnitude = vaddq_f32(magnitude, m);
+        weighted = vmlaq_f32(weighted, m, index);
+        index = vaddq_f32(index, four);
+    }
+    sums.flux = vaddvq_f32(flux);
+    sums.power = vaddvq_f32(total);
+    sums.magnitude = vaddvq_f32(magnitude);
+    sums.weighted = vaddvq_f32(weighted);
+#endif
+    for (; k < bins; ++k) {
+        const float p = re[k] * re[k] + im[k] * im[k];
+        power[k] = p;
+        const float m = std::sqrt(p);
+        const float c = std::sqrt(m);
+        sums.flux += qMax(0.0f, c - previous[k]);
+        previous[k] = c;
+        sums.power += p;
+        sums.magnitude += m;
+        sums.weighted += m * k;
+    }
+    return sums;
+}
+
+float mean(const QList<float> &values)
+{
+    if (values.isEmpty()) return 0.0f;
+    double sum = 0.0;
+    for (float value : values) sum += value;
+    return float(sum / values.size());
+}
+
+float deviation(const QList<float> &values, float average)
+{
+    if (values.size() < 2) return 0.0f;
+    double sum = 0.0;
+    for (float value : values) sum += double(value - average) * (value - average);
+    return float(std::sqrt(sum / values.size()));
+}
+
+} // namespace
+
+bool AudioFeatures::isAvailable()
+{
+    static const bool available = !QStandardPaths::findExecutable("ffmpeg").isEmpty();
+    return available;
+}
+
+qint64 AudioFeatures::excerptStartMs(qint64 durationMs, int seconds)
+{
+    // Середина трека характернее вступления; короткие треки берутся с начала
+    if (durationMs <= (seconds + 20) * 1000LL) return 0;
+    return durationMs / 2 - seconds * 500LL;
+}
+
+QList<float> AudioFeatures::decode(const QString &fileName, qint64 durationMs, int seconds,
+                                   const QAtomicInt &cancelFlag, QString *errorString)
+{
+    QStringList arguments = {"-nostdin", "-hide_banner", "-loglevel", "error", "-threads", "1"};
+    // -ss до -i ищет по контейнеру, без декодирования. У виртуального трека отрывок
+    // отсчитывается от начала отрезка и не заходит за его конец
+    const VirtualTrack range = VirtualTrack::fromPath(fileName);
+    const qint64 startMs = range.startMs() + excerptStartMs(durationMs, seconds);
+    qint64 lengthMs = seconds * 1000LL;
+    if (range.endUs >= 0) lengthMs = qMin(lengthMs, range.endMs() - startMs);
+    if (startMs > 0) arguments << "-ss" << QString::number(startMs / 1000.0, 'f', 3);
+    arguments << "-t" << QString::number(lengthMs / 1000.0, 'f', 3) << "-i" << range.filePath
+              << "-vn" << "-ac" << "1" << "-ar" << QString::number(SampleRate) << "-f" << "f32le" << "-";
+
+    QProcess process;
+    process.start(QStandardPaths::findExecutable("ffmpeg"), arguments);
+    if (!process.waitForStarted()) {
+        if (errorString) *errorString = process.errorString();
+        return {};
+    }
+
+    QByteArray pcm;
+    while (!process.waitForFinished(pollIntervalMs)) {
+        pcm += process.readAllStandardOutput();
+        if (process.state() == QProcess::NotRunning) break;
+        if (cancelFlag.loadRelaxed()) {
+            process.kill();
+            process.waitForFinished();
+            if (errorString) *errorString = "cancelled";
+            return {};
+        }
+    }
+    pcm += process.readAllStandardOutput();
+
+    if (process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0) {
+        if (errorString) {
+            const QString message = QString::fromLocal8Bit(process.readAllStandardError()).trimmed();
+            *errorString = message.isEmpty() ? QString("ffmpeg exited with code %1").arg(process.exitCode())
+                                             : message.section('\n', -1).trimmed();
+        }
+        return {};
+    }
+
+    // f32le совпадает с порядком байт на x86 и ARM
+    QList<float> samples(pcm.size() / qsizetype(sizeof(float)));
+    std::memcpy(samples.data(), pcm.constData(), size_t(samples.size()) * sizeof(float));
+    return samples;
+}
+
+AudioDescriptor AudioFeatures::analyze(const QString &fileName, qint64 durationMs,
+                                       const QAtomicInt &cancelFlag, QString *errorString)
+{
+    const QList<float> samples = decode(fileName, durationMs, excerptSeconds, cancelFlag, errorString);
+    if (samples.size() < 3 * SampleRate) {
+        if (errorString && errorString->isEmpty()) *errorString = "too short to analyze";
+        return AudioDescriptor();
+    }
+    AudioDescriptor result = extract(samples);
+
+    // Сетка из фрагмента продлевается на весь трек: храним долю, ближайшую к началу
+    TrackTempo &tempo = result.tempo;
+    if (tempo.isValid()) {
+        const double beat = tempo.beatMs();
+        tempo.beatOffsetMs = float(std::fmod(excerptStartMs(durationMs, excerptSeconds) + double(tempo.beatOffsetMs), beat));
+    }
+    return result;
+}
+
+AudioDescriptor AudioFeatures::extract(const QList<float> &samples)
+{
+    AudioDescriptor result;
+    result.seconds = float(samples.size()) / SampleRate;
+    const int frames = int((samples.size() - frameSize) / hopSize) + 1;
+    if (frames < 2) return result;
+
+    const QList<float> &window = hannWindow(frameSize);
+    const QList<float> &chromaWindow = hannWindow(chromaFrameSize);
+    const float binHz = float(SampleRate) / frameSize;
+    const int bins = frameSize / 2 + 1;
+
+    QList<float> centroids;
+    QList<float> rolloffs;
+    QList<float> flatness;
+    QList<float> crossings;
+    QList<float> levels;
+    QList<float> onsets;
+    centroids.reserve(frames);
+    onsets.reserve(frames);
+
+    double bandPower[bandCount] = {};
+    double chroma[12] = {};
+    QList<float> re(chromaFrameSize);
+    QList<float> im(chromaFrameSize);
+    QList<float> power(bins);
+    QList<float> previous(bins, 0.0f);
+
+    // Бины хромы: номер ноты по MIDI, по модулю октавы
+    const float chromaBinHz = float(SampleRate) / chromaFrameSize;
+    const int chromaFirst = int(std::ceil(chromaLowHz / chromaBinHz));
+    const int chromaLast = int(chromaHighHz / chromaBinHz);
+    QList<int> pitchClass(chromaLast + 1, 0);
+    for (int k = chromaFirst; k <= chromaLast; ++k) {
+        const long note = std::lround(12.0 * std::log2(k * chromaBinHz / 440.0) + 69.0);
+        pitchClass[k] = int(((note % 12) + 12) % 12);
+    }
+
+    for (int f = 0; f < frames; ++f) {
+        const float *frame = samples.constData() + qsizetype(f) * hopSize;
+
+        double energy = 0.0;
+        int signChanges = 0;
+        for (int i = 0; i < frameSize; ++i) {
+            energy += double(frame[i]) * frame[i];
+            if (i > 0 && (frame[i] >= 0.0f) != (frame[i - 1] >= 0.0f)) ++signChanges;
+            re[i] = frame[i] * window.at(i);
+            im[i] = 0.0f;
+        }
+        fft(re.data(), im.data(), frameSize);
+
+        const SpectrumSums sums = spectrumFrame(re.constData(), im.constData(), power.data(), previous.data(), bins);
+        onsets.append(f > 0 ? sums.flux : 0.0f);
+
+        const double rms = std::sqrt(energy / frameSize);
+        if (rms < 1e-4) continue;       // тишина не описывает звучание
+
+        centroids.append(sums.weighted / sums.magnitude / (bins - 1));
+
+        const double total = sums.power;
+        double cumulative = 0.0;
+        double logSum = 0.0;
+        int rolloff = -1;
+        for (int k = 0; k < bins; ++k) {
+            cumulative += power.at(k);
+            logSum += std::log(power.at(k) + 1e-12);
+            if (rolloff < 0 && cumulative >= 0.85 * total) rolloff = k;
+        }
+        rolloffs.append(float(rolloff < 0 ? bins - 1 : rolloff) / (bins - 1));
+
+        const double arithmetic = total / bins + 1e-12;
+        flatness.append(float(std::exp(logSum / bins) / arithmetic));
+        crossings.append(float(signChanges) / frameSize);
+        levels.append(float(20.0 * std::log10(rms)));
+
+        int band = 0;
+        for (int k = 1; k < bins && band < bandCount; ++k) {
+            const float hz = k * binHz;
+            if (hz < bandEdges[0]) continue;
+            while (band < bandCount && hz >= bandEdges[band + 1]) ++band;
+            if (band < bandCount) bandPower[band] += power.at(k);
+        }
+
+        // Хрома - по длинному окну и реже: нужна разрешающая способность, а не время
+        if (f % chromaEvery == 0 && qsizetype(f) * hopSize + chromaFrameSize <= samples.size()) {
+            for (int i = 0; i < chromaFrameSize; ++i) {
+                re[i] = frame[i] * chromaWindow.at(i);
+                im[i] = 0.0f;
+            }
+            fft(re.data(), im.data(), chromaFrameSize);
+            double frameChroma[12] = {};
+            double frameTotal = 0.0;
+            for (int k = chromaFirst; k <= chromaLast; ++k) {
+                const double magnitude = std::sqrt(double(re.at(k)) * re.at(k) + double(im.at(k)) * im.at(k));
+                frameChroma[pitchClass.at(k)] += magnitude;
+                frameTotal += magnitude;
+            }
+            // Каждый кадр с равным весом: громкий припев не перекрывает тональность куплета
+            if (frameTotal > 0.0) {
+                for (int c = 0; c < 12; ++c) chroma[c] += frameChroma[c] / frameTotal;
+            }
+        }
+    }
+    if (levels.size() < frames / 4) return result;
+
+    float clarity = 0.0f;
+    float phase = 0.0f;
+    const float framesPerSecond = float(SampleRate) / hopSize;
+    result.tempo.bpm = estimateTempo(onsets, framesPerSecond, &clarity, &phase);
+    if (result.tempo.isValid()) {
+        // Поток кадра относится к его середине
+        result.tempo.beatOffsetMs = (phase * hopSize + frameSize / 2) * 1000.0f / SampleRate;
+    }
+    result.tempo.key = estimateKey(chroma, &result.tempo.keyStrength);
+
+    const float centroid = mean(centroids);
+    const float level = mean(levels);
+    result.loudnessDb = level;
+
+    // Масштабы подобраны так, чтобы у типичной музыки каждая компонента менялась примерно на 0..1
+    float *v = result.values;
+    v[0] = centroid * 3.0f;
+    v[1] = deviation(centroids, centroid) * 6.0f;
+    v[2] = mean(rolloffs) * 1.5f;
+    v[3] = std::sqrt(mean(flatness)) * 1.5f;
+    v[4] = mean(crossings) * 8.0f;
+    v[5] = (level + 40.0f) / 20.0f;
+    v[6] = deviation(levels, level) / 6.0f;
+
+    double bandTotal = 0.0;
+    for (double value : bandPower) bandTotal += value;
+    for (int b = 0; b < bandCount; ++b) {
+        v[7 + b] = bandTotal > 0.0 ? float(std::sqrt(bandPower[b] / bandTotal)) * 1.5f : 0.0f;
+    }
+
+    // Темп - угол на окружности октав: 60, 120 и 240 BPM совпадают,
+    // ошибка оценки вдвое не уводит трек в другой угол пространства
+    if (result.tempo.isValid()) {
+        const float angle = 2.0f * pi * std::log2(result.tempo.bpm / 60.0f);
+        v[13] = 0.5f * clarity * std::cos(angle);
+        v[14] = 0.5f * clarity * std::sin(angle);
+    }
+    v[15] = clarity * 2.0f;
+
+    result.valid = true;
+    return result;
+}
+
+float AudioFeatures::estimateTempo(const QList<float> &onsets, float framesPerSecond,
+                                   float *clarity, float *phaseFrames)
+{
+    *clarity = 0.0f;
+    *phaseFrames = 0.0f;
+    const int count = onsets.size();
+    const float average = mean(onsets);
+
+    // Сглаживание: пик автокорреляции на дробной задержке не разваливается между кадрами
+    static const float kernel[] = {1.0f / 16, 4.0f / 16, 6.0f / 16, 4.0f / 16, 1.0f / 16};
+    QList<float> envelope(count, 0.0f);
+    for (int i = 0; i < count; ++i) {
+        for (int k = -2; k <= 2; ++k) {
+            const int j = qBound(0, i + k, count - 1);
+            envelope[i] += kernel[k + 2] * (onsets.at(j) - average);
+        }
+    }
+
+    const int minLag = qMax(1, int(framesPerSecond * 60.0f / 200.0f));
+    const int maxLag = int(std::ceil(framesPerSecond * 60.0f / 60.0f));
+    // Нужны задержки до 2 * maxLag + 1 для гармоники
+    if (2 * maxLag + 2 >= count) return 0.0f;
+
+    QList<double> values(2 * maxLag + 2, 0.0);
+    for (int lag = 0; lag < values.size(); ++lag) {
+        double sum = 0.0;
+        for (int i = lag; i < count; ++i) sum += double(envelope.at(i)) * envelope.at(i - lag);
+        values[lag] = sum / (count - lag);
+    }
+    const double zero = values.at(0);
+    if (zero <= 0.0) return 0.0f;
+
+    int best = -1;
+    double bestScore = 0.0;
+    for (int lag = minLag; lag <= maxLag; ++lag) {
+        // Период подтверждается пиком на удвоенной задержке; предпочтение темпам
+        // около 120 BPM снимает оставшуюся неоднозначность между кратными
+        const double harmonic = qMax(values.at(2 * lag - 1), qMax(values.at(2 * lag), values.at(2 * lag + 1)));
+        const float bpm = 60.0f * framesPerSecond / lag;
+        const float octaves = std::log2(bpm / 120.0f);
+        const double score = (values.at(lag) + 0.5 * harmonic) * std::exp(-0.5 * octaves * octaves);
+        if (score > bestScore) {
+            bestScore = score;
+            best = lag;
+        }
+    }
+    if (best < 0) return 0.0f;
+
+    // Параболическая интерполяция пика - точность лучше одного кадра
+    double offset = 0.0;
+    const double left = values.at(best - 1);
+    const double centre = values.at(best);
+    const double right = values.at(best + 1);
+    const double denominator = left - 2.0 * centre + right;
+    if (denominator < 0.0) offset = qBound(-0.5, 0.5 * (left - right) / denominator, 0.5);
+
+    // Сетка долей: период уточняется вместе с фазой по совпадению долей с атаками.
+    // Ошибка периода в десятую кадра за полминуты сдвигает сетку на сотню миллисекунд
+    double period = best + offset;
+    double bestPhase = 0.0;
+    double bestSum = -1e300;
+    const double estimate = period;
+    for (double candidate = estimate - 0.3; candidate <= estimate + 0.3; candidate += 0.02) {
+        for (double phase = 0.0; phase < candidate; phase += 0.25) {
+            double sum = 0.0;
+            for (double t = phase; t < count - 1; t += candidate) {
+                const int i = int(t);
+                const double fraction = t - i;
+                sum += envelope.at(i) * (1.0 - fraction) + envelope.at(i + 1) * fraction;
+            }
+            if (sum > bestSum) {
+                bestSum = sum;
+                bestPhase = phase;
+                period = candidate;
+            }
+        }
+    }
+
+    *clarity = float(qBound(0.0, centre / zero, 1.0));
+    *phaseFrames = float(bestPhase);
+    return float(60.0 * framesPerSecond / period);
+}
+
+int AudioFeatures::estimateKey(const double *chroma, float *strength)
+{
+    *strength = 0.0f;
+    double total = 0.0;
+    for (int c = 0; c < 12; ++c) total += chroma[c];
+    if (total <= 0.0) return -1;
+
+    // Корреляция Пирсона с профилем, повёрнутым на каждую из 12 тоник
+    auto correlate = [chroma](const double *profile, int tonic) {
+        double profileMean = 0.0;
+        double chromaMean = 0.0;
+        for (int c = 0; c < 12; ++c) {
+            profileMean += profile[c];
+            chromaMean += chroma[c];
+        }
+        profileMean /= 12.0;
+        chromaMean /= 12.0;
+        double covariance = 0.0;
+        double profileVariance = 0.0;
+        double chromaVariance = 0.0;
+        for (int c = 0; c < 12; ++c) {
+            const double p = profile[(c - tonic + 12) % 12] - profileMean;
+            const double x = chroma[c] - chromaMean;
+            covariance += p * x;
+            profileVariance += p * p;
+            chromaVariance += x * x;
+        }
+        const double denominator = std::sqrt(profileVariance * chromaVariance);
+        return denominator > 0.0 ? covariance / denominator : 0.0;
+    };
+
+    int best = -1;
+    double bestScore = 0.0;
+    for (int tonic = 0; tonic < 12; ++tonic) {
+        const double major = correlate(majorProfile, tonic);
+        const double minor = correlate(minorProfile, tonic);
+        if (major > bestScore) {
+            bestScore = major;
+            best = tonic;
+        }
+        if (minor > bestScore) {
+            bestScore = minor;
+            best = 12 + tonic;
+        }
+    }
+    *strength = float(bestScore);
+    return best;
+}
+
+QString AudioFeatures::keyName(int key)
+{
+    static const char *const names[] = {"C", "C#", "D", "Eb", "E", "F", "F#", "G", "Ab", "A", "Bb", "B"};
+    if (key < 0 || key >= 24) return QString();
+    return QString::fromLatin1(names[key % 12]) + (key >= 12 ? "m" : "");
+}
+
+QString AudioFeatures::camelotName(int key)
+{
+    if (key < 0 || key >= 24) return QString();
+    // Минор делит номер со своим параллельным мажором (A-moll - C-dur, 8A и 8B)
+    const bool minor = key >= 12;
+    const int major = minor ? (key % 12 + 3) % 12 : key;
+    const int number = (major * 7 % 12 + 7) % 12 + 1;
+    return QString::number(number) + (minor ? "A" : "B");
+}
+
+bool AudioFeatures::keysCompatible(int a, int b)
+{
+    if (a < 0 || b < 0) return true;    // неизвестная тональность не мешает сведению
+    if (a == b) return true;
+    const QString first = camelotName(a);
+    const QString second = camelotName(b);
+    const int numberA = first.chopped(1).toInt();
+    const int numberB = second.chopped(1).toInt();
+    if (numberA == numberB) return true;
+    if (first.back() != second.back()) return false;
+    const int step = (numberA - numberB + 12) % 12;
+    return step == 1 || step == 11;
+}
+
+void AudioFeatures::fft(float *re, float *im, int size)
+{
+    // Итеративный radix-2: перестановка с обращением битов, затем бабочки
+    for (int i = 1, j = 0; i < size; ++i) {
+        int bit = size >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+    for (int length = 2; length <= size; length <<= 1) {
+        const float angle = -2.0f * pi / length;
+        const float stepRe = std::cos(angle);
+        const float stepIm = std::sin(angle);
+        for (int start = 0; start < size; start += length) {
+            float wRe = 1.0f;
+            float wIm = 0.0f;
+            for (int k = 0; k < length / 2; ++k) {
+                const int a = start + k;
+                const int b = a + length / 2;
+                const float tRe = re[b] * wRe - im[b] * wIm;
+                const float tIm = re[b] * wIm + im[b] * wRe;
+                re[b] = re[a] - tRe;
+                im[b] = im[a] - tIm;
+                re[a] += tRe;
+                im[a] += tIm;
+                const float next = wRe * stepRe - wIm * stepIm;
+                wIm = wRe * stepIm + wIm * stepRe;
+                wRe = next;
+            }
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef AUDIOFEATURES_H
+#define AUDIOFEATURES_H
+
+#include <QAtomicInt>
+#include <QList>
+#include <QString>
+
+// Темп, сетка долей и тональность - для сведения соседних треков в автомиксе.
+// Сетка считается равномерной: по фрагменту из середины продлевается на весь трек
+struct TrackTempo {
+    float bpm = 0;
+    float beatOffsetMs = 0;             // положение одной из долей от начала трека, 0..период
+    int key = -1;                       // 0..11 - мажор от C, 12..23 - минор от C, -1 - не определена
+    float keyStrength = 0;              // корреляция с профилем тональности, 0..1
+
+    bool isValid() const { return bpm > 0; }
+    double beatMs() const { return bpm > 0 ? 60000.0 / bpm : 0.0; }
+};
+
+// Компактный описатель звучания трека для поиска похожих: темп, форма спектра, громкость.
+// Считается по 30-секундному фрагменту из середины трека, декодированному ffmpeg в моно 22050 Гц.
+// Компоненты приведены к сравнимым масштабам, так что евклидово расстояние имеет смысл как есть.
+struct AudioDescriptor {
+    static constexpr int Dimensions = 16;
+
+    float values[Dimensions] = {};
+    TrackTempo tempo;                   // в values темп закодирован по октавам, здесь - как есть
+    float loudnessDb = 0;
+    float seconds = 0;                  // длина проанализированного фрагмента
+    bool valid = false;
+};
+
+class AudioFeatures
+{
+public:
+    static constexpr int SampleRate = 22050;
+
+    // false, если ffmpeg не найден - анализ тогда недоступен
+    static bool isAvailable();
+
+    // Моно float PCM фрагмента длиной до seconds секунд; durationMs - для выбора середины
+    static QList<float> decode(const QString &fileName, qint64 durationMs, int seconds,
+                               const QAtomicInt &cancelFlag, QString *errorString = nullptr);
+    // Позиция сетки долей в результате - от начала samples
+    static AudioDescriptor extract(const QList<float> &samples);
+    static AudioDescriptor analyze(const QString &fileName, qint64 durationMs,
+                                   const QAtomicInt &cancelFlag, QString *errorString = nullptr);
+    static qint64 excerptStartMs(qint64 durationMs, int seconds);
+
+    static QString keyName(int key);
+    // Обозначение по кругу Camelot ("8A"): совместимы соседи по кругу и одна позиция в другом ряду
+    static QString camelotName(int key);
+    static bool keysCompatible(int a, int b);
+
+private:
+    static void fft(float *re, float *im, int size);
+    static float estimateTempo(const QList<float> &onsets, float framesPerSecond,
+                               float *clarity, float *phaseFrames);
+    static int estimateKey(const double *chroma, float *strength);
+};
+
+#endif // AUDIOFEATURES_H
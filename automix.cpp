@@ -0,0 +1,53 @@
+#include "automix.h"
+#include <cmath>
+
+static const qint64 plainFadeMs = 6000;
+static const qint64 tailMarginMs = 500;        // последние полсекунды часто тишина
+static const int phraseBeats = 4;
+static const int longFadeBeats = 16;
+static const int shortFadeBeats = 8;
+
+double Automix::matchRate(float outgoingBpm, float incomingBpm)
+{
+    if (outgoingBpm <= 0.0f || incomingBpm <= 0.0f) return 0.0;
+
+    // 70 и 140 BPM сводятся без изменения темпа: доля входящего совпадает с каждой второй
+    double rate = double(outgoingBpm) / incomingBpm;
+    while (rate > std::sqrt(2.0)) rate /= 2.0;
+    while (rate < std::sqrt(0.5)) rate *= 2.0;
+    return std::abs(rate - 1.0) <= MaxRateChange ? rate : 0.0;
+}
+
+Automix::Plan Automix::plan(const TrackTempo &outgoing, qint64 outgoingDurationMs,
+                            const TrackTempo &incoming, qint64 incomingDurationMs)
+{
+    Plan result;
+    // Короткие треки не сводим: переход съел бы заметную их часть
+    if (outgoingDurationMs < 4 * plainFadeMs || incomingDurationMs < 4 * plainFadeMs) return result;
+
+    const double rate = matchRate(outgoing.bpm, incoming.bpm);
+    if (rate > 0.0) {
+        // При конфликте тональностей наложение короче
+        const int beats = AudioFeatures::keysCompatible(outgoing.key, incoming.key) ? longFadeBeats : shortFadeBeats;
+        const double beat = outgoing.beatMs();
+        const double fade = beats * beat;
+        const double last = outgoingDurationMs - tailMarginMs - fade;
+
+        // Последняя подходящая доля на границе фразы, считая от первой доли сетки
+        qint64 index = qint64(std::floor((last - outgoing.beatOffsetMs) / beat));
+        index -= index % phraseBeats;
+        const double start = outgoing.beatOffsetMs + index * beat;
+        if (index >= 0 && start >= outgoingDurationMs / 2) {
+            result.startMs = qRound64(start);
+            result.fadeMs = qRound64(fade);
+            result.incomingStartMs = qRound64(incoming.beatOffsetMs);
+            result.rate = rate;
+            result.beatMatched = true;
+            return result;
+        }
+    }
+
+    result.startMs = outgoingDurationMs - tailMarginMs - plainFadeMs;
+    result.fadeMs = plainFadeMs;
+    return result;
+}
@@ -0,0 +1,32 @@
+#ifndef AUTOMIX_H
+#define AUTOMIX_H
+
+#include <QtGlobal>
+#include "audiofeatures.h"
+
+// План перехода между соседними треками. При близких темпах входящий трек подстраивается
+// по скорости и вступает на долю уходящего, переход идёт целыми фразами по четыре доли;
+// иначе - обычный кроссфейд перед концом трека. Все позиции - во времени своих треков.
+class Automix
+{
+public:
+    struct Plan {
+        qint64 startMs = 0;             // позиция уходящего трека, с которой звучат оба
+        qint64 fadeMs = 0;              // длительность перехода по часам уходящего
+        qint64 incomingStartMs = 0;     // откуда начинает входящий
+        double rate = 1.0;              // скорость входящего относительно уходящего
+        bool beatMatched = false;
+
+        bool isValid() const { return fadeMs > 0; }
+    };
+
+    // Темп меняется не больше чем на 6%: QMediaPlayer меняет вместе с ним высоту звука
+    static constexpr double MaxRateChange = 0.06;
+
+    static Plan plan(const TrackTempo &outgoing, qint64 outgoingDurationMs,
+                     const TrackTempo &incoming, qint64 incomingDurationMs);
+    // Скорость входящего, при которой доли совпадают (с точностью до удвоения), или 0
+    static double matchRate(float outgoingBpm, float incomingBpm);
+};
+
+#endif // AUTOMIX_H
@@ -0,0 +1,158 @@
+// Бенчмарк анализа темпа и тональности: пропускная способность на 1, 2, 4... потоках
+// и точность на синтетических фрагментах с известным темпом, сеткой и тональностью:
+//   mp3player_analysis_bench --tracks 48 --output analysis.json
+// Фрагменты - 30 секунд, как у TrackAnalyzer; декодирование ffmpeg не входит в замер.
+
+#include "audiofeatures.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <cmath>
+
+namespace {
+
+const int excerptSeconds = 30;
+const double pi = 3.14159265358979323846;
+
+struct Sample {
+    QList<float> samples;
+    float bpm;
+    double beatOffsetMs;
+    int key;
+    AudioDescriptor result;
+};
+
+// Щелчки на долях поверх трезвучий I-IV-V-I в заданной тональности и тихого шума
+Sample synthesize(float bpm, int key, quint32 seed)
+{
+    const int rate = AudioFeatures::SampleRate;
+    QRandomGenerator random(seed);
+    Sample sample;
+    sample.bpm = bpm;
+    sample.key = key;
+    sample.beatOffsetMs = random.bounded(60000.0 / bpm);
+    sample.samples.resize(qsizetype(rate) * excerptSeconds);
+
+    const int tonic = key % 12;
+    const int third = key >= 12 ? 3 : 4;
+    const int chords[4][3] = {{0, third, 7}, {5, 5 + third, 12}, {7, 11, 14}, {0, third, 7}};
+    const double period = 60.0 / bpm * rate;
+    const double offset = sample.beatOffsetMs / 1000.0 * rate;
+    for (qsizetype i = 0; i < sample.samples.size(); ++i) {
+        const double phase = std::fmod(i - offset + 1000.0 * period, period);
+        double value = 0.02 * (random.generateDouble() * 2.0 - 1.0);
+        if (phase < 2000.0) value += 0.6 * std::exp(-phase / 300.0) * std::sin(i * 0.3);
+
+        const int chord = int(i / (2 * rate)) % 4;
+        for (int note : chords[chord]) {
+            const double frequency = 130.81 * std::pow(2.0, (tonic + note) / 12.0);
+            value += 0.05 * std::sin(2.0 * pi * frequency * i / rate) + 0.02 * std::sin(4.0 * pi * frequency * i / rate);
+        }
+        sample.samples[i] = float(value);
+    }
+    return sample;
+}
+
+QJsonObject run(QList<Sample> &samples, int threads)
+{
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+
+    QElapsedTimer timer;
+    timer.start();
+    QtConcurrent::blockingMap(&pool, samples, [](Sample &sample) {
+        sample.result = AudioFeatures::extract(sample.samples);
+    });
+    const double seconds = timer.nsecsElapsed() / 1e9;
+
+    int tempoHits = 0;
+    int keyHits = 0;
+    double phaseError = 0;
+    for (const Sample &sample : std::as_const(samples)) {
+        const TrackTempo &tempo = sample.result.tempo;
+        if (std::abs(tempo.bpm - sample.bpm) < 1.0f) {
+            ++tempoHits;
+            const double beat = 60000.0 / sample.bpm;
+            double error = std::fmod(tempo.beatOffsetMs - sample.beatOffsetMs + 10.0 * beat, beat);
+            if (error > beat / 2) error -= beat;
+            phaseError += std::abs(error);
+        }
+        if (tempo.key == sample.key) ++keyHits;
+    }
+
+    const double tracksPerSecond = seconds > 0 ? samples.size() / seconds : 0.0;
+    return {
+        {"threads", threads},
+        {"tracks", int(samples.size())},
+        {"tracks_per_s", tracksPerSecond},
+        {"realtime_x", tracksPerSecond * excerptSeconds},
+        {"tempo_accuracy", double(tempoHits) / samples.size()},
+        {"beat_phase_error_ms", tempoHits > 0 ? phaseError / tempoHits : 0.0},
+        {"key_accuracy", double(keyHits) / samples.size()}
+    };
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Tempo and key analysis throughput benchmark");
+    parser.addHelpOption();
+    parser.addOption({"tracks", "Number of synthetic excerpts.", "count", "48"});
+    parser.addOption({"output", "Write JSON results to file instead of stdout.", "file"});
+    parser.process(app);
+
+    const int count = qMax(1, parser.value("tracks").toInt());
+    QList<Sample> samples;
+    samples.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        // Темпы 70..180 BPM с дробной частью, все 24 тональности по кругу
+        const float bpm = 70.0f + std::fmod(i * 37.3f, 110.0f);
+        samples.append(synthesize(bpm, (i * 7) % 24, 0x5eed + i));
+    }
+
+    QJsonArray json;
+    double single = 0;
+    const int cores = QThread::idealThreadCount();
+    for (int threads = 1; ; threads = qMin(threads * 2, cores)) {
+        QJsonObject result = run(samples, threads);
+        const double tracksPerSecond = result.value("tracks_per_s").toDouble();
+        if (threads == 1) single = tracksPerSecond;
+        // Масштабирование: при линейном ускорении эффективность близка к 1
+        const double speedup = single > 0 ? tracksPerSecond / single : 0.0;
+        result.insert("speedup", speedup);
+        result.insert("efficiency", speedup / threads);
+        json.append(result);
+
+        QTextStream(stderr) << threads << " threads: " << tracksPerSecond << " tracks/s, speedup "
+                            << speedup << ", tempo " << result.value("tempo_accuracy").toDouble()
+                            << ", key " << result.value("key_accuracy").toDouble() << "\n";
+        if (threads >= cores) break;
+    }
+
+    const QByteArray output = QJsonDocument(json).toJson();
+    if (parser.isSet("output")) {
+        QFile file(parser.value("output"));
+        if (!file.open(QIODevice::WriteOnly)) {
+            QTextStream(stderr) << "Cannot write " << parser.value("output") << "\n";
+            return 2;
+        }
+        file.write(output);
+    } else {
+        QTextStream(stdout) << output;
+    }
+    return 0;
+}
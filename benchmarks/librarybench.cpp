@@ -0,0 +1,595 @@
+// Бенчмарк операций библиотеки на синтетических данных.
+// Результаты - JSON (массив объектов), пригодный для сравнения с базовой линией:
+//   mp3player_bench --sizes 1000,10000,100000 --collections 1,10,100,1000 --output result.json
+//   mp3player_bench --baseline result.json --threshold 1.2
+// Отчёт о памяти (резидентный размер таблицы треков в пересчёте на 100k треков):
+//   mp3player_bench --memory --sizes 100000
+
+#include "playerengine.h"
+#include "musiccollection.h"
+#include "tracktable.h"
+#include "playqueue.h"
+#include "listeninghistory.h"
+#include "similarityindex.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QRandomGenerator>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <numeric>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+struct Result {
+    QString name;
+    int tracks = 0;
+    int collections = 0;
+    int iterations = 0;
+    double totalMs = 0;
+
+    QString key() const
+    {
+        return QString("%1/%2/%3").arg(name).arg(tracks).arg(collections);
+    }
+
+    QJsonObject toJson() const
+    {
+        return {
+            {"benchmark", name},
+            {"tracks", tracks},
+            {"collections", collections},
+            {"iterations", iterations},
+            {"total_ms", totalMs},
+            {"per_op_us", iterations > 0 ? totalMs * 1000.0 / iterations : 0.0}
+        };
+    }
+};
+
+QList<Result> results;
+
+double timeMs(const std::function<void()> &body)
+{
+    QElapsedTimer timer;
+    timer.start();
+    body();
+    return timer.nsecsElapsed() / 1e6;
+}
+
+void record(const QString &name, int tracks, int collections, int iterations, double totalMs)
+{
+    Result result;
+    result.name = name;
+    result.tracks = tracks;
+    result.collections = collections;
+    result.iterations = iterations;
+    result.totalMs = totalMs;
+    results.append(result);
+
+    QTextStream(stderr) << result.key() << ": " << totalMs << " ms (" << iterations << " ops)\n";
+}
+
+QString trackPath(const QString &root, int index)
+{
+    // 100 треков на папку - похоже на реальные альбомы
+    return QString("%1/artist_%2/album_%3/track_%4.mp3")
+        .arg(root).arg(index / 1000, 4, 10, QChar('0'))
+        .arg(index / 100, 5, 10, QChar('0'))
+        .arg(index, 7, 10, QChar('0'));
+}
+
+QStringList syntheticTracks(const QString &root, int count)
+{
+    QStringList tracks;
+    tracks.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        tracks.append(trackPath(root, i));
+    }
+    return tracks;
+}
+
+void writeTrackList(const QStringList &tracks)
+{
+    QSettings settings;
+    settings.beginGroup("TrackList");
+    settings.setValue("tracks", tracks);
+    settings.endGroup();
+    settings.sync();
+}
+
+void writeCollections(const QStringList &tracks, int collectionCount)
+{
+    QSettings settings;
+    settings.remove("Collections");
+    settings.beginWriteArray("Collections");
+    const int perCollection = collectionCount > 0 ? tracks.size() / collectionCount : 0;
+    for (int c = 0; c < collectionCount; ++c) {
+        settings.setArrayIndex(c);
+        settings.setValue("name", QString("collection_%1").arg(c));
+        settings.setValue("tracks", tracks.mid(c * perCollection, perCollection));
+    }
+    settings.endArray();
+    settings.sync();
+}
+
+// Минимальный корректный WAV: 8 кГц, моно, 8 бит, 10 мс тишины -
+// пустые файлы теперь отсеиваются проверкой формата при импорте
+QByteArray silentWav()
+{
+    const quint32 dataSize = 80;
+    QByteArray wav;
+    QDataStream stream(&wav, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.writeRawData("RIFF", 4);
+    stream << quint32(36 + dataSize);
+    stream.writeRawData("WAVEfmt ", 8);
+    stream << quint32(16) << quint16(1) << quint16(1) << quint32(8000) << quint32(8000)
+           << quint16(1) << quint16(8);
+    stream.writeRawData("data", 4);
+    stream << dataSize;
+    wav.append(QByteArray(dataSize, char(0x80)));
+    return wav;
+}
+
+void benchImport(int trackCount)
+{
+    QTemporaryDir dir;
+    const QByteArray wav = silentWav();
+    for (int i = 0; i < trackCount; ++i) {
+        QFile file(dir.filePath(QString("track_%1.wav").arg(i, 7, 10, QChar('0'))));
+        file.open(QIODevice::WriteOnly);
+        file.write(wav);
+    }
+
+    writeTrackList({});
+    PlayerEngine engine;
+    double ms = timeMs([&] { engine.loadFolder(dir.path()); });
+    record("import_folder", trackCount, 0, trackCount, ms);
+
+    // Переименование и удаление - на реальных файлах
+    const QStringList tracks = engine.tracks();
+    const int ops = qMin(100, tracks.size());
+    ms = timeMs([&] {
+        for (int i = 0; i < ops; ++i) {
+            engine.renameTrack(tracks.at(i), QString("renamed_%1").arg(i));
+        }
+        // Переименования идут в фоне - время до того, как библиотека приняла последнее
+        QEventLoop loop;
+        QObject::connect(engine.fileOperations(), &FileOperations::finished, &loop, [&]() {
+            if (engine.fileOperations()->isIdle()) loop.quit();
+        });
+        if (!engine.fileOperations()->isIdle()) loop.exec();
+    });
+    record("rename_track", trackCount, 0, ops, ms);
+
+    const QStringList renamed = engine.tracks();
+    ms = timeMs([&] {
+        for (int i = 0; i < ops; ++i) {
+            engine.removeTrack(renamed.at(i));
+        }
+    });
+    record("remove_track", trackCount, 0, ops, ms);
+}
+
+void benchLibrary(int trackCount)
+{
+    const QStringList tracks = syntheticTracks("/music", trackCount);
+    writeTrackList(tracks);
+    writeCollections({}, 0);
+
+    // Разрушение движка в замер не входит: время запуска - это создание и загрузка
+    std::unique_ptr<PlayerEngine> loaded;
+    double ms = timeMs([&] {
+        loaded.reset(new PlayerEngine);
+        loaded->loadTrackList();
+    });
+    record("startup_load", trackCount, 0, 1, ms);
+    loaded.reset();
+
+    PlayerEngine engine;
+    engine.loadTrackList();
+
+    const QStringList queries = {"track_00", "album_0001", "nothing_matches", "7"};
+    ms = timeMs([&] {
+        for (const QString &query : queries) {
+            engine.setFilter(query);
+        }
+        engine.setFilter(QString());
+    });
+    record("filter_tracks", trackCount, 0, queries.size() + 1, ms);
+}
+
+void benchQueue(int trackCount)
+{
+    QList<TrackId> ids(trackCount);
+    std::iota(ids.begin(), ids.end(), TrackId(0));
+
+    PlayQueue queue;
+    double ms = timeMs([&] { queue.append(ids); });
+    record("queue_append", trackCount, 0, 1, ms);
+
+    // Правки в середине - худший случай для плоского списка
+    const int ops = 1000;
+    ms = timeMs([&] {
+        for (int i = 0; i < ops; ++i) {
+            queue.insert(queue.size() / 2, TrackId(i));
+        }
+    });
+    record("queue_insert_middle", trackCount, 0, ops, ms);
+
+    ms = timeMs([&] {
+        for (int i = 0; i < ops; ++i) {
+            queue.move((i * 7919) % (queue.size() - 10), 10, queue.size() / 3);
+        }
+    });
+    record("queue_move", trackCount, 0, ops, ms);
+
+    ms = timeMs([&] {
+        for (int i = 0; i < ops; ++i) {
+            queue.at((i * 104729) % queue.size());
+        }
+    });
+    record("queue_at", trackCount, 0, ops, ms);
+
+    ms = timeMs([&] {
+        for (int i = 0; i < ops; ++i) {
+            queue.removeRange(queue.size() / 4, 5);
+        }
+    });
+    record("queue_remove_range", trackCount, 0, ops, ms);
+
+    ms = timeMs([&] {
+        for (int i = 0; i < ops; ++i) {
+            queue.takeFirst();
+        }
+    });
+    record("queue_take_first", trackCount, 0, ops, ms);
+}
+
+void benchHistory(int trackCount)
+{
+    // Десять прослушиваний на трек за последний год
+    const int eventCount = trackCount * 10;
+    const QStringList tracks = syntheticTracks("/music", trackCount);
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    const qint64 year = 365LL * 24 * 60 * 60 * 1000;
+
+    QTemporaryDir dir;
+    ListeningHistory history(dir.path());
+    double ms = timeMs([&] {
+        for (int i = 0; i < eventCount; ++i) {
+            const qint64 startedAt = now - year + qint64(i) * (year / eventCount);
+            history.record(tracks.at((i * 7919) % trackCount), startedAt, 180000, i % 5 == 0);
+        }
+    });
+    record("history_record", trackCount, 0, eventCount, ms);
+
+    ms = timeMs([&] { history.aggregate(ListeningHistory::Month, ListeningHistory::Track); });
+    record("history_query_events", trackCount, 0, eventCount, ms);
+
+    QEventLoop loop;
+    QObject::connect(&history, &ListeningHistory::compacted, &loop, &QEventLoop::quit);
+    ms = timeMs([&] {
+        history.compact();
+        if (history.isCompacting()) loop.exec();
+    });
+    record("history_compact", trackCount, 0, eventCount, ms);
+
+    ms = timeMs([&] { history.aggregate(ListeningHistory::Month, ListeningHistory::Artist); });
+    record("history_query_rollups", trackCount, 0, history.rollupCount(), ms);
+}
+
+void benchSimilarity(int trackCount)
+{
+    // Описатели сгруппированы вокруг "жанров", как у настоящей библиотеки
+    const int dimensions = SimilarityIndex::Dimensions;
+    const int clusters = qMax(1, trackCount / 500);
+    QRandomGenerator random(42);
+    auto gaussian = [&random]() {
+        return float(std::sqrt(-2.0 * std::log(1.0 - random.generateDouble()))
+                     * std::cos(2.0 * 3.14159265358979 * random.generateDouble()));
+    };
+    QList<float> centres(qsizetype(clusters) * dimensions);
+    for (float &value : centres) value = gaussian();
+    QList<float> vectors(qsizetype(trackCount) * dimensions);
+    for (int i = 0; i < trackCount; ++i) {
+        const int cluster = int(random.bounded(clusters));
+        for (int d = 0; d < dimensions; ++d) {
+            vectors[qsizetype(i) * dimensions + d] = centres.at(cluster * dimensions + d) + 0.3f * gaussian();
+        }
+    }
+
+    SimilarityIndex index;
+    double ms = timeMs([&] {
+        for (int i = 0; i < trackCount; ++i) {
+            index.insert(TrackId(i), vectors.constData() + qsizetype(i) * dimensions);
+        }
+    });
+    record("similarity_build", trackCount, 0, trackCount, ms);
+
+    const int queries = 1000;
+    ms = timeMs([&] {
+        for (int q = 0; q < queries; ++q) {
+            index.similar(TrackId((q * 7919) % trackCount), 25);
+        }
+    });
+    record("similarity_query", trackCount, 0, queries, ms);
+
+    // Полнота относительно полного перебора - быстрый поиск не должен терять соседей
+    const int checked = 100;
+    int hits = 0;
+    for (int q = 0; q < checked; ++q) {
+        const float *query = vectors.constData() + qsizetype((q * 104729) % trackCount) * dimensions;
+        const QList<SimilarityIndex::Neighbour> approximate = index.search(query, 10);
+        const QList<SimilarityIndex::Neighbour> exact = index.exactSearch(query, 10);
+        for (const SimilarityIndex::Neighbour &neighbour : exact) {
+            for (const SimilarityIndex::Neighbour &found : approximate) {
+                if (found.id == neighbour.id) {
+                    ++hits;
+                    break;
+                }
+            }
+        }
+    }
+    QTextStream(stderr) << "similarity_recall_at_10/" << trackCount << ": "
+                        << double(hits) / (checked * 10) << "\n";
+}
+
+void benchCollections(int trackCount, int collectionCount)
+{
+    const QStringList tracks = syntheticTracks("/music", trackCount);
+    writeCollections(tracks, collectionCount);
+
+    TrackTable table;
+    MusicCollection collection(&table);
+    double ms = timeMs([&] { collection.loadCollections(); });
+    record("collections_load", trackCount, collectionCount, 1, ms);
+
+    ms = timeMs([&] { collection.saveCollections(); });
+    record("collections_save", trackCount, collectionCount, 1, ms);
+
+    // Каждая мутация сейчас сохраняет всё состояние целиком
+    const int ops = 20;
+    const QString target = "collection_0";
+    ms = timeMs([&] {
+        for (int i = 0; i < ops; ++i) {
+            collection.addTrackToCollection(target, trackPath("/extra", i));
+        }
+    });
+    record("collection_add_track", trackCount, collectionCount, ops, ms);
+
+    ms = timeMs([&] {
+        for (int i = 0; i < ops; ++i) {
+            collection.removeTrackFromCollection(target, trackPath("/extra", i));
+        }
+    });
+    record("collection_remove_track", trackCount, collectionCount, ops, ms);
+
+    ms = timeMs([&] {
+        collection.replaceTrackInAllCollections(tracks.value(trackCount / 2), trackPath("/moved", 0));
+    });
+    record("collection_rename_track", trackCount, collectionCount, 1, ms);
+}
+
+qint64 residentKb()
+{
+#ifdef Q_OS_LINUX
+    QFile statm("/proc/self/statm");
+    if (statm.open(QIODevice::ReadOnly)) {
+        const QList<QByteArray> fields = statm.readAll().split(' ');
+        if (fields.size() > 1) {
+            return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE) / 1024;
+        }
+    }
+#endif
+#ifdef Q_OS_UNIX
+    // Запасной вариант - пиковый размер, для прироста от нуля тоже годится
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef Q_OS_MACOS
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return -1;
+#endif
+}
+
+// Строит таблицу треков с идентификаторами библиотеки, коллекции и статистики
+// и печатает прирост RSS. Запускается в отдельном процессе, чтобы в замер
+// не попадала память, занятая самим бенчмарком.
+int runMemoryChild(int trackCount)
+{
+    if (trackCount <= 0) return 2;
+    const qint64 before = residentKb();
+
+    TrackTable table;
+    QList<TrackId> trackIds;
+    QList<TrackId> collectionIds;
+    for (int i = 0; i < trackCount; ++i) {
+        const TrackId id = table.intern(trackPath("/music", i));
+        trackIds.append(id);
+        collectionIds.append(id);
+    }
+    QList<PlayerEngine::TrackStats> stats(table.size());
+    QList<bool> inLibrary(table.size(), true);
+
+    QTextStream(stdout) << (residentKb() - before) << ' ' << table.memoryUsage() << '\n';
+    return 0;
+}
+
+QJsonArray benchMemory(const QList<int> &sizes)
+{
+    QJsonArray report;
+    for (int size : sizes) {
+        QProcess child;
+        child.start(QCoreApplication::applicationFilePath(),
+                    {"--memory-child", "--memory-tracks", QString::number(size)});
+        if (!child.waitForFinished(-1) || child.exitCode() != 0) {
+            QTextStream(stderr) << "Memory run failed: " << size << "\n";
+            continue;
+        }
+
+        const QList<QByteArray> values = child.readAllStandardOutput().trimmed().split(' ');
+        const qint64 residentDelta = values.value(0).toLongLong();
+        const double per100k = residentDelta * 100000.0 / size;
+        report.append(QJsonObject{
+            {"benchmark", "memory_rss"},
+            {"tracks", size},
+            {"rss_kb", residentDelta},
+            {"per_100k_tracks_kb", per100k},
+            {"table_bytes", values.value(1).toLongLong()}
+        });
+        QTextStream(stderr) << "memory/" << size << ": "
+                            << residentDelta << " KB (" << per100k << " KB per 100k tracks)\n";
+    }
+    return report;
+}
+
+QList<int> parseSizes(const QString &value)
+{
+    QList<int> sizes;
+    for (const QString &part : value.split(',', Qt::SkipEmptyParts)) {
+        bool ok = false;
+        int size = part.trimmed().toInt(&ok);
+        if (ok && size > 0) sizes.append(size);
+    }
+    return sizes;
+}
+
+int compareWithBaseline(const QString &fileName, double threshold)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        QTextStream(stderr) << "Cannot open baseline " << fileName << "\n";
+        return 2;
+    }
+
+    QHash<QString, double> baseline;
+    const QJsonArray entries = QJsonDocument::fromJson(file.readAll()).array();
+    for (const QJsonValue &value : entries) {
+        const QJsonObject entry = value.toObject();
+        const QString key = QString("%1/%2/%3").arg(entry.value("benchmark").toString())
+                                .arg(entry.value("tracks").toInt())
+                                .arg(entry.value("collections").toInt());
+        baseline.insert(key, entry.value("total_ms").toDouble());
+    }
+
+    int regressions = 0;
+    for (const Result &result : std::as_const(results)) {
+        const double base = baseline.value(result.key(), -1);
+        if (base <= 0) continue;
+
+        const double ratio = result.totalMs / base;
+        if (ratio > threshold) {
+            QTextStream(stderr) << "REGRESSION " << result.key() << ": "
+                                << base << " ms -> " << result.totalMs << " ms (x" << ratio << ")\n";
+            ++regressions;
+        }
+    }
+    return regressions > 0 ? 1 : 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setOrganizationName("Mp3PlayerBench");
+    QCoreApplication::setApplicationName("mp3player_bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Library operations benchmark");
+    parser.addHelpOption();
+    parser.addOption({"sizes", "Library sizes in tracks.", "list", "1000,10000,100000"});
+    parser.addOption({"collections", "Collection counts.", "list", "1,10,100,1000"});
+    parser.addOption({"import-limit", "Largest library imported from real files.", "count", "100000"});
+    parser.addOption({"output", "Write JSON results to file instead of stdout.", "file"});
+    parser.addOption({"baseline", "Compare against a previous JSON result.", "file"});
+    parser.addOption({"threshold", "Slowdown ratio reported as regression.", "ratio", "1.2"});
+    parser.addOption({"memory", "Report resident memory of the track table instead of timings."});
+
+    QCommandLineOption memoryChild("memory-child", "Internal: build the track table and print RSS.");
+    QCommandLineOption memoryTracks("memory-tracks", "Internal: track count for --memory-child.", "count");
+    memoryChild.setFlags(QCommandLineOption::HiddenFromHelp);
+    memoryTracks.setFlags(QCommandLineOption::HiddenFromHelp);
+    parser.addOption(memoryChild);
+    parser.addOption(memoryTracks);
+    parser.process(app);
+
+    if (parser.isSet(memoryChild)) {
+        return runMemoryChild(parser.value(memoryTracks).toInt());
+    }
+
+    // Настройки и история бенчмарка не должны трогать данные плеера
+    QStandardPaths::setTestModeEnabled(true);
+    QTemporaryDir settingsDir;
+    QSettings::setDefaultFormat(QSettings::IniFormat);
+    QSettings::setPath(QSettings::IniFormat, QSettings::UserScope, settingsDir.path());
+
+    const QList<int> sizes = parseSizes(parser.value("sizes"));
+    const QList<int> collectionCounts = parseSizes(parser.value("collections"));
+    const int importLimit = parser.value("import-limit").toInt();
+
+    const bool memoryMode = parser.isSet("memory");
+    const QJsonArray memoryReport = memoryMode ? benchMemory(sizes) : QJsonArray();
+
+    for (int size : memoryMode ? QList<int>() : sizes) {
+        if (size <= importLimit) {
+            benchImport(size);
+        }
+        benchLibrary(size);
+        benchQueue(size);
+        benchHistory(size);
+        benchSimilarity(size);
+        for (int collections : collectionCounts) {
+            if (collections <= size) {
+                benchCollections(size, collections);
+            }
+        }
+    }
+
+    QJsonArray json = memoryReport;
+    for (const Result &result : std::as_const(results)) {
+        json.append(result.toJson());
+    }
+    const QByteArray output = QJsonDocument(json).toJson();
+
+    if (parser.isSet("output")) {
+        QFile file(parser.value("output"));
+        if (!file.open(QIODevice::WriteOnly)) {
+            QTextStream(stderr) << "Cannot write " << parser.value("output") << "\n";
+            return 2;
+        }
+        file.write(output);
+    } else {
+        QTextStream(stdout) << output;
+    }
+
+    if (parser.isSet("baseline")) {
+        return compareWithBaseline(parser.value("baseline"), parser.value("threshold").toDouble());
+    }
+    return 0;
+}
@@ -0,0 +1,151 @@
+// Бенчмарк ресемплера: пропускная способность и THD+N для каждого уровня качества.
+// Вход - синус 997 Гц (и 15 кГц у верхней границы полосы), стерео, 10 секунд:
+//   mp3player_resampler_bench --output resampler.json
+// THD+N - отношение остатка после вычитания подогнанной синусоиды к самой синусоиде.
+
+#include "resampler.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <cmath>
+
+namespace {
+
+const int channels = 2;
+const int blockFrames = 4096;
+const double pi = 3.14159265358979323846;
+
+QList<float> sine(int rate, double frequency, int frames)
+{
+    QList<float> samples(qsizetype(frames) * channels);
+    for (int i = 0; i < frames; ++i) {
+        const float value = float(0.5 * std::sin(2.0 * pi * frequency * i / rate));
+        for (int c = 0; c < channels; ++c) {
+            samples[qsizetype(i) * channels + c] = value;
+        }
+    }
+    return samples;
+}
+
+// Подгоняем A*sin + B*cos на известной частоте методом наименьших квадратов
+// и считаем энергию остатка; края с переходными процессами отрезаем
+double thdnDb(const QList<float> &output, int rate, double frequency)
+{
+    const qsizetype frames = output.size() / channels;
+    const qsizetype from = rate / 4;
+    const qsizetype to = frames - rate / 4;
+    if (to <= from) return 0.0;
+
+    double ys = 0, yc = 0, ss = 0, cc = 0, sc = 0;
+    for (qsizetype n = from; n < to; ++n) {
+        const double w = 2.0 * pi * frequency * n / rate;
+        const double s = std::sin(w);
+        const double c = std::cos(w);
+        const double y = output.at(n * channels);
+        ys += y * s;
+        yc += y * c;
+        ss += s * s;
+        cc += c * c;
+        sc += s * c;
+    }
+    const double det = ss * cc - sc * sc;
+    const double a = (ys * cc - yc * sc) / det;
+    const double b = (yc * ss - ys * sc) / det;
+
+    double signal = 0, residual = 0;
+    for (qsizetype n = from; n < to; ++n) {
+        const double w = 2.0 * pi * frequency * n / rate;
+        const double fitted = a * std::sin(w) + b * std::cos(w);
+        const double error = output.at(n * channels) - fitted;
+        signal += fitted * fitted;
+        residual += error * error;
+    }
+    return residual > 0 ? 10.0 * std::log10(residual / signal) : -200.0;
+}
+
+QJsonObject run(int inputRate, int outputRate, Resampler::Quality quality, double frequency, int seconds)
+{
+    const int frames = inputRate * seconds;
+    const QList<float> input = sine(inputRate, frequency, frames);
+
+    Resampler resampler(inputRate, outputRate, channels, quality);
+    QList<float> output;
+    output.reserve(qsizetype(double(frames) * outputRate / inputRate + resampler.taps()) * channels);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int offset = 0; offset < frames; offset += blockFrames) {
+        resampler.process(input.constData() + qsizetype(offset) * channels,
+                          qMin(blockFrames, frames - offset), output);
+    }
+    resampler.flush(output);
+    const double elapsedMs = timer.nsecsElapsed() / 1e6;
+
+    const double framesPerSecond = elapsedMs > 0 ? frames / (elapsedMs / 1000.0) : 0.0;
+    const QJsonObject result = {
+        {"input_rate", inputRate},
+        {"output_rate", outputRate},
+        {"quality", Resampler::qualityName(quality)},
+        {"taps", resampler.taps()},
+        {"frequency_hz", frequency},
+        {"mframes_per_s", framesPerSecond / 1e6},
+        {"realtime_x", framesPerSecond / inputRate},
+        {"thdn_db", thdnDb(output, outputRate, frequency)}
+    };
+
+    QTextStream(stderr) << inputRate << "->" << outputRate << " " << Resampler::qualityName(quality)
+                        << " " << frequency << " Hz: "
+                        << result.value("mframes_per_s").toDouble() << " Mframes/s, THD+N "
+                        << result.value("thdn_db").toDouble() << " dB\n";
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Resampler throughput and THD+N benchmark");
+    parser.addHelpOption();
+    parser.addOption({"seconds", "Length of the test signal.", "seconds", "10"});
+    parser.addOption({"output", "Write JSON results to file instead of stdout.", "file"});
+    parser.process(app);
+
+    const int seconds = qMax(1, parser.value("seconds").toInt());
+    const QList<QPair<int, int>> ratios = {
+        {44100, 48000}, {48000, 44100}, {96000, 48000}, {192000, 48000}, {88200, 44100}, {44100, 96000}
+    };
+    const QList<Resampler::Quality> tiers = {Resampler::Fast, Resampler::Balanced, Resampler::Best};
+
+    QJsonArray json;
+    for (const auto &ratio : ratios) {
+        for (Resampler::Quality quality : tiers) {
+            json.append(run(ratio.first, ratio.second, quality, 997.0, seconds));
+        }
+    }
+    // Верх полосы: здесь уровни качества различаются сильнее всего
+    for (Resampler::Quality quality : tiers) {
+        json.append(run(44100, 48000, quality, 15000.0, seconds));
+    }
+
+    const QByteArray output = QJsonDocument(json).toJson();
+    if (parser.isSet("output")) {
+        QFile file(parser.value("output"));
+        if (!file.open(QIODevice::WriteOnly)) {
+            QTextStream(stderr) << "Cannot write " << parser.value("output") << "\n";
+            return 2;
+        }
+        file.write(output);
+    } else {
+        QTextStream(stdout) << output;
+    }
+    return 0;
+}
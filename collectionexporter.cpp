@@ -0,0 +1,293 @@
+#include "collectionexporter.h"
+#include "virtualtrack.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QThread>
+#include <algorithm>
+
+static const qint64 copyBlockSize = 256 * 1024;
+static const int pollIntervalMs = 100;
+
+CollectionExporter::CollectionExporter(QObject *parent)
+    : QObject(parent)
+{
+    pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+CollectionExporter::~CollectionExporter()
+{
+    cancelled.storeRelaxed(1);
+    pool.clear();
+    pool.waitForDone();
+}
+
+QString CollectionExporter::formatName(Format format)
+{
+    switch (format) {
+    case Copy: return "copy";
+    case Opus: return "opus";
+    case Mp3: return "mp3";
+    case Flac: return "flac";
+    }
+    return QString();
+}
+
+bool CollectionExporter::parseFormat(const QString &name, Format *format)
+{
+    for (Format candidate : {Copy, Opus, Mp3, Flac}) {
+        if (formatName(candidate) == name.toLower()) {
+            *format = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+QList<CollectionExporter::Format> CollectionExporter::availableFormats()
+{
+    // Без кодировщика доступно только копирование как есть
+    if (encoderPath().isEmpty()) return {Copy};
+    return {Opus, Mp3, Flac, Copy};
+}
+
+bool CollectionExporter::start(const QString &collectionName, const QStringList &tracks,
+                               const Options &options, QString *errorString)
+{
+    if (running) {
+        if (errorString) *errorString = "Export is already running";
+        return false;
+    }
+    if (tracks.isEmpty()) {
+        if (errorString) *errorString = "Collection is empty";
+        return false;
+    }
+    if (options.format != Copy && encoderPath().isEmpty()) {
+        if (errorString) *errorString = "ffmpeg not found, only 'copy' is available";
+        return false;
+    }
+
+    destination = QDir(options.targetDir).filePath(sanitize(collectionName));
+    if (!QDir().mkpath(destination)) {
+        if (errorString) *errorString = "Cannot create " + destination;
+        return false;
+    }
+
+    // Номер в имени сохраняет порядок коллекции на устройствах, сортирующих по имени
+    const int width = QString::number(tracks.size()).size();
+    QList<Job> jobs;
+    for (int i = 0; i < tracks.size(); ++i) {
+        // Дорожка образа называется по листу, размер для сортировки - размер образа
+        const VirtualTrack range = VirtualTrack::fromPath(tracks.at(i));
+        const QFileInfo info(range.filePath);
+        Job job;
+        job.source = tracks.at(i);
+        job.size = info.size();
+        job.target = QDir(destination).filePath(QString("%1 - %2.%3")
+                                                    .arg(i + 1, width, 10, QChar('0'))
+                                                    .arg(sanitize(VirtualTrack::displayName(job.source)),
+                                                         suffix(options.format, job.source)));
+        jobs.append(job);
+    }
+    // Крупные файлы первыми, чтобы пакет не заканчивался одним длинным треком на одном ядре
+    std::stable_sort(jobs.begin(), jobs.end(), [](const Job &a, const Job &b) {
+        return a.size > b.size;
+    });
+
+    cancelled.storeRelaxed(0);
+    running = true;
+    remaining = jobs.size();
+    current = Progress();
+    current.total = jobs.size();
+    timer.start();
+
+    for (const Job &job : std::as_const(jobs)) {
+        pool.start([this, job, options]() {
+            qint64 bytesWritten = 0;
+            bool skipped = false;
+            QString error;
+
+            const QFileInfo existing(job.target);
+            if (existing.exists() && existing.size() > 0) {
+                skipped = true;
+            } else if (cancelled.loadRelaxed()) {
+                error = "cancelled";
+            } else {
+                error = runJob(job, options, cancelled, &bytesWritten);
+            }
+
+            const qint64 bytesRead = skipped || !error.isEmpty() ? 0 : job.size;
+            QMetaObject::invokeMethod(this, [this, job, bytesRead, bytesWritten, skipped, error]() {
+                handleJobDone(job.source, bytesRead, bytesWritten, skipped, error);
+            }, Qt::QueuedConnection);
+        });
+    }
+    emit progressChanged(progress());
+    return true;
+}
+
+void CollectionExporter::cancel()
+{
+    // Задания в очереди завершатся сразу, запущенные прибьют свой ffmpeg
+    cancelled.storeRelaxed(1);
+}
+
+CollectionExporter::Progress CollectionExporter::progress() const
+{
+    Progress result = current;
+    result.elapsedMs = running ? timer.elapsed() : current.elapsedMs;
+    return result;
+}
+
+void CollectionExporter::handleJobDone(const QString &source, qint64 bytesRead, qint64 bytesWritten,
+                                       bool skipped, const QString &error)
+{
+    if (skipped) {
+        ++current.skipped;
+    } else if (!error.isEmpty()) {
+        if (!cancelled.loadRelaxed()) {
+            ++current.failed;
+            emit trackFailed(source, error);
+        }
+    } else {
+        ++current.done;
+        current.bytesRead += bytesRead;
+        current.bytesWritten += bytesWritten;
+    }
+
+    if (--remaining > 0) {
+        emit progressChanged(progress());
+        return;
+    }
+
+    current.elapsedMs = timer.elapsed();
+    running = false;
+    emit progressChanged(progress());
+    emit finished(cancelled.loadRelaxed() != 0);
+}
+
+QString CollectionExporter::encoderPath()
+{
+    static const QString path = QStandardPaths::findExecutable("ffmpeg");
+    return path;
+}
+
+QString CollectionExporter::suffix(Format format, const QString &source)
+{
+    switch (format) {
+    case Opus: return "opus";
+    case Mp3: return "mp3";
+    case Flac: return "flac";
+    case Copy: break;
+    }
+    // Отрезок файла копией не вырезать - он перекодируется без потерь
+    if (VirtualTrack::isVirtual(source)) return "flac";
+    return QFileInfo(source).suffix().toLower();
+}
+
+QString CollectionExporter::sanitize(const QString &name)
+{
+    // FAT на плеерах не принимает эти символы в именах
+    QString result = name;
+    static const QString forbidden = "<>:\"/\\|?*";
+    for (QChar &c : result) {
+        if (forbidden.contains(c) || c.unicode() < 0x20) c = '_';
+    }
+    result = result.trimmed();
+    return result.isEmpty() ? QString("_") : result;
+}
+
+QString CollectionExporter::runJob(const Job &job, const Options &options, const QAtomicInt &cancelFlag,
+                                   qint64 *bytesWritten)
+{
+    // Пишем во временный файл: по готовому имени при повторном запуске судим, что трек готов
+    const QString partPath = job.target + ".part";
+    Job partJob = job;
+    partJob.target = partPath;
+
+    const bool copy = options.format == Copy && !VirtualTrack::isVirtual(job.source);
+    const QString error = copy ? copyFile(partJob, cancelFlag, bytesWritten)
+                               : transcode(partJob, options, cancelFlag, bytesWritten);
+    if (!error.isEmpty()) {
+        QFile::remove(partPath);
+        return error;
+    }
+    QFile::remove(job.target);
+    if (!QFile::rename(partPath, job.target)) {
+        QFile::remove(partPath);
+        return "cannot rename " + partPath;
+    }
+    return QString();
+}
+
+QString CollectionExporter::copyFile(const Job &job, const QAtomicInt &cancelFlag, qint64 *bytesWritten)
+{
+    QFile input(job.source);
+    if (!input.open(QIODevice::ReadOnly)) return input.errorString();
+    QFile output(job.target);
+    if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate)) return output.errorString();
+
+    // Блоками фиксированного размера: файл целиком в памяти не держим
+    QByteArray buffer(copyBlockSize, Qt::Uninitialized);
+    for (;;) {
+        if (cancelFlag.loadRelaxed()) return "cancelled";
+        const qint64 chunk = input.read(buffer.data(), buffer.size());
+        if (chunk < 0) return input.errorString();
+        if (chunk == 0) break;
+        if (output.write(buffer.constData(), chunk) != chunk) return output.errorString();
+        *bytesWritten += chunk;
+    }
+    return QString();
+}
+
+QString CollectionExporter::transcode(const Job &job, const Options &options, const QAtomicInt &cancelFlag,
+                                      qint64 *bytesWritten)
+{
+    // Один поток ffmpeg на задание: параллелим по файлам, а не внутри файла
+    QStringList arguments = {"-nostdin", "-hide_banner", "-loglevel", "error", "-y", "-threads", "1"};
+    arguments << VirtualTrack::fromPath(job.source).inputArguments() << "-vn" << "-map_metadata" << "0";
+    if (options.sampleRate > 0) {
+        arguments << "-ar" << QString::number(options.sampleRate);
+    }
+    switch (options.format) {
+    case Opus:
+        arguments << "-c:a" << "libopus" << "-f" << "opus";
+        break;
+    case Mp3:
+        arguments << "-c:a" << "libmp3lame" << "-f" << "mp3";
+        break;
+    case Flac:
+    case Copy:      // копией сюда приходят только дорожки образа
+        arguments << "-c:a" << "flac" << "-f" << "flac";
+        break;
+    }
+    if (hasBitrate(options.format)) {
+        arguments << "-b:a" << QString::number(options.bitrateKbps) + "k";
+    }
+    arguments << job.target;
+
+    QProcess process;
+    process.setProcessChannelMode(QProcess::SeparateChannels);
+    process.setStandardOutputFile(QProcess::nullDevice());
+    process.start(encoderPath(), arguments);
+    if (!process.waitForStarted()) return process.errorString();
+
+    while (!process.waitForFinished(pollIntervalMs)) {
+        if (process.state() == QProcess::NotRunning) break;
+        if (cancelFlag.loadRelaxed()) {
+            process.kill();
+            process.waitForFinished();
+            return "cancelled";
+        }
+    }
+
+    if (process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0) {
+        const QString message = QString::fromLocal8Bit(process.readAllStandardError()).trimmed();
+        const QString lastLine = message.section('\n', -1).trimmed();
+        return lastLine.isEmpty() ? QString("ffmpeg exited with code %1").arg(process.exitCode()) : lastLine;
+    }
+    *bytesWritten += QFileInfo(job.target).size();
+    return QString();
+}
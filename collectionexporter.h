@@ -0,0 +1,94 @@
+#ifndef COLLECTIONEXPORTER_H
+#define COLLECTIONEXPORTER_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QThreadPool>
+
+// Пакетный экспорт коллекции в папку (например, на плеер) в едином формате и битрейте.
+// Каждый трек - отдельное задание в пуле по числу ядер; декодирование, ресемплинг и
+// кодирование делает ffmpeg, результат пишется потоком прямо в файл.
+// Прерванный экспорт продолжается с места остановки: готовые файлы пропускаются,
+// недописанные (*.part) перезаписываются.
+class CollectionExporter : public QObject
+{
+    Q_OBJECT
+public:
+    enum Format {
+        Copy,
+        Opus,
+        Mp3,
+        Flac
+    };
+
+    struct Options {
+        QString targetDir;
+        Format format = Opus;
+        int bitrateKbps = 160;
+        int sampleRate = 0;             // 0 - как в исходнике
+    };
+
+    struct Progress {
+        int total = 0;
+        int done = 0;
+        int skipped = 0;
+        int failed = 0;
+        qint64 bytesRead = 0;
+        qint64 bytesWritten = 0;
+        qint64 elapsedMs = 0;
+
+        double tracksPerSecond() const { return elapsedMs > 0 ? done * 1000.0 / elapsedMs : 0.0; }
+        double readMBps() const { return elapsedMs > 0 ? bytesRead / 1024.0 / 1024.0 * 1000.0 / elapsedMs : 0.0; }
+    };
+
+    explicit CollectionExporter(QObject *parent = nullptr);
+    ~CollectionExporter();
+
+    static QString formatName(Format format);
+    static bool parseFormat(const QString &name, Format *format);
+    static QList<Format> availableFormats();
+    static bool hasBitrate(Format format) { return format == Opus || format == Mp3; }
+
+    bool start(const QString &collectionName, const QStringList &tracks,
+               const Options &options, QString *errorString = nullptr);
+    void cancel();
+    bool isRunning() const { return running; }
+    Progress progress() const;
+    QString outputDir() const { return destination; }
+
+signals:
+    void progressChanged(const CollectionExporter::Progress &progress);
+    void trackFailed(const QString &filePath, const QString &reason);
+    void finished(bool cancelled);
+
+private:
+    struct Job {
+        QString source;
+        QString target;
+        qint64 size = 0;
+    };
+
+    QThreadPool pool;
+    QAtomicInt cancelled;
+    bool running = false;
+    int remaining = 0;
+    QString destination;
+    Progress current;
+    QElapsedTimer timer;
+
+    void handleJobDone(const QString &source, qint64 bytesRead, qint64 bytesWritten,
+                       bool skipped, const QString &error);
+
+    static QString encoderPath();
+    static QString suffix(Format format, const QString &source);
+    static QString sanitize(const QString &name);
+    static QString runJob(const Job &job, const Options &options, const QAtomicInt &cancelFlag,
+                          qint64 *bytesWritten);
+    static QString copyFile(const Job &job, const QAtomicInt &cancelFlag, qint64 *bytesWritten);
+    static QString transcode(const Job &job, const Options &options, const QAtomicInt &cancelFlag,
+                             qint64 *bytesWritten);
+};
+
+#endif // COLLECTIONEXPORTER_H
@@ -0,0 +1,380 @@
+#include "controlserver.h"
+#include "playerengine.h"
+#include "musiccollection.h"
+#include "playbackmonitor.h"
+#include "prefetcher.h"
+#include "listeninghistory.h"
+#include "trackanalyzer.h"
+#include "streamserver.h"
+#include "mappedfile.h"
+#include "powerscheduler.h"
+#include "playlistfile.h"
+#include <QCoreApplication>
+#include <QFileInfo>
+
+ControlServer::ControlServer(PlayerEngine *engine, QObject *parent)
+    : QObject(parent),
+    server(new QLocalServer(this)),
+    engine(engine),
+    streams(new StreamServer(engine, this))
+{
+    connect(server, &QLocalServer::newConnection, this, &ControlServer::handleNewConnection);
+}
+
+QString ControlServer::defaultServerName()
+{
+    return QStringLiteral("mp3player-control");
+}
+
+bool ControlServer::listen(const QString &name)
+{
+    // Сокет мог остаться после аварийного завершения
+    QLocalServer::removeServer(name);
+    server->setSocketOptions(QLocalServer::UserAccessOption);
+    return server->listen(name);
+}
+
+QString ControlServer::errorString() const
+{
+    return server->errorString();
+}
+
+void ControlServer::handleNewConnection()
+{
+    while (QLocalSocket *socket = server->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::readyRead, this, &ControlServer::readCommands);
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
+
+void ControlServer::readCommands()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>(sender());
+    if (!socket) return;
+
+    while (socket->canReadLine()) {
+        const QString line = QString::fromUtf8(socket->readLine()).trimmed();
+        if (line.isEmpty()) continue;
+
+        const QStringList reply = execute(line);
+        for (const QString &replyLine : reply) {
+            socket->write(replyLine.toUtf8());
+            socket->write("\n");
+        }
+    }
+    socket->flush();
+}
+
+QStringList ControlServer::execute(const QString &line)
+{
+    const int space = line.indexOf(' ');
+    const QString command = line.left(space).toLower();
+    const QString argument = space < 0 ? QString() : line.mid(space + 1).trimmed();
+
+    QStringList reply;
+
+    if (command == "play") {
+        if (argument.isEmpty()) {
+            engine->play();
+        } else {
+            bool isIndex = false;
+            int index = argument.toInt(&isIndex);
+            if (isIndex) {
+                if (index < 0 || index >= engine->currentPlaylist().size()) {
+                    return {"ERR index out of range"};
+                }
+                engine->playTrack(index);
+            } else if (QFileInfo::exists(argument)) {
+                engine->playFile(argument);
+            } else {
+                return {"ERR no such file"};
+            }
+        }
+    } else if (command == "pause") {
+        engine->pause();
+    } else if (command == "toggle") {
+        if (engine->mediaPlayer()->playbackState() == QMediaPlayer::PlayingState) {
+            engine->pause();
+        } else {
+            engine->play();
+        }
+    } else if (command == "stop") {
+        engine->stop();
+    } else if (command == "next") {
+        engine->next();
+    } else if (command == "prev") {
+        engine->previous();
+    } else if (command == "seek") {
+        bool ok = false;
+        double seconds = argument.toDouble(&ok);
+        if (!ok || seconds < 0) return {"ERR usage: seek <seconds>"};
+        engine->seek(static_cast<qint64>(seconds * 1000));
+    } else if (command == "volume") {
+        bool ok = false;
+        int value = argument.toInt(&ok);
+        if (!ok) return {"ERR usage: volume <0-100>"};
+        engine->setVolume(value / 100.0f);
+    } else if (command == "shuffle") {
+        // Без аргумента - переключает; в ответе новое состояние
+        if (argument == "on" || argument == "1") engine->setShuffle(true);
+        else if (argument == "off" || argument == "0") engine->setShuffle(false);
+        else if (argument.isEmpty()) engine->setShuffle(!engine->isShuffle());
+        else return {"ERR usage: shuffle [on|off]"};
+        reply << QString("shuffle %1").arg(engine->isShuffle() ? "on" : "off");
+    } else if (command == "queue") {
+        if (argument.isEmpty()) {
+            reply = engine->queue();
+        } else if (QFileInfo::exists(argument)) {
+            engine->enqueue(argument);
+        } else {
+            return {"ERR no such file"};
+        }
+    } else if (command == "playnext") {
+        if (!QFileInfo::exists(argument)) return {"ERR no such file"};
+        engine->playNext(argument);
+    } else if (command == "unqueue" || command == "movequeue") {
+        // unqueue <from> [count], movequeue <from> <count> <to>
+        const QStringList parts = argument.split(' ', Qt::SkipEmptyParts);
+        QList<int> numbers;
+        for (const QString &part : parts) {
+            bool ok = false;
+            numbers.append(part.toInt(&ok));
+            if (!ok) return {"ERR usage: unqueue <from> [count] | movequeue <from> <count> <to>"};
+        }
+        const int size = engine->playQueue().size();
+        if (command == "unqueue") {
+            if (numbers.isEmpty() || numbers.size() > 2) return {"ERR usage: unqueue <from> [count]"};
+            if (numbers.at(0) < 0 || numbers.at(0) >= size) return {"ERR index out of range"};
+            engine->removeQueued(numbers.at(0), numbers.value(1, 1));
+        } else {
+            if (numbers.size() != 3) return {"ERR usage: movequeue <from> <count> <to>"};
+            if (!engine->moveQueued(numbers.at(0), numbers.at(1), numbers.at(2))) {
+                return {"ERR index out of range"};
+            }
+        }
+    } else if (command == "clearqueue") {
+        engine->clearQueue();
+    } else if (command == "radio") {
+        if (argument == "off") {
+            engine->stopRadio();
+        } else if (!QFileInfo::exists(argument)) {
+            return {"ERR usage: radio <file> | radio off"};
+        } else if (!engine->startRadio(argument)) {
+            return {"ERR track is not in the library or not analyzed yet"};
+        }
+    } else if (command == "similar") {
+        // similar <file>: ближайшие по звучанию треки с расстоянием
+        const TrackId id = engine->trackTable().find(argument);
+        if (!engine->analyzer()->isIndexed(id)) return {"ERR track is not analyzed yet"};
+        const QList<SimilarityIndex::Neighbour> neighbours = engine->analyzer()->index().similar(id, 20);
+        for (const SimilarityIndex::Neighbour &neighbour : neighbours) {
+            reply << QString::number(neighbour.distance, 'f', 3) + "\t" + engine->trackTable().path(neighbour.id);
+        }
+    } else if (command == "analysis") {
+        const TrackAnalyzer *analyzer = engine->analyzer();
+        reply << "available " + QString(AudioFeatures::isAvailable() ? "yes" : "no")
+              << "indexed " + QString::number(analyzer->indexedCount())
+              << "pending " + QString::number(analyzer->pendingCount())
+              << "failed " + QString::number(analyzer->failedCount());
+
+        // Пропускная способность текущей (или последней) волны анализа
+        const TrackAnalyzer::Throughput throughput = analyzer->throughput();
+        reply << "workers " + QString::number(throughput.workers)
+              << "analyzed " + QString::number(throughput.tracks)
+              << "tracks_per_second " + QString::number(throughput.tracksPerSecond(), 'f', 2)
+              << "audio_realtime_factor " + QString::number(throughput.wallSeconds > 0
+                                                               ? throughput.audioSeconds / throughput.wallSeconds : 0.0, 'f', 1)
+              << "worker_utilization " + QString::number(throughput.wallSeconds > 0 && throughput.workers > 0
+                                                            ? throughput.busySeconds / (throughput.wallSeconds * throughput.workers) : 0.0, 'f', 2);
+    } else if (command == "tempo") {
+        // tempo <file>: темп, положение сетки долей и тональность
+        const TrackId id = engine->trackTable().find(argument);
+        if (!engine->analyzer()->isIndexed(id)) return {"ERR track is not analyzed yet"};
+        const TrackTempo tempo = engine->analyzer()->tempo(id);
+        if (!tempo.isValid()) return {"ERR tempo not detected"};
+        reply << "bpm " + QString::number(tempo.bpm, 'f', 2)
+              << "beat_offset_ms " + QString::number(tempo.beatOffsetMs, 'f', 1)
+              << "key " + (tempo.key >= 0 ? AudioFeatures::keyName(tempo.key) + " " + AudioFeatures::camelotName(tempo.key)
+                                          : QString("unknown"))
+              << "key_strength " + QString::number(tempo.keyStrength, 'f', 2);
+    } else if (command == "automix") {
+        if (argument != "on" && argument != "off") return {"ERR usage: automix on|off"};
+        engine->setAutomix(argument == "on");
+    } else if (command == "stream") {
+        // stream on [lan] [port] | stream off | stream - состояние и счётчики
+        const QStringList parts = argument.split(' ', Qt::SkipEmptyParts);
+        if (parts.value(0) == "on") {
+            const bool lan = parts.contains("lan");
+            quint16 port = StreamServer::DefaultPort;
+            for (const QString &part : parts.mid(1)) {
+                bool ok = false;
+                const int value = part.toInt(&ok);
+                if (ok && value > 0 && value < 65536) port = quint16(value);
+                else if (part != "lan") return {"ERR usage: stream on [lan] [port] | stream off"};
+            }
+            if (!streams->listen(lan ? QHostAddress::Any : QHostAddress::LocalHost, port)) {
+                return {"ERR " + streams->errorString()};
+            }
+        } else if (parts.value(0) == "off") {
+            streams->close();
+        } else if (!parts.isEmpty()) {
+            return {"ERR usage: stream on [lan] [port] | stream off"};
+        }
+        const StreamServer::Stats stats = streams->stats();
+        reply << "url " + (streams->isListening() ? streams->baseUrl() : QString("off"))
+              << "listeners " + QString::number(stats.listeners)
+              << "peak_listeners " + QString::number(stats.peakListeners)
+              << "transcodes " + QString::number(stats.transcodes)
+              << "requests " + QString::number(stats.requests)
+              << "bytes_sent " + QString::number(stats.bytesSent)
+              << "zero_copy_bytes " + QString::number(stats.zeroCopyBytes);
+    } else if (command == "add") {
+        QFileInfo info(argument);
+        if (!info.exists()) return {"ERR no such file or folder"};
+        // Импорт идёт в фоне, ответ не ждёт проверки заголовков
+        if (info.isDir()) {
+            engine->importFolder(info.absoluteFilePath());
+        } else {
+            engine->importTracks({info.absoluteFilePath()});
+        }
+        reply << "importing";
+    } else if (command == "quarantine") {
+        const QStringList paths = engine->quarantined();
+        for (const QString &path : paths) {
+            reply << path + "\t" + engine->quarantineReason(path);
+        }
+    } else if (command == "release") {
+        if (engine->quarantineReason(argument).isEmpty()) return {"ERR not quarantined"};
+        reply << QString::number(engine->releaseFromQuarantine(argument));
+    } else if (command == "search") {
+        reply = engine->search(argument);
+    } else if (command == "list") {
+        const QStringList playlist = engine->currentPlaylist();
+        for (int i = 0; i < playlist.size(); ++i) {
+            reply << QString("%1 %2").arg(i).arg(playlist.at(i));
+        }
+    } else if (command == "collections") {
+        reply = engine->collections()->getCollectionNames();
+    } else if (command == "collection") {
+        reply = engine->collections()->getTracksInCollection(argument);
+    } else if (command == "playcollection") {
+        if (!engine->playCollection(argument)) return {"ERR no such collection or it is empty"};
+    } else if (command == "status") {
+        const QMediaPlayer *player = engine->mediaPlayer();
+        QString state = "stopped";
+        if (player->playbackState() == QMediaPlayer::PlayingState) state = "playing";
+        else if (player->playbackState() == QMediaPlayer::PausedState) state = "paused";
+
+        reply << "state " + state
+              << "track " + engine->currentFilePath()
+              << "index " + QString::number(engine->currentIndex())
+              << "position " + QString::number(engine->position())
+              << "duration " + QString::number(engine->duration())
+              << QString("shuffle %1").arg(engine->isShuffle() ? "on" : "off")
+              << QString("radio %1").arg(engine->isRadio() ? "on" : "off")
+              << QString("automix %1").arg(engine->isAutomix() ? "on" : "off")
+              << ("context " + PlaybackContext::kindName(engine->contextKind()) + " "
+                  + engine->playbackContext().name()).trimmed();
+    } else if (command == "history") {
+        // history [day|month] [artist|album|track]
+        const QStringList parts = argument.split(' ', Qt::SkipEmptyParts);
+        const QString period = parts.value(0, "month");
+        const QString group = parts.value(1, "artist");
+        if (period != "day" && period != "month") return {"ERR usage: history [day|month] [artist|album|track]"};
+        ListeningHistory::GroupBy groupBy = ListeningHistory::Artist;
+        if (group == "album") groupBy = ListeningHistory::Album;
+        else if (group == "track") groupBy = ListeningHistory::Track;
+        else if (group != "artist") return {"ERR usage: history [day|month] [artist|album|track]"};
+
+        const QList<ListeningHistory::Bucket> buckets = engine->listeningHistory()->aggregate(
+            period == "day" ? ListeningHistory::Day : ListeningHistory::Month, groupBy);
+        for (const ListeningHistory::Bucket &bucket : buckets) {
+            reply << QString("%1\t%2\t%3\t%4\t%5").arg(bucket.period, bucket.key)
+                         .arg(bucket.listenedMs / 3600000.0, 0, 'f', 2)
+                         .arg(bucket.plays).arg(bucket.skips);
+        }
+    } else if (command == "exporthistory") {
+        // exporthistory events|rollups|columns <path>
+        const int split = argument.indexOf(' ');
+        const QString kind = argument.left(split);
+        const QString target = split < 0 ? QString() : argument.mid(split + 1).trimmed();
+        if (target.isEmpty()) return {"ERR usage: exporthistory events|rollups|columns <path>"};
+
+        QString error;
+        bool ok = false;
+        if (kind == "events") ok = engine->listeningHistory()->exportCsv(target, ListeningHistory::Events, &error);
+        else if (kind == "rollups") ok = engine->listeningHistory()->exportCsv(target, ListeningHistory::Rollups, &error);
+        else if (kind == "columns") ok = engine->listeningHistory()->exportColumns(target, &error);
+        else return {"ERR usage: exporthistory events|rollups|columns <path>"};
+        if (!ok) return {"ERR " + error};
+    } else if (command == "trash") {
+        QString error;
+        if (!engine->trashTrack(argument, &error)) return {"ERR " + error};
+    } else if (command == "undo") {
+        const QString text = engine->fileOperations()->undoText();
+        if (!engine->undoFileOperation()) return {"ERR nothing to undo"};
+        reply << text;
+    } else if (command == "fileops") {
+        // Последние операции с файлами: id, состояние, описание, ошибка
+        static const char *const stateNames[] = {"pending", "done", "failed", "undone"};
+        const QList<FileOperation> operations = engine->fileOperations()->history();
+        for (const FileOperation &operation : operations) {
+            reply << QString("%1\t%2\t%3\t%4").arg(operation.id).arg(QLatin1String(stateNames[operation.state]),
+                                                                   operation.describe(), operation.error);
+        }
+    } else if (command == "import") {
+        // Плейлист читается в фоне, ответ не ждёт проверки путей
+        if (PlaylistFile::formatForFile(argument) == PlaylistFile::Unknown) return {"ERR unsupported playlist format"};
+        if (!QFileInfo::exists(argument)) return {"ERR no such file"};
+        engine->collections()->importPlaylist(QFileInfo(argument).completeBaseName(), argument);
+        reply << "importing";
+    } else if (command == "stats") {
+        const PlaybackMonitor::Stats stats = engine->monitor()->stats();
+        reply << "first_audio_us " + QString::number(stats.lastTimeToFirstAudioUs)
+              << "first_audio_avg_us " + QString::number(stats.averageTimeToFirstAudioUs)
+              << "seek_latency_us " + QString::number(stats.lastSeekLatencyUs)
+              << "buffer_fill " + QString::number(stats.bufferFill)
+              << "underruns " + QString::number(stats.underruns)
+              << "cpu_percent " + QString::number(stats.cpuPercent, 'f', 1);
+
+        const Prefetcher::Stats prefetch = engine->prefetcher()->stats();
+        reply << "prefetch_hits " + QString::number(prefetch.hits)
+              << "prefetch_misses " + QString::number(prefetch.misses)
+              << "prefetch_first_audio_hit_us " + QString::number(prefetch.hitFirstAudioUs)
+              << "prefetch_first_audio_miss_us " + QString::number(prefetch.missFirstAudioUs)
+              << "prefetch_saved_us " + QString::number(prefetch.savedUs)
+              << "prefetch_throughput_mbps " + QString::number(prefetch.throughputMBps, 'f', 1)
+              << "prefetch_depth " + QString::number(prefetch.depth);
+
+        const MappedFileCache::Stats mapped = MappedFileCache::instance().stats();
+        reply << "mapped_files " + QString::number(mapped.files)
+              << "mapped_bytes " + QString::number(mapped.mappedBytes)
+              << "map_hits " + QString::number(mapped.hits)
+              << "map_misses " + QString::number(mapped.misses)
+              << "map_evictions " + QString::number(mapped.evictions);
+    } else if (command == "power") {
+        // Частота пробуждений - с предыдущего запроса: два запроса подряд дают её на интервале
+        const PowerScheduler::Stats power = engine->powerScheduler()->stats();
+        reply << "state " + PowerScheduler::stateName(power.state)
+              << "state_ms " + QString::number(power.stateMs)
+              << "wakeups " + QString::number(power.wakeups)
+              << "timer_wakeups " + QString::number(power.ticks)
+              << "wakeups_per_sec " + QString::number(power.wakeupsPerSecond, 'f', 2)
+              << "state_wakeups_per_sec " + QString::number(power.stateWakeupsPerSecond, 'f', 2)
+              << "state_cpu_percent " + QString::number(power.stateCpuPercent, 'f', 2)
+              << "context_switches " + QString::number(power.contextSwitches)
+              << "tasks " + QString::number(power.tasks)
+              << "runnable_tasks " + QString::number(power.runnableTasks);
+    } else if (command == "trace") {
+        if (argument.isEmpty() || !engine->monitor()->exportChromeTrace(argument)) {
+            return {"ERR usage: trace <file.json>"};
+        }
+    } else if (command == "quit") {
+        QCoreApplication::quit();
+    } else {
+        return {"ERR unknown command: " + command};
+    }
+
+    reply << "OK";
+    return reply;
+}
@@ -0,0 +1,39 @@
+#ifndef CONTROLSERVER_H
+#define CONTROLSERVER_H
+
+#include <QObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QStringList>
+
+class PlayerEngine;
+class StreamServer;
+
+// Локальный API управления: одна текстовая команда на строку,
+// ответ - строки данных и завершающая "OK" или "ERR <причина>"
+class ControlServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ControlServer(PlayerEngine *engine, QObject *parent = nullptr);
+
+    static QString defaultServerName();
+
+    bool listen(const QString &name = defaultServerName());
+    QString errorString() const;
+    // HTTP-трансляция запускается командой "stream on" или параметром --stream
+    StreamServer *streamServer() const { return streams; }
+
+private slots:
+    void handleNewConnection();
+    void readCommands();
+
+private:
+    QLocalServer *server;
+    PlayerEngine *engine;
+    StreamServer *streams;
+
+    QStringList execute(const QString &line);
+};
+
+#endif // CONTROLSERVER_H
@@ -0,0 +1,198 @@
+#include "coverartcache.h"
+#include "tagreader.h"
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QStandardPaths>
+
+static const QString embeddedPrefix = QStringLiteral("embedded:");
+static const QString folderPrefix = QStringLiteral("folder:");
+
+CoverArtCache::CoverArtCache(QObject *parent)
+    : QObject(parent)
+{
+    // Оставляем ядра под декодирование звука
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+    setMemoryBudget(64 * 1024 * 1024);
+
+    thumbnailDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/thumbnails";
+    QDir().mkpath(thumbnailDir);
+}
+
+CoverArtCache::~CoverArtCache()
+{
+    pool.clear();
+    pool.waitForDone();
+}
+
+void CoverArtCache::setMemoryBudget(qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    images.setMaxCost(bytes);
+}
+
+QImage CoverArtCache::art(const QString &trackPath, int size)
+{
+    {
+        QMutexLocker locker(&mutex);
+        auto source = trackSources.constFind(trackPath);
+        if (source != trackSources.cend()) {
+            if (source->isEmpty()) return QImage();
+            if (QImage *image = images.object(cacheKey(*source, size))) {
+                return *image;
+            }
+        }
+    }
+
+    const QString request = cacheKey(trackPath, size);
+    if (pendingRequests.contains(request)) return QImage();
+    pendingRequests.insert(request);
+
+    pool.start([this, trackPath, size]() {
+        const bool found = !loadArt(trackPath, size).isNull();
+        QMetaObject::invokeMethod(this, [this, trackPath, size, found]() {
+            pendingRequests.remove(cacheKey(trackPath, size));
+            if (found) emit artReady(trackPath, size);
+        }, Qt::QueuedConnection);
+    });
+    return QImage();
+}
+
+QImage CoverArtCache::loadArt(const QString &trackPath, int size)
+{
+    QString source;
+    QByteArray embedded;
+    bool known = false;
+    {
+        QMutexLocker locker(&mutex);
+        auto it = trackSources.constFind(trackPath);
+        if (it != trackSources.cend()) {
+            source = *it;
+            known = true;
+        }
+    }
+    if (!known) {
+        source = resolveSource(trackPath, &embedded);
+        QMutexLocker locker(&mutex);
+        trackSources.insert(trackPath, source);
+    }
+    if (source.isEmpty()) return QImage();
+
+    // Одна и та же обложка (folder.jpg альбома) декодируется ровно один раз
+    const QString key = cacheKey(source, size);
+    {
+        QMutexLocker locker(&mutex);
+        while (decoding.contains(key)) {
+            decoded.wait(&mutex);
+        }
+        if (QImage *image = images.object(key)) {
+            return *image;
+        }
+        decoding.insert(key);
+    }
+
+    const QString thumbnail = thumbnailPath(source, size);
+    QImage image(thumbnail);
+    if (image.isNull()) {
+        if (source.startsWith(embeddedPrefix) && embedded.isEmpty()) {
+            embedded = TagReader::read(trackPath, true).picture;
+        }
+        image = decode(source, embedded, size);
+        if (!image.isNull()) {
+            image.save(thumbnail, "JPG", 85);
+        }
+    }
+
+    QMutexLocker locker(&mutex);
+    if (!image.isNull()) {
+        images.insert(key, new QImage(image), qMax<qint64>(1, image.sizeInBytes()));
+    }
+    decoding.remove(key);
+    decoded.wakeAll();
+    return image;
+}
+
+QString CoverArtCache::resolveSource(const QString &trackPath, QByteArray *embedded)
+{
+    const TrackTags tags = TagReader::read(trackPath, true);
+    if (!tags.picture.isEmpty()) {
+        *embedded = tags.picture;
+        return embeddedPrefix + trackPath;
+    }
+
+    const QString cover = folderCover(QFileInfo(trackPath).absolutePath());
+    return cover.isEmpty() ? QString() : folderPrefix + cover;
+}
+
+QString CoverArtCache::folderCover(const QString &dirPath)
+{
+    {
+        QMutexLocker locker(&mutex);
+        auto it = folderCovers.constFind(dirPath);
+        if (it != folderCovers.cend()) return *it;
+    }
+
+    static const QStringList candidates = {
+        "folder.jpg", "cover.jpg", "front.jpg", "albumart.jpg",
+        "folder.png", "cover.png", "front.png"
+    };
+
+    QString cover;
+    const QStringList files = QDir(dirPath).entryList(candidates, QDir::Files);
+    for (const QString &candidate : candidates) {
+        for (const QString &file : files) {
+            if (file.compare(candidate, Qt::CaseInsensitive) == 0) {
+                cover = dirPath + "/" + file;
+                break;
+            }
+        }
+        if (!cover.isEmpty()) break;
+    }
+
+    QMutexLocker locker(&mutex);
+    folderCovers.insert(dirPath, cover);
+    return cover;
+}
+
+QString CoverArtCache::thumbnailPath(const QString &source, int size) const
+{
+    // Изменение исходного файла меняет имя миниатюры
+    const QString sourceFile = source.mid(source.indexOf(':') + 1);
+    const QByteArray id = source.toUtf8() + '@'
+                          + QByteArray::number(QFileInfo(sourceFile).lastModified().toMSecsSinceEpoch());
+    const QByteArray hash = QCryptographicHash::hash(id, QCryptographicHash::Sha1).toHex();
+    return QString("%1/%2-%3.jpg").arg(thumbnailDir, QString::fromLatin1(hash)).arg(size);
+}
+
+QImage CoverArtCache::decode(const QString &source, const QByteArray &embedded, int size)
+{
+    QBuffer buffer;
+    QImageReader reader;
+    if (source.startsWith(embeddedPrefix)) {
+        buffer.setData(embedded);
+        buffer.open(QIODevice::ReadOnly);
+        reader.setDevice(&buffer);
+    } else {
+        reader.setFileName(source.mid(folderPrefix.size()));
+    }
+    reader.setAutoTransform(true);
+
+    // JPEG умеет декодировать сразу в уменьшенном размере
+    const QSize original = reader.size();
+    if (original.isValid()) {
+        reader.setScaledSize(original.scaled(size, size, Qt::KeepAspectRatio));
+    }
+
+    QImage image = reader.read();
+    if (!image.isNull() && (image.width() > size || image.height() > size)) {
+        image = image.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    return image;
+}
+
+QString CoverArtCache::cacheKey(const QString &key, int size)
+{
+    return key + '#' + QString::number(size);
+}
@@ -0,0 +1,53 @@
+#ifndef COVERARTCACHE_H
+#define COVERARTCACHE_H
+
+#include <QObject>
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QSet>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+// Обложки альбомов: встроенные картинки (APIC/PICTURE) или folder.jpg рядом с треком.
+// Декодирование и масштабирование - в пуле потоков, результат держится в
+// LRU-кэше с бюджетом в байтах и в компактном дисковом хранилище миниатюр.
+class CoverArtCache : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CoverArtCache(QObject *parent = nullptr);
+    ~CoverArtCache();
+
+    void setMemoryBudget(qint64 bytes);
+
+    // Не блокирует: если обложки ещё нет в памяти, ставит загрузку в очередь
+    // и возвращает пустую картинку, по готовности придёт artReady()
+    QImage art(const QString &trackPath, int size);
+
+signals:
+    void artReady(const QString &trackPath, int size);
+
+private:
+    QThreadPool pool;
+    QString thumbnailDir;
+
+    QMutex mutex;
+    QWaitCondition decoded;
+    QCache<QString, QImage> images;
+    QHash<QString, QString> trackSources;
+    QHash<QString, QString> folderCovers;
+    QSet<QString> decoding;
+
+    QSet<QString> pendingRequests;
+
+    QImage loadArt(const QString &trackPath, int size);
+    QString resolveSource(const QString &trackPath, QByteArray *embedded);
+    QString folderCover(const QString &dirPath);
+    QString thumbnailPath(const QString &source, int size) const;
+    static QImage decode(const QString &source, const QByteArray &embedded, int size);
+    static QString cacheKey(const QString &key, int size);
+};
+
+#endif // COVERARTCACHE_H
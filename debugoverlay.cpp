@@ -0,0 +1,101 @@
+#include "debugoverlay.h"
+#include "playbackmonitor.h"
+#include "prefetcher.h"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QPushButton>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QDir>
+
+static QString formatUs(qint64 us)
+{
+    if (us < 0) return "-";
+    return QString("%1 ms").arg(us / 1000.0, 0, 'f', 1);
+}
+
+DebugOverlay::DebugOverlay(PlaybackMonitor *monitor, Prefetcher *prefetcher, QWidget *parent)
+    : QDialog(parent),
+    monitor(monitor),
+    prefetcher(prefetcher),
+    statsLabel(new QLabel(this)),
+    refreshTimer(new QTimer(this))
+{
+    setWindowTitle("Playback diagnostics");
+    setWindowFlags(windowFlags() | Qt::Tool);
+
+    statsLabel->setTextFormat(Qt::PlainText);
+    statsLabel->setStyleSheet("font-family: monospace; font-size: 12px;");
+
+    QPushButton *exportButton = new QPushButton("Export Chrome trace...", this);
+    QPushButton *closeButton = new QPushButton("Close", this);
+    connect(exportButton, &QPushButton::clicked, this, &DebugOverlay::exportTrace);
+    connect(closeButton, &QPushButton::clicked, this, &QDialog::hide);
+
+    QHBoxLayout *buttons = new QHBoxLayout;
+    buttons->addWidget(exportButton);
+    buttons->addStretch();
+    buttons->addWidget(closeButton);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(statsLabel);
+    layout->addLayout(buttons);
+
+    // Обновляем только пока окно видно
+    refreshTimer->setInterval(500);
+    connect(refreshTimer, &QTimer::timeout, this, &DebugOverlay::refresh);
+}
+
+void DebugOverlay::showEvent(QShowEvent *event)
+{
+    refresh();
+    refreshTimer->start();
+    QDialog::showEvent(event);
+}
+
+void DebugOverlay::hideEvent(QHideEvent *event)
+{
+    refreshTimer->stop();
+    QDialog::hideEvent(event);
+}
+
+void DebugOverlay::refresh()
+{
+    const PlaybackMonitor::Stats stats = monitor->stats();
+    const Prefetcher::Stats prefetch = prefetcher->stats();
+    statsLabel->setText(QString(
+        "Time to first audio:  %1 (avg %2)\n"
+        "Seek latency:         %3\n"
+        "Buffer fill:          %4%\n"
+        "Underruns:            %5\n"
+        "Process CPU:          %6% (%7 ms while playing)\n"
+        "Trace events:         %8\n"
+        "Prefetch hits:        %9 / %10 (%11%)\n"
+        "First audio hit/miss: %12 / %13, saved %14\n"
+        "Storage:              %15 MB/s, depth %16")
+        .arg(formatUs(stats.lastTimeToFirstAudioUs), formatUs(stats.averageTimeToFirstAudioUs),
+             formatUs(stats.lastSeekLatencyUs))
+        .arg(stats.bufferFill)
+        .arg(stats.underruns)
+        .arg(stats.cpuPercent, 0, 'f', 1)
+        .arg(stats.cpuTimeMs)
+        .arg(monitor->trace().size())
+        .arg(prefetch.hits)
+        .arg(prefetch.hits + prefetch.misses)
+        .arg(prefetch.hitRate() * 100, 0, 'f', 0)
+        .arg(formatUs(prefetch.hitFirstAudioUs), formatUs(prefetch.missFirstAudioUs), formatUs(prefetch.savedUs))
+        .arg(prefetch.throughputMBps, 0, 'f', 1)
+        .arg(prefetch.depth));
+}
+
+void DebugOverlay::exportTrace()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Export trace"),
+                                                    QDir::homePath() + "/mp3player-trace.json",
+                                                    tr("Chrome trace (*.json)"));
+    if (fileName.isEmpty()) return;
+
+    if (!monitor->exportChromeTrace(fileName)) {
+        QMessageBox::warning(this, "Ошибка", "Не удалось сохранить трассу");
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef DEBUGOVERLAY_H
+#define DEBUGOVERLAY_H
+
+#include <QDialog>
+#include <QLabel>
+#include <QTimer>
+
+class PlaybackMonitor;
+class Prefetcher;
+
+// Окно отладки аудиотракта, открывается кнопкой настроек
+class DebugOverlay : public QDialog
+{
+    Q_OBJECT
+public:
+    DebugOverlay(PlaybackMonitor *monitor, Prefetcher *prefetcher, QWidget *parent = nullptr);
+
+protected:
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+
+private slots:
+    void refresh();
+    void exportTrace();
+
+private:
+    PlaybackMonitor *monitor;
+    Prefetcher *prefetcher;
+    QLabel *statsLabel;
+    QTimer *refreshTimer;
+};
+
+#endif // DEBUGOVERLAY_H
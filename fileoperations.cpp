@@ -0,0 +1,539 @@
+#include "fileoperations.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#endif
+
+// В журнале держим последние две сотни операций; переписываем его, когда записей вчетверо больше
+static const int maxHistory = 200;
+static const int maxJournalRecords = maxHistory * 4;
+static const int retagTimeoutMs = 5 * 60 * 1000;
+
+static QString ffmpegPath()
+{
+    static const QString path = QStandardPaths::findExecutable("ffmpeg");
+    return path;
+}
+
+static QJsonObject tagsToJson(const TrackTags &tags)
+{
+    return QJsonObject{{"title", tags.title}, {"artist", tags.artist}, {"album", tags.album}};
+}
+
+static TrackTags tagsFromJson(const QJsonValue &value)
+{
+    const QJsonObject object = value.toObject();
+    TrackTags tags;
+    tags.title = object.value("title").toString();
+    tags.artist = object.value("artist").toString();
+    tags.album = object.value("album").toString();
+    return tags;
+}
+
+// Подменяет target готовым файлом одним переименованием: читатель видит либо старый файл,
+// либо новый, а открытые дескрипторы и отображения старого остаются целыми до закрытия
+static bool replaceFile(const QString &source, const QString &target, QString *errorString)
+{
+#ifdef Q_OS_WIN
+    if (MoveFileExW(reinterpret_cast<const wchar_t *>(QDir::toNativeSeparators(source).utf16()),
+                    reinterpret_cast<const wchar_t *>(QDir::toNativeSeparators(target).utf16()),
+                    MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        return true;
+    }
+    *errorString = QString("MoveFileEx failed with error %1").arg(GetLastError());
+#else
+    if (::rename(QFile::encodeName(source).constData(), QFile::encodeName(target).constData()) == 0) return true;
+    *errorString = QString::fromLocal8Bit(std::strerror(errno));
+#endif
+    return false;
+}
+
+static bool sameTags(const TrackTags &a, const TrackTags &b)
+{
+    return a.title == b.title && a.artist == b.artist && a.album == b.album;
+}
+
+QString FileOperation::kindName(Kind kind)
+{
+    switch (kind) {
+    case Rename: return "rename";
+    case Move: return "move";
+    case Trash: return "trash";
+    case Restore: return "restore";
+    case Retag: return "retag";
+    }
+    return QString();
+}
+
+QString FileOperation::describe() const
+{
+    const QString name = QFileInfo(source).fileName();
+    switch (kind) {
+    case Rename: return kindName(kind) + " " + name + " -> " + QFileInfo(target).fileName();
+    case Move: return kindName(kind) + " " + name + " -> " + QFileInfo(target).path();
+    case Restore: return kindName(kind) + " " + QFileInfo(target).fileName();
+    case Trash:
+    case Retag: break;
+    }
+    return kindName(kind) + " " + name;
+}
+
+FileOperations::FileOperations(const QString &journalPath, QObject *parent)
+    : QObject(parent),
+    journalPath(journalPath.isEmpty()
+                    ? QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/fileops.journal"
+                    : journalPath)
+{
+    // Один поток: операции над одним файлом не обгоняют друг друга, а сетевой диск не дёргается вразнобой
+    pool.setMaxThreadCount(1);
+
+    QDir().mkpath(QFileInfo(this->journalPath).path());
+    loadJournal();
+    journal.setFileName(this->journalPath);
+    journal.open(QIODevice::WriteOnly | QIODevice::Append);
+}
+
+FileOperations::~FileOperations()
+{
+    // Недописанные в журнал операции доведёт recover() при следующем запуске
+    pool.waitForDone();
+}
+
+qint64 FileOperations::rename(const QString &source, const QString &target)
+{
+    FileOperation operation;
+    operation.kind = FileOperation::Rename;
+    operation.source = source;
+    operation.target = target;
+    return submit(operation);
+}
+
+qint64 FileOperations::move(const QString &source, const QString &target)
+{
+    FileOperation operation;
+    operation.kind = FileOperation::Move;
+    operation.source = source;
+    operation.target = target;
+    return submit(operation);
+}
+
+qint64 FileOperations::trash(const QString &source, const QStringList &tracks)
+{
+    FileOperation operation;
+    operation.kind = FileOperation::Trash;
+    operation.source = source;
+    operation.tracks = tracks;
+    return submit(operation);
+}
+
+qint64 FileOperations::retag(const QString &source, const TrackTags &tags)
+{
+    FileOperation operation;
+    operation.kind = FileOperation::Retag;
+    operation.source = source;
+    operation.tags = tags;
+    return submit(operation);
+}
+
+qint64 FileOperations::undo()
+{
+    if (!canUndo()) return 0;
+    const FileOperation &original = *lastUndoable();
+
+    FileOperation inverse;
+    inverse.undoOf = original.id;
+    inverse.tracks = original.tracks;
+    switch (original.kind) {
+    case FileOperation::Rename:
+    case FileOperation::Move:
+        inverse.kind = original.kind;
+        inverse.source = original.target;
+        inverse.target = original.source;
+        break;
+    case FileOperation::Trash:
+        inverse.kind = FileOperation::Restore;
+        inverse.source = original.target;
+        inverse.target = original.source;
+        break;
+    case FileOperation::Retag:
+        inverse.kind = FileOperation::Retag;
+        inverse.source = original.source;
+        inverse.tags = original.previousTags;
+        break;
+    case FileOperation::Restore:
+        return 0;
+    }
+    return submit(inverse);
+}
+
+bool FileOperations::canUndo() const
+{
+    // Пока что-то выполняется, "последняя операция" ещё не определена
+    return isIdle() && lastUndoable() != nullptr;
+}
+
+QString FileOperations::undoText() const
+{
+    const FileOperation *operation = canUndo() ? lastUndoable() : nullptr;
+    return operation ? operation->describe() : QString();
+}
+
+bool FileOperations::isBusy(const QString &path) const
+{
+    for (const FileOperation &operation : running) {
+        if (operation.source == path || operation.target == path) return true;
+    }
+    return false;
+}
+
+bool FileOperations::canRetag()
+{
+    return !ffmpegPath().isEmpty();
+}
+
+qint64 FileOperations::submit(FileOperation operation)
+{
+    if (operation.source.isEmpty() || isBusy(operation.source)) return 0;
+
+    operation.id = ++lastId;
+    operation.state = FileOperation::Pending;
+    operation.time = QDateTime::currentDateTime();
+    // Запись о начале - до ввода-вывода: по ней после падения видно, что операция была
+    writeRecord("begin", operation);
+    remember(operation);
+    running.insert(operation.id, operation);
+    emit undoChanged();
+
+    pool.start([this, operation]() mutable {
+        operation.error = execute(operation);
+        QMetaObject::invokeMethod(this, [this, operation]() {
+            handleDone(operation);
+        }, Qt::QueuedConnection);
+    });
+    return operation.id;
+}
+
+void FileOperations::handleDone(const FileOperation &result)
+{
+    FileOperation operation = result;
+    running.remove(operation.id);
+    operation.state = operation.error.isEmpty() ? FileOperation::Done : FileOperation::Failed;
+    writeRecord(operation.error.isEmpty() ? "done" : "failed", operation);
+    remember(operation);
+
+    if (operation.state == FileOperation::Done && operation.undoOf != 0) {
+        for (FileOperation &original : operations) {
+            if (original.id != operation.undoOf) continue;
+            original.state = FileOperation::Undone;
+            writeRecord("undone", original);
+            break;
+        }
+    }
+
+    emit finished(operation);
+    emit undoChanged();
+    if (journalRecords > maxJournalRecords && isIdle()) compactJournal();
+}
+
+void FileOperations::recover()
+{
+    bool changed = false;
+    for (int i = 0; i < operations.size(); ++i) {
+        FileOperation &operation = operations[i];
+        if (operation.state != FileOperation::Pending || running.contains(operation.id)) continue;
+
+        // Закончить могла сама операция - не успела только запись о конце
+        const bool done = settle(operation);
+        operation.state = done ? FileOperation::Done : FileOperation::Failed;
+        if (!done && operation.error.isEmpty()) operation.error = "interrupted";
+        writeRecord(done ? "done" : "failed", operation);
+        changed = true;
+
+        const FileOperation recovered = operation;
+        if (done && recovered.undoOf != 0) {
+            for (FileOperation &original : operations) {
+                if (original.id != recovered.undoOf) continue;
+                original.state = FileOperation::Undone;
+                writeRecord("undone", original);
+                break;
+            }
+        }
+        emit finished(recovered);
+    }
+    if (changed) emit undoChanged();
+}
+
+void FileOperations::loadJournal()
+{
+    QFile file(journalPath);
+    if (!file.open(QIODevice::ReadOnly)) return;
+
+    QHash<qint64, int> indexById;
+    while (!file.atEnd()) {
+        // Последняя строка могла оборваться при падении - такие просто пропускаем
+        const QJsonObject record = QJsonDocument::fromJson(file.readLine()).object();
+        const qint64 id = record.value("id").toInteger();
+        if (record.isEmpty() || id <= 0) continue;
+        ++journalRecords;
+        lastId = qMax(lastId, id);
+
+        const QString event = record.value("event").toString();
+        if (event == "begin") {
+            FileOperation operation;
+            operation.id = id;
+            const QString kind = record.value("kind").toString();
+            for (int k = FileOperation::Rename; k <= FileOperation::Retag; ++k) {
+                if (FileOperation::kindName(FileOperation::Kind(k)) == kind) operation.kind = FileOperation::Kind(k);
+            }
+            operation.source = record.value("source").toString();
+            operation.target = record.value("target").toString();
+            for (const QJsonValue &track : record.value("tracks").toArray()) {
+                operation.tracks.append(track.toString());
+            }
+            operation.tags = tagsFromJson(record.value("tags"));
+            operation.undoOf = record.value("undoOf").toInteger();
+            operation.time = QDateTime::fromString(record.value("time").toString(), Qt::ISODate);
+            indexById.insert(id, operations.size());
+            operations.append(operation);
+            continue;
+        }
+
+        const int index = indexById.value(id, -1);
+        if (index < 0) continue;
+        FileOperation &operation = operations[index];
+        if (event == "done") {
+            operation.state = FileOperation::Done;
+            if (record.contains("target")) operation.target = record.value("target").toString();
+            if (record.contains("previous")) operation.previousTags = tagsFromJson(record.value("previous"));
+            operation.reversible = record.value("reversible").toBool();
+        } else if (event == "failed") {
+            operation.state = FileOperation::Failed;
+            operation.error = record.value("error").toString();
+        } else if (event == "undone") {
+            operation.state = FileOperation::Undone;
+        }
+    }
+
+    if (operations.size() > maxHistory) operations.erase(operations.begin(), operations.end() - maxHistory);
+}
+
+void FileOperations::writeRecord(const QString &event, const FileOperation &operation)
+{
+    QJsonObject record{{"id", operation.id}, {"event", event}};
+    if (event == "begin") {
+        record.insert("kind", FileOperation::kindName(operation.kind));
+        record.insert("source", operation.source);
+        if (!operation.target.isEmpty()) record.insert("target", operation.target);
+        if (!operation.tracks.isEmpty()) record.insert("tracks", QJsonArray::fromStringList(operation.tracks));
+        if (operation.kind == FileOperation::Retag) record.insert("tags", tagsToJson(operation.tags));
+        if (operation.undoOf != 0) record.insert("undoOf", operation.undoOf);
+        record.insert("time", operation.time.toString(Qt::ISODate));
+    } else if (event == "done") {
+        // У корзины путь становится известен только здесь, у тегов - прежние значения
+        if (!operation.target.isEmpty()) record.insert("target", operation.target);
+        if (operation.kind == FileOperation::Retag) record.insert("previous", tagsToJson(operation.previousTags));
+        record.insert("reversible", operation.reversible);
+    } else if (event == "failed") {
+        record.insert("error", operation.error);
+    }
+
+    journal.write(QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n');
+    journal.flush();
+    ++journalRecords;
+}
+
+void FileOperations::compactJournal()
+{
+    // Переписываем журнал целиком из истории: begin и итог каждой операции
+    journal.close();
+    QSaveFile file(journalPath);
+    if (file.open(QIODevice::WriteOnly)) {
+        const QList<FileOperation> kept = operations;
+        journalRecords = 0;
+        for (const FileOperation &operation : kept) {
+            QJsonObject begin{{"id", operation.id}, {"event", "begin"},
+                              {"kind", FileOperation::kindName(operation.kind)},
+                              {"source", operation.source}, {"target", operation.target},
+                              {"tracks", QJsonArray::fromStringList(operation.tracks)},
+                              {"tags", tagsToJson(operation.tags)}, {"undoOf", operation.undoOf},
+                              {"time", operation.time.toString(Qt::ISODate)}};
+            file.write(QJsonDocument(begin).toJson(QJsonDocument::Compact) + '\n');
+            QJsonObject end{{"id", operation.id}};
+            if (operation.state == FileOperation::Failed) {
+                end.insert("event", "failed");
+                end.insert("error", operation.error);
+            } else {
+                end.insert("event", "done");
+                end.insert("target", operation.target);
+                end.insert("previous", tagsToJson(operation.previousTags));
+                end.insert("reversible", operation.reversible);
+            }
+            file.write(QJsonDocument(end).toJson(QJsonDocument::Compact) + '\n');
+            journalRecords += 2;
+            if (operation.state == FileOperation::Undone) {
+                file.write(QJsonDocument(QJsonObject{{"id", operation.id}, {"event", "undone"}})
+                               .toJson(QJsonDocument::Compact) + '\n');
+                ++journalRecords;
+            }
+        }
+        file.commit();
+    }
+    journal.setFileName(journalPath);
+    journal.open(QIODevice::WriteOnly | QIODevice::Append);
+}
+
+void FileOperations::remember(const FileOperation &operation)
+{
+    for (int i = operations.size() - 1; i >= 0; --i) {
+        if (operations.at(i).id == operation.id) {
+            operations[i] = operation;
+            return;
+        }
+    }
+    operations.append(operation);
+    if (operations.size() > maxHistory) operations.removeFirst();
+}
+
+const FileOperation *FileOperations::lastUndoable() const
+{
+    // Отмена идёт назад по истории; сами отмены и неудачные операции пропускаются
+    for (int i = operations.size() - 1; i >= 0; --i) {
+        const FileOperation &operation = operations.at(i);
+        if (operation.undoOf != 0 || operation.state != FileOperation::Done) continue;
+        if (operation.reversible) return &operation;
+    }
+    return nullptr;
+}
+
+QString FileOperations::execute(FileOperation &operation)
+{
+    switch (operation.kind) {
+    case FileOperation::Rename:
+    case FileOperation::Move:
+    case FileOperation::Restore: {
+        if (QFileInfo::exists(operation.target)) return "target exists: " + operation.target;
+        QDir().mkpath(QFileInfo(operation.target).path());
+        // Между дисками QFile::rename копирует и удаляет исходник
+        QFile file(operation.source);
+        if (!file.rename(operation.target)) return file.errorString();
+        if (operation.kind == FileOperation::Restore) {
+            // Описание в корзине freedesktop остаётся сиротой, если его не убрать
+            const QFileInfo trashed(operation.source);
+            if (trashed.dir().dirName() == "files") {
+                QFile::remove(trashed.dir().absoluteFilePath("../info/" + trashed.fileName() + ".trashinfo"));
+            }
+        }
+        operation.reversible = true;
+        return QString();
+    }
+    case FileOperation::Trash: {
+        QFile file(operation.source);
+        if (!file.moveToTrash()) return file.errorString();
+        operation.target = file.fileName();
+        operation.reversible = true;
+        return QString();
+    }
+    case FileOperation::Retag: {
+        operation.previousTags = TagReader::read(operation.source);
+        const QString error = runRetag(operation.source, operation.tags);
+        operation.reversible = error.isEmpty();
+        return error;
+    }
+    }
+    return "unknown operation";
+}
+
+QString FileOperations::retagPartPath(const QString &fileName)
+{
+    // Расширение сохраняем: по нему ffmpeg выбирает контейнер
+    const QFileInfo info(fileName);
+    return info.path() + "/." + info.completeBaseName() + ".retag." + info.suffix();
+}
+
+QString FileOperations::runRetag(const QString &fileName, const TrackTags &tags)
+{
+    if (ffmpegPath().isEmpty()) return "ffmpeg not found";
+
+    // Потоки копируются как есть - меняется только контейнер с тегами, звук не перекодируется
+    const QString partPath = retagPartPath(fileName);
+    const QStringList arguments = {"-nostdin", "-hide_banner", "-loglevel", "error", "-y",
+                                   "-i", fileName, "-map", "0", "-c", "copy", "-map_metadata", "0",
+                                   "-metadata", "title=" + tags.title,
+                                   "-metadata", "artist=" + tags.artist,
+                                   "-metadata", "album=" + tags.album,
+                                   partPath};
+    QProcess process;
+    process.setProcessChannelMode(QProcess::SeparateChannels);
+    process.setStandardOutputFile(QProcess::nullDevice());
+    process.start(ffmpegPath(), arguments);
+    if (!process.waitForStarted()) return process.errorString();
+    if (!process.waitForFinished(retagTimeoutMs)) {
+        process.kill();
+        process.waitForFinished();
+        QFile::remove(partPath);
+        return "ffmpeg timed out";
+    }
+    if (process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0
+        || QFileInfo(partPath).size() <= 0) {
+        QFile::remove(partPath);
+        const QString message = QString::fromLocal8Bit(process.readAllStandardError()).trimmed();
+        const QString lastLine = message.section('\n', -1).trimmed();
+        return lastLine.isEmpty() ? QString("ffmpeg exited with code %1").arg(process.exitCode()) : lastLine;
+    }
+
+    // Атомарная подмена; если ОС или файловая система её не дают - удаление и переименование,
+    // окно между ними закрывает восстановление по журналу
+    QString replaceError;
+    if (replaceFile(partPath, fileName, &replaceError)) return QString();
+    qWarning() << "Atomic replace failed for" << fileName << replaceError;
+    QFile original(fileName);
+    if (!original.remove()) {
+        QFile::remove(partPath);
+        return original.errorString();
+    }
+    QFile part(partPath);
+    if (!part.rename(fileName)) return part.errorString() + " (new file left at " + partPath + ")";
+    return QString();
+}
+
+bool FileOperations::settle(FileOperation &operation)
+{
+    switch (operation.kind) {
+    case FileOperation::Rename:
+    case FileOperation::Move:
+    case FileOperation::Restore:
+        operation.reversible = true;
+        return !QFileInfo::exists(operation.source) && QFileInfo::exists(operation.target);
+    case FileOperation::Trash:
+        // Куда файл попал в корзине, записать не успели - отменить такое удаление нельзя
+        operation.reversible = false;
+        return !QFileInfo::exists(operation.source);
+    case FileOperation::Retag: {
+        // Прежние теги записываются только с итогом - после падения они неизвестны
+        operation.reversible = false;
+        // Готовый файл рядом с оригиналом - подмена не случилась, запись тегов не доведена.
+        // Оригинала нет - упали в запасном пути между удалением и переименованием
+        const QString partPath = retagPartPath(operation.source);
+        if (QFileInfo::exists(partPath)) {
+            if (!QFileInfo::exists(operation.source)) return QFile::rename(partPath, operation.source);
+            QFile::remove(partPath);
+            return false;
+        }
+        return sameTags(TagReader::read(operation.source), operation.tags);
+    }
+    }
+    return false;
+}
@@ -0,0 +1,109 @@
+#ifndef FILEOPERATIONS_H
+#define FILEOPERATIONS_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QStringList>
+#include <QThreadPool>
+#include "tagreader.h"
+
+// Одна операция над файлом библиотеки. Пути - к самим файлам, без фрагментов виртуальных треков
+struct FileOperation
+{
+    enum Kind {
+        Rename,
+        Move,
+        Trash,
+        Restore,                        // возврат из корзины - отмена Trash
+        Retag
+    };
+
+    enum State {
+        Pending,
+        Done,
+        Failed,
+        Undone
+    };
+
+    qint64 id = 0;
+    Kind kind = Rename;
+    State state = Pending;
+    QString source;
+    QString target;                     // у Trash - куда файл попал в корзине
+    QStringList tracks;                 // треки библиотеки из файла: для Trash их вернёт отмена
+    TrackTags tags;                     // у Retag - новые теги
+    TrackTags previousTags;             // у Retag - прежние, для отмены
+    qint64 undoOf = 0;                  // эта операция отменяет операцию с таким id
+    bool reversible = false;            // известно всё, что нужно для отмены
+    QString error;
+    QDateTime time;
+
+    static QString kindName(Kind kind);
+    // Кратко для меню и журнала в консоли: "rename a.mp3 -> b.mp3"
+    QString describe() const;
+};
+
+// Переименование, перенос, удаление в корзину и запись тегов вне GUI-потока.
+// Операции выполняются по одной в порядке постановки; когда ввод-вывод закончен, сигнал finished
+// приходит в поток объекта, и библиотека обновляется разом. Каждая операция пишется в журнал
+// (строки JSON в AppDataLocation) до начала и после конца - по нему работают отмена и
+// восстановление: операция, начатая до падения, при следующем запуске доводится до
+// согласованного состояния по тому, что реально лежит на диске.
+class FileOperations : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FileOperations(const QString &journalPath = QString(), QObject *parent = nullptr);
+    ~FileOperations();
+
+    // Возвращают id операции, 0 - если её нельзя поставить (путь занят другой операцией)
+    qint64 rename(const QString &source, const QString &target);
+    qint64 move(const QString &source, const QString &target);
+    qint64 trash(const QString &source, const QStringList &tracks);
+    qint64 retag(const QString &source, const TrackTags &tags);
+
+    // Отменяет последнюю выполненную операцию обратной; 0 - отменять нечего
+    qint64 undo();
+    bool canUndo() const;
+    QString undoText() const;
+    // Выполняется или ждёт операция с этим файлом
+    bool isBusy(const QString &path) const;
+    bool isIdle() const { return running.isEmpty(); }
+    QList<FileOperation> history() const { return operations; }
+
+    // Доводит операции, прерванные падением; готовые приходят через finished
+    void recover();
+
+    static bool canRetag();
+
+signals:
+    void finished(const FileOperation &operation);
+    void undoChanged();
+
+private:
+    QThreadPool pool;
+    QString journalPath;
+    QFile journal;
+    int journalRecords = 0;
+    qint64 lastId = 0;
+    QList<FileOperation> operations;    // история по возрастанию id, не длиннее maxHistory
+    QHash<qint64, FileOperation> running;
+
+    qint64 submit(FileOperation operation);
+    void handleDone(const FileOperation &operation);
+    void loadJournal();
+    void writeRecord(const QString &event, const FileOperation &operation);
+    void compactJournal();
+    void remember(const FileOperation &operation);
+    const FileOperation *lastUndoable() const;
+
+    static QString execute(FileOperation &operation);
+    static QString runRetag(const QString &fileName, const TrackTags &tags);
+    static QString retagPartPath(const QString &fileName);
+    static bool settle(FileOperation &operation);
+};
+
+#endif // FILEOPERATIONS_H
@@ -0,0 +1,343 @@
+#include "formatprobe.h"
+#include "virtualtrack.h"
+#include <QFile>
+
+static const qint64 headSize = 64 * 1024;
+static const qint64 tailSize = 64 * 1024;
+
+static quint32 readBigEndian(const char *data, int bytes)
+{
+    quint32 value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | quint8(data[i]);
+    }
+    return value;
+}
+
+static quint32 readLittleEndian(const char *data, int bytes)
+{
+    quint32 value = 0;
+    for (int i = bytes - 1; i >= 0; --i) {
+        value = (value << 8) | quint8(data[i]);
+    }
+    return value;
+}
+
+static quint64 readLittleEndian64(const char *data)
+{
+    return quint64(readLittleEndian(data, 4)) | (quint64(readLittleEndian(data + 4, 4)) << 32);
+}
+
+static bool isSaneSampleRate(int sampleRate)
+{
+    return sampleRate >= 8000 && sampleRate <= 384000;
+}
+
+namespace {
+
+struct Mp3Frame {
+    int version = 0;        // 1 - MPEG1, 2 - MPEG2, 25 - MPEG2.5
+    int layer = 0;
+    int bitrate = 0;        // бит/с
+    int sampleRate = 0;
+    int channels = 0;
+    int samplesPerFrame = 0;
+    int length = 0;         // байт
+
+    bool sameStream(const Mp3Frame &other) const
+    {
+        return version == other.version && layer == other.layer && sampleRate == other.sampleRate;
+    }
+};
+
+bool parseMp3Header(const char *data, Mp3Frame &frame)
+{
+    const quint8 b1 = quint8(data[1]);
+    const quint8 b2 = quint8(data[2]);
+    if (quint8(data[0]) != 0xff || (b1 & 0xe0) != 0xe0) return false;
+
+    const int versionBits = (b1 >> 3) & 3;
+    const int layerBits = (b1 >> 1) & 3;
+    const int bitrateIndex = b2 >> 4;
+    const int rateIndex = (b2 >> 2) & 3;
+    if (versionBits == 1 || layerBits == 0 || bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3) {
+        return false;
+    }
+
+    static const int bitrates[5][15] = {
+        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},   // MPEG1 Layer I
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},      // MPEG1 Layer II
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},       // MPEG1 Layer III
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},      // MPEG2 Layer I
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}            // MPEG2 Layer II/III
+    };
+    static const int sampleRates[3] = {44100, 48000, 32000};
+
+    frame.version = versionBits == 3 ? 1 : versionBits == 2 ? 2 : 25;
+    frame.layer = 4 - layerBits;
+
+    const int table = frame.version == 1 ? frame.layer - 1 : (frame.layer == 1 ? 3 : 4);
+    frame.bitrate = bitrates[table][bitrateIndex] * 1000;
+    frame.sampleRate = sampleRates[rateIndex] / (frame.version == 1 ? 1 : frame.version == 2 ? 2 : 4);
+    frame.channels = (quint8(data[3]) >> 6) == 3 ? 1 : 2;
+
+    const int padding = (b2 >> 1) & 1;
+    if (frame.layer == 1) {
+        frame.samplesPerFrame = 384;
+        frame.length = (12 * frame.bitrate / frame.sampleRate + padding) * 4;
+    } else {
+        frame.samplesPerFrame = (frame.layer == 3 && frame.version != 1) ? 576 : 1152;
+        frame.length = frame.samplesPerFrame / 8 * frame.bitrate / frame.sampleRate + padding;
+    }
+    return frame.length > 4;
+}
+
+} // namespace
+
+ProbeResult FormatProbe::probe(const QString &fileName)
+{
+    // Виртуальный трек проверяется по своему файлу, длительность - длина отрезка
+    const VirtualTrack range = VirtualTrack::fromPath(fileName);
+    if (!range.isWhole()) {
+        ProbeResult result = probe(range.filePath);
+        if (!result.isPlayable()) return result;
+        if (result.durationMs > 0 && range.startMs() >= result.durationMs) {
+            result.error = "range starts past the end of file";
+            return result;
+        }
+        result.durationMs = range.durationMs(result.durationMs);
+        return result;
+    }
+
+    ProbeResult result;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        result.error = "cannot open file";
+        return result;
+    }
+
+    QByteArray head = file.read(headSize);
+    if (head.size() < 12) {
+        result.error = "file too short";
+        return result;
+    }
+
+    // ID3v2 может стоять и перед MP3, и перед FLAC
+    qint64 audioStart = id3v2Size(head);
+    if (audioStart > 0) {
+        if (!file.seek(audioStart)) {
+            result.error = "truncated ID3 tag";
+            return result;
+        }
+        head = file.read(headSize);
+    }
+
+    bool recognized = false;
+    if (head.startsWith("RIFF") && head.mid(8, 4) == "WAVE") {
+        result.codec = ProbeResult::Wav;
+        recognized = probeWav(file, result);
+    } else if (head.startsWith("fLaC")) {
+        result.codec = ProbeResult::Flac;
+        // Первый блок метаданных FLAC обязан быть STREAMINFO
+        recognized = head.size() >= 8 + 34 && (quint8(head[4]) & 0x7f) == 0
+                     && probeFlacStreamInfo(head.mid(8, 34), result);
+    } else if (head.startsWith("OggS")) {
+        recognized = probeOgg(file, head, result);
+    } else {
+        qint64 audioBytes = file.size() - audioStart;
+        // ID3v1 в конце файла
+        if (file.seek(file.size() - 128) && file.read(3) == "TAG") {
+            audioBytes -= 128;
+        }
+        result.codec = ProbeResult::Mp3;
+        recognized = probeMp3(head, audioBytes, result);
+    }
+
+    if (!recognized) {
+        result.codec = ProbeResult::Unknown;
+        if (result.error.isEmpty()) result.error = "unrecognized audio format";
+    } else if (!isSaneSampleRate(result.sampleRate)) {
+        result.error = QString("unsupported sample rate %1").arg(result.sampleRate);
+    } else if (result.channels <= 0) {
+        result.error = "no audio channels";
+    } else if (result.durationMs <= 0) {
+        result.error = "no audio data";
+    }
+    return result;
+}
+
+QString FormatProbe::codecName(ProbeResult::Codec codec)
+{
+    switch (codec) {
+    case ProbeResult::Mp3: return "mp3";
+    case ProbeResult::Wav: return "wav";
+    case ProbeResult::Flac: return "flac";
+    case ProbeResult::Vorbis: return "vorbis";
+    case ProbeResult::Opus: return "opus";
+    case ProbeResult::Unknown: break;
+    }
+    return "unknown";
+}
+
+bool FormatProbe::probeMp3(const QByteArray &data, qint64 audioBytes, ProbeResult &result)
+{
+    // Ищем два подряд идущих согласованных кадра: одиночная "синхронизация"
+    // легко встречается в мусоре
+    const char *bytes = data.constData();
+    for (int pos = 0; pos + 4 <= data.size(); ++pos) {
+        Mp3Frame frame;
+        if (!parseMp3Header(bytes + pos, frame)) continue;
+
+        Mp3Frame next;
+        const int nextPos = pos + frame.length;
+        if (nextPos + 4 > data.size() || !parseMp3Header(bytes + nextPos, next) || !frame.sameStream(next)) {
+            continue;
+        }
+
+        result.sampleRate = frame.sampleRate;
+        result.channels = frame.channels;
+
+        // VBR: число кадров из заголовка Xing/Info или VBRI в первом кадре
+        const int sideInfo = frame.version == 1 ? (frame.channels == 1 ? 17 : 32)
+                                                : (frame.channels == 1 ? 9 : 17);
+        const int xing = pos + 4 + sideInfo;
+        const int vbri = pos + 4 + 32;
+        qint64 frames = 0;
+        if (xing + 12 <= data.size() && (data.mid(xing, 4) == "Xing" || data.mid(xing, 4) == "Info")) {
+            if (readBigEndian(bytes + xing + 4, 4) & 1) {
+                frames = readBigEndian(bytes + xing + 8, 4);
+            }
+        } else if (vbri + 18 <= data.size() && data.mid(vbri, 4) == "VBRI") {
+            frames = readBigEndian(bytes + vbri + 14, 4);
+        }
+
+        if (frames > 0) {
+            result.durationMs = frames * frame.samplesPerFrame * 1000 / frame.sampleRate;
+        } else {
+            const qint64 streamBytes = audioBytes - pos;
+            result.durationMs = streamBytes * 8 * 1000 / frame.bitrate;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool FormatProbe::probeWav(QFile &file, ProbeResult &result)
+{
+    // Чанки RIFF: fmt может стоять после LIST, data - после fmt
+    qint64 pos = 12;
+    qint64 byteRate = 0;
+    bool hasFormat = false;
+    while (file.seek(pos)) {
+        const QByteArray header = file.read(8);
+        if (header.size() < 8) break;
+
+        const qint64 size = readLittleEndian(header.constData() + 4, 4);
+        if (header.startsWith("fmt ")) {
+            const QByteArray format = file.read(16);
+            if (format.size() < 16) break;
+
+            const int audioFormat = int(readLittleEndian(format.constData(), 2));
+            if (audioFormat != 1 && audioFormat != 3 && audioFormat != 0xfffe) {
+                result.error = QString("unsupported WAV encoding 0x%1").arg(audioFormat, 0, 16);
+                return false;
+            }
+            result.channels = int(readLittleEndian(format.constData() + 2, 2));
+            result.sampleRate = int(readLittleEndian(format.constData() + 4, 4));
+            byteRate = readLittleEndian(format.constData() + 8, 4);
+            hasFormat = true;
+        } else if (header.startsWith("data")) {
+            if (!hasFormat || byteRate <= 0) break;
+
+            // Размер 0xFFFFFFFF или больше файла - потоковая запись, берём остаток файла
+            const qint64 available = file.size() - (pos + 8);
+            const qint64 dataSize = qMin(size, available);
+            result.durationMs = dataSize * 1000 / byteRate;
+            return true;
+        }
+        pos += 8 + size + (size & 1);
+    }
+
+    if (result.error.isEmpty()) {
+        result.error = hasFormat ? "missing WAV data chunk" : "missing WAV fmt chunk";
+    }
+    return false;
+}
+
+bool FormatProbe::probeFlacStreamInfo(const QByteArray &block, ProbeResult &result)
+{
+    if (block.size() < 18) return false;
+
+    const char *data = block.constData();
+    result.sampleRate = int(readBigEndian(data + 10, 3) >> 4);
+    result.channels = ((quint8(data[12]) >> 1) & 7) + 1;
+    const quint64 totalSamples = (quint64(quint8(data[13]) & 0x0f) << 32) | readBigEndian(data + 14, 4);
+    if (result.sampleRate > 0) {
+        result.durationMs = qint64(totalSamples * 1000 / quint64(result.sampleRate));
+    }
+    return true;
+}
+
+bool FormatProbe::probeOgg(QFile &file, const QByteArray &head, ProbeResult &result)
+{
+    if (head.size() < 28) return false;
+
+    const int segments = quint8(head[26]);
+    const QByteArray packet = head.mid(27 + segments);
+    const quint32 serial = readLittleEndian(head.constData() + 14, 4);
+
+    quint64 preSkip = 0;
+    int granuleRate = 0;
+    if (packet.startsWith("\x01vorbis") && packet.size() >= 16) {
+        result.codec = ProbeResult::Vorbis;
+        result.channels = quint8(packet[11]);
+        result.sampleRate = int(readLittleEndian(packet.constData() + 12, 4));
+        granuleRate = result.sampleRate;
+    } else if (packet.startsWith("OpusHead") && packet.size() >= 16) {
+        result.codec = ProbeResult::Opus;
+        result.channels = quint8(packet[9]);
+        preSkip = readLittleEndian(packet.constData() + 10, 2);
+        // Opus всегда декодируется в 48 кГц, поле - частота исходника
+        result.sampleRate = 48000;
+        granuleRate = 48000;
+    } else if (packet.startsWith("\x7f" "FLAC") && packet.size() >= 17 + 34) {
+        // FLAC в Ogg: STREAMINFO после заголовка отображения и сигнатуры fLaC
+        result.codec = ProbeResult::Flac;
+        return probeFlacStreamInfo(packet.mid(17, 34), result);
+    } else {
+        result.error = "unsupported Ogg codec";
+        return false;
+    }
+
+    // Длительность - позиция последней страницы этого потока
+    const qint64 tailStart = qMax<qint64>(0, file.size() - tailSize);
+    if (!file.seek(tailStart)) return false;
+    const QByteArray tail = file.read(tailSize);
+
+    // Позиция -1 означает страницу без завершённых пакетов, ищем дальше назад
+    qint64 lastGranule = -1;
+    qsizetype pos = tail.lastIndexOf("OggS");
+    while (pos >= 0 && lastGranule < 0) {
+        if (pos + 27 <= tail.size() && readLittleEndian(tail.constData() + pos + 14, 4) == serial) {
+            lastGranule = qint64(readLittleEndian64(tail.constData() + pos + 6));
+        }
+        if (pos == 0) break;
+        pos = tail.lastIndexOf("OggS", pos - 1);
+    }
+    if (lastGranule > qint64(preSkip) && granuleRate > 0) {
+        result.durationMs = (lastGranule - qint64(preSkip)) * 1000 / granuleRate;
+    }
+    return true;
+}
+
+qint64 FormatProbe::id3v2Size(const QByteArray &head)
+{
+    if (head.size() < 10 || !head.startsWith("ID3")) return 0;
+
+    const char *data = head.constData();
+    const qint64 size = (qint64(quint8(data[6]) & 0x7f) << 21) | (qint64(quint8(data[7]) & 0x7f) << 14)
+                        | (qint64(quint8(data[8]) & 0x7f) << 7) | qint64(quint8(data[9]) & 0x7f);
+    const bool footer = quint8(data[5]) & 0x10;
+    return 10 + size + (footer ? 10 : 0);
+}
@@ -0,0 +1,45 @@
+#ifndef FORMATPROBE_H
+#define FORMATPROBE_H
+
+#include <QByteArray>
+#include <QString>
+
+class QFile;
+
+struct ProbeResult {
+    enum Codec {
+        Unknown,
+        Mp3,
+        Wav,
+        Flac,
+        Vorbis,
+        Opus
+    };
+
+    Codec codec = Unknown;
+    int sampleRate = 0;
+    int channels = 0;
+    qint64 durationMs = 0;
+    QString error;
+
+    bool isPlayable() const { return error.isEmpty() && codec != Unknown; }
+};
+
+// Проверка файла при импорте по заголовкам, без декодирования:
+// кодек определяется по содержимому, а не по расширению,
+// длительность - по заголовкам Xing/VBRI, STREAMINFO, чанку data или последней странице Ogg
+class FormatProbe
+{
+public:
+    static ProbeResult probe(const QString &fileName);
+    static QString codecName(ProbeResult::Codec codec);
+
+private:
+    static bool probeMp3(const QByteArray &data, qint64 audioBytes, ProbeResult &result);
+    static bool probeWav(QFile &file, ProbeResult &result);
+    static bool probeFlacStreamInfo(const QByteArray &block, ProbeResult &result);
+    static bool probeOgg(QFile &file, const QByteArray &head, ProbeResult &result);
+    static qint64 id3v2Size(const QByteArray &head);
+};
+
+#endif // FORMATPROBE_H
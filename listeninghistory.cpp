@@ -0,0 +1,640 @@
+#include "listeninghistory.h"
+#include "tagreader.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTextStream>
+#include <QTimer>
+#include <QtConcurrent>
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const qint64 msecsPerDay = 24 * 60 * 60 * 1000;
+static const qint64 msecsPerQuarterHour = 15 * 60 * 1000;
+static const qint64 unixEpochJulianDay = 2440588;
+static const int compactionIntervalMs = 60 * 60 * 1000;
+static const int startupCompactionDelayMs = 5000;
+
+static const QStringList eventColumnNames = {"events.timestamp", "events.track", "events.listened", "events.skipped"};
+static const QStringList rollupColumnNames = {"rollups.day", "rollups.track", "rollups.plays",
+                                              "rollups.skips", "rollups.listened"};
+
+namespace {
+
+// Столбец - плоский массив значений в порядке байт машины (little-endian на всех целевых платформах)
+template<typename T>
+QList<T> readColumn(const QString &fileName)
+{
+    QList<T> values;
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) return values;
+
+    values.resize(file.size() / qint64(sizeof(T)));
+    const qint64 bytes = qint64(values.size()) * qint64(sizeof(T));
+    if (file.read(reinterpret_cast<char*>(values.data()), bytes) != bytes) values.clear();
+    return values;
+}
+
+// QSaveFile перед подменой сбрасывает данные на диск: столбец поколения не окажется пустым
+// после отключения питания, даже если каталог уже переименован
+template<typename T>
+bool writeColumn(const QString &fileName, const QList<T> &values)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+    const qint64 bytes = qint64(values.size()) * qint64(sizeof(T));
+    return file.write(reinterpret_cast<const char*>(values.constData()), bytes) == bytes && file.commit();
+}
+
+// Переименование каталога поколения попадает на диск только с записью родительского каталога
+void syncDirectory(const QString &path)
+{
+#ifdef Q_OS_UNIX
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    ::fsync(fd);
+    ::close(fd);
+#else
+    Q_UNUSED(path);
+#endif
+}
+
+qint32 dayOf(qint64 msecsSinceEpoch, qint64 offsetMs)
+{
+    const qint64 local = msecsSinceEpoch + offsetMs;
+    return qint32(local >= 0 ? local / msecsPerDay : (local - msecsPerDay + 1) / msecsPerDay);
+}
+
+// Местный день события. Смещение от UTC берётся на момент самого события: прослушивания
+// по обе стороны перехода на летнее время или смены пояса попадают в свои дни. Переходы
+// случаются на границах четверти часа, поэтому смещение запоминается по четвертям -
+// сканирование миллионов событий обращается к базе поясов несколько тысяч раз
+class LocalCalendar
+{
+public:
+    qint32 day(qint64 msecsSinceEpoch)
+    {
+        const qint64 slot = msecsSinceEpoch >= 0 ? msecsSinceEpoch / msecsPerQuarterHour
+                                                 : (msecsSinceEpoch - msecsPerQuarterHour + 1) / msecsPerQuarterHour;
+        auto it = offsets.constFind(slot);
+        if (it == offsets.constEnd()) {
+            it = offsets.insert(slot, QDateTime::fromMSecsSinceEpoch(msecsSinceEpoch).offsetFromUtc() * 1000LL);
+        }
+        return dayOf(msecsSinceEpoch, it.value());
+    }
+
+private:
+    QHash<qint64, qint64> offsets;
+};
+
+template<typename T>
+bool appendValue(QFile *file, T value)
+{
+    return file->write(reinterpret_cast<const char*>(&value), sizeof(T)) == qint64(sizeof(T));
+}
+
+QString csvField(const QString &value)
+{
+    if (!value.contains(',') && !value.contains('"') && !value.contains('\n')) return value;
+    QString escaped = value;
+    escaped.replace('"', "\"\"");
+    return '"' + escaped + '"';
+}
+
+QDate dateOfDay(qint32 day)
+{
+    return QDate::fromJulianDay(day + unixEpochJulianDay);
+}
+
+} // namespace
+
+ListeningHistory::ListeningHistory(const QString &directory, QObject *parent)
+    : QObject(parent),
+    root(directory.isEmpty()
+             ? QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/history"
+             : directory)
+{
+    load();
+    openForAppend();
+
+    connect(&watcher, &QFutureWatcher<Compaction>::finished, this, &ListeningHistory::finishCompaction);
+    connect(&tagWatcher, &QFutureWatcher<QList<QPair<QString, TrackTags>>>::finished,
+            this, &ListeningHistory::handleTagsRead);
+
+    QTimer *timer = new QTimer(this);
+    timer->setInterval(compactionIntervalMs);
+    // Раз в час и без спешки: ОС объединяет такое пробуждение с соседними
+    timer->setTimerType(Qt::VeryCoarseTimer);
+    connect(timer, &QTimer::timeout, this, &ListeningHistory::compact);
+    timer->start();
+    QTimer::singleShot(startupCompactionDelayMs, this, &ListeningHistory::compact);
+}
+
+ListeningHistory::~ListeningHistory()
+{
+    // Незавершённое сворачивание просто отбрасываем: исходные файлы не тронуты
+    watcher.waitForFinished();
+    // Теги, прочитанные к выходу, должны попасть в словарь
+    while (tagsPending) {
+        tagWatcher.waitForFinished();
+        handleTagsRead();
+    }
+    closeFiles();
+}
+
+QString ListeningHistory::currentDir() const
+{
+    return root + "/current";
+}
+
+void ListeningHistory::record(const QString &filePath, qint64 startedAtMs, qint64 listenedMs, bool skipped,
+                              const TrackTags *knownTags)
+{
+    const quint32 track = trackId(filePath, knownTags);
+    const quint32 listened = quint32(qBound<qint64>(0, listenedMs, std::numeric_limits<quint32>::max()));
+
+    events.timestamp.append(startedAtMs);
+    events.track.append(track);
+    events.listened.append(listened);
+    events.skipped.append(skipped ? 1 : 0);
+
+    if (eventFiles.size() != eventColumnNames.size()) return;
+    appendValue(eventFiles.at(0), startedAtMs);
+    appendValue(eventFiles.at(1), track);
+    appendValue(eventFiles.at(2), listened);
+    appendValue(eventFiles.at(3), quint8(skipped ? 1 : 0));
+    // Только сброс в ОС: при отключении питания можно потерять последние события, но не
+    // больше - load() обрезает столбцы до последней полной строки
+    for (QFile *file : std::as_const(eventFiles)) {
+        file->flush();
+    }
+}
+
+quint32 ListeningHistory::trackId(const QString &filePath, const TrackTags *knownTags)
+{
+    const auto it = trackIds.constFind(filePath);
+    if (it != trackIds.constEnd()) return it.value();
+
+    // Артист и альбом фиксируются при первом прослушивании, чтобы запросы не читали файлы.
+    // Неизвестные теги читаются в фоне и дописываются в словарь отдельной записью
+    const quint32 id = trackPaths.size();
+    trackPaths.append(filePath);
+    trackArtists.append(knownTags ? knownTags->artist : QString());
+    trackAlbums.append(knownTags ? knownTags->album : QString());
+    trackIds.insert(filePath, id);
+    appendTrackRecord(id);
+
+    if (!knownTags) {
+        tagQueue.append(filePath);
+        requestTags();
+    }
+    return id;
+}
+
+void ListeningHistory::appendTrackRecord(quint32 id)
+{
+    if (!tracksFile) return;
+    QDataStream stream(tracksFile);
+    stream << trackPaths.at(id) << trackArtists.at(id) << trackAlbums.at(id);
+    tracksFile->flush();
+}
+
+void ListeningHistory::requestTags()
+{
+    if (tagQueue.isEmpty() || tagWatcher.isRunning()) return;
+
+    const QStringList batch = tagQueue;
+    tagQueue.clear();
+    tagsPending = true;
+    tagWatcher.setFuture(QtConcurrent::run([batch]() {
+        QList<QPair<QString, TrackTags>> results;
+        results.reserve(batch.size());
+        for (const QString &filePath : batch) {
+            results.append({filePath, TagReader::read(filePath)});
+        }
+        return results;
+    }));
+}
+
+void ListeningHistory::handleTagsRead()
+{
+    if (!tagsPending) return;
+    tagsPending = false;
+    const QList<QPair<QString, TrackTags>> results = tagWatcher.result();
+    for (const auto &result : results) {
+        const auto it = trackIds.constFind(result.first);
+        if (it == trackIds.constEnd()) continue;
+        const quint32 id = it.value();
+        if (result.second.artist.isEmpty() && result.second.album.isEmpty()) continue;
+        trackArtists[id] = result.second.artist;
+        trackAlbums[id] = result.second.album;
+        appendTrackRecord(id);
+    }
+    requestTags();
+}
+
+void ListeningHistory::load()
+{
+    QDir dir(root);
+    dir.mkpath(".");
+
+    // Прерванная подмена поколения: новое поколение целиком записано - доводим подмену
+    if (QFile::exists(root + "/next/complete")) {
+        QDir(currentDir()).removeRecursively();
+        dir.rename("next", "current");
+        QFile::remove(currentDir() + "/complete");
+    } else {
+        QDir(root + "/next").removeRecursively();
+    }
+    dir.mkpath("current");
+
+    const QString current = currentDir() + "/";
+    events.timestamp = readColumn<qint64>(current + eventColumnNames.at(0));
+    events.track = readColumn<quint32>(current + eventColumnNames.at(1));
+    events.listened = readColumn<quint32>(current + eventColumnNames.at(2));
+    events.skipped = readColumn<quint8>(current + eventColumnNames.at(3));
+
+    // Сбой посреди дозаписи оставляет столбцы разной длины: обрезаем до полной строки
+    const int rows = qMin(qMin(events.timestamp.size(), events.track.size()),
+                          qMin(events.listened.size(), events.skipped.size()));
+    events.timestamp.resize(rows);
+    events.track.resize(rows);
+    events.listened.resize(rows);
+    events.skipped.resize(rows);
+    QFile::resize(current + eventColumnNames.at(0), rows * qint64(sizeof(qint64)));
+    QFile::resize(current + eventColumnNames.at(1), rows * qint64(sizeof(quint32)));
+    QFile::resize(current + eventColumnNames.at(2), rows * qint64(sizeof(quint32)));
+    QFile::resize(current + eventColumnNames.at(3), rows * qint64(sizeof(quint8)));
+
+    rollups.day = readColumn<qint32>(current + rollupColumnNames.at(0));
+    rollups.track = readColumn<quint32>(current + rollupColumnNames.at(1));
+    rollups.plays = readColumn<quint32>(current + rollupColumnNames.at(2));
+    rollups.skips = readColumn<quint32>(current + rollupColumnNames.at(3));
+    rollups.listened = readColumn<qint64>(current + rollupColumnNames.at(4));
+
+    QFile file(root + "/tracks.dat");
+    if (file.open(QIODevice::ReadOnly)) {
+        QDataStream stream(&file);
+        qint64 validSize = 0;
+        while (!stream.atEnd()) {
+            QString path, artist, album;
+            stream >> path >> artist >> album;
+            if (stream.status() != QDataStream::Ok) break;
+            // Повторная запись пути уточняет теги уже известного трека
+            const auto known = trackIds.constFind(path);
+            if (known != trackIds.constEnd()) {
+                trackArtists[known.value()] = artist;
+                trackAlbums[known.value()] = album;
+            } else {
+                trackIds.insert(path, trackPaths.size());
+                trackPaths.append(path);
+                trackArtists.append(artist);
+                trackAlbums.append(album);
+            }
+            validSize = file.pos();
+        }
+        file.close();
+        if (validSize < QFileInfo(file).size()) file.resize(validSize);
+    }
+}
+
+void ListeningHistory::openForAppend()
+{
+    closeFiles();
+    for (const QString &name : eventColumnNames) {
+        QFile *file = new QFile(currentDir() + "/" + name);
+        if (!file->open(QIODevice::WriteOnly | QIODevice::Append)) {
+            delete file;
+            closeFiles();
+            return;
+        }
+        eventFiles.append(file);
+    }
+
+    tracksFile = new QFile(root + "/tracks.dat");
+    if (!tracksFile->open(QIODevice::WriteOnly | QIODevice::Append)) {
+        delete tracksFile;
+        tracksFile = nullptr;
+    }
+}
+
+void ListeningHistory::closeFiles()
+{
+    qDeleteAll(eventFiles);
+    eventFiles.clear();
+    delete tracksFile;
+    tracksFile = nullptr;
+}
+
+void ListeningHistory::compact()
+{
+    if (watcher.isRunning()) return;
+
+    LocalCalendar calendar;
+    const qint32 today = calendar.day(QDateTime::currentMSecsSinceEpoch());
+    const bool hasFinishedDays = std::any_of(events.timestamp.cbegin(), events.timestamp.cend(),
+                                             [today, &calendar](qint64 timestamp) {
+        return calendar.day(timestamp) < today;
+    });
+    if (!hasFinishedDays) return;
+
+    // Снимки столбцов разделяются неявно: дозапись во время сворачивания их не портит
+    watcher.setFuture(QtConcurrent::run(&ListeningHistory::fold, events, rollups, today));
+}
+
+ListeningHistory::Compaction ListeningHistory::fold(EventColumns snapshot, RollupColumns rollups,
+                                                    qint32 today)
+{
+    LocalCalendar calendar;
+    Compaction result;
+    result.snapshotRows = snapshot.timestamp.size();
+    result.rollups = std::move(rollups);
+
+    QHash<quint64, int> rows;           // (день, трек) -> строка среди новых сводок
+    for (int i = 0; i < result.snapshotRows; ++i) {
+        const qint32 day = calendar.day(snapshot.timestamp.at(i));
+        if (day >= today) {
+            result.remaining.timestamp.append(snapshot.timestamp.at(i));
+            result.remaining.track.append(snapshot.track.at(i));
+            result.remaining.listened.append(snapshot.listened.at(i));
+            result.remaining.skipped.append(snapshot.skipped.at(i));
+            continue;
+        }
+
+        const quint32 track = snapshot.track.at(i);
+        const quint64 key = (quint64(quint32(day)) << 32) | track;
+        auto it = rows.find(key);
+        if (it == rows.end()) {
+            it = rows.insert(key, result.rollups.day.size());
+            result.rollups.day.append(day);
+            result.rollups.track.append(track);
+            result.rollups.plays.append(0);
+            result.rollups.skips.append(0);
+            result.rollups.listened.append(0);
+        }
+        const int row = it.value();
+        ++result.rollups.plays[row];
+        result.rollups.skips[row] += snapshot.skipped.at(i);
+        result.rollups.listened[row] += snapshot.listened.at(i);
+        ++result.folded;
+    }
+    return result;
+}
+
+void ListeningHistory::finishCompaction()
+{
+    Compaction result = watcher.result();
+
+    // События, записанные пока шло сворачивание, переносим в новое поколение как есть
+    for (int i = result.snapshotRows; i < events.timestamp.size(); ++i) {
+        result.remaining.timestamp.append(events.timestamp.at(i));
+        result.remaining.track.append(events.track.at(i));
+        result.remaining.listened.append(events.listened.at(i));
+        result.remaining.skipped.append(events.skipped.at(i));
+    }
+
+    // Новое поколение пишется рядом и подменяет текущее целиком: сбой процесса в любой
+    // момент оставляет либо старое, либо новое состояние. Столбцы и отметка о готовности
+    // сбрасываются на диск до подмены, сам каталог - после; на системах без fsync каталога
+    // отключение питания сразу после подмены может вернуть прежнее поколение
+    closeFiles();
+    const QString next = root + "/next";
+    QDir(next).removeRecursively();
+    const bool written = QDir().mkpath(next) && writeGeneration(next, result.remaining, result.rollups);
+    if (written) {
+        QSaveFile marker(next + "/complete");
+        marker.open(QIODevice::WriteOnly);
+        marker.commit();
+
+        QDir(currentDir()).removeRecursively();
+        QDir(root).rename("next", "current");
+        syncDirectory(root);
+        QFile::remove(currentDir() + "/complete");
+
+        events = result.remaining;
+        rollups = result.rollups;
+    } else {
+        QDir(next).removeRecursively();
+    }
+    openForAppend();
+
+    emit compacted(written ? result.folded : 0, rollups.day.size());
+}
+
+bool ListeningHistory::writeGeneration(const QString &directory, const EventColumns &eventColumns,
+                                       const RollupColumns &rollupColumns) const
+{
+    const QString prefix = directory + "/";
+    return writeColumn(prefix + eventColumnNames.at(0), eventColumns.timestamp)
+           && writeColumn(prefix + eventColumnNames.at(1), eventColumns.track)
+           && writeColumn(prefix + eventColumnNames.at(2), eventColumns.listened)
+           && writeColumn(prefix + eventColumnNames.at(3), eventColumns.skipped)
+           && writeColumn(prefix + rollupColumnNames.at(0), rollupColumns.day)
+           && writeColumn(prefix + rollupColumnNames.at(1), rollupColumns.track)
+           && writeColumn(prefix + rollupColumnNames.at(2), rollupColumns.plays)
+           && writeColumn(prefix + rollupColumnNames.at(3), rollupColumns.skips)
+           && writeColumn(prefix + rollupColumnNames.at(4), rollupColumns.listened);
+}
+
+QList<ListeningHistory::Bucket> ListeningHistory::aggregate(Period period, GroupBy groupBy,
+                                                            qint64 fromMs, qint64 toMs) const
+{
+    LocalCalendar calendar;
+    const qint32 fromDay = fromMs <= 0 ? std::numeric_limits<qint32>::min() : calendar.day(fromMs);
+    const qint32 toDay = toMs == std::numeric_limits<qint64>::max() ? std::numeric_limits<qint32>::max()
+                                                                     : calendar.day(toMs);
+
+    // Группа каждого трека вычисляется один раз, дальше сканирование идёт по целым числам
+    QStringList groupNames;
+    QHash<QString, int> groupIds;
+    QList<int> groupOf(trackPaths.size());
+    for (int i = 0; i < trackPaths.size(); ++i) {
+        QString name = groupBy == Artist ? trackArtists.at(i)
+                       : groupBy == Album ? trackAlbums.at(i)
+                                          : trackPaths.at(i);
+        if (name.isEmpty()) name = "(unknown)";
+        auto it = groupIds.constFind(name);
+        if (it == groupIds.constEnd()) {
+            it = groupIds.insert(name, groupNames.size());
+            groupNames.append(name);
+        }
+        groupOf[i] = it.value();
+    }
+
+    struct Totals {
+        int plays = 0;
+        int skips = 0;
+        qint64 listenedMs = 0;
+    };
+    QHash<quint64, Totals> totals;
+    QHash<qint32, qint32> monthOfDay;   // дней в истории - тысячи, строк - миллионы
+
+    auto periodKey = [&](qint32 day) -> qint32 {
+        if (period == Day) return day;
+        auto it = monthOfDay.constFind(day);
+        if (it == monthOfDay.constEnd()) {
+            const QDate date = dateOfDay(day);
+            it = monthOfDay.insert(day, date.year() * 12 + date.month() - 1);
+        }
+        return it.value();
+    };
+    auto add = [&](qint32 day, quint32 track, int plays, int skips, qint64 listened) {
+        if (track >= quint32(groupOf.size())) return;
+        const quint64 key = (quint64(quint32(periodKey(day))) << 32) | quint32(groupOf.at(track));
+        Totals &entry = totals[key];
+        entry.plays += plays;
+        entry.skips += skips;
+        entry.listenedMs += listened;
+    };
+
+    for (int i = 0; i < rollups.day.size(); ++i) {
+        const qint32 day = rollups.day.at(i);
+        if (day < fromDay || day > toDay) continue;
+        add(day, rollups.track.at(i), rollups.plays.at(i), rollups.skips.at(i), rollups.listened.at(i));
+    }
+    for (int i = 0; i < events.timestamp.size(); ++i) {
+        const qint64 timestamp = events.timestamp.at(i);
+        if (timestamp < fromMs || timestamp > toMs) continue;
+        add(calendar.day(timestamp), events.track.at(i), 1, events.skipped.at(i), events.listened.at(i));
+    }
+
+    QList<QPair<qint32, Bucket>> sorted;
+    sorted.reserve(totals.size());
+    for (auto it = totals.constBegin(); it != totals.constEnd(); ++it) {
+        const qint32 key = qint32(quint32(it.key() >> 32));
+        Bucket bucket;
+        if (period == Day) {
+            bucket.period = dateOfDay(key).toString("yyyy-MM-dd");
+        } else {
+            bucket.period = QString("%1-%2").arg(key / 12).arg(key % 12 + 1, 2, 10, QChar('0'));
+        }
+        bucket.key = groupNames.at(int(quint32(it.key())));
+        bucket.plays = it.value().plays;
+        bucket.skips = it.value().skips;
+        bucket.listenedMs = it.value().listenedMs;
+        sorted.append({key, bucket});
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+        if (a.first != b.first) return a.first < b.first;
+        return a.second.listenedMs > b.second.listenedMs;
+    });
+
+    QList<Bucket> result;
+    result.reserve(sorted.size());
+    for (const auto &entry : std::as_const(sorted)) {
+        result.append(entry.second);
+    }
+    return result;
+}
+
+bool ListeningHistory::exportCsv(const QString &fileName, Table table, QString *errorString) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+
+    QTextStream out(&file);
+    auto trackFields = [this](quint32 track) {
+        if (track >= quint32(trackPaths.size())) return QString(",,");
+        return csvField(trackPaths.at(track)) + "," + csvField(trackArtists.at(track)) + ","
+               + csvField(trackAlbums.at(track));
+    };
+
+    if (table == Events) {
+        out << "started_at,path,artist,album,listened_ms,skipped\n";
+        for (int i = 0; i < events.timestamp.size(); ++i) {
+            out << QDateTime::fromMSecsSinceEpoch(events.timestamp.at(i)).toString(Qt::ISODate) << ","
+                << trackFields(events.track.at(i)) << ","
+                << events.listened.at(i) << "," << events.skipped.at(i) << "\n";
+        }
+    } else {
+        out << "date,path,artist,album,plays,skips,listened_ms\n";
+        for (int i = 0; i < rollups.day.size(); ++i) {
+            out << dateOfDay(rollups.day.at(i)).toString("yyyy-MM-dd") << ","
+                << trackFields(rollups.track.at(i)) << ","
+                << rollups.plays.at(i) << "," << rollups.skips.at(i) << ","
+                << rollups.listened.at(i) << "\n";
+        }
+    }
+
+    out.flush();
+    if (file.error() != QFile::NoError) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool ListeningHistory::exportColumns(const QString &directory, QString *errorString) const
+{
+    if (!QDir().mkpath(directory) || !writeGeneration(directory, events, rollups)) {
+        if (errorString) *errorString = "Cannot write to " + directory;
+        return false;
+    }
+
+    // Словарь треков - построчно, номер строки и есть значение столбца track
+    QFile tracks(directory + "/tracks.tsv");
+    if (!tracks.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        if (errorString) *errorString = tracks.errorString();
+        return false;
+    }
+    QTextStream out(&tracks);
+    for (int i = 0; i < trackPaths.size(); ++i) {
+        out << trackPaths.at(i) << "\t" << trackArtists.at(i) << "\t" << trackAlbums.at(i) << "\n";
+    }
+    out.flush();
+
+    auto column = [](const QString &name, const QString &type) {
+        return QJsonObject{{"file", name}, {"type", type}};
+    };
+    const QJsonObject schema = {
+        {"byte_order", "little-endian"},
+        {"dictionary", "tracks.tsv"},
+        {"events", QJsonObject{
+            {"rows", events.timestamp.size()},
+            {"columns", QJsonArray{column(eventColumnNames.at(0), "int64 ms since epoch"),
+                                   column(eventColumnNames.at(1), "uint32 track"),
+                                   column(eventColumnNames.at(2), "uint32 ms"),
+                                   column(eventColumnNames.at(3), "uint8 bool")}}}},
+        {"rollups", QJsonObject{
+            {"rows", rollups.day.size()},
+            {"columns", QJsonArray{column(rollupColumnNames.at(0), "int32 days since epoch, local"),
+                                   column(rollupColumnNames.at(1), "uint32 track"),
+                                   column(rollupColumnNames.at(2), "uint32"),
+                                   column(rollupColumnNames.at(3), "uint32"),
+                                   column(rollupColumnNames.at(4), "int64 ms")}}}}
+    };
+    QFile schemaFile(directory + "/schema.json");
+    if (!schemaFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (errorString) *errorString = schemaFile.errorString();
+        return false;
+    }
+    schemaFile.write(QJsonDocument(schema).toJson());
+    return true;
+}
+
+QString ListeningHistory::periodName(Period period)
+{
+    return period == Day ? "day" : "month";
+}
+
+QString ListeningHistory::groupName(GroupBy groupBy)
+{
+    switch (groupBy) {
+    case Track: return "track";
+    case Artist: return "artist";
+    case Album: return "album";
+    }
+    return QString();
+}
@@ -0,0 +1,131 @@
+#ifndef LISTENINGHISTORY_H
+#define LISTENINGHISTORY_H
+
+#include <QObject>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QList>
+#include <QStringList>
+#include <limits>
+#include "tagreader.h"
+
+// История прослушиваний: append-only хранилище по столбцам (отдельный файл на столбец),
+// одно событие на прослушивание - время начала, трек, сколько прослушано, пропуск.
+// Завершённые дни в фоне сворачиваются в дневные сводки (день, трек, число, пропуски, время),
+// так что запросы вида "часы по артистам по месяцам" сканируют компактные массивы.
+// Треки хранятся в собственном словаре по пути: история переживает удаление трека из библиотеки.
+class ListeningHistory : public QObject
+{
+    Q_OBJECT
+public:
+    enum Period {
+        Day,
+        Month
+    };
+
+    enum GroupBy {
+        Track,
+        Artist,
+        Album
+    };
+
+    enum Table {
+        Events,
+        Rollups
+    };
+
+    struct Bucket {
+        QString period;                 // "2026-10" или "2026-10-19"
+        QString key;
+        int plays = 0;
+        int skips = 0;
+        qint64 listenedMs = 0;
+    };
+
+    // По умолчанию - AppDataLocation/history
+    explicit ListeningHistory(const QString &directory = QString(), QObject *parent = nullptr);
+    ~ListeningHistory();
+
+    // knownTags - теги, которые у вызывающего уже есть; без них новый трек получает
+    // артиста и альбом из файла в фоне
+    void record(const QString &filePath, qint64 startedAtMs, qint64 listenedMs, bool skipped,
+                const TrackTags *knownTags = nullptr);
+
+    int eventCount() const { return events.timestamp.size(); }
+    int rollupCount() const { return rollups.day.size(); }
+    bool isCompacting() const { return watcher.isRunning(); }
+
+    // Отсортировано по периоду, внутри - по убыванию времени прослушивания
+    QList<Bucket> aggregate(Period period, GroupBy groupBy,
+                            qint64 fromMs = 0, qint64 toMs = std::numeric_limits<qint64>::max()) const;
+
+    bool exportCsv(const QString &fileName, Table table, QString *errorString = nullptr) const;
+    // Копия столбцов и schema.json: читается любым инструментом для столбцовых данных
+    bool exportColumns(const QString &directory, QString *errorString = nullptr) const;
+
+    static QString periodName(Period period);
+    static QString groupName(GroupBy groupBy);
+
+public slots:
+    // Сворачивает события завершённых дней в сводки; тяжёлая часть - в пуле потоков
+    void compact();
+
+signals:
+    void compacted(int foldedEvents, int rollupRows);
+
+private:
+    struct EventColumns {
+        QList<qint64> timestamp;
+        QList<quint32> track;
+        QList<quint32> listened;
+        QList<quint8> skipped;
+    };
+
+    struct RollupColumns {
+        QList<qint32> day;
+        QList<quint32> track;
+        QList<quint32> plays;
+        QList<quint32> skips;
+        QList<qint64> listened;
+    };
+
+    struct Compaction {
+        int snapshotRows = 0;
+        int folded = 0;
+        EventColumns remaining;
+        RollupColumns rollups;
+    };
+
+    QString root;
+    EventColumns events;
+    RollupColumns rollups;
+
+    QStringList trackPaths;
+    QStringList trackArtists;
+    QStringList trackAlbums;
+    QHash<QString, quint32> trackIds;
+
+    QList<QFile*> eventFiles;           // открыты на дозапись, по столбцу
+    QFile *tracksFile = nullptr;
+    QFutureWatcher<Compaction> watcher;
+    QFutureWatcher<QList<QPair<QString, TrackTags>>> tagWatcher;
+    QStringList tagQueue;
+    bool tagsPending = false;           // результат чтения тегов ещё не применён
+
+    QString currentDir() const;
+    void load();
+    void openForAppend();
+    void closeFiles();
+    quint32 trackId(const QString &filePath, const TrackTags *knownTags);
+    void appendTrackRecord(quint32 id);
+    void requestTags();
+    void handleTagsRead();
+    void finishCompaction();
+    bool writeGeneration(const QString &directory, const EventColumns &eventColumns,
+                         const RollupColumns &rollupColumns) const;
+
+    static Compaction fold(EventColumns snapshot, RollupColumns rollups, qint32 today);
+};
+
+#endif // LISTENINGHISTORY_H
@@ -1,10 +1,77 @@
 #include "mainwindow.h"
+#include "playerengine.h"
+#include "controlserver.h"
+#include "streamserver.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QFileInfo>
+#include <cstring>
+
+static bool isHeadless(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--headless") == 0) return true;
+    }
+    return false;
+}
+
+// Режим без окна: ядро воспроизведения + локальный сокет управления
+static int runHeadless(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Mp3Player headless mode");
+    parser.addHelpOption();
+    parser.addOption({"headless", "Run without GUI, controlled through a local socket."});
+    parser.addOption({"socket", "Local socket name or path.", "name",
+                      ControlServer::defaultServerName()});
+    parser.addOption({"stream", "Serve the queue and collections over HTTP on this port.", "port"});
+    parser.addOption({"stream-lan", "Accept stream listeners from the local network, not only localhost."});
+    parser.addPositionalArgument("paths", "Audio files or folders to add before starting.", "[paths...]");
+    parser.process(a);
+
+    PlayerEngine engine;
+    ControlServer server(&engine);
+
+    if (!server.listen(parser.value("socket"))) {
+        qCritical("Cannot listen on %s: %s", qPrintable(parser.value("socket")),
+                  qPrintable(server.errorString()));
+        return 1;
+    }
+    if (parser.isSet("stream")) {
+        const quint16 port = quint16(parser.value("stream").toUInt());
+        const QHostAddress address = parser.isSet("stream-lan") ? QHostAddress::Any : QHostAddress::LocalHost;
+        if (!server.streamServer()->listen(address, port)) {
+            qCritical("Cannot stream on port %s: %s", qPrintable(parser.value("stream")),
+                      qPrintable(server.streamServer()->errorString()));
+            return 1;
+        }
+    }
+
+    engine.loadTrackList();
+    for (const QString &path : parser.positionalArguments()) {
+        QFileInfo info(path);
+        if (info.isDir()) {
+            engine.importFolder(info.absoluteFilePath());
+        } else if (info.exists()) {
+            engine.importTracks({info.absoluteFilePath()});
+        }
+    }
+
+    return a.exec();
+}
 
 int main(int argc, char *argv[])
 {
+    if (isHeadless(argc, argv)) {
+        return runHeadless(argc, argv);
+    }
+
+#ifdef Q_OS_WIN
     qputenv("QT_QPA_PLATFORM","windows:darkmode=0");
+#endif
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
@@ -13,18 +13,32 @@
 #include <QVBoxLayout>
 #include <QHeaderView>
 #include <QTableWidget>
+#include <QMenu>
+#include "playlistfile.h"
+#include "smartcollections.h"
+#include "collectionexporter.h"
+#include "trackanalyzer.h"
+#include "powerscheduler.h"
+#include <QProgressDialog>
+#include <QSharedPointer>
+#include <QScrollBar>
+#include <QTimer>
+#include <QClipboard>
+#include <QGuiApplication>
+
+static const int listArtSize = 32;
+static const int nowPlayingArtSize = 128;
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent),
     ui(new Ui::MainWindow),
 
-    player(new QMediaPlayer(this)),
-    audioOutput(new QAudioOutput(this)),
-    musicCollection(new MusicCollection(this)),
-    m_playbackTimer(new QTimer(this)),
-    currentTrackIndex(-1),
+    engine(new PlayerEngine(this)),
+    player(engine->mediaPlayer()),
+    musicCollection(engine->collections()),
+    coverArt(new CoverArtCache(this)),
+    coverLabel(new QLabel(this)),
     currentCollection(""),
-    shuffleMode(false),
     playbackSpeed(1.0f),
     isSeeking(false),
     isFullscreen(false)
@@ -40,16 +54,12 @@ MainWindow::MainWindow(QWidget *parent)
     applyStyles();
     setupAnimations();
 
-    audioOutput->setVolume(0.7);
-    player->setAudioOutput(audioOutput);
-    player->setPlaybackRate(playbackSpeed);
+    engine->setVolume(0.7f);
+    engine->setPlaybackRate(playbackSpeed);
 
-    loadTrackList();
+    engine->loadTrackList();
     updateCollectionsList();
     updatePlayerControls();
-    m_playbackTimer->setInterval(1000);
-    connect(m_playbackTimer, &QTimer::timeout,
-            this, &MainWindow::updatePlaybackStatistics);
 }
 
 
@@ -115,11 +125,41 @@ void MainWindow::initConnections()
     connect(ui->speedSlider, &QSlider::valueChanged, this, &MainWindow::handleSpeedChange);
     connect(ui->progressSlider, &QSlider::sliderMoved, this, &MainWindow::seekTrack);
 
-    connect(player, &QMediaPlayer::positionChanged, this, &MainWindow::updatePlaybackPosition);
-    connect(player, &QMediaPlayer::durationChanged, this, [this](qint64 duration) {
+    attachPlayer(engine->mediaPlayer());
+    connect(engine, &PlayerEngine::mediaPlayerChanged, this, &MainWindow::attachPlayer);
+    // Позиция и длительность - трека, а не файла: у дорожки образа они от начала её отрезка
+    connect(engine, &PlayerEngine::positionChanged, this, &MainWindow::updatePlaybackPosition);
+    connect(engine, &PlayerEngine::durationChanged, this, [this](qint64 duration) {
         ui->progressSlider->setMaximum(static_cast<int>(duration / 1000));
     });
-    connect(player, &QMediaPlayer::mediaStatusChanged, this, &MainWindow::handleMediaStatusChanged);
+
+    connect(engine, &PlayerEngine::playlistChanged, this, &MainWindow::updateTrackList);
+    connect(engine, &PlayerEngine::currentTrackChanged, this, &MainWindow::handleCurrentTrackChanged);
+    connect(engine, &PlayerEngine::trackQuarantined, this, [this](const QString &filePath, const QString &reason) {
+        ui->trackInfoLabel->setText(QString("В карантине: %1 (%2)").arg(QFileInfo(filePath).fileName(), reason));
+    });
+    // Папку читает ядро в фоне - что звука в ней нет, становится известно только по итогу
+    connect(engine, &PlayerEngine::importFinished, this, [this](int, int found, const QString &folderPath) {
+        if (!folderPath.isEmpty() && found == 0) {
+            QMessageBox::information(this, "No Audio Files", "No supported audio files found in the selected folder.");
+        }
+    });
+    connect(engine, &PlayerEngine::trackFailed, this, [this](const QString &filePath, const QString &reason) {
+        ui->trackInfoLabel->setText(QString("Не удалось воспроизвести: %1 (%2)")
+                                        .arg(QFileInfo(filePath).fileName(), reason));
+    });
+    // Файловые операции завершаются в фоне: ядро к этому моменту уже обновило библиотеку
+    connect(engine->fileOperations(), &FileOperations::finished, this, [this](const FileOperation &operation) {
+        if (operation.state != FileOperation::Done) return;
+        updateCurrentCollectionTracks();
+        updateTrackInfo();
+    });
+    // Окно на экране или нет - от этого зависит, какие периодические задачи будит планировщик
+    connect(qGuiApp, &QGuiApplication::applicationStateChanged, this, &MainWindow::updatePowerVisibility);
+    connect(engine, &PlayerEngine::fileOperationFailed, this, [this](const QString &filePath, const QString &error) {
+        QMessageBox::warning(this, "Ошибка", QString("Не удалось выполнить операцию с файлом %1:\n%2")
+                                                 .arg(QFileInfo(filePath).fileName(), error));
+    });
 
     connect(ui->openFileButton, &QPushButton::clicked, this, &MainWindow::openFile);
     connect(ui->openFolderButton, &QPushButton::clicked, this, &MainWindow::openFolder);
@@ -131,12 +171,57 @@ void MainWindow::initConnections()
 
     connect(ui->playlistsList, &QListWidget::currentTextChanged,
             this, &MainWindow::updateCurrentCollection);
+    connect(ui->playlistsList, &QListWidget::customContextMenuRequested,
+            this, &MainWindow::showCollectionsMenu);
+    connect(engine->smartCollections(), &SmartCollections::collectionsChanged,
+            this, &MainWindow::updateCollectionsList);
+    // Обновляем только то, что изменилось в опубликованном снимке
+    connect(musicCollection, &MusicCollection::collectionAdded,
+            this, &MainWindow::updateCollectionsList);
+    connect(musicCollection, &MusicCollection::collectionRemoved,
+            this, &MainWindow::updateCollectionsList);
+    connect(musicCollection, &MusicCollection::collectionRenamed,
+            this, [this](const QString &oldName, const QString &newName) {
+        if (oldName == currentCollection) {
+            currentCollection = newName;
+        }
+        updateCollectionsList();
+    });
+    connect(musicCollection, &MusicCollection::playlistImported,
+            this, [this](const QString &collectionName, int added, const QString &error) {
+        if (!error.isEmpty()) {
+            QMessageBox::warning(this, "Ошибка", "Не удалось прочитать плейлист: " + error);
+        }
+        ui->trackInfoLabel->setText(QString("Imported %1 tracks into %2").arg(added).arg(collectionName));
+    });
+    connect(musicCollection, &MusicCollection::collectionTracksChanged,
+            this, [this](const QString &name) {
+        if (name == currentCollection) {
+            updateCurrentCollectionTracks();
+        }
+    });
+    connect(engine->smartCollections(), &SmartCollections::membershipChanged,
+            this, &MainWindow::handleSmartMembershipChanged);
     connect(ui->trackList, &QListWidget::itemDoubleClicked,
             this, &MainWindow::playSelectedTrack);
+    connect(ui->trackList, &QListWidget::customContextMenuRequested,
+            this, &MainWindow::showTrackMenu);
+    connect(ui->collectionTracksList, &QListWidget::customContextMenuRequested,
+            this, &MainWindow::showTrackMenu);
     connect(ui->collectionTracksList, &QListWidget::itemDoubleClicked,
             this, &MainWindow::playSelectedCollectionTrack);
 
     connect(ui->searchEdit, &QLineEdit::textChanged, this, &MainWindow::filterTracks);
+    connect(ui->settingsButton, &QPushButton::clicked, this, &MainWindow::showDebugOverlay);
+
+    // Обложки грузим только для видимых строк
+    connect(coverArt, &CoverArtCache::artReady, this, &MainWindow::handleArtReady);
+    connect(ui->trackList->verticalScrollBar(), &QScrollBar::valueChanged, this, [this]() {
+        requestVisibleArt(ui->trackList);
+    });
+    connect(ui->collectionTracksList->verticalScrollBar(), &QScrollBar::valueChanged, this, [this]() {
+        requestVisibleArt(ui->collectionTracksList);
+    });
 }
 void MainWindow::initUI()
 {
@@ -147,6 +232,15 @@ void MainWindow::initUI()
     ui->nextButton->installEventFilter(this);
     ui->trackList->installEventFilter(this);
     ui->collectionTracksList->installEventFilter(this);
+    ui->playlistsList->setContextMenuPolicy(Qt::CustomContextMenu);
+    ui->trackList->setContextMenuPolicy(Qt::CustomContextMenu);
+    ui->collectionTracksList->setContextMenuPolicy(Qt::CustomContextMenu);
+    ui->trackList->setIconSize(QSize(listArtSize, listArtSize));
+    ui->collectionTracksList->setIconSize(QSize(listArtSize, listArtSize));
+
+    coverLabel->setFixedSize(nowPlayingArtSize, nowPlayingArtSize);
+    coverLabel->setAlignment(Qt::AlignCenter);
+    ui->verticalLayout_4->insertWidget(0, coverLabel);
     ui->playButton->setIcon(QIcon(":/assets/play.png"));
     ui->pauseButton->setIcon(QIcon(":/assets/pause.png"));
     ui->stopButton->setIcon(QIcon(":/assets/stop.png"));
@@ -357,6 +451,51 @@ bool MainWindow::eventFilter(QObject *watched, QEvent *event)
     return QMainWindow::eventFilter(watched, event);
 }
 
+void MainWindow::changeEvent(QEvent *event)
+{
+    QMainWindow::changeEvent(event);
+    if (event->type() == QEvent::WindowStateChange) updatePowerVisibility();
+}
+
+void MainWindow::showEvent(QShowEvent *event)
+{
+    QMainWindow::showEvent(event);
+    updatePowerVisibility();
+}
+
+void MainWindow::hideEvent(QHideEvent *event)
+{
+    QMainWindow::hideEvent(event);
+    updatePowerVisibility();
+}
+
+void MainWindow::updatePowerVisibility()
+{
+    const Qt::ApplicationState state = QGuiApplication::applicationState();
+    const bool onScreen = isVisible() && !isMinimized()
+                          && state != Qt::ApplicationHidden && state != Qt::ApplicationSuspended;
+    PowerScheduler *power = engine->powerScheduler();
+    if (onScreen == power->isVisible()) return;
+
+    if (!onScreen) settleAnimations();
+    power->setVisible(onScreen);
+    if (onScreen) updatePlaybackPosition(engine->position());
+}
+
+void MainWindow::settleAnimations()
+{
+    // Кадры свёрнутого окна никто не увидит: анимации сразу переводим в конечное состояние
+    const QList<QAbstractAnimation*> animations = findChildren<QAbstractAnimation*>();
+    for (QAbstractAnimation *animation : animations) {
+        if (animation->state() == QAbstractAnimation::Stopped) continue;
+        if (animation->totalDuration() >= 0) {
+            animation->setCurrentTime(animation->direction() == QAbstractAnimation::Forward
+                                          ? animation->totalDuration() : 0);
+        }
+        animation->stop();
+    }
+}
+
 void MainWindow::toggleFullscreen()
 {
     if (isFullscreen) {
@@ -377,24 +516,10 @@ void MainWindow::closeWindow()
 
 void MainWindow::togglePlayPause()
 {
-    if (playlist.isEmpty()) return;
-
     if (player->playbackState() == QMediaPlayer::PlayingState) {
-        player->pause();
-        ui->pauseButton->hide();
-        ui->playButton->show();
+        engine->pause();
     } else {
-        if (player->mediaStatus() == QMediaPlayer::NoMedia ||
-            player->playbackState() == QMediaPlayer::StoppedState) {
-            if (currentTrackIndex < 0 && !playlist.isEmpty()) {
-                currentTrackIndex = 0;
-            }
-            playTrack(currentTrackIndex);
-        } else {
-            player->play();
-        }
-        ui->playButton->hide();
-        ui->pauseButton->show();
+        engine->play();
     }
     updatePlayerControls();
 }
@@ -404,22 +529,38 @@ void MainWindow::togglePlayPause()
 void MainWindow::createCollection()
 {
     QString name = QInputDialog::getText(this, "Создать коллекцию", "Введите название:");
-    if (!name.isEmpty()) {
+    if (!name.isEmpty() && !engine->smartCollections()->contains(name)) {
         musicCollection->addCollection(name);
-        updateCollectionsList();
+    }
+}
+
+void MainWindow::createSmartCollection()
+{
+    SmartCollections *smart = engine->smartCollections();
+    QString name = QInputDialog::getText(this, "Умная коллекция", "Введите название:");
+    if (name.isEmpty()) return;
+    if (smart->contains(name) || musicCollection->getCollectionNames().contains(name)) {
+        QMessageBox::warning(this, "Ошибка", "Коллекция '" + name + "' уже существует");
+        return;
+    }
+
+    QString rules = QInputDialog::getText(this, "Умная коллекция", SmartCollections::syntaxHelp());
+    if (rules.isEmpty()) return;
+
+    QString error;
+    if (!smart->addCollection(name, rules, &error)) {
+        QMessageBox::warning(this, "Ошибка", error);
     }
 }
 
 void MainWindow::renameCollection()
 {
-    if (currentCollection.isEmpty()) return;
+    if (currentCollection.isEmpty() || engine->smartCollections()->contains(currentCollection)) return;
 
     QString newName = QInputDialog::getText(this, "Переименовать", "Новое название:",
                                             QLineEdit::Normal, currentCollection);
-    if (!newName.isEmpty()) {
+    if (!newName.isEmpty() && !engine->smartCollections()->contains(newName)) {
         musicCollection->renameCollection(currentCollection, newName);
-        currentCollection = newName;
-        updateCollectionsList();
     }
 }
 
@@ -430,7 +571,11 @@ void MainWindow::removeCollection()
     if (QMessageBox::question(this, "Удаление",
                               "Удалить коллекцию '" + currentCollection + "'?",
                               QMessageBox::Yes|QMessageBox::No) == QMessageBox::Yes) {
-        musicCollection->removeCollection(currentCollection);
+        if (engine->smartCollections()->contains(currentCollection)) {
+            engine->smartCollections()->removeCollection(currentCollection);
+        } else {
+            musicCollection->removeCollection(currentCollection);
+        }
         currentCollection = "";
         updateCollectionsList();
         ui->collectionTracksList->clear();
@@ -439,20 +584,236 @@ void MainWindow::removeCollection()
 
 void MainWindow::addToCollection()
 {
-    if (currentCollection.isEmpty() || currentTrackIndex < 0) return;
+    // Состав умной коллекции определяется только правилами
+    if (currentCollection.isEmpty() || engine->currentFilePath().isEmpty() ||
+        engine->smartCollections()->contains(currentCollection)) return;
 
-    QString trackPath = playlist.at(currentTrackIndex);
-    musicCollection->addTrackToCollection(currentCollection, trackPath);
-    updateCurrentCollectionTracks();
+    musicCollection->addTrackToCollection(currentCollection, engine->currentFilePath());
 }
 
 void MainWindow::removeFromCollection()
 {
-    if (currentCollection.isEmpty() || !ui->collectionTracksList->currentItem()) return;
+    if (currentCollection.isEmpty() || !ui->collectionTracksList->currentItem() ||
+        engine->smartCollections()->contains(currentCollection)) return;
 
-    QString trackPath = ui->collectionTracksList->currentItem()->data(Qt::UserRole).toString();
+    QString trackPath = itemPath(ui->collectionTracksList->currentItem());
     musicCollection->removeTrackFromCollection(currentCollection, trackPath);
-    updateCurrentCollectionTracks();
+}
+
+void MainWindow::showCollectionsMenu(const QPoint &pos)
+{
+    QListWidgetItem *item = ui->playlistsList->itemAt(pos);
+    const QString collectionName = item ? item->text() : QString();
+    const bool isSmart = engine->smartCollections()->contains(collectionName);
+
+    QMenu menu(this);
+    menu.addAction("Создать умную коллекцию...", this, &MainWindow::createSmartCollection);
+    if (isSmart) {
+        menu.addAction("Правила: " + engine->smartCollections()->definition(collectionName))->setEnabled(false);
+    }
+    menu.addSeparator();
+    menu.addAction("Импортировать плейлист...", this, [this, collectionName]() {
+        importPlaylist(collectionName);
+    });
+    QAction *exportAction = menu.addAction("Экспортировать плейлист...", this, [this, collectionName]() {
+        exportPlaylist(collectionName);
+    });
+    exportAction->setEnabled(item != nullptr && !isSmart);
+    QAction *deviceAction = menu.addAction("Экспорт на устройство...", this, [this, collectionName]() {
+        exportToDevice(collectionName);
+    });
+    deviceAction->setEnabled(item != nullptr && !engine->exporter()->isRunning());
+    QAction *streamAction = menu.addAction("Слушать по сети", this, [this, collectionName]() {
+        streamCollection(collectionName);
+    });
+    streamAction->setEnabled(item != nullptr);
+    menu.exec(ui->playlistsList->mapToGlobal(pos));
+}
+
+void MainWindow::showTrackMenu(const QPoint &pos)
+{
+    QListWidget *list = qobject_cast<QListWidget*>(sender());
+    if (!list) return;
+
+    QList<TrackId> ids;
+    const QList<QListWidgetItem*> selected = list->selectedItems();
+    for (const QListWidgetItem *item : selected) {
+        ids.append(item->data(Qt::UserRole).toUInt());
+    }
+    if (ids.isEmpty()) {
+        if (QListWidgetItem *item = list->itemAt(pos)) ids.append(item->data(Qt::UserRole).toUInt());
+    }
+
+    QMenu menu(this);
+    QAction *nextAction = menu.addAction("Играть следующим", this, [this, ids]() {
+        engine->playNext(ids);
+    });
+    QAction *queueAction = menu.addAction("Добавить в очередь", this, [this, ids]() {
+        engine->enqueue(ids);
+    });
+    nextAction->setEnabled(!ids.isEmpty());
+    queueAction->setEnabled(!ids.isEmpty());
+
+    // Радио строится от одного трека и только когда его звучание уже проанализировано
+    const TrackId seed = ids.value(0, TrackTable::InvalidId);
+    const bool analyzed = engine->analyzer()->isIndexed(seed);
+    QAction *radioAction = menu.addAction(analyzed ? "Радио по этому треку" : "Радио по этому треку (идёт анализ)",
+                                          this, [this, seed]() {
+        engine->startRadio(engine->trackTable().path(seed));
+    });
+    radioAction->setEnabled(analyzed);
+    QAction *automixAction = menu.addAction("Автомикс", this, [this](bool checked) {
+        engine->setAutomix(checked);
+    });
+    automixAction->setCheckable(true);
+    automixAction->setChecked(engine->isAutomix());
+    menu.addSeparator();
+    const QString seedPath = engine->trackTable().path(seed);
+    QAction *trashAction = menu.addAction("Удалить файл в корзину", this, [this, seedPath]() {
+        if (QMessageBox::question(this, "Удаление файла",
+                                  QString("Переместить файл %1 в корзину?").arg(QFileInfo(seedPath).fileName()),
+                                  QMessageBox::Yes|QMessageBox::No) != QMessageBox::Yes) return;
+        QString error;
+        if (!engine->trashTrack(seedPath, &error)) {
+            QMessageBox::warning(this, "Ошибка", "Не удалось удалить файл: " + error);
+        }
+    });
+    trashAction->setEnabled(ids.size() == 1 && !VirtualTrack::isVirtual(seedPath));
+    const QString undoText = engine->fileOperations()->undoText();
+    QAction *undoAction = menu.addAction(undoText.isEmpty() ? QString("Отменить операцию с файлом")
+                                                            : "Отменить: " + undoText,
+                                         this, [this]() { engine->undoFileOperation(); });
+    undoAction->setEnabled(!undoText.isEmpty());
+    menu.addSeparator();
+    menu.addAction(QString("Очередь (%1)...").arg(engine->playQueue().size()),
+                   this, &MainWindow::showQueueWindow);
+    menu.exec(list->mapToGlobal(pos));
+}
+
+void MainWindow::showQueueWindow()
+{
+    if (!queueWindow) {
+        queueWindow = new QueueWindow(engine, this);
+    }
+    queueWindow->show();
+    queueWindow->raise();
+}
+
+void MainWindow::streamCollection(const QString &collectionName)
+{
+    // Сервер поднимается по первому запросу и слушает только этот компьютер
+    if (!streamServer) {
+        streamServer = new StreamServer(engine, this);
+    }
+    if (!streamServer->isListening() && !streamServer->listen()) {
+        QMessageBox::warning(this, "Трансляция", "Не удалось запустить сервер: " + streamServer->errorString());
+        return;
+    }
+
+    const QString url = streamServer->collectionUrl(collectionName);
+    QGuiApplication::clipboard()->setText(url);
+    QMessageBox::information(this, "Трансляция",
+                             QString("Плейлист доступен по адресу\n%1\n\nСсылка скопирована в буфер обмена.").arg(url));
+}
+
+void MainWindow::exportToDevice(const QString &collectionName)
+{
+    const QStringList tracks = engine->smartCollections()->contains(collectionName)
+                                   ? engine->smartCollections()->tracks(collectionName)
+                                   : musicCollection->getTracksInCollection(collectionName);
+    if (tracks.isEmpty()) {
+        QMessageBox::information(this, "Экспорт", "Коллекция пуста");
+        return;
+    }
+
+    CollectionExporter::Options options;
+    options.targetDir = QFileDialog::getExistingDirectory(this, "Папка назначения", QDir::homePath());
+    if (options.targetDir.isEmpty()) return;
+
+    QStringList formatNames;
+    const QList<CollectionExporter::Format> formats = CollectionExporter::availableFormats();
+    for (CollectionExporter::Format format : formats) {
+        formatNames << CollectionExporter::formatName(format);
+    }
+    bool ok = false;
+    const QString formatName = QInputDialog::getItem(this, "Экспорт", "Формат:", formatNames, 0, false, &ok);
+    if (!ok || !CollectionExporter::parseFormat(formatName, &options.format)) return;
+    if (CollectionExporter::hasBitrate(options.format)) {
+        options.bitrateKbps = QInputDialog::getInt(this, "Экспорт", "Битрейт, кбит/с:", 160, 32, 320, 16, &ok);
+        if (!ok) return;
+    }
+
+    CollectionExporter *exporter = engine->exporter();
+    QString error;
+    if (!exporter->start(collectionName, tracks, options, &error)) {
+        QMessageBox::warning(this, "Ошибка", "Не удалось начать экспорт: " + error);
+        return;
+    }
+
+    // Немодальный прогресс: слушать музыку во время экспорта можно
+    QProgressDialog *progressDialog = new QProgressDialog("Экспорт " + collectionName, "Отмена",
+                                                          0, tracks.size(), this);
+    progressDialog->setAttribute(Qt::WA_DeleteOnClose);
+    progressDialog->setAutoClose(false);
+    progressDialog->setAutoReset(false);
+    progressDialog->setMinimumDuration(0);
+    connect(progressDialog, &QProgressDialog::canceled, exporter, &CollectionExporter::cancel);
+
+    QSharedPointer<QStringList> failures(new QStringList);
+    connect(exporter, &CollectionExporter::progressChanged, progressDialog,
+            [progressDialog](const CollectionExporter::Progress &progress) {
+        const int processed = progress.done + progress.skipped + progress.failed;
+        progressDialog->setValue(processed);
+        progressDialog->setLabelText(QString("Готово %1 из %2 (пропущено %3, ошибок %4)\n%5 трек/с, %6 МБ/с")
+                                         .arg(processed).arg(progress.total)
+                                         .arg(progress.skipped).arg(progress.failed)
+                                         .arg(progress.tracksPerSecond(), 0, 'f', 1)
+                                         .arg(progress.readMBps(), 0, 'f', 1));
+    });
+    connect(exporter, &CollectionExporter::trackFailed, progressDialog,
+            [failures](const QString &filePath, const QString &reason) {
+        failures->append(QFileInfo(filePath).fileName() + ": " + reason);
+    });
+    connect(exporter, &CollectionExporter::finished, progressDialog,
+            [this, progressDialog, failures, exporter](bool cancelled) {
+        disconnect(exporter, nullptr, progressDialog, nullptr);
+        progressDialog->close();
+        if (cancelled) {
+            ui->trackInfoLabel->setText("Экспорт прерван, повторный запуск продолжит с места остановки");
+        } else if (!failures->isEmpty()) {
+            QMessageBox::warning(this, "Экспорт", "Не удалось экспортировать:\n" + failures->mid(0, 20).join('\n'));
+        } else {
+            ui->trackInfoLabel->setText("Экспорт завершён: " + exporter->outputDir());
+        }
+    });
+    progressDialog->show();
+}
+
+void MainWindow::importPlaylist(const QString &collectionName)
+{
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Import Playlist"),
+                                                    QDir::homePath(), PlaylistFile::fileDialogFilter());
+    if (fileName.isEmpty()) return;
+
+    // Без выбранной коллекции создаём новую по имени файла
+    QString targetName = collectionName.isEmpty() || engine->smartCollections()->contains(collectionName)
+                             ? QFileInfo(fileName).completeBaseName()
+                             : collectionName;
+    // Итог придёт сигналом playlistImported, когда плейлист прочитается в фоне
+    musicCollection->importPlaylist(targetName, fileName);
+}
+
+void MainWindow::exportPlaylist(const QString &collectionName)
+{
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Export Playlist"),
+                                                    QDir::homePath() + "/" + collectionName + ".m3u8",
+                                                    PlaylistFile::fileDialogFilter());
+    if (fileName.isEmpty()) return;
+
+    QString error;
+    if (!musicCollection->exportPlaylist(collectionName, fileName, &error)) {
+        QMessageBox::warning(this, "Ошибка", "Не удалось сохранить плейлист: " + error);
+    }
 }
 
 void MainWindow::paintEvent(QPaintEvent *event)
@@ -463,74 +824,38 @@ void MainWindow::paintEvent(QPaintEvent *event)
 
 void MainWindow::stopPlayback()
 {
-    player->stop();
+    engine->stop();
     ui->progressSlider->setValue(0);
     ui->currentTimeLabel->setText("00:00");
-    ui->playButton->show();
-    ui->pauseButton->hide();
     updatePlayerControls();
-    m_playbackTimer->stop();
 }
 
 void MainWindow::playNextTrack()
 {
-    if (playlist.isEmpty()) return;
-
-    if (shuffleMode) {
-        playRandomTrack();
-    } else {
-        int nextIndex = currentTrackIndex + 1;
-        if (nextIndex < playlist.size()) {
-            playTrack(nextIndex);
-        } else {
-            player->stop();
-            currentTrackIndex = -1;
-            updatePlayerControls();
-        }
-    }
+    engine->next();
+    updatePlayerControls();
 }
 
 void MainWindow::removeTrack()
 {
-    if (currentTrackIndex < 0 || currentTrackIndex >= playlist.size()) return;
-
-    QString trackPath = playlist.at(currentTrackIndex);
+    QString trackPath = engine->currentFilePath();
+    if (trackPath.isEmpty()) return;
 
     if (QMessageBox::question(this, "Удаление трека",
                               "Вы уверены, что хотите удалить этот трек из списка?",
                               QMessageBox::Yes|QMessageBox::No) == QMessageBox::Yes) {
-        // Удаляем трек из всех коллекций
-        QStringList collections = musicCollection->getCollectionNames();
-        for (const QString &collection : collections) {
-            if (musicCollection->getTracksInCollection(collection).contains(trackPath)) {
-                musicCollection->removeTrackFromCollection(collection, trackPath);
-            }
-        }
-
-        // Удаляем из основного списка (только одно вхождение)
-        allTracks.removeOne(trackPath);
-        playlist.removeAt(currentTrackIndex); // Удаляем по индексу
-        trackStatistics.remove(trackPath);
-
-        // Обновляем интерфейс
-        loadTrackList();
+        // Ядро удаляет трек из списка, коллекций и статистики
+        engine->removeTrack(trackPath);
         updateCurrentCollectionTracks();
-
-        // Если удаляемый трек был текущим, останавливаем воспроизведение
-        if (currentFilePath == trackPath) {
-            stopPlayback();
-            currentTrackIndex = -1;
-        }
-
-        saveTrackList();
+        updateTrackInfo();
     }
 }
 
 void MainWindow::renameTrack()
 {
-    if (currentTrackIndex < 0 || currentTrackIndex >= playlist.size()) return;
+    QString oldPath = engine->currentFilePath();
+    if (oldPath.isEmpty()) return;
 
-    QString oldPath = playlist.at(currentTrackIndex);
     QFileInfo fileInfo(oldPath);
     QString currentName = fileInfo.fileName();
 
@@ -540,79 +865,30 @@ void MainWindow::renameTrack()
                                             currentName.left(currentName.lastIndexOf('.')));
 
     if (!newName.isEmpty() && newName != currentName) {
-        QString newPath = fileInfo.path() + "/" + newName + "." + fileInfo.suffix();
-
-        if (QFile::rename(oldPath, newPath)) {
-            // Обновляем пути во всех коллекциях
-            updateTrackNameInCollections(oldPath, newPath);
-
-            // Обновляем основной список
-            int index = allTracks.indexOf(oldPath);
-            if (index != -1) {
-                allTracks.replace(index, newPath);
-            }
-
-            index = playlist.indexOf(oldPath);
-            if (index != -1) {
-                playlist.replace(index, newPath);
-            }
-
-            // Обновляем статистику
-            if (trackStatistics.contains(oldPath)) {
-                trackStatistics[newPath] = trackStatistics[oldPath];
-                trackStatistics.remove(oldPath);
-            }
-
-            // Если переименовываем текущий трек
-            if (currentFilePath == oldPath) {
-                currentFilePath = newPath;
-            }
-
-            saveTrackList();
-            loadTrackList();
-            updateCurrentCollectionTracks();
-        } else {
-            QMessageBox::warning(this, "Ошибка", "Не удалось переименовать файл");
-        }
-    }
-}
-
-void MainWindow::updateTrackNameInCollections(const QString &oldPath, const QString &newPath)
-{
-    QStringList collections = musicCollection->getCollectionNames();
-    for (const QString &collection : collections) {
-        QStringList tracks = musicCollection->getTracksInCollection(collection);
-        if (tracks.contains(oldPath)) {
-            musicCollection->removeTrackFromCollection(collection, oldPath);
-            musicCollection->addTrackToCollection(collection, newPath);
+        // Переименование идёт в фоне; списки обновятся, когда файл будет на месте
+        QString error;
+        if (!engine->renameTrack(oldPath, newName, &error)) {
+            QMessageBox::warning(this, "Ошибка", "Не удалось переименовать файл: " + error);
         }
     }
 }
 
 void MainWindow::playPreviousTrack()
 {
-    if (playlist.isEmpty()) return;
-
-    if (player->position() > 3000) {
-        player->setPosition(0);
-    } else {
-        if (currentTrackIndex > 0) {
-            playTrack(currentTrackIndex - 1);
-        } else {
-            player->setPosition(0);
-        }
-    }
+    engine->previous();
 }
 
 void MainWindow::seekTrack(int position)
 {
     isSeeking = true;
-    player->setPosition(position * 1000);
+    engine->seek(static_cast<qint64>(position) * 1000);
     isSeeking = false;
 }
 
 void MainWindow::updatePlaybackPosition(qint64 position)
 {
+    // Невидимое окно не перерисовываем; позицию догоним, когда оно вернётся на экран
+    if (!engine->powerScheduler()->isVisible()) return;
     if (!isSeeking && !ui->progressSlider->isSliderDown()) {
         ui->progressSlider->setValue(static_cast<int>(position / 1000));
         updateTimeDisplay(position);
@@ -625,7 +901,7 @@ void MainWindow::updateTimeDisplay(qint64 position)
     currentTime = currentTime.addMSecs(position);
 
     QTime totalTime(0, 0, 0);
-    totalTime = totalTime.addMSecs(player->duration());
+    totalTime = totalTime.addMSecs(engine->duration());
 
     QString timeFormat = "mm:ss";
     if (totalTime.hour() > 0) {
@@ -636,79 +912,66 @@ void MainWindow::updateTimeDisplay(qint64 position)
     ui->totalTimeLabel->setText(totalTime.toString(timeFormat));
 }
 
-void MainWindow::updateTrackInfo()
+void MainWindow::attachPlayer(QMediaPlayer *newPlayer)
 {
-    if (!playlist.isEmpty()) {
-        QFileInfo fileInfo(currentFilePath);
-        QString fileName = fileInfo.fileName();
-        fileName = fileName.left(fileName.lastIndexOf('.'));
-
-        ui->trackInfoLabel->setText(QString("Now playing: %1").arg(fileName));
+    // После автомикса звучит вторая дека - прогресс и кнопки следят за ней
+    disconnect(player, nullptr, this, nullptr);
+    player = newPlayer;
+
+    connect(player, &QMediaPlayer::playbackStateChanged, this, [this](QMediaPlayer::PlaybackState state) {
+        bool isPlaying = state == QMediaPlayer::PlayingState;
+        ui->playButton->setVisible(!isPlaying);
+        ui->pauseButton->setVisible(isPlaying);
+        updatePlayerControls();
+    });
 
-        for (int i = 0; i < ui->trackList->count(); ++i) {
-            ui->trackList->item(i)->setIcon(QIcon());
-        }
+    const bool isPlaying = player->playbackState() == QMediaPlayer::PlayingState;
+    ui->progressSlider->setMaximum(static_cast<int>(engine->duration() / 1000));
+    ui->playButton->setVisible(!isPlaying);
+    ui->pauseButton->setVisible(isPlaying);
+    updatePlayerControls();
+}
 
-        if (currentTrackIndex >= 0 && currentTrackIndex < ui->trackList->count()) {
-            QListWidgetItem* currentItem = ui->trackList->item(currentTrackIndex);
+void MainWindow::updateTrackInfo()
+{
+    if (!engine->currentFilePath().isEmpty()) {
+        const TrackId id = engine->trackTable().find(engine->currentFilePath());
+        QString fileName = engine->displayName(id);
+        if (!VirtualTrack::isVirtual(engine->currentFilePath())) fileName = fileName.left(fileName.lastIndexOf('.'));
+
+        QString info = QString("Now playing: %1").arg(fileName);
+        const TrackTempo tempo = engine->analyzer()->tempo(id);
+        if (tempo.isValid()) {
+            info += QString("  ·  %1 BPM").arg(qRound(tempo.bpm));
+            if (tempo.key >= 0) info += QString("  ·  %1 (%2)").arg(AudioFeatures::keyName(tempo.key),
+                                                                   AudioFeatures::camelotName(tempo.key));
         }
+        ui->trackInfoLabel->setText(info);
     } else {
         ui->trackInfoLabel->setText("No track selected");
     }
 }
 
-void MainWindow::playTrack(int index)
-{
-    if (index >= 0 && index < playlist.size()) {
-        isSeeking = false;
-        currentTrackIndex = index;
-        currentFilePath = playlist.at(index);
-
-        player->setSource(QUrl::fromLocalFile(currentFilePath));
-        player->play();
-
-        updateTrackInfo();
-        ui->trackList->setCurrentRow(index);
-        ui->playButton->hide();
-        ui->pauseButton->show();
-
-        m_currentTrackStartTime = QDateTime::currentMSecsSinceEpoch();
-        m_playbackTimer->start();
-
-        trackStatistics[currentFilePath].playCount++;
-        trackStatistics[currentFilePath].lastPlayed = QDateTime::currentDateTime();
-
-        updatePlayerControls();
-    }
-}
-
-void MainWindow::playRandomTrack()
+void MainWindow::handleCurrentTrackChanged(int index)
 {
-    if (playlist.isEmpty()) return;
-
-    int newIndex;
-    do {
-        newIndex = QRandomGenerator::global()->bounded(playlist.size());
-    } while (newIndex == currentTrackIndex && playlist.size() > 1);
-
-    playTrack(newIndex);
-}
+    isSeeking = false;
+    updateTrackInfo();
+    updateCoverArt();
+    ui->trackList->setCurrentRow(index);
 
-void MainWindow::updatePlaybackStatistics()
-{
-    if (player->playbackState() == QMediaPlayer::PlayingState) {
-        qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
-        qint64 elapsed = currentTime - currentTrackStartTime;
-        trackStatistics[currentFilePath].totalPlayTime += elapsed;
-        currentTrackStartTime = currentTime;
+    const PlaybackContext &context = engine->playbackContext();
+    if (engine->contextKind() == PlaybackContext::Collection && context.name() == currentCollection) {
+        ui->collectionTracksList->setCurrentRow(context.cursor());
     }
+    updatePlayerControls();
 }
 
 void MainWindow::updatePlayerControls()
 {
-    bool hasTracks = !playlist.isEmpty();
+    bool hasTracks = !engine->currentPlaylist().isEmpty();
     bool isPlaying = player->playbackState() == QMediaPlayer::PlayingState;
-    bool hasCurrentTrack = currentTrackIndex >= 0 && currentTrackIndex < playlist.size();
+    bool hasCurrentTrack = !engine->currentFilePath().isEmpty();
+    bool shuffleMode = engine->isShuffle();
 
     ui->playButton->setEnabled(hasTracks);
     ui->pauseButton->setEnabled(hasTracks);
@@ -725,14 +988,13 @@ void MainWindow::updatePlayerControls()
 
 void MainWindow::handleVolumeChange(int value)
 {
-    float volume = qBound(0.0f, value / 100.0f, 1.0f);
-    audioOutput->setVolume(volume);
+    engine->setVolume(value / 100.0f);
 }
 
 void MainWindow::handleSpeedChange(int value)
 {
     playbackSpeed = value / 100.0f;
-    player->setPlaybackRate(playbackSpeed);
+    engine->setPlaybackRate(playbackSpeed);
     ui->speedLabel->setText(QString("Speed: %1x").arg(playbackSpeed, 0, 'f', 1));
 }
 
@@ -740,13 +1002,13 @@ void MainWindow::resetSpeed()
 {
     playbackSpeed = 1.0f;
     ui->speedSlider->setValue(100);
-    player->setPlaybackRate(playbackSpeed);
+    engine->setPlaybackRate(playbackSpeed);
     ui->speedLabel->setText("Speed: 1.0x");
 }
 
 void MainWindow::toggleShuffle()
 {
-    shuffleMode = !shuffleMode;
+    engine->setShuffle(!engine->isShuffle());
     updatePlayerControls();
 }
 
@@ -756,30 +1018,11 @@ void MainWindow::openFile()
         this,
         tr("Open Audio Files"),
         QDir::homePath(),
-        tr("Audio Files (*.mp3 *.wav *.ogg *.flac)")
+        tr("Audio Files (*.mp3 *.wav *.ogg *.flac *.cue)")
         );
 
     if (!filePaths.isEmpty()) {
-        bool newFilesAdded = false;
-
-        for (const QString &filePath : filePaths) {
-            if (!allTracks.contains(filePath)) {
-                allTracks.append(filePath);
-                QListWidgetItem *item = new QListWidgetItem(QFileInfo(filePath).fileName());
-                item->setData(Qt::UserRole, filePath);
-                ui->trackList->addItem(item);
-                newFilesAdded = true;
-            }
-        }
-
-        if (newFilesAdded) {
-            saveTrackList();
-        }
-
-        playlist = allTracks;
-        currentTrackIndex = allTracks.indexOf(filePaths.first());
-        currentFilePath = filePaths.first();
-        playTrack(currentTrackIndex);
+        engine->importTracks(filePaths, true);
     }
 }
 
@@ -799,88 +1042,38 @@ void MainWindow::openFolder()
 
 void MainWindow::loadFolder(const QString &folderPath)
 {
-    QDir directory(folderPath);
-    QStringList audioFiles = directory.entryList(
-        {"*.mp3", "*.wav", "*.ogg", "*.flac"},
-        QDir::Files,
-        QDir::Name
-        );
-
-    if (audioFiles.isEmpty()) {
-        QMessageBox::information(this, "No Audio Files", "No supported audio files found in the selected folder.");
-        return;
-    }
-
-    for (const QString &file : audioFiles) {
-        QString filePath = directory.filePath(file);
-        if (!allTracks.contains(filePath)) {
-            allTracks.append(filePath);
-            QListWidgetItem *item = new QListWidgetItem(file);
-            item->setData(Qt::UserRole, filePath);
-            ui->trackList->addItem(item);
-        }
-    }
-
-    playlist = allTracks;
-    currentTrackIndex = 0;
-    currentFilePath = playlist.first();
-    playTrack(currentTrackIndex);
-    saveTrackList();
+    // Папка читается в фоне, без проверки здесь: сетевая папка не должна останавливать окно.
+    // Образ с листом CUE начнётся с первой дорожки листа
+    engine->importFolder(folderPath, true);
 }
 
 void MainWindow::playSelectedTrack(QListWidgetItem *item)
 {
     int index = ui->trackList->row(item);
-    if (index >= 0 && index < playlist.size()) {
-        playTrack(index);
-    }
+    engine->playTrack(index);
 }
 
 void MainWindow::playSelectedCollectionTrack(QListWidgetItem *item)
 {
+    // Коллекция играет своим контекстом: next/prev идут по ней, а не по библиотеке
     if (!currentCollection.isEmpty()) {
-        QStringList tracks = musicCollection->getTracksInCollection(currentCollection);
-        int index = ui->collectionTracksList->row(item);
-
-        if (index >= 0 && index < tracks.size()) {
-            QString trackPath = tracks.at(index);
-            currentTrackIndex = allTracks.indexOf(trackPath);
-            if (currentTrackIndex >= 0) {
-                currentFilePath = trackPath;
-                playTrack(currentTrackIndex);
-            }
-        }
+        engine->playCollection(currentCollection, ui->collectionTracksList->row(item));
     }
 }
 
 void MainWindow::filterTracks(const QString &text)
 {
-    ui->trackList->clear();
-
-    if (text.isEmpty()) {
-        for (const QString &filePath : allTracks) {
-            QListWidgetItem *item = new QListWidgetItem(QFileInfo(filePath).fileName());
-            item->setData(Qt::UserRole, filePath);
-            ui->trackList->addItem(item);
-        }
-        playlist = allTracks;
-    } else {
-        playlist.clear();
-        for (const QString &filePath : allTracks) {
-            QString fileName = QFileInfo(filePath).fileName();
-            if (fileName.contains(text, Qt::CaseInsensitive)) {
-                QListWidgetItem *item = new QListWidgetItem(fileName);
-                item->setData(Qt::UserRole, filePath);
-                ui->trackList->addItem(item);
-                playlist.append(filePath);
-            }
-        }
-    }
+    engine->setFilter(text);
+    updatePlayerControls();
+}
 
-    if (currentTrackIndex >= playlist.size()) {
-        currentTrackIndex = -1;
+void MainWindow::showDebugOverlay()
+{
+    if (!debugOverlay) {
+        debugOverlay = new DebugOverlay(engine->monitor(), engine->prefetcher(), this);
     }
-    updatePlayerControls();
+    debugOverlay->show();
+    debugOverlay->raise();
 }
 
 void MainWindow::updateCurrentCollection(const QString &collectionName)
@@ -893,71 +1086,131 @@ void MainWindow::updateCurrentCollection(const QString &collectionName)
 void MainWindow::updateCurrentCollectionTracks()
 {
     ui->collectionTracksList->clear();
+    collectionItems.clear();
     if (currentCollection.isEmpty()) return;
 
-    QStringList tracks = musicCollection->getTracksInCollection(currentCollection);
-    for (const QString &trackPath : tracks) {
-        QListWidgetItem *item = new QListWidgetItem(QFileInfo(trackPath).fileName());
-        item->setData(Qt::UserRole, trackPath);
+    SmartCollections *smart = engine->smartCollections();
+    const QList<TrackId> tracks = smart->contains(currentCollection) ? smart->trackIds(currentCollection)
+                                                                     : musicCollection->trackIds(currentCollection);
+    for (TrackId id : tracks) {
+        QListWidgetItem *item = new QListWidgetItem(engine->displayName(id));
+        item->setData(Qt::UserRole, id);
         ui->collectionTracksList->addItem(item);
+        collectionItems.insert(id, item);
     }
+
+    // Геометрия строк известна только после раскладки
+    QTimer::singleShot(0, this, [this]() { requestVisibleArt(ui->collectionTracksList); });
 }
 
 void MainWindow::updateCollectionsList()
 {
     ui->playlistsList->clear();
-    QStringList collections = musicCollection->getCollectionNames();
+    const QStringList collections = musicCollection->snapshot()->names();
     for (const QString &name : collections) {
         QListWidgetItem *item = new QListWidgetItem(QIcon(":/icons/playlist.png"), name);
         ui->playlistsList->addItem(item);
     }
+
+    const QStringList smartNames = engine->smartCollections()->names();
+    for (const QString &name : smartNames) {
+        QListWidgetItem *item = new QListWidgetItem(QIcon(":/icons/playlist.png"), name);
+        item->setToolTip(engine->smartCollections()->definition(name));
+        QFont font = item->font();
+        font.setItalic(true);
+        item->setFont(font);
+        ui->playlistsList->addItem(item);
+    }
 }
 
-void MainWindow::saveTrackList()
+void MainWindow::handleSmartMembershipChanged(const QString &collectionName)
 {
-    QSettings settings;
-    settings.beginGroup("TrackList");
-    settings.setValue("tracks", allTracks);
-    settings.endGroup();
+    if (collectionName == currentCollection) {
+        updateCurrentCollectionTracks();
+    }
 }
 
-void MainWindow::loadTrackList()
+void MainWindow::updateTrackList()
 {
     ui->trackList->clear();
-    for (const QString &filePath : allTracks) {
-        QListWidgetItem *item = new QListWidgetItem(QFileInfo(filePath).fileName());
-        item->setData(Qt::UserRole, filePath);
+    trackItems.clear();
+    const QList<TrackId> playlist = engine->playlistIds();
+    for (TrackId id : playlist) {
+        QListWidgetItem *item = new QListWidgetItem(engine->displayName(id));
+        item->setData(Qt::UserRole, id);
         ui->trackList->addItem(item);
+        trackItems.insert(id, item);
     }
 
-    if (!allTracks.isEmpty()) {
-        playlist = allTracks;
-        // Обновляем текущий индекс после удаления
-        currentTrackIndex = allTracks.indexOf(currentFilePath);
-        updatePlayerControls();
-    } else {
-        currentTrackIndex = -1;
-        currentFilePath = "";
-        updatePlayerControls();
+    if (engine->currentIndex() >= 0) {
+        ui->trackList->setCurrentRow(engine->currentIndex());
     }
+    updatePlayerControls();
+    QTimer::singleShot(0, this, [this]() { requestVisibleArt(ui->trackList); });
 }
 
-void MainWindow::handleMediaStatusChanged(QMediaPlayer::MediaStatus status)
+QString MainWindow::itemPath(const QListWidgetItem *item) const
 {
-    if (status == QMediaPlayer::EndOfMedia && !isSeeking) {
-        if (currentTrackIndex < playlist.size() - 1) {
-            playNextTrack();
-        } else {
-            player->stop();
-            updatePlayerControls();
+    return engine->trackTable().path(item->data(Qt::UserRole).toUInt());
+}
+
+void MainWindow::requestVisibleArt(QListWidget *list)
+{
+    if (list->count() == 0) return;
+
+    const QRect viewport = list->viewport()->rect();
+    int first = list->row(list->itemAt(viewport.topLeft()));
+    int last = list->row(list->itemAt(viewport.bottomLeft()));
+    if (first < 0) first = 0;
+    if (last < 0) last = list->count() - 1;
+
+    for (int row = first; row <= last; ++row) {
+        QListWidgetItem *item = list->item(row);
+        if (!item->icon().isNull()) continue;
+
+        const QImage image = coverArt->art(itemPath(item), listArtSize);
+        if (!image.isNull()) {
+            item->setIcon(QIcon(QPixmap::fromImage(image)));
+        }
+    }
+}
+
+void MainWindow::handleArtReady(const QString &trackPath, int size)
+{
+    if (size == nowPlayingArtSize) {
+        if (trackPath == engine->currentFilePath()) {
+            updateCoverArt();
         }
+        return;
+    }
+
+    const QImage image = coverArt->art(trackPath, size);
+    if (image.isNull()) return;
+
+    const QIcon icon(QPixmap::fromImage(image));
+    const TrackId id = engine->trackTable().find(trackPath);
+    if (QListWidgetItem *item = trackItems.value(id)) {
+        item->setIcon(icon);
+    }
+    if (QListWidgetItem *item = collectionItems.value(id)) {
+        item->setIcon(icon);
+    }
+}
+
+void MainWindow::updateCoverArt()
+{
+    const QString trackPath = engine->currentFilePath();
+    const QImage image = trackPath.isEmpty() ? QImage()
+                                             : coverArt->art(trackPath, nowPlayingArtSize);
+    if (image.isNull()) {
+        coverLabel->clear();
+    } else {
+        coverLabel->setPixmap(QPixmap::fromImage(image));
     }
 }
 
 MainWindow::~MainWindow()
 {
-    saveTrackList();
-    delete player;
-    delete audioOutput;
+    delete engine;
     delete ui;
 }
@@ -3,16 +3,17 @@
 
 #include <QMainWindow>
 #include <QMediaPlayer>
-#include <QAudioOutput>
 #include <QPropertyAnimation>
 #include <QGraphicsOpacityEffect>
 #include "musiccollection.h"
+#include "playerengine.h"
+#include "debugoverlay.h"
+#include "queuewindow.h"
+#include "coverartcache.h"
+#include "streamserver.h"
 #include <QListWidgetItem>
 #include <QMouseEvent>
-#include <QDateTime>
-#include <QMap>
-#include <QTimer>
-#include <QTableWidget>
+#include <QLabel>
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -31,10 +32,13 @@ protected:
     void mousePressEvent(QMouseEvent *event) override;
     void mouseMoveEvent(QMouseEvent *event) override;
     bool eventFilter(QObject *obj, QEvent *event) override;
+    // Свёрнутое или скрытое окно сообщает планировщику: фоновая работа GUI засыпает
+    void changeEvent(QEvent *event) override;
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
 
 private slots:
     void togglePlayPause();
-    void updatePlaybackStatistics();
     void stopPlayback();
     void playNextTrack();
     void playPreviousTrack();
@@ -54,36 +58,51 @@ private slots:
     void seekTrack(int position);
 
     void createCollection();
+    void createSmartCollection();
     void renameCollection();
     void removeCollection();
     void addToCollection();
     void removeFromCollection();
     void updateCurrentCollection(const QString &collectionName);
+    void showCollectionsMenu(const QPoint &pos);
+    void showTrackMenu(const QPoint &pos);
+    void showQueueWindow();
+    void importPlaylist(const QString &collectionName);
+    void exportPlaylist(const QString &collectionName);
+    void exportToDevice(const QString &collectionName);
+    void streamCollection(const QString &collectionName);
 
 
+    void attachPlayer(QMediaPlayer *newPlayer);
     void updatePlaybackPosition(qint64 position);
-    void handleMediaStatusChanged(QMediaPlayer::MediaStatus status);
     void updateTimeDisplay(qint64 position);
     void updateTrackInfo();
     void updatePlayerControls();
+    void updateTrackList();
+    void handleCurrentTrackChanged(int index);
     void removeTrack();
     void renameTrack();
     void playSelectedTrack(QListWidgetItem *item);
     void playSelectedCollectionTrack(QListWidgetItem *item);
     void filterTracks(const QString &text);
+    void showDebugOverlay();
+    void handleArtReady(const QString &trackPath, int size);
 
 private:
     Ui::MainWindow *ui;
+    PlayerEngine *engine;
     QMediaPlayer *player;
-    QAudioOutput *audioOutput;
     MusicCollection *musicCollection;
+    DebugOverlay *debugOverlay = nullptr;
+    QueueWindow *queueWindow = nullptr;
+    StreamServer *streamServer = nullptr;
+    CoverArtCache *coverArt;
+    QLabel *coverLabel;
+    // В строках списков хранится TrackId (Qt::UserRole), путь берётся из таблицы ядра
+    QHash<TrackId, QListWidgetItem*> trackItems;
+    QHash<TrackId, QListWidgetItem*> collectionItems;
 
-    QString currentFilePath;
-    QStringList playlist;
-    QStringList allTracks;
     QString currentCollection;
-    int currentTrackIndex;
-    bool shuffleMode;
     float playbackSpeed;
     bool isSeeking;
     bool isFullscreen;
@@ -94,27 +113,14 @@ private:
     void applyStyles();
     void setupAnimations();
     void loadFolder(const QString &folderPath);
-    void playTrack(int index);
-    void playRandomTrack();
-    void updateTrackNameInCollections(const QString &oldPath, const QString &newPath);
     void updateCollectionsList();
+    void handleSmartMembershipChanged(const QString &collectionName);
     void updateCurrentCollectionTracks();
-    void saveTrackList();
-    void loadTrackList();
-
-    struct TrackStats {
-        int playCount = 0;
-        qint64 totalPlayTime = 0;
-        QDateTime lastPlayed;
-    };
-
-    QMap<QString, TrackStats> trackStatistics;
-
-    QTimer* m_playbackTimer;
-    qint64 currentTrackStartTime = 0;
-
-    void updateTrackStats(const QString& filePath, qint64 duration);// Переименовываем для ясности
-    qint64 m_currentTrackStartTime = 0;
+    QString itemPath(const QListWidgetItem *item) const;
+    void requestVisibleArt(QListWidget *list);
+    void updateCoverArt();
+    void updatePowerVisibility();
+    void settleAnimations();
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,253 @@
+#include "mappedfile.h"
+#include <QBuffer>
+#include <QFile>
+#include <QFileInfo>
+#include <QStorageInfo>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Виртуальные адреса, а не память: физически страницы живут в кэше ОС и вытесняются им.
+// Число файлов ограничено, потому что каждое отображение держит открытый дескриптор
+static const qint64 defaultCapacityBytes = qint64(1) << 30;
+static const int maxEntries = 128;
+static const qint64 maxMappedFileBytes = sizeof(void *) >= 8 ? qint64(4) << 30 : qint64(256) << 20;
+
+struct MappedFile::Mapping {
+    QString fileName;
+    mutable QFile file;
+    uchar *data = nullptr;
+    qint64 size = 0;
+
+    ~Mapping()
+    {
+        if (data) file.unmap(data);
+    }
+};
+
+namespace {
+
+// Отображаем только файлы на локальных несъёмных дисках. Страница, которую не удалось прочесть -
+// отключили сеть, выдернули флешку, файл укоротили, - приходит не ошибкой чтения, а SIGBUS,
+// и падает весь плеер. С таких дисков читаем обычным путём, где сбой - просто ошибка
+bool isLocalFixedStorage(const QStorageInfo &storage, const QString &fileName)
+{
+    if (!storage.isValid() || !storage.isReady()) return false;
+    if (fileName.startsWith("//") || fileName.startsWith("\\\\")) return false;
+
+    const QByteArray type = storage.fileSystemType().toLower();
+    static const QList<QByteArray> networkTypes = {"nfs", "nfs4", "cifs", "smb3", "smbfs", "ncpfs", "afs",
+                                                   "9p", "ceph", "glusterfs", "davfs", "afpfs", "webdav"};
+    if (networkTypes.contains(type) || type.startsWith("fuse")) return false;
+
+#ifdef Q_OS_LINUX
+    // Съёмное устройство ядро отмечает в sysfs; USB-диски и карты памяти часто помечены
+    // несъёмными, поэтому смотрим ещё и на шину
+    const QByteArray device = storage.device();
+    if (!device.startsWith("/dev/")) return false;
+    QString block = QFileInfo("/sys/class/block/" + QString::fromLocal8Bit(device.mid(5))).canonicalFilePath();
+    if (block.isEmpty()) return false;
+    if (QFileInfo::exists(block + "/partition")) block = QFileInfo(block).path();
+    if (block.contains("/usb") || block.contains("/mmc")) return false;
+    QFile removable(block + "/removable");
+    if (removable.open(QIODevice::ReadOnly) && removable.readAll().trimmed() == "1") return false;
+    return true;
+#else
+    // Без sysfs отличаем флешки только по файловой системе
+    return type != "vfat" && type != "msdos" && type != "exfat" && type != "fat32";
+#endif
+}
+
+// QBuffer поверх страниц отображения: данные не копируются, отображение живёт вместе с устройством
+class MappedDevice : public QBuffer
+{
+public:
+    MappedDevice(const MappedFile &file, QObject *parent)
+        : QBuffer(parent),
+        mapped(file)
+    {
+        setData(mapped.view());
+        open(QIODevice::ReadOnly);
+    }
+
+private:
+    MappedFile mapped;
+};
+
+} // namespace
+
+QString MappedFile::fileName() const
+{
+    return d ? d->fileName : QString();
+}
+
+qint64 MappedFile::size() const
+{
+    return d ? d->size : 0;
+}
+
+const uchar *MappedFile::data() const
+{
+    return d ? d->data : nullptr;
+}
+
+QByteArray MappedFile::view(qint64 offset, qint64 length) const
+{
+    if (!d || offset < 0 || offset >= d->size) return QByteArray();
+    if (length < 0 || length > d->size - offset) length = d->size - offset;
+    return QByteArray::fromRawData(reinterpret_cast<const char *>(d->data + offset), length);
+}
+
+QIODevice *MappedFile::createDevice(QObject *parent) const
+{
+    if (!d) return nullptr;
+    return new MappedDevice(*this, parent);
+}
+
+void MappedFile::willNeed(qint64 offset, qint64 length) const
+{
+    if (!d || offset < 0 || offset >= d->size) return;
+    if (length < 0 || length > d->size - offset) length = d->size - offset;
+#ifdef Q_OS_UNIX
+    // madvise требует адрес, выровненный по странице
+    static const qint64 pageSize = ::sysconf(_SC_PAGESIZE);
+    const qint64 start = offset - offset % pageSize;
+    ::posix_madvise(d->data + start, size_t(length + offset - start), POSIX_MADV_WILLNEED);
+#else
+    Q_UNUSED(length);
+#endif
+}
+
+MappedFileCache::MappedFileCache()
+    : capacityBytes(defaultCapacityBytes)
+{
+}
+
+MappedFileCache &MappedFileCache::instance()
+{
+    static MappedFileCache cache;
+    return cache;
+}
+
+MappedFile MappedFileCache::open(const QString &fileName, QString *errorString)
+{
+    const QFileInfo info(fileName);
+    const QDateTime modified = info.lastModified();
+    const QStorageInfo storage(info.absolutePath());
+    {
+        QMutexLocker locker(&mutex);
+        // Решение запоминаем по точке монтирования: sysfs на каждом открытии не читаем
+        auto mappable = storageMappable.constFind(storage.rootPath());
+        if (mappable == storageMappable.constEnd()) {
+            mappable = storageMappable.insert(storage.rootPath(), isLocalFixedStorage(storage, fileName));
+        }
+        if (!mappable.value()) {
+            if (errorString) *errorString = "file is not on a local fixed disk";
+            return MappedFile();
+        }
+
+        auto it = entries.find(fileName);
+        if (it != entries.end()) {
+            // Файл перезаписали - старое отображение отдаём тем, кто его уже держит, и забываем
+            if (it->file.size() == info.size() && it->modified == modified) {
+                it->lastUse = ++useCounter;
+                ++hits;
+                return it->file;
+            }
+            mappedBytes -= it->file.size();
+            entries.erase(it);
+        }
+        ++misses;
+    }
+
+    // Отображаем вне блокировки: первое обращение к диску не должно задерживать другие потоки
+    auto mapping = std::make_shared<MappedFile::Mapping>();
+    mapping->fileName = fileName;
+    mapping->file.setFileName(fileName);
+    if (!mapping->file.open(QIODevice::ReadOnly)) {
+        if (errorString) *errorString = mapping->file.errorString();
+        return MappedFile();
+    }
+    mapping->size = mapping->file.size();
+    if (mapping->size <= 0 || mapping->size > maxMappedFileBytes) {
+        if (errorString) *errorString = mapping->size <= 0 ? "empty file" : "file too large to map";
+        return MappedFile();
+    }
+    mapping->data = mapping->file.map(0, mapping->size);
+    if (!mapping->data) {
+        if (errorString) *errorString = mapping->file.errorString();
+        return MappedFile();
+    }
+
+    MappedFile result;
+    result.d = std::move(mapping);
+
+    QMutexLocker locker(&mutex);
+    // Пока отображали, тот же файл мог открыть другой поток - берём его отображение
+    auto it = entries.find(fileName);
+    if (it != entries.end() && it->file.size() == result.size() && it->modified == modified) {
+        it->lastUse = ++useCounter;
+        return it->file;
+    }
+    if (it != entries.end()) {
+        mappedBytes -= it->file.size();
+        entries.erase(it);
+    }
+    entries.insert(fileName, {result, modified, ++useCounter});
+    mappedBytes += result.size();
+    evict();
+    return result;
+}
+
+void MappedFileCache::invalidate(const QString &fileName)
+{
+    QMutexLocker locker(&mutex);
+    auto it = entries.find(fileName);
+    if (it == entries.end()) return;
+    mappedBytes -= it->file.size();
+    entries.erase(it);
+}
+
+void MappedFileCache::clear()
+{
+    QMutexLocker locker(&mutex);
+    entries.clear();
+    storageMappable.clear();
+    mappedBytes = 0;
+}
+
+void MappedFileCache::setCapacity(qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    capacityBytes = qMax<qint64>(0, bytes);
+    evict();
+}
+
+MappedFileCache::Stats MappedFileCache::stats() const
+{
+    QMutexLocker locker(&mutex);
+    Stats result;
+    result.files = entries.size();
+    result.mappedBytes = mappedBytes;
+    result.capacityBytes = capacityBytes;
+    result.hits = hits;
+    result.misses = misses;
+    result.evictions = evictions;
+    return result;
+}
+
+void MappedFileCache::evict()
+{
+    // Вызывается под mutex. Линейный поиск старейшего: записей не больше maxEntries
+    while (!entries.isEmpty() && (mappedBytes > capacityBytes || entries.size() > maxEntries)) {
+        auto oldest = entries.begin();
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (it->lastUse < oldest->lastUse) oldest = it;
+        }
+        mappedBytes -= oldest->file.size();
+        entries.erase(oldest);
+        ++evictions;
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <memory>
+
+class QIODevice;
+class QObject;
+
+// Файл, отображённый в память только для чтения. Копии дешёвые и разделяют одно отображение,
+// оно снимается вместе с последней копией. Представления (view) ссылаются на страницы
+// отображения без копирования и не должны переживать сам MappedFile.
+// Любой сбой чтения отображённой страницы - укороченный на лету файл, отключённый сетевой
+// диск, извлечённая флешка - приходит сигналом SIGBUS и роняет процесс. Поэтому кэш
+// отображает только файлы на локальных несъёмных дисках, сверяет размер и время изменения
+// при каждом открытии, а запись тегов подменяет файл целиком, не укорачивая старый.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+
+    bool isValid() const { return d != nullptr; }
+    QString fileName() const;
+    qint64 size() const;
+    const uchar *data() const;
+
+    // QByteArray поверх страниц отображения, length < 0 - до конца файла
+    QByteArray view(qint64 offset = 0, qint64 length = -1) const;
+    // Устройство для QMediaPlayer::setSourceDevice и парсеров на QIODevice;
+    // держит отображение, пока существует само
+    QIODevice *createDevice(QObject *parent = nullptr) const;
+    // Подсказка ОС подгрузить диапазон заранее; без эффекта там, где её нет
+    void willNeed(qint64 offset, qint64 length) const;
+
+private:
+    friend class MappedFileCache;
+    struct Mapping;
+    std::shared_ptr<const Mapping> d;
+};
+
+// Общий кэш отображений: декодер, чтение тегов и прогрев открывают файл один раз,
+// и один проход воспроизведения с анализом затрагивает страницы файла однократно.
+// Кэш держит недавние отображения в пределах бюджета по байтам и числу файлов (LRU);
+// отображения, которые ещё используются снаружи, живут и после вытеснения.
+// Потокобезопасен: открывается из пулов тегов и прогрева.
+class MappedFileCache
+{
+public:
+    struct Stats {
+        int files = 0;
+        qint64 mappedBytes = 0;
+        qint64 capacityBytes = 0;
+        qint64 hits = 0;
+        qint64 misses = 0;
+        qint64 evictions = 0;
+    };
+
+    static MappedFileCache &instance();
+
+    // Недействительный MappedFile, если файл не открывается, пуст, слишком велик
+    // или лежит на сетевом либо съёмном диске - тогда читать его обычным путём
+    MappedFile open(const QString &fileName, QString *errorString = nullptr);
+    // Файл переименован, удалён или перезаписан
+    void invalidate(const QString &fileName);
+    void clear();
+
+    void setCapacity(qint64 bytes);
+    Stats stats() const;
+
+private:
+    struct Entry {
+        MappedFile file;
+        QDateTime modified;
+        qint64 lastUse = 0;
+    };
+
+    mutable QMutex mutex;
+    QHash<QString, Entry> entries;
+    QHash<QString, bool> storageMappable;  // по точке монтирования
+    qint64 capacityBytes;
+    qint64 mappedBytes = 0;
+    qint64 useCounter = 0;
+    qint64 hits = 0;
+    qint64 misses = 0;
+    qint64 evictions = 0;
+
+    MappedFileCache();
+    void evict();
+};
+
+#endif // MAPPEDFILE_H
@@ -1,85 +1,330 @@
 #include "musiccollection.h"
+#include "playlistfile.h"
 #include <QDebug>
+#include <QSet>
+#include <QTimer>
+#include <QtConcurrent>
 
-MusicCollection::MusicCollection(QObject *parent) : QObject(parent)
+// Правки пачкой (импорт, перенос файлов) дают одно сохранение
+static const int saveDelayMs = 1000;
+
+CollectionSnapshot::CollectionSnapshot(quint64 version, const QMap<QString, QList<TrackId>> &collections)
+    : snapshotVersion(version),
+    collections(collections)
 {
+}
+
+MusicCollection::MusicCollection(TrackTable *table, QObject *parent)
+    : QObject(parent),
+    table(table),
+    saveTimer(new QTimer(this))
+{
+    // Сохранения идут по порядку версий
+    savePool.setMaxThreadCount(1);
+    saveTimer->setSingleShot(true);
+    saveTimer->setInterval(saveDelayMs);
+    connect(saveTimer, &QTimer::timeout, this, &MusicCollection::startSave);
+    // Плейлисты читаются по одному; проверку путей внутри чтения разбирает общий пул
+    importPool.setMaxThreadCount(1);
+    connect(&importWatcher, &QFutureWatcher<PlaylistImport>::finished,
+            this, &MusicCollection::handlePlaylistRead);
     loadCollections();
 }
 
+MusicCollection::~MusicCollection()
+{
+    // Недочитанный плейлист уже не попадёт в коллекцию - ждём только ради потока
+    importWatcher.waitForFinished();
+    if (saveTimer->isActive()) saveCollections();
+    savePool.waitForDone();
+}
+
+CollectionSnapshotPtr MusicCollection::snapshot() const
+{
+    return std::atomic_load_explicit(&current, std::memory_order_acquire);
+}
+
 QStringList MusicCollection::getCollectionNames() const
 {
-    return collections.keys();
+    return snapshot()->names();
 }
 
 QStringList MusicCollection::getTracksInCollection(const QString &collectionName) const
 {
-    return collections.value(collectionName);
+    return table->paths(snapshot()->trackIds(collectionName));
+}
+
+QList<TrackId> MusicCollection::trackIds(const QString &collectionName) const
+{
+    return snapshot()->trackIds(collectionName);
+}
+
+void MusicCollection::publish()
+{
+    // Копия QMap - только счётчик ссылок; писатель отделит изменённый список при следующей правке
+    const auto next = std::make_shared<const CollectionSnapshot>(++nextVersion, collections);
+    std::atomic_store_explicit(&current, CollectionSnapshotPtr(next), std::memory_order_release);
+    emit snapshotPublished(next->version());
+}
+
+void MusicCollection::scheduleSave()
+{
+    if (!saveTimer->isActive()) saveTimer->start();
+}
+
+void MusicCollection::startSave()
+{
+    // Пути разворачиваются в фоне по копии таблицы: копия разделяет данные с оригиналом,
+    // и поток владельца платит за неё, только если заведёт новый путь до конца записи.
+    // Отложенный старт делает это не чаще раза в saveDelayMs, а не на каждую правку
+    const CollectionSnapshotPtr state = snapshot();
+    const quint64 version = state->version();
+    const TrackTable paths = *table;
+    latestSave.storeRelease(version);
+    savePool.start([this, version, state, paths]() {
+        // Пока ждали, опубликована более новая версия - её и запишет следующее задание
+        if (latestSave.loadAcquire() != version) return;
+        writeCollections(resolve(*state, paths));
+    });
 }
 
 void MusicCollection::addCollection(const QString &name)
 {
     if (!collections.contains(name)) {
-        collections.insert(name, QStringList());
-        saveCollections();
+        collections.insert(name, QList<TrackId>());
+        publish();
+        scheduleSave();
+        emit collectionAdded(name);
     }
 }
 
 void MusicCollection::renameCollection(const QString &oldName, const QString &newName)
 {
     if (collections.contains(oldName) && !collections.contains(newName)) {
-        QStringList tracks = collections.take(oldName);
+        QList<TrackId> tracks = collections.take(oldName);
         collections.insert(newName, tracks);
-        saveCollections();
+        publish();
+        scheduleSave();
+        emit collectionRenamed(oldName, newName);
     }
 }
 
 void MusicCollection::removeCollection(const QString &name)
 {
-    collections.remove(name);
-    saveCollections();
+    if (collections.remove(name) > 0) {
+        publish();
+        scheduleSave();
+        emit collectionRemoved(name);
+    }
 }
 
 void MusicCollection::addTrackToCollection(const QString &collectionName, const QString &trackPath)
 {
     if (collections.contains(collectionName)) {
-        QStringList &tracks = collections[collectionName];
-        if (!tracks.contains(trackPath)) {
-            tracks.append(trackPath);
-            saveCollections();
+        QList<TrackId> &tracks = collections[collectionName];
+        const TrackId id = table->intern(trackPath);
+        if (!tracks.contains(id)) {
+            tracks.append(id);
+            publish();
+            scheduleSave();
+            emit collectionTracksChanged(collectionName);
         }
     }
 }
 
+int MusicCollection::addTracksToCollection(const QString &collectionName, const QStringList &trackPaths)
+{
+    if (!collections.contains(collectionName)) return 0;
+
+    // Одна публикация и одно сохранение на всю пачку
+    const int added = appendTracks(collectionName, trackPaths);
+    if (added > 0) {
+        publish();
+        scheduleSave();
+        emit collectionTracksChanged(collectionName);
+    }
+    return added;
+}
+
+int MusicCollection::appendTracks(const QString &collectionName, const QStringList &trackPaths)
+{
+    QList<TrackId> &tracks = collections[collectionName];
+    QSet<TrackId> known(tracks.cbegin(), tracks.cend());
+
+    int added = 0;
+    for (const QString &trackPath : trackPaths) {
+        const TrackId id = table->intern(trackPath);
+        if (!known.contains(id)) {
+            known.insert(id);
+            tracks.append(id);
+            ++added;
+        }
+    }
+    return added;
+}
+
+void MusicCollection::importPlaylist(const QString &collectionName, const QString &fileName)
+{
+    importQueue.append({collectionName, fileName, QStringList(), QString()});
+    startPlaylistImport();
+}
+
+void MusicCollection::startPlaylistImport()
+{
+    if (importingPlaylist || importQueue.isEmpty()) return;
+    importingPlaylist = true;
+    // Чтение файла и проверка существования путей - в фоне: плейлист на сетевом диске
+    // с сотней тысяч строк не должен останавливать поток владельца
+    importWatcher.setFuture(QtConcurrent::run(&importPool, [job = importQueue.takeFirst()]() mutable {
+        job.tracks = PlaylistFile::read(job.fileName, &job.error);
+        return job;
+    }));
+}
+
+void MusicCollection::handlePlaylistRead()
+{
+    const PlaylistImport job = importWatcher.result();
+    importingPlaylist = false;
+    const int added = job.tracks.isEmpty() ? 0 : commitImport(job.collectionName, job.tracks);
+    emit playlistImported(job.collectionName, added, job.error);
+    startPlaylistImport();
+}
+
+int MusicCollection::commitImport(const QString &collectionName, const QStringList &tracks)
+{
+    // Новая коллекция и её треки публикуются одним снимком; созданная сохраняется, даже если
+    // все пути в ней уже были
+    const bool created = !collections.contains(collectionName);
+    if (created) collections.insert(collectionName, QList<TrackId>());
+    const int added = appendTracks(collectionName, tracks);
+    if (created || added > 0) {
+        publish();
+        scheduleSave();
+    }
+    if (created) emit collectionAdded(collectionName);
+    if (added > 0) emit collectionTracksChanged(collectionName);
+    return added;
+}
+
+bool MusicCollection::exportPlaylist(const QString &collectionName, const QString &fileName,
+                                     QString *errorString) const
+{
+    const CollectionSnapshotPtr state = snapshot();
+    if (!state->contains(collectionName)) {
+        if (errorString) *errorString = "No such collection";
+        return false;
+    }
+    return PlaylistFile::write(fileName, table->paths(state->trackIds(collectionName)), errorString);
+}
+
 void MusicCollection::removeTrackFromCollection(const QString &collectionName, const QString &trackPath)
 {
-    if (collections.contains(collectionName)) {
-        collections[collectionName].removeAll(trackPath);
-        saveCollections();
+    if (collections.contains(collectionName)
+        && collections[collectionName].removeAll(table->find(trackPath)) > 0) {
+        publish();
+        scheduleSave();
+        emit collectionTracksChanged(collectionName);
+    }
+}
+
+void MusicCollection::removeTrackFromAllCollections(const QString &trackPath)
+{
+    const TrackId id = table->find(trackPath);
+    if (id == TrackTable::InvalidId) return;
+
+    QStringList changed;
+    for (auto it = collections.begin(); it != collections.end(); ++it) {
+        // Не трогаем списки без трека: removeAll отделил бы их от опубликованного снимка
+        if (it.value().contains(id) && it.value().removeAll(id) > 0) {
+            changed.append(it.key());
+        }
+    }
+    if (!changed.isEmpty()) {
+        publish();
+        scheduleSave();
+        for (const QString &name : std::as_const(changed)) {
+            emit collectionTracksChanged(name);
+        }
+    }
+}
+
+void MusicCollection::replaceTrackInAllCollections(const QString &oldPath, const QString &newPath)
+{
+    const TrackId oldId = table->find(oldPath);
+    if (oldId == TrackTable::InvalidId) return;
+    const TrackId newId = table->intern(newPath);
+
+    QStringList changed;
+    for (auto it = collections.begin(); it != collections.end(); ++it) {
+        if (!it.value().contains(oldId)) continue;
+        QList<TrackId> &tracks = it.value();
+        int index = tracks.indexOf(oldId);
+
+        // Сохраняем позицию трека в коллекции
+        if (tracks.contains(newId)) {
+            tracks.removeAt(index);
+        } else {
+            tracks.replace(index, newId);
+        }
+        tracks.removeAll(oldId);
+        changed.append(it.key());
+    }
+    if (!changed.isEmpty()) {
+        publish();
+        scheduleSave();
+        for (const QString &name : std::as_const(changed)) {
+            emit collectionTracksChanged(name);
+        }
     }
 }
 
 void MusicCollection::saveCollections()
 {
+    saveTimer->stop();
+    const CollectionSnapshotPtr state = snapshot();
+    latestSave.storeRelease(state->version());
+    savePool.waitForDone();
+    writeCollections(resolve(*state, *table));
+}
+
+MusicCollection::SavedCollections MusicCollection::resolve(const CollectionSnapshot &snapshot,
+                                                           const TrackTable &table)
+{
+    SavedCollections saved;
+    const QStringList names = snapshot.names();
+    saved.reserve(names.size());
+    for (const QString &name : names) {
+        saved.append({name, table.paths(snapshot.trackIds(name))});
+    }
+    return saved;
+}
+
+void MusicCollection::writeCollections(const SavedCollections &saved)
+{
+    // Отдельный QSettings в каждом потоке - так разрешает документация Qt
     QSettings settings;
+    settings.remove("Collections");
     settings.beginWriteArray("Collections");
-    int i = 0;
-    for (auto it = collections.constBegin(); it != collections.constEnd(); ++it) {
-        settings.setArrayIndex(i++);
-        settings.setValue("name", it.key());
-        settings.setValue("tracks", it.value());
+    for (int i = 0; i < saved.size(); ++i) {
+        settings.setArrayIndex(i);
+        settings.setValue("name", saved.at(i).first);
+        settings.setValue("tracks", saved.at(i).second);
     }
     settings.endArray();
 }
 
 void MusicCollection::loadCollections()
 {
+    collections.clear();
+
     QSettings settings;
     int size = settings.beginReadArray("Collections");
     for (int i = 0; i < size; ++i) {
         settings.setArrayIndex(i);
         QString name = settings.value("name").toString();
         QStringList tracks = settings.value("tracks").toStringList();
-        collections.insert(name, tracks);
+        collections.insert(name, table->intern(tracks));
     }
     settings.endArray();
+    publish();
 }
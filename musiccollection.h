@@ -2,29 +2,119 @@
 #define MUSICCOLLECTION_H
 
 #include <QObject>
+#include <QAtomicInteger>
+#include <QFutureWatcher>
 #include <QMap>
 #include <QStringList>
 #include <QSettings>
+#include <QThreadPool>
+#include <memory>
+#include "tracktable.h"
+
+// Неизменяемый снимок коллекций: только списки идентификаторов. Списки разделяются неявно,
+// поэтому снимок дешёв, а читатели в любых потоках держат его сколько нужно без блокировок.
+// Таблицы путей в снимке нет: её копия заставила бы писателя при следующем intern()
+// скопировать таблицу целиком. Пути разворачивает MusicCollection: для читателей - в потоке
+// владельца, для отложенного сохранения - в фоне по копии таблицы, снятой раз на запись.
+class CollectionSnapshot
+{
+public:
+    CollectionSnapshot(quint64 version, const QMap<QString, QList<TrackId>> &collections);
+
+    quint64 version() const { return snapshotVersion; }
+    QStringList names() const { return collections.keys(); }
+    bool contains(const QString &name) const { return collections.contains(name); }
+    int size() const { return collections.size(); }
+    QList<TrackId> trackIds(const QString &name) const { return collections.value(name); }
+
+private:
+    quint64 snapshotVersion;
+    QMap<QString, QList<TrackId>> collections;
+};
+
+using CollectionSnapshotPtr = std::shared_ptr<const CollectionSnapshot>;
+
+class QTimer;
 
 class MusicCollection : public QObject
 {
     Q_OBJECT
 public:
-    explicit MusicCollection(QObject *parent = nullptr);
+    // Треки коллекций хранятся идентификаторами из общей таблицы путей.
+    // Изменения - только из потока владельца; каждое публикует новый снимок.
+    explicit MusicCollection(TrackTable *table, QObject *parent = nullptr);
+    ~MusicCollection();
+
+    // Атомарно читает текущую версию; безопасно из любого потока
+    CollectionSnapshotPtr snapshot() const;
+    quint64 version() const { return snapshot()->version(); }
 
     QStringList getCollectionNames() const;
+    // Пути - через таблицу владельца, только из его потока
     QStringList getTracksInCollection(const QString &collectionName) const;
+    QList<TrackId> trackIds(const QString &collectionName) const;
 
     void addCollection(const QString &name);
     void renameCollection(const QString &oldName, const QString &newName);
     void removeCollection(const QString &name);
     void addTrackToCollection(const QString &collectionName, const QString &trackPath);
+    int addTracksToCollection(const QString &collectionName, const QStringList &trackPaths);
     void removeTrackFromCollection(const QString &collectionName, const QString &trackPath);
+    void removeTrackFromAllCollections(const QString &trackPath);
+    void replaceTrackInAllCollections(const QString &oldPath, const QString &newPath);
 
-private:
-    QMap<QString, QStringList> collections;
+    // Плейлист читается в фоне, импорты - по одному в порядке вызова; итог - playlistImported
+    void importPlaylist(const QString &collectionName, const QString &fileName);
+    bool exportPlaylist(const QString &collectionName, const QString &fileName,
+                        QString *errorString = nullptr) const;
+
+    // Синхронная запись; после изменений сохранение идёт в фоне из снимка
     void saveCollections();
     void loadCollections();
+
+signals:
+    void collectionAdded(const QString &name);
+    void collectionRemoved(const QString &name);
+    void collectionRenamed(const QString &oldName, const QString &newName);
+    void collectionTracksChanged(const QString &name);
+    void snapshotPublished(quint64 version);
+    // error непуст, если файл не прочитался; added - сколько треков добавилось
+    void playlistImported(const QString &collectionName, int added, const QString &error);
+
+private:
+    TrackTable *table;
+    // Рабочая копия писателя; читатели видят только опубликованные снимки
+    QMap<QString, QList<TrackId>> collections;
+    CollectionSnapshotPtr current;
+    quint64 nextVersion = 0;
+
+    QThreadPool savePool;
+    QAtomicInteger<quint64> latestSave;
+    QTimer *saveTimer;                  // отложенное сохранение: правки пачкой пишутся один раз
+
+    struct PlaylistImport {
+        QString collectionName;
+        QString fileName;
+        QStringList tracks;             // заполняется в фоне
+        QString error;
+    };
+    QThreadPool importPool;
+    QFutureWatcher<PlaylistImport> importWatcher;
+    QList<PlaylistImport> importQueue;
+    bool importingPlaylist = false;
+
+    // Имя коллекции и пути её треков, развёрнутые для записи
+    using SavedCollections = QList<QPair<QString, QStringList>>;
+
+    void publish();
+    void scheduleSave();
+    void startSave();
+    int appendTracks(const QString &collectionName, const QStringList &trackPaths);
+    void startPlaylistImport();
+    void handlePlaylistRead();
+    int commitImport(const QString &collectionName, const QStringList &tracks);
+    static SavedCollections resolve(const CollectionSnapshot &snapshot, const TrackTable &table);
+    static void writeCollections(const SavedCollections &saved);
 };
 
 #endif
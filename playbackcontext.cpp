@@ -0,0 +1,45 @@
+#include "playbackcontext.h"
+
+PlaybackContext::PlaybackContext(Kind kind, const QString &name, const QList<TrackId> &tracks, int cursor)
+    : contextKind(kind),
+    contextName(name),
+    sequence(tracks),
+    position(cursor >= 0 && cursor < tracks.size() ? cursor : -1)
+{
+}
+
+TrackId PlaybackContext::current() const
+{
+    return at(position);
+}
+
+TrackId PlaybackContext::at(int index) const
+{
+    return index >= 0 && index < sequence.size() ? sequence.at(index) : TrackTable::InvalidId;
+}
+
+bool PlaybackContext::setCursor(int index)
+{
+    if (index < -1 || index >= sequence.size()) return false;
+    position = index;
+    return true;
+}
+
+TrackId PlaybackContext::step(int delta)
+{
+    const int target = position + delta;
+    if (target < 0 || target >= sequence.size()) return TrackTable::InvalidId;
+    position = target;
+    return sequence.at(position);
+}
+
+QString PlaybackContext::kindName(Kind kind)
+{
+    switch (kind) {
+    case Library: return "library";
+    case Filtered: return "filtered";
+    case Collection: return "collection";
+    case Queue: return "queue";
+    }
+    return QString();
+}
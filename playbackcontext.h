@@ -0,0 +1,48 @@
+#ifndef PLAYBACKCONTEXT_H
+#define PLAYBACKCONTEXT_H
+
+#include <QList>
+#include <QString>
+#include "tracktable.h"
+
+// Откуда играет плеер: вся библиотека, отфильтрованный вид или коллекция.
+// Контекст держит свою упорядоченную последовательность треков и курсор;
+// список разделяется неявно (copy-on-write), поэтому переключение не копирует данные,
+// а переход вперёд/назад - O(1).
+class PlaybackContext
+{
+public:
+    enum Kind {
+        Library,
+        Filtered,
+        Collection,
+        Queue
+    };
+
+    PlaybackContext() = default;
+    PlaybackContext(Kind kind, const QString &name, const QList<TrackId> &tracks, int cursor = -1);
+
+    Kind kind() const { return contextKind; }
+    QString name() const { return contextName; }
+    const QList<TrackId> &tracks() const { return sequence; }
+    int size() const { return sequence.size(); }
+    bool isEmpty() const { return sequence.isEmpty(); }
+
+    int cursor() const { return position; }
+    TrackId current() const;
+    TrackId at(int index) const;
+    bool setCursor(int index);
+
+    // Сдвигает курсор, если есть куда; возвращает новый трек или InvalidId
+    TrackId step(int delta);
+
+    static QString kindName(Kind kind);
+
+private:
+    Kind contextKind = Library;
+    QString contextName;
+    QList<TrackId> sequence;
+    int position = -1;
+};
+
+#endif // PLAYBACKCONTEXT_H
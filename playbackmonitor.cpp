@@ -0,0 +1,160 @@
+#include "playbackmonitor.h"
+#include "powerscheduler.h"
+#include <QFile>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+PlaybackMonitor::PlaybackMonitor(QMediaPlayer *player, PowerScheduler *scheduler, QObject *parent)
+    : QObject(parent),
+    player(player),
+    scheduler(scheduler),
+    cpuTask(scheduler->addTask("cpu-sample", 1000, PowerScheduler::Always, this, [this]() { sampleCpu(); }))
+{
+    scheduler->setTaskEnabled(cpuTask, false);
+    connectPlayer();
+}
+
+void PlaybackMonitor::setPlayer(QMediaPlayer *newPlayer)
+{
+    if (newPlayer == player) return;
+    disconnect(player, nullptr, this, nullptr);
+    player = newPlayer;
+    connectPlayer();
+}
+
+void PlaybackMonitor::connectPlayer()
+{
+    connect(player, &QMediaPlayer::positionChanged, this, &PlaybackMonitor::handlePositionChanged);
+    connect(player, &QMediaPlayer::mediaStatusChanged, this, &PlaybackMonitor::handleMediaStatusChanged);
+    connect(player, &QMediaPlayer::bufferProgressChanged, this, &PlaybackMonitor::handleBufferProgress);
+    connect(player, &QMediaPlayer::playbackStateChanged, this, &PlaybackMonitor::handlePlaybackStateChanged);
+}
+
+void PlaybackMonitor::markTrackStart()
+{
+    trackStartUs = eventTrace.nowUs();
+    seekStartUs = -1;
+    eventTrace.record(TraceEvent::TrackStart);
+}
+
+void PlaybackMonitor::markSeek(qint64 targetMs)
+{
+    seekStartUs = eventTrace.nowUs();
+    seekTargetMs = targetMs;
+}
+
+PlaybackMonitor::Stats PlaybackMonitor::stats() const
+{
+    return current;
+}
+
+bool PlaybackMonitor::exportChromeTrace(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    eventTrace.writeChromeTrace(&file);
+    return true;
+}
+
+void PlaybackMonitor::handlePositionChanged(qint64 position)
+{
+    const qint64 now = eventTrace.nowUs();
+
+    // Первая ненулевая позиция после playTrack - звук реально пошёл
+    if (trackStartUs >= 0 && position > 0) {
+        const qint64 latency = now - trackStartUs;
+        trackStartUs = -1;
+
+        firstAudioTotalUs += latency;
+        ++firstAudioCount;
+        current.lastTimeToFirstAudioUs = latency;
+        current.averageTimeToFirstAudioUs = firstAudioTotalUs / firstAudioCount;
+        eventTrace.record(TraceEvent::FirstAudio, latency);
+        emit firstAudio(latency);
+    }
+
+    if (seekStartUs >= 0 && qAbs(position - seekTargetMs) < 1000) {
+        const qint64 latency = now - seekStartUs;
+        seekStartUs = -1;
+
+        current.lastSeekLatencyUs = latency;
+        eventTrace.record(TraceEvent::Seek, latency, seekTargetMs);
+    }
+}
+
+void PlaybackMonitor::handleMediaStatusChanged(QMediaPlayer::MediaStatus status)
+{
+    if (status == QMediaPlayer::StalledMedia &&
+        player->playbackState() == QMediaPlayer::PlayingState) {
+        ++current.underruns;
+        eventTrace.record(TraceEvent::Underrun, 0, current.underruns);
+    }
+}
+
+void PlaybackMonitor::handleBufferProgress(float filled)
+{
+    const int percent = qRound(filled * 100);
+    if (percent == current.bufferFill) return;
+
+    current.bufferFill = percent;
+    eventTrace.record(TraceEvent::BufferFill, 0, percent);
+}
+
+void PlaybackMonitor::handlePlaybackStateChanged(QMediaPlayer::PlaybackState state)
+{
+    if (state == QMediaPlayer::PlayingState) {
+        lastCpuUs = processCpuUs();
+        lastWallUs = eventTrace.nowUs();
+        sampling = true;
+    } else {
+        sampleCpu();
+        sampling = false;
+    }
+    scheduler->setTaskEnabled(cpuTask, sampling);
+}
+
+void PlaybackMonitor::sampleCpu()
+{
+    if (!sampling) return;
+
+    const qint64 cpuUs = processCpuUs();
+    const qint64 wallUs = eventTrace.nowUs();
+    const qint64 cpuDelta = cpuUs - lastCpuUs;
+    const qint64 wallDelta = wallUs - lastWallUs;
+    lastCpuUs = cpuUs;
+    lastWallUs = wallUs;
+
+    // Декодирование идёт в нашем процессе, так что время процесса во
+    // время воспроизведения - верхняя оценка затрат на декодирование
+    cpuTotalUs += cpuDelta;
+    current.cpuTimeMs = cpuTotalUs / 1000;
+    current.cpuPercent = wallDelta > 0 ? 100.0 * cpuDelta / wallDelta : 0.0;
+    eventTrace.record(TraceEvent::CpuSample, wallDelta, cpuDelta);
+}
+
+qint64 PlaybackMonitor::processCpuUs()
+{
+#ifdef Q_OS_WIN
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    auto toUs = [](const FILETIME &time) {
+        return ((qint64(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 10;
+    };
+    return toUs(kernel) + toUs(user);
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return qint64(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+           + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+}
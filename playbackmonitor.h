@@ -0,0 +1,70 @@
+#ifndef PLAYBACKMONITOR_H
+#define PLAYBACKMONITOR_H
+
+#include <QObject>
+#include <QMediaPlayer>
+#include "playbacktrace.h"
+
+class PowerScheduler;
+
+// Инструментирование аудиотракта: время до первого звука, задержка
+// перемотки, заполнение буфера, недогрузки и процессорное время
+class PlaybackMonitor : public QObject
+{
+    Q_OBJECT
+public:
+    struct Stats {
+        qint64 lastTimeToFirstAudioUs = -1;
+        qint64 averageTimeToFirstAudioUs = -1;
+        qint64 lastSeekLatencyUs = -1;
+        int bufferFill = 0;
+        int underruns = 0;
+        double cpuPercent = 0.0;
+        qint64 cpuTimeMs = 0;
+    };
+
+    // Замеры процессора идут задачей общего планировщика, только пока дека играет
+    PlaybackMonitor(QMediaPlayer *player, PowerScheduler *scheduler, QObject *parent = nullptr);
+
+    // Автомикс меняет деки местами - следим за той, что сейчас звучит
+    void setPlayer(QMediaPlayer *newPlayer);
+    void markTrackStart();
+    void markSeek(qint64 targetMs);
+
+    Stats stats() const;
+    const PlaybackTrace &trace() const { return eventTrace; }
+    bool exportChromeTrace(const QString &fileName) const;
+
+signals:
+    void firstAudio(qint64 latencyUs);
+
+private slots:
+    void handlePositionChanged(qint64 position);
+    void handleMediaStatusChanged(QMediaPlayer::MediaStatus status);
+    void handleBufferProgress(float filled);
+    void handlePlaybackStateChanged(QMediaPlayer::PlaybackState state);
+    void sampleCpu();
+
+private:
+    QMediaPlayer *player;
+    PowerScheduler *scheduler;
+    int cpuTask;
+    bool sampling = false;
+    PlaybackTrace eventTrace;
+    Stats current;
+
+    qint64 trackStartUs = -1;
+    qint64 seekStartUs = -1;
+    qint64 seekTargetMs = 0;
+    qint64 firstAudioTotalUs = 0;
+    int firstAudioCount = 0;
+
+    qint64 lastCpuUs = 0;
+    qint64 lastWallUs = 0;
+    qint64 cpuTotalUs = 0;
+
+    void connectPlayer();
+    static qint64 processCpuUs();
+};
+
+#endif // PLAYBACKMONITOR_H
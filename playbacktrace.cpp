@@ -0,0 +1,120 @@
+#include "playbacktrace.h"
+#include <QIODevice>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+static_assert((PlaybackTrace::Capacity & (PlaybackTrace::Capacity - 1)) == 0,
+              "Capacity must be a power of two");
+
+static const char *eventName(TraceEvent::Type type)
+{
+    switch (type) {
+    case TraceEvent::TrackStart: return "track_start";
+    case TraceEvent::FirstAudio: return "time_to_first_audio";
+    case TraceEvent::Seek: return "seek";
+    case TraceEvent::BufferFill: return "buffer_fill";
+    case TraceEvent::Underrun: return "underrun";
+    case TraceEvent::CpuSample: return "cpu";
+    }
+    return "unknown";
+}
+
+PlaybackTrace::PlaybackTrace()
+{
+    clock.start();
+}
+
+qint64 PlaybackTrace::nowUs() const
+{
+    return clock.nsecsElapsed() / 1000;
+}
+
+void PlaybackTrace::record(TraceEvent::Type type, qint64 durationUs, qint64 value)
+{
+    const quint64 index = head.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = ring[index & (Capacity - 1)];
+
+    // Нечётная последовательность - слот в процессе записи
+    slot.sequence.store(index * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.type.store(type, std::memory_order_relaxed);
+    slot.timestampUs.store(nowUs(), std::memory_order_relaxed);
+    slot.durationUs.store(durationUs, std::memory_order_relaxed);
+    slot.value.store(value, std::memory_order_relaxed);
+
+    slot.sequence.store(index * 2 + 2, std::memory_order_release);
+}
+
+QVector<TraceEvent> PlaybackTrace::snapshot() const
+{
+    const quint64 end = head.load(std::memory_order_acquire);
+    const quint64 begin = end > quint64(Capacity) ? end - Capacity : 0;
+
+    QVector<TraceEvent> events;
+    events.reserve(int(end - begin));
+    for (quint64 index = begin; index < end; ++index) {
+        const Slot &slot = ring[index & (Capacity - 1)];
+
+        const quint64 before = slot.sequence.load(std::memory_order_acquire);
+        if (before != index * 2 + 2) continue;
+
+        TraceEvent event;
+        event.type = static_cast<TraceEvent::Type>(slot.type.load(std::memory_order_relaxed));
+        event.timestampUs = slot.timestampUs.load(std::memory_order_relaxed);
+        event.durationUs = slot.durationUs.load(std::memory_order_relaxed);
+        event.value = slot.value.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == before) {
+            events.append(event);
+        }
+    }
+    return events;
+}
+
+void PlaybackTrace::writeChromeTrace(QIODevice *device) const
+{
+    QJsonArray traceEvents;
+    const QVector<TraceEvent> events = snapshot();
+    for (const TraceEvent &event : events) {
+        QJsonObject json{
+            {"name", eventName(event.type)},
+            {"pid", 1},
+            {"tid", 1}
+        };
+
+        switch (event.type) {
+        case TraceEvent::FirstAudio:
+        case TraceEvent::Seek:
+            json.insert("ph", "X");
+            json.insert("ts", double(event.timestampUs - event.durationUs));
+            json.insert("dur", double(event.durationUs));
+            break;
+        case TraceEvent::BufferFill:
+            json.insert("ph", "C");
+            json.insert("ts", double(event.timestampUs));
+            json.insert("args", QJsonObject{{"percent", double(event.value)}});
+            break;
+        case TraceEvent::CpuSample:
+            json.insert("ph", "C");
+            json.insert("ts", double(event.timestampUs));
+            json.insert("args", QJsonObject{{"cpu_us", double(event.value)}});
+            break;
+        case TraceEvent::TrackStart:
+        case TraceEvent::Underrun:
+            json.insert("ph", "i");
+            json.insert("s", "g");
+            json.insert("ts", double(event.timestampUs));
+            break;
+        }
+        traceEvents.append(json);
+    }
+
+    QJsonObject root{
+        {"traceEvents", traceEvents},
+        {"displayTimeUnit", "ms"}
+    };
+    device->write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+}
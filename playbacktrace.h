@@ -0,0 +1,58 @@
+#ifndef PLAYBACKTRACE_H
+#define PLAYBACKTRACE_H
+
+#include <QElapsedTimer>
+#include <QVector>
+#include <array>
+#include <atomic>
+
+class QIODevice;
+
+struct TraceEvent {
+    enum Type {
+        TrackStart,
+        FirstAudio,
+        Seek,
+        BufferFill,
+        Underrun,
+        CpuSample
+    };
+
+    Type type = TrackStart;
+    qint64 timestampUs = 0;
+    qint64 durationUs = 0;
+    qint64 value = 0;
+};
+
+// Кольцевой буфер событий без блокировок: писать можно из любого потока,
+// читатель пропускает слоты, которые в этот момент перезаписываются
+class PlaybackTrace
+{
+public:
+    static constexpr int Capacity = 4096;
+
+    PlaybackTrace();
+
+    qint64 nowUs() const;
+    void record(TraceEvent::Type type, qint64 durationUs = 0, qint64 value = 0);
+    QVector<TraceEvent> snapshot() const;
+    // Сколько событий записано с начала и сколько из них ещё в кольце - без копирования слотов
+    quint64 recordedCount() const { return head.load(std::memory_order_relaxed); }
+    int size() const { return int(qMin<quint64>(recordedCount(), Capacity)); }
+    void writeChromeTrace(QIODevice *device) const;
+
+private:
+    struct Slot {
+        std::atomic<quint64> sequence{0};
+        std::atomic<int> type{0};
+        std::atomic<qint64> timestampUs{0};
+        std::atomic<qint64> durationUs{0};
+        std::atomic<qint64> value{0};
+    };
+
+    std::array<Slot, Capacity> ring;
+    std::atomic<quint64> head{0};
+    QElapsedTimer clock;
+};
+
+#endif // PLAYBACKTRACE_H
@@ -0,0 +1,1529 @@
+#include "playerengine.h"
+#include "musiccollection.h"
+#include "playbackmonitor.h"
+#include "smartcollections.h"
+#include "formatprobe.h"
+#include "prefetcher.h"
+#include "collectionexporter.h"
+#include "listeninghistory.h"
+#include "trackanalyzer.h"
+#include "mappedfile.h"
+#include "powerscheduler.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#include <QRandomGenerator>
+#include <QSet>
+#include <QUrl>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+
+static const QStringList audioFilters = {"*.mp3", "*.wav", "*.ogg", "*.flac"};
+
+// Радио держит в очереди полтора десятка треков и пополняется, когда их остаётся пять
+static const int radioBatch = 15;
+static const int radioLowWater = 5;
+static const int radioSkipMemory = 10;
+// Не повторяем последние двести треков эфира: ширина поиска от длины эфира не зависит
+static const int radioPlayedMemory = 200;
+
+// Автомикс: вторая дека загружается за десять секунд до перехода, фаза сверяется
+// один раз в начале наложения, скорость после перехода возвращается на 0.2% за такт
+static const int mixTickMs = 50;
+static const qint64 mixPreloadMs = 10000;
+static const qint64 mixPhaseCheckMs = 250;
+static const qint64 mixPhaseToleranceMs = 15;
+static const double mixRateStep = 0.002;
+static const double halfPi = 1.57079632679489662;
+
+// Отрезки внутри файла: за полсекунды до конца заводится точный таймер; переход к отрезку,
+// начало которого в пределах допуска от текущей позиции, не трогает деку вовсе
+static const qint64 rangeLookaheadMs = 500;
+static const qint64 gaplessToleranceMs = 250;
+
+// Статистика пишется не чаще раза в полминуты после изменения - падение теряет не больше
+static const int statsSaveDelayMs = 30000;
+
+// Трек, который не удалось декодировать, переходы обходят десять минут
+static const qint64 playbackRetryMs = 10 * 60 * 1000;
+
+PlayerEngine::PlayerEngine(QObject *parent)
+    : QObject(parent),
+    player(new QMediaPlayer(this)),
+    audioOutput(new QAudioOutput(this)),
+    mixPlayer(new QMediaPlayer(this)),
+    mixOutput(new QAudioOutput(this)),
+    power(new PowerScheduler(this)),
+    musicCollection(new MusicCollection(&table, this)),
+    playbackMonitor(new PlaybackMonitor(player, power, this)),
+    smart(new SmartCollections(this, this)),
+    prefetch(new Prefetcher(this)),
+    collectionExporter(new CollectionExporter(this)),
+    history(new ListeningHistory(QString(), this)),
+    trackAnalyzer(new TrackAnalyzer(&table, this)),
+    fileOps(new FileOperations(QString(), this)),
+    currentId(TrackTable::InvalidId),
+    currentTrackIndex(-1),
+    shuffleMode(false),
+    mixTimer(new QTimer(this)),
+    boundaryTimer(new QTimer(this)),
+    statsSaveTimer(new QTimer(this))
+{
+    audioOutput->setVolume(userVolume);
+    player->setAudioOutput(audioOutput);
+    mixOutput->setVolume(0.0f);
+    mixPlayer->setAudioOutput(mixOutput);
+
+    // Деки меняются местами после каждого перехода; обработчик отличает текущую по sender()
+    connect(player, &QMediaPlayer::mediaStatusChanged,
+            this, &PlayerEngine::handleMediaStatusChanged);
+    connect(mixPlayer, &QMediaPlayer::mediaStatusChanged,
+            this, &PlayerEngine::handleMediaStatusChanged);
+
+    mixTimer->setInterval(mixTickMs);
+    connect(mixTimer, &QTimer::timeout, this, &PlayerEngine::updateMix);
+
+    for (QMediaPlayer *deck : {player, mixPlayer}) {
+        connect(deck, &QMediaPlayer::positionChanged, this, &PlayerEngine::handlePositionChanged);
+        connect(deck, &QMediaPlayer::durationChanged, this, &PlayerEngine::handleDurationChanged);
+        // Пока ни одна дека не играет, задачи воспроизведения не будят процесс
+        connect(deck, &QMediaPlayer::playbackStateChanged, this, [this]() {
+            power->setPlaying(player->playbackState() == QMediaPlayer::PlayingState
+                              || mixPlayer->playbackState() == QMediaPlayer::PlayingState);
+        });
+    }
+    boundaryTimer->setSingleShot(true);
+    boundaryTimer->setTimerType(Qt::PreciseTimer);
+    connect(boundaryTimer, &QTimer::timeout, this, &PlayerEngine::finishRange);
+
+    statsSaveTimer->setSingleShot(true);
+    statsSaveTimer->setTimerType(Qt::VeryCoarseTimer);
+    statsSaveTimer->setInterval(statsSaveDelayMs);
+    connect(statsSaveTimer, &QTimer::timeout, this, &PlayerEngine::saveStatistics);
+
+    connect(playbackMonitor, &PlaybackMonitor::firstAudio,
+            prefetch, &Prefetcher::recordFirstAudio);
+
+    power->addTask("playback-statistics", 1000, PowerScheduler::WhilePlaying, this,
+                   [this]() { updatePlaybackStatistics(); });
+
+    // Новые треки анализируются в фоне; готовые описатели берём с диска
+    trackAnalyzer->load();
+    connect(this, &PlayerEngine::tracksAdded, this, &PlayerEngine::analyzeTracks);
+
+    connect(fileOps, &FileOperations::finished, this, &PlayerEngine::handleFileOperation);
+
+    connect(&importExpandWatcher, &QFutureWatcher<QStringList>::finished,
+            this, &PlayerEngine::handleImportExpanded);
+    connect(&importProbeWatcher, &QFutureWatcher<ProbeResult>::finished,
+            this, &PlayerEngine::handleImportProbed);
+}
+
+PlayerEngine::~PlayerEngine()
+{
+    updatePlaybackStatistics();
+    finishListening(false);
+    saveTrackList();
+    saveStatistics();
+}
+
+QStringList PlayerEngine::tracks() const
+{
+    return table.paths(allTracks);
+}
+
+QStringList PlayerEngine::currentPlaylist() const
+{
+    return table.paths(playlist);
+}
+
+QStringList PlayerEngine::queue() const
+{
+    return table.paths(upNext.toList());
+}
+
+int PlayerEngine::currentIndex() const
+{
+    return currentTrackIndex;
+}
+
+QString PlayerEngine::currentFilePath() const
+{
+    return table.path(currentId);
+}
+
+bool PlayerEngine::isShuffle() const
+{
+    return shuffleMode;
+}
+
+float PlayerEngine::playbackRate() const
+{
+    return userRate;
+}
+
+PlayerEngine::TrackStats PlayerEngine::trackStats(const QString &filePath) const
+{
+    return trackStats(table.find(filePath));
+}
+
+PlayerEngine::TrackStats PlayerEngine::trackStats(TrackId id) const
+{
+    return trackStatistics.value(id);
+}
+
+QString PlayerEngine::displayName(TrackId id) const
+{
+    const QString path = table.path(id);
+    return VirtualTrack::isVirtual(path) ? VirtualTrack::displayName(path) : table.fileName(id);
+}
+
+qint64 PlayerEngine::position() const
+{
+    return qMax<qint64>(0, player->position() - currentRange.startMs());
+}
+
+qint64 PlayerEngine::duration() const
+{
+    if (currentRange.endUs >= 0) return currentRange.endMs() - currentRange.startMs();
+    return qMax<qint64>(0, player->duration() - currentRange.startMs());
+}
+
+// Листы и главы разбираются параллельно, как и проверка заголовков
+static QStringList expandAll(const QStringList &filePaths)
+{
+    const QList<QStringList> expandedLists = QtConcurrent::blockingMapped<QList<QStringList>>(
+        filePaths, &CueSheet::expand);
+    QStringList expanded;
+    for (const QStringList &paths : expandedLists) {
+        expanded += paths;
+    }
+    return expanded;
+}
+
+// Образ, описанный листом, попадает в библиотеку только дорожками листа
+static QStringList folderTracks(const QString &folderPath)
+{
+    QDir directory(folderPath);
+    const QStringList audioFiles = directory.entryList(audioFilters, QDir::Files, QDir::Name);
+
+    QStringList filePaths;
+    QSet<QString> covered;
+    for (const QString &cue : directory.entryList({"*.cue"}, QDir::Files, QDir::Name)) {
+        const QList<VirtualTrack> sheet = CueSheet::read(directory.filePath(cue));
+        for (const VirtualTrack &track : sheet) {
+            covered.insert(QFileInfo(track.filePath).absoluteFilePath());
+            filePaths.append(track.path());
+        }
+    }
+    filePaths.reserve(filePaths.size() + audioFiles.size());
+    for (const QString &file : audioFiles) {
+        const QString filePath = directory.filePath(file);
+        if (!covered.contains(QFileInfo(filePath).absoluteFilePath())) filePaths.append(filePath);
+    }
+    return filePaths;
+}
+
+int PlayerEngine::addTracks(const QStringList &filePaths)
+{
+    QStringList candidatePaths;
+    const QList<TrackId> candidates = filterCandidates(expandAll(filePaths), &candidatePaths);
+    if (candidates.isEmpty()) return 0;
+
+    // Заголовки читаются параллельно: на медленном диске время уходит на ожидание I/O
+    const QList<ProbeResult> probes = QtConcurrent::blockingMapped<QList<ProbeResult>>(
+        candidatePaths, &FormatProbe::probe);
+    return acceptProbes(candidates, candidatePaths, probes);
+}
+
+int PlayerEngine::loadFolder(const QString &folderPath)
+{
+    return addTracks(folderTracks(folderPath));
+}
+
+void PlayerEngine::importTracks(const QStringList &filePaths, bool playFirst)
+{
+    importQueue.append({filePaths, QString(), playFirst});
+    startImport();
+}
+
+void PlayerEngine::importFolder(const QString &folderPath, bool playFirst)
+{
+    importQueue.append({QStringList(), folderPath, playFirst});
+    startImport();
+}
+
+void PlayerEngine::startImport()
+{
+    if (importing || importQueue.isEmpty()) return;
+    importing = true;
+    const ImportJob job = importQueue.takeFirst();
+    importPlayFirst = job.playFirst;
+    importFolderPath = job.folderPath;
+    importFound = 0;
+    // Таблица путей не потокобезопасна: в фоне только чтение папки и разбор листов,
+    // отбор новых треков - в handleImportExpanded()
+    importExpandWatcher.setFuture(QtConcurrent::run([job]() {
+        return expandAll(job.folderPath.isEmpty() ? job.filePaths : folderTracks(job.folderPath));
+    }));
+}
+
+void PlayerEngine::handleImportExpanded()
+{
+    const QStringList expanded = importExpandWatcher.result();
+    importFound = expanded.size();
+    importPlayPath = importPlayFirst ? expanded.value(0) : QString();
+    importCandidates = filterCandidates(expanded, &importCandidatePaths);
+    if (importCandidates.isEmpty()) {
+        finishImport(0);
+        return;
+    }
+    importProbeWatcher.setFuture(QtConcurrent::mapped(importCandidatePaths, &FormatProbe::probe));
+}
+
+void PlayerEngine::handleImportProbed()
+{
+    finishImport(acceptProbes(importCandidates, importCandidatePaths, importProbeWatcher.future().results()));
+}
+
+void PlayerEngine::finishImport(int added)
+{
+    importCandidates.clear();
+    importCandidatePaths.clear();
+    const QString playPath = importPlayPath;
+    const QString folderPath = importFolderPath;
+    importPlayPath.clear();
+    importFolderPath.clear();
+    importing = false;
+
+    emit importFinished(added, importFound, folderPath);
+    if (!playPath.isEmpty()) playFile(playPath);
+    startImport();
+}
+
+QList<TrackId> PlayerEngine::filterCandidates(const QStringList &expanded, QStringList *candidatePaths)
+{
+    // Карантинные файлы повторно не проверяем - только через releaseFromQuarantine()
+    QList<TrackId> candidates;
+    candidatePaths->clear();
+    QSet<TrackId> seen;
+    for (const QString &filePath : expanded) {
+        const TrackId id = internTrack(filePath);
+        if (!inLibrary.at(id) && !quarantine.contains(id) && !seen.contains(id)) {
+            seen.insert(id);
+            candidates.append(id);
+            candidatePaths->append(filePath);
+        }
+    }
+    return candidates;
+}
+
+int PlayerEngine::acceptProbes(const QList<TrackId> &candidates, const QStringList &candidatePaths,
+                               const QList<ProbeResult> &probes)
+{
+    const QDateTime now = QDateTime::currentDateTime();
+    QList<TrackId> added;
+    bool quarantineChanged = false;
+    for (int i = 0; i < candidates.size() && i < probes.size(); ++i) {
+        const TrackId id = candidates.at(i);
+        // Пока заголовки читались в фоне, трек мог прийти другим путём
+        if (inLibrary.at(id) || quarantine.contains(id)) continue;
+
+        const ProbeResult &probe = probes.at(i);
+        if (!probe.isPlayable()) {
+            quarantine.insert(id, probe.error);
+            quarantineChanged = true;
+            emit trackQuarantined(candidatePaths.at(i), probe.error);
+            continue;
+        }
+
+        inLibrary[id] = true;
+        allTracks.append(id);
+        TrackStats &stats = trackStatistics[id];
+        stats.added = now;
+        stats.durationMs = probe.durationMs;
+        added.append(id);
+    }
+
+    if (quarantineChanged) {
+        saveQuarantine();
+    }
+
+    if (!added.isEmpty()) {
+        saveTrackList();
+        scheduleStatisticsSave();
+        emit tracksChanged();
+        emit tracksAdded(added);
+        rebuildPlaylist();
+    }
+    return added.size();
+}
+
+QStringList PlayerEngine::search(const QString &text) const
+{
+    return table.paths(matching(text));
+}
+
+void PlayerEngine::setFilter(const QString &text)
+{
+    filterText = text;
+    rebuildPlaylist();
+}
+
+QStringList PlayerEngine::quarantined() const
+{
+    QStringList result;
+    for (auto it = quarantine.constBegin(); it != quarantine.constEnd(); ++it) {
+        result.append(table.path(it.key()));
+    }
+    result.sort();
+    return result;
+}
+
+QString PlayerEngine::quarantineReason(const QString &filePath) const
+{
+    return quarantine.value(table.find(filePath));
+}
+
+int PlayerEngine::releaseFromQuarantine(const QString &filePath)
+{
+    // Файл могли исправить - проверяем заново
+    if (!quarantine.remove(table.find(filePath))) return 0;
+    saveQuarantine();
+    return addTracks({filePath});
+}
+
+bool PlayerEngine::removeTrack(const QString &filePath)
+{
+    const TrackId id = table.find(filePath);
+    if (!contains(id)) return false;
+    removeTracks({id});
+    return true;
+}
+
+void PlayerEngine::removeTracks(const QList<TrackId> &ids)
+{
+    bool queueTouched = false;
+    for (TrackId id : ids) {
+        const QString filePath = table.path(id);
+        musicCollection->removeTrackFromAllCollections(filePath);
+        trackAnalyzer->forget(id);
+        MappedFileCache::instance().invalidate(VirtualTrack::fromPath(filePath).filePath);
+        inLibrary[id] = false;
+        allTracks.removeOne(id);
+        queueTouched = upNext.removeAll(id) > 0 || queueTouched;
+        trackStatistics[id] = TrackStats();
+
+        // Если удаляемый трек был текущим, останавливаем воспроизведение;
+        // в истории прослушиваний он остаётся
+        if (currentId == id) {
+            stop();
+            currentId = TrackTable::InvalidId;
+        }
+    }
+
+    saveTrackList();
+    scheduleStatisticsSave();
+    if (queueTouched) emit queueChanged();
+    emit tracksChanged();
+    for (TrackId id : ids) {
+        emit trackRemoved(table.path(id));
+    }
+    rebuildPlaylist();
+}
+
+QList<TrackId> PlayerEngine::tracksOfFile(const QString &filePath) const
+{
+    // Целый файл и все его дорожки или главы
+    QList<TrackId> ids;
+    for (TrackId id : allTracks) {
+        const QString path = table.path(id);
+        if (path.startsWith(filePath) && VirtualTrack::fromPath(path).filePath == filePath) ids.append(id);
+    }
+    return ids;
+}
+
+bool PlayerEngine::checkFileOperation(const QString &filePath, QString *errorString) const
+{
+    QString error;
+    if (VirtualTrack::isVirtual(filePath)) {
+        error = "track is a part of " + QFileInfo(VirtualTrack::fromPath(filePath).filePath).fileName();
+    } else if (fileOps->isBusy(filePath)) {
+        error = "another operation with this file is in progress";
+    } else if (!QFileInfo::exists(filePath)) {
+        error = "no such file";
+    }
+    if (errorString) *errorString = error;
+    return error.isEmpty();
+}
+
+bool PlayerEngine::renameTrack(const QString &filePath, const QString &newBaseName, QString *errorString)
+{
+    if (!checkFileOperation(filePath, errorString)) return false;
+
+    const QFileInfo fileInfo(filePath);
+    const QString newPath = fileInfo.path() + "/" + newBaseName + "." + fileInfo.suffix();
+    if (newBaseName.isEmpty() || newBaseName.contains('/') || newPath == filePath) {
+        if (errorString) *errorString = "invalid name";
+        return false;
+    }
+    if (QFileInfo::exists(newPath)) {
+        if (errorString) *errorString = "file already exists";
+        return false;
+    }
+    return fileOps->rename(filePath, newPath) != 0;
+}
+
+bool PlayerEngine::moveTrack(const QString &filePath, const QString &targetDir, QString *errorString)
+{
+    if (!checkFileOperation(filePath, errorString)) return false;
+
+    const QString newPath = QDir(targetDir).absoluteFilePath(QFileInfo(filePath).fileName());
+    if (QFileInfo(newPath) == QFileInfo(filePath)) {
+        if (errorString) *errorString = "file is already there";
+        return false;
+    }
+    if (QFileInfo::exists(newPath)) {
+        if (errorString) *errorString = "file already exists";
+        return false;
+    }
+    return fileOps->move(filePath, newPath) != 0;
+}
+
+bool PlayerEngine::trashTrack(const QString &filePath, QString *errorString)
+{
+    if (!checkFileOperation(filePath, errorString)) return false;
+    // Отмена вернёт файл и его треки в библиотеку
+    return fileOps->trash(filePath, table.paths(tracksOfFile(filePath))) != 0;
+}
+
+bool PlayerEngine::retagTrack(const QString &filePath, const TrackTags &tags, QString *errorString)
+{
+    if (!checkFileOperation(filePath, errorString)) return false;
+    if (!FileOperations::canRetag()) {
+        if (errorString) *errorString = "ffmpeg not found";
+        return false;
+    }
+    return fileOps->retag(filePath, tags) != 0;
+}
+
+bool PlayerEngine::undoFileOperation()
+{
+    return fileOps->undo() != 0;
+}
+
+void PlayerEngine::handleFileOperation(const FileOperation &operation)
+{
+    if (operation.state != FileOperation::Done) {
+        emit fileOperationFailed(operation.source, operation.error);
+        return;
+    }
+
+    switch (operation.kind) {
+    case FileOperation::Rename:
+    case FileOperation::Move:
+        relocateFile(operation.source, operation.target);
+        break;
+    case FileOperation::Trash:
+        removeTracks(tracksOfFile(operation.source));
+        break;
+    case FileOperation::Restore:
+        importTracks(operation.tracks);
+        break;
+    case FileOperation::Retag: {
+        MappedFileCache::instance().invalidate(operation.source);
+        const QList<TrackId> ids = tracksOfFile(operation.source);
+        for (TrackId id : ids) {
+            emit trackTagsChanged(table.path(id));
+        }
+        break;
+    }
+    }
+}
+
+void PlayerEngine::relocateFile(const QString &oldFile, const QString &newFile)
+{
+    MappedFileCache::instance().invalidate(oldFile);
+
+    // Все треки файла (целый и его дорожки) переезжают в одном проходе, сигналы - после
+    // того как согласованы все структуры. Новый путь - новый идентификатор, старый
+    // просто перестаёт использоваться
+    QList<QPair<TrackId, TrackId>> moved;
+    for (TrackId oldId : tracksOfFile(oldFile)) {
+        const TrackId newId = internTrack(newFile + table.path(oldId).mid(oldFile.size()));
+        moved.append({oldId, newId});
+    }
+
+    bool queueTouched = false;
+    for (const auto &pair : std::as_const(moved)) {
+        const TrackId oldId = pair.first;
+        const TrackId newId = pair.second;
+        allTracks.replace(allTracks.indexOf(oldId), newId);
+        inLibrary[oldId] = false;
+        inLibrary[newId] = true;
+        trackStatistics[newId] = trackStatistics.at(oldId);
+        trackStatistics[oldId] = TrackStats();
+        // Звучание файла не изменилось - описатель переезжает на новый идентификатор
+        if (!trackAnalyzer->relabel(oldId, newId)) {
+            trackAnalyzer->analyze(newId, trackStatistics.at(newId).durationMs);
+        }
+        queueTouched = upNext.replaceAll(oldId, newId) > 0 || queueTouched;
+        if (currentId == oldId) currentId = newId;
+        if (mixId == oldId) mixId = newId;
+    }
+
+    // Деки продолжают играть уже открытое отображение; запоминаем новое имя файла
+    for (QMediaPlayer *deck : {player, mixPlayer}) {
+        if (deckFiles.value(deck) == oldFile) deckFiles.insert(deck, newFile);
+    }
+    if (currentRange.filePath == oldFile) currentRange.filePath = newFile;
+    if (mixRange.filePath == oldFile) mixRange.filePath = newFile;
+
+    for (const auto &pair : std::as_const(moved)) {
+        musicCollection->replaceTrackInAllCollections(table.path(pair.first), table.path(pair.second));
+    }
+    saveTrackList();
+    scheduleStatisticsSave();
+    if (queueTouched) emit queueChanged();
+    emit tracksChanged();
+    for (const auto &pair : std::as_const(moved)) {
+        emit trackRenamed(table.path(pair.first), table.path(pair.second));
+    }
+    rebuildPlaylist();
+}
+
+void PlayerEngine::playTrack(int index)
+{
+    if (index < 0 || index >= playlist.size()) return;
+
+    stopRadio();
+    setContext(PlaybackContext(libraryKind(), filterText, playlist, index));
+    // Явный выбор - повторная попытка для трека, который не удалось воспроизвести
+    playbackFailures.remove(context.current());
+    startSource(context.current());
+}
+
+bool PlayerEngine::playCollection(const QString &name, int index)
+{
+    const QList<TrackId> tracks = smart->contains(name) ? smart->trackIds(name)
+                                                        : musicCollection->trackIds(name);
+    if (index < 0 || index >= tracks.size()) return false;
+
+    stopRadio();
+    setContext(PlaybackContext(PlaybackContext::Collection, name, tracks, index));
+    playbackFailures.remove(context.current());
+    if (isSkipped(context.current())) {
+        next();
+    } else {
+        startSource(context.current());
+    }
+    return true;
+}
+
+void PlayerEngine::playFile(const QString &filePath)
+{
+    // Лист CUE или файл с главами играется с первой дорожки
+    const QStringList parts = CueSheet::expand(filePath);
+    if (parts.isEmpty()) return;
+    if (parts.first() != filePath) {
+        addTracks({filePath});
+        playFile(parts.first());
+        return;
+    }
+
+    const TrackId id = internTrack(filePath);
+    int index = playlist.indexOf(id);
+    if (index < 0) {
+        addTracks({filePath});
+        index = playlist.indexOf(id);
+    }
+    if (index < 0) {
+        // Трек скрыт фильтром поиска - играем его вне контекста
+        playbackFailures.remove(id);
+        if (!isSkipped(id)) {
+            startSource(id);
+        }
+        return;
+    }
+    playTrack(index);
+}
+
+void PlayerEngine::play()
+{
+    if (context.isEmpty() && upNext.isEmpty()) return;
+
+    if (player->mediaStatus() == QMediaPlayer::NoMedia ||
+        player->playbackState() == QMediaPlayer::StoppedState) {
+        if (context.cursor() < 0) {
+            next();
+        } else {
+            startSource(context.current());
+        }
+    } else {
+        player->play();
+        m_currentTrackStartTime = QDateTime::currentMSecsSinceEpoch();
+    }
+}
+
+void PlayerEngine::pause()
+{
+    abortMix();
+    boundaryTimer->stop();
+    pendingStartMs = -1;
+    updatePlaybackStatistics();
+    player->pause();
+}
+
+void PlayerEngine::stop()
+{
+    abortMix();
+    boundaryTimer->stop();
+    pendingStartMs = -1;
+    updatePlaybackStatistics();
+    finishListening(false);
+    player->stop();
+}
+
+void PlayerEngine::next()
+{
+    if (radioActive && upNext.size() < radioLowWater) {
+        refillRadio();
+    }
+
+    // Очередь "далее" имеет приоритет; курсор контекста при этом стоит на месте
+    int taken = 0;
+    while (!upNext.isEmpty()) {
+        const TrackId id = upNext.takeFirst();
+        ++taken;
+        if (isSkipped(id)) continue;
+
+        playingQueued = true;
+        notifyQueueChanged(QueueEdit::HeadTaken, taken);
+        startSource(id);
+        return;
+    }
+    if (taken > 0) notifyQueueChanged(QueueEdit::HeadTaken, taken);
+    playingQueued = false;
+
+    if (context.isEmpty()) return;
+
+    if (shuffleMode) {
+        playRandomTrack();
+        return;
+    }
+
+    const TrackId id = step(1);
+    if (id == TrackTable::InvalidId) {
+        stop();
+        context.setCursor(-1);
+        currentTrackIndex = -1;
+        return;
+    }
+    startSource(id);
+}
+
+void PlayerEngine::previous()
+{
+    if (position() > 3000 || context.cursor() <= 0) {
+        seek(0);
+        return;
+    }
+
+    playingQueued = false;
+    const TrackId id = step(-1);
+    if (id == TrackTable::InvalidId) {
+        seek(0);
+    } else {
+        startSource(id);
+    }
+}
+
+void PlayerEngine::seek(qint64 positionMs)
+{
+    abortMix();
+    boundaryTimer->stop();
+    const qint64 target = currentRange.startMs() + positionMs;
+    playbackMonitor->markSeek(target);
+    player->setPosition(target);
+}
+
+void PlayerEngine::enqueue(const QString &filePath)
+{
+    upNext.append(internTrack(filePath));
+    notifyQueueChanged(QueueEdit::Appended, 1);
+    schedulePrefetch();
+}
+
+void PlayerEngine::enqueue(const QList<TrackId> &ids)
+{
+    if (ids.isEmpty()) return;
+    upNext.append(ids);
+    notifyQueueChanged(QueueEdit::Appended, ids.size());
+    schedulePrefetch();
+}
+
+void PlayerEngine::playNext(const QString &filePath)
+{
+    playNext(QList<TrackId>{internTrack(filePath)});
+}
+
+void PlayerEngine::playNext(const QList<TrackId> &ids)
+{
+    if (ids.isEmpty()) return;
+    upNext.insert(0, ids);
+    emit queueChanged();
+    schedulePrefetch();
+}
+
+bool PlayerEngine::moveQueued(int from, int count, int to)
+{
+    if (!upNext.move(from, count, to)) return false;
+    emit queueChanged();
+    // Прогреваем только голову очереди, перестановки дальше неё его не меняют
+    if (qMin(from, to) < prefetch->depth()) schedulePrefetch();
+    return true;
+}
+
+void PlayerEngine::removeQueued(int from, int count)
+{
+    if (from < 0 || count <= 0 || from >= upNext.size()) return;
+    upNext.removeRange(from, count);
+    emit queueChanged();
+    if (from < prefetch->depth()) schedulePrefetch();
+}
+
+void PlayerEngine::clearQueue()
+{
+    stopRadio();
+    if (upNext.isEmpty()) return;
+    upNext.clear();
+    emit queueChanged();
+    schedulePrefetch();
+}
+
+bool PlayerEngine::startRadio(const QString &filePath)
+{
+    const TrackId seed = table.find(filePath);
+    if (!contains(seed) || !trackAnalyzer->isIndexed(seed)) return false;
+
+    radioActive = true;
+    radioSeed = seed;
+    radioAnchor = seed;
+    radioPlayed = {seed};
+    radioPlayedOrder = {seed};
+    radioSkipped.clear();
+
+    // Эфир заменяет очередь целиком и начинается с самого трека
+    upNext.clear();
+    upNext.append(radioPicks(radioBatch));
+    emit radioChanged(true);
+    if (currentId == seed) {
+        emit queueChanged();
+        schedulePrefetch();
+    } else {
+        upNext.insert(0, seed);
+        next();
+    }
+    return true;
+}
+
+void PlayerEngine::stopRadio()
+{
+    if (!radioActive) return;
+    radioActive = false;
+    radioPlayed.clear();
+    radioPlayedOrder.clear();
+    radioSkipped.clear();
+    emit radioChanged(false);
+}
+
+void PlayerEngine::refillRadio()
+{
+    const QList<TrackId> picks = radioPicks(radioBatch - upNext.size());
+    if (picks.isEmpty()) return;
+    upNext.append(picks);
+    notifyQueueChanged(QueueEdit::Appended, picks.size());
+}
+
+void PlayerEngine::notifyQueueChanged(QueueEdit::Kind kind, int count)
+{
+    queueEdit = {kind, count};
+    emit queueChanged();
+    queueEdit = QueueEdit();
+}
+
+QList<TrackId> PlayerEngine::radioPicks(int count)
+{
+    if (count <= 0) return {};
+    const TrackId anchor = trackAnalyzer->isIndexed(radioAnchor) ? radioAnchor : radioSeed;
+    if (!trackAnalyzer->isIndexed(anchor)) return {};
+
+    // Кандидатов берём с запасом: уже игравшие отсеются, остальные переранжируются
+    const SimilarityIndex &index = trackAnalyzer->index();
+    const QList<SimilarityIndex::Neighbour> candidates = index.similar(anchor, count * 4 + radioPlayedMemory);
+
+    struct Pick {
+        TrackId id;
+        double score;
+    };
+    QList<Pick> picks;
+    for (const SimilarityIndex::Neighbour &candidate : candidates) {
+        if (!contains(candidate.id) || isSkipped(candidate.id) || radioPlayed.contains(candidate.id)) {
+            continue;
+        }
+
+        // Трек, который обычно пропускают, опускается тем ниже, чем чаще это бывает
+        const TrackStats &stats = trackStatistics.at(candidate.id);
+        const double skipRate = stats.playCount > 0 ? qMin(1.0, double(stats.skipCount) / stats.playCount) : 0.0;
+        double score = candidate.distance * (1.0 + 2.0 * skipRate);
+
+        // Ближе к пропущенному в этом эфире, чем к якорю - уводит туда, откуда слушатель ушёл
+        for (TrackId skippedId : std::as_const(radioSkipped)) {
+            const float distance = index.distance(candidate.id, skippedId);
+            if (distance >= 0.0f && distance < candidate.distance) {
+                score *= 1.5;
+            }
+        }
+        picks.append({candidate.id, score});
+    }
+    std::stable_sort(picks.begin(), picks.end(), [](const Pick &a, const Pick &b) {
+        return a.score < b.score;
+    });
+
+    QList<TrackId> result;
+    for (const Pick &pick : std::as_const(picks)) {
+        if (result.size() >= count) break;
+        result.append(pick.id);
+        radioPlayed.insert(pick.id);
+        radioPlayedOrder.append(pick.id);
+        if (radioPlayedOrder.size() > radioPlayedMemory) radioPlayed.remove(radioPlayedOrder.takeFirst());
+    }
+    return result;
+}
+
+QList<TrackId> PlayerEngine::upcoming(int count) const
+{
+    // Тот же порядок, что и в next(): очередь, затем заранее выбранные
+    // случайные треки или продолжение контекста
+    QList<TrackId> result;
+    for (int i = 0; i < upNext.size(); ++i) {
+        if (result.size() >= count) return result;
+        const TrackId id = upNext.at(i);
+        if (!isSkipped(id)) result.append(id);
+    }
+
+    if (shuffleMode) {
+        for (int index : shuffleAhead) {
+            if (result.size() >= count) break;
+            result.append(context.at(index));
+        }
+    } else {
+        for (int i = context.cursor() + 1; i < context.size() && result.size() < count; ++i) {
+            if (!isSkipped(context.at(i))) result.append(context.at(i));
+        }
+    }
+    return result;
+}
+
+void PlayerEngine::setAutomix(bool enabled)
+{
+    if (automixEnabled == enabled) return;
+    automixEnabled = enabled;
+    if (enabled) {
+        mixTimer->start();
+    } else {
+        abortMix();
+        mixTimer->stop();
+        player->setPlaybackRate(userRate);
+    }
+    emit automixChanged(enabled);
+}
+
+void PlayerEngine::setVolume(float volume)
+{
+    // Во время перехода громкости дек выставляет updateMix() относительно заданной
+    userVolume = qBound(0.0f, volume, 1.0f);
+    if (mixState != MixFading) audioOutput->setVolume(userVolume);
+}
+
+void PlayerEngine::setPlaybackRate(float rate)
+{
+    userRate = rate;
+    player->setPlaybackRate(rate);
+    if (mixState != MixIdle) mixPlayer->setPlaybackRate(rate * mixPlan.rate);
+}
+
+void PlayerEngine::setShuffle(bool enabled)
+{
+    shuffleMode = enabled;
+    shuffleAhead.clear();
+    schedulePrefetch();
+}
+
+void PlayerEngine::saveTrackList() const
+{
+    QSettings settings;
+    settings.beginGroup("TrackList");
+    settings.setValue("tracks", table.paths(allTracks));
+    settings.endGroup();
+}
+
+void PlayerEngine::loadTrackList()
+{
+    QSettings settings;
+    settings.beginGroup("TrackList");
+    const QStringList storedTracks = settings.value("tracks").toStringList();
+    settings.endGroup();
+
+    inLibrary.fill(false);
+    allTracks.clear();
+    allTracks.reserve(storedTracks.size());
+    for (const QString &filePath : storedTracks) {
+        const TrackId id = internTrack(filePath);
+        if (!inLibrary.at(id)) {
+            inLibrary[id] = true;
+            allTracks.append(id);
+        }
+    }
+
+    // Статистика: путь -> [число прослушиваний, время, последний раз, добавлен]
+    trackStatistics.fill(TrackStats());
+    settings.beginGroup("TrackStats");
+    const QVariantMap stored = settings.value("stats").toMap();
+    settings.endGroup();
+    for (auto it = stored.constBegin(); it != stored.constEnd(); ++it) {
+        const QVariantList values = it.value().toList();
+        if (values.size() < 4) continue;
+
+        TrackStats &stats = trackStatistics[internTrack(it.key())];
+        stats.playCount = values.at(0).toInt();
+        stats.totalPlayTime = values.at(1).toLongLong();
+        stats.lastPlayed = values.at(2).toDateTime();
+        stats.added = values.at(3).toDateTime();
+        stats.durationMs = values.value(4).toLongLong();
+        stats.skipCount = values.value(5).toInt();
+    }
+
+    quarantine.clear();
+    settings.beginGroup("Quarantine");
+    const QVariantMap storedQuarantine = settings.value("tracks").toMap();
+    settings.endGroup();
+    for (auto it = storedQuarantine.constBegin(); it != storedQuarantine.constEnd(); ++it) {
+        const TrackId id = internTrack(it.key());
+        quarantine.insert(id, it.value().toString());
+        if (inLibrary.at(id)) {
+            inLibrary[id] = false;
+            allTracks.removeOne(id);
+        }
+    }
+
+    emit tracksChanged();
+    emit tracksAdded(allTracks);
+    rebuildPlaylist();
+
+    // Операции, прерванные прошлым запуском, доводятся по журналу и применяются к списку
+    fileOps->recover();
+}
+
+void PlayerEngine::saveStatistics() const
+{
+    // Храним только треки библиотеки: у удалённых и переименованных статистика сброшена
+    QVariantMap stored;
+    for (TrackId id : allTracks) {
+        const TrackStats &stats = trackStatistics.at(id);
+        stored.insert(table.path(id), QVariantList{stats.playCount, stats.totalPlayTime,
+                                                   stats.lastPlayed, stats.added, stats.durationMs,
+                                                   stats.skipCount});
+    }
+
+    QSettings settings;
+    settings.beginGroup("TrackStats");
+    settings.setValue("stats", stored);
+    settings.endGroup();
+}
+
+void PlayerEngine::saveQuarantine() const
+{
+    QVariantMap stored;
+    for (auto it = quarantine.constBegin(); it != quarantine.constEnd(); ++it) {
+        stored.insert(table.path(it.key()), it.value());
+    }
+
+    QSettings settings;
+    settings.beginGroup("Quarantine");
+    settings.setValue("tracks", stored);
+    settings.endGroup();
+}
+
+void PlayerEngine::handleMediaStatusChanged(QMediaPlayer::MediaStatus status)
+{
+    if (sender() != player) {
+        // Входящий не декодируется - переход отменяется; в свой черёд трек не сыграет, будет
+        // отмечен неудачным и пропускаться до повторной попытки
+        if (sender() == mixPlayer && status == QMediaPlayer::InvalidMedia && mixState != MixIdle) {
+            mixDeclined = currentId;
+            abortMix();
+        }
+        return;
+    }
+
+    if (pendingStartMs >= 0 && (status == QMediaPlayer::LoadedMedia || status == QMediaPlayer::BufferedMedia)) {
+        // Отрезок внутри файла: перематываем до первого звука, затем запускаем
+        player->setPosition(pendingStartMs);
+        pendingStartMs = -1;
+        player->play();
+        return;
+    }
+
+    if (status == QMediaPlayer::EndOfMedia) {
+        if (mixState == MixFading) {
+            completeMix();
+            return;
+        }
+        abortMix();
+        updatePlaybackStatistics();
+        finishListening(true);
+        next();
+    } else if (status == QMediaPlayer::InvalidMedia && currentId != TrackTable::InvalidId) {
+        // Заголовок прошёл проверку, но декодер не справился. Причина может быть временной -
+        // диск отключён, файл ещё пишется, - поэтому трек остаётся в библиотеке, а переходы
+        // обходят его, пока не выйдет срок повтора или пока его не выберут явно
+        pendingStartMs = -1;
+        const QString reason = player->errorString().isEmpty() ? QString("cannot decode")
+                                                               : player->errorString();
+        updatePlaybackStatistics();
+        // Неиграбельный трек не прослушивание и не пропуск: в историю не пишем
+        listening = false;
+        playbackFailures.insert(currentId, QDateTime::currentMSecsSinceEpoch());
+        emit trackFailed(table.path(currentId), reason);
+        if (context.cursor() >= 0) {
+            next();
+        } else {
+            stop();
+        }
+    }
+}
+
+bool PlayerEngine::isSkipped(TrackId id) const
+{
+    if (quarantine.contains(id)) return true;
+    const auto failure = playbackFailures.constFind(id);
+    return failure != playbackFailures.constEnd()
+           && QDateTime::currentMSecsSinceEpoch() - failure.value() < playbackRetryMs;
+}
+
+void PlayerEngine::updatePlaybackStatistics()
+{
+    if (player->playbackState() == QMediaPlayer::PlayingState && currentId != TrackTable::InvalidId) {
+        qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
+        trackStatistics[currentId].totalPlayTime += currentTime - m_currentTrackStartTime;
+        listenedMs += currentTime - m_currentTrackStartTime;
+        m_currentTrackStartTime = currentTime;
+        scheduleStatisticsSave();
+    }
+}
+
+void PlayerEngine::scheduleStatisticsSave()
+{
+    // Не перезапускаем: при непрерывном воспроизведении запись всё равно должна случиться
+    if (!statsSaveTimer->isActive()) statsSaveTimer->start();
+}
+
+void PlayerEngine::playRandomTrack()
+{
+    // Случайный порядок выбирается заранее, чтобы его можно было прогреть
+    while (!shuffleAhead.isEmpty()) {
+        const int index = shuffleAhead.takeFirst();
+        if (index != context.cursor() && !isSkipped(context.at(index))) {
+            context.setCursor(index);
+            startSource(context.current());
+            return;
+        }
+    }
+
+    int newIndex;
+    do {
+        newIndex = QRandomGenerator::global()->bounded(context.size());
+    } while (newIndex == context.cursor() && context.size() > 1);
+
+    context.setCursor(newIndex);
+    startSource(context.current());
+}
+
+void PlayerEngine::finishListening(bool completed)
+{
+    if (!listening) return;
+    listening = false;
+    if (currentId == TrackTable::InvalidId) return;
+
+    // Пропуск - ушли с трека, не дослушав до половины (до 30 с, если длительность неизвестна)
+    const qint64 duration = trackStatistics.at(currentId).durationMs;
+    const bool skipped = !completed && listenedMs < (duration > 0 ? duration / 2 : 30000);
+    // Теги из кэша умных коллекций избавляют историю от чтения файла
+    TrackTags tags;
+    const bool tagsKnown = smart->cachedTags(currentId, &tags);
+    history->record(table.path(currentId), listenStartedAt, listenedMs, skipped, tagsKnown ? &tags : nullptr);
+
+    if (skipped) {
+        trackStatistics[currentId].skipCount++;
+        scheduleStatisticsSave();
+    }
+    if (radioActive) {
+        if (skipped) {
+            radioSkipped.append(currentId);
+            if (radioSkipped.size() > radioSkipMemory) radioSkipped.removeFirst();
+        } else if (trackAnalyzer->isIndexed(currentId)) {
+            radioAnchor = currentId;
+        }
+    }
+}
+
+void PlayerEngine::startSource(TrackId id)
+{
+    // После перехода входящий трек уже звучит на этой деке
+    const bool handover = mixHandover && id == mixId;
+    if (!handover) abortMix();
+    updatePlaybackStatistics();
+    finishListening(false);
+
+    currentId = id;
+    mixDeclined = TrackTable::InvalidId;
+    currentTrackIndex = (!playingQueued && isLibraryContext() && context.current() == id) ? context.cursor() : -1;
+    const QString filePath = table.path(id);
+    currentRange = VirtualTrack::fromPath(filePath);
+    boundaryTimer->stop();
+    // Виртуальные треки не греются - в попадания и промахи они не входят
+    prefetch->trackStarted(currentRange.isWhole() ? currentRange.filePath : QString());
+    if (!handover) {
+        const QMediaPlayer::MediaStatus status = player->mediaStatus();
+        const bool loaded = pendingStartMs < 0 && deckFiles.value(player) == currentRange.filePath
+                            && (status == QMediaPlayer::LoadedMedia || status == QMediaPlayer::BufferingMedia
+                                || status == QMediaPlayer::BufferedMedia || status == QMediaPlayer::EndOfMedia);
+        if (loaded) {
+            // Файл уже открыт на деке: соседний отрезок звучит дальше без перезагрузки
+            // и без паузы, к дальнему - только перемотка
+            if (qAbs(player->position() - currentRange.startMs()) > gaplessToleranceMs) {
+                playbackMonitor->markSeek(currentRange.startMs());
+                player->setPosition(currentRange.startMs());
+            }
+            player->play();
+        } else {
+            playbackMonitor->markTrackStart();
+            setDeckSource(player, currentRange.filePath);
+            pendingStartMs = currentRange.startMs() > 0 ? currentRange.startMs() : -1;
+            if (pendingStartMs < 0) player->play();
+        }
+    }
+
+    m_currentTrackStartTime = QDateTime::currentMSecsSinceEpoch();
+    schedulePrefetch();
+
+    listening = true;
+    listenStartedAt = m_currentTrackStartTime;
+    listenedMs = 0;
+
+    TrackStats &stats = trackStatistics[currentId];
+    stats.playCount++;
+    stats.lastPlayed = QDateTime::currentDateTime();
+    scheduleStatisticsSave();
+
+    emit currentTrackChanged(currentTrackIndex, filePath);
+    emit trackStatsChanged(filePath);
+    emit durationChanged(duration());
+}
+
+void PlayerEngine::handlePositionChanged(qint64 filePosition)
+{
+    // Пока дека не перемотана к началу отрезка, её позиция ещё не позиция трека
+    if (sender() != player || pendingStartMs >= 0) return;
+    emit positionChanged(position());
+
+    if (currentRange.endUs < 0 || currentId == TrackTable::InvalidId || mixState == MixFading) return;
+    const qint64 remaining = currentRange.endMs() - filePosition;
+    if (remaining <= 0) {
+        finishRange();
+    } else if (remaining <= rangeLookaheadMs && !boundaryTimer->isActive()
+               && player->playbackState() == QMediaPlayer::PlayingState) {
+        // Позиция приходит раз в несколько десятков миллисекунд - конец ловим таймером
+        boundaryTimer->start(int(remaining / qMax(0.1, double(player->playbackRate()))));
+    }
+}
+
+void PlayerEngine::handleDurationChanged()
+{
+    if (sender() == player) emit durationChanged(duration());
+}
+
+void PlayerEngine::finishRange()
+{
+    boundaryTimer->stop();
+    if (currentId == TrackTable::InvalidId || currentRange.endUs < 0 || mixState == MixFading) return;
+    // Таймер мог опередить декодер, но не больше чем на запас упреждения
+    if (player->position() < currentRange.endMs() - rangeLookaheadMs) return;
+
+    // Конец отрезка - как конец файла; соседний отрезок того же файла продолжится с той же деки
+    abortMix();
+    updatePlaybackStatistics();
+    finishListening(true);
+    if (context.isEmpty() && upNext.isEmpty()) {
+        // Трек играл вне контекста - дальше в файле уже не он
+        stop();
+        return;
+    }
+    next();
+}
+
+void PlayerEngine::updateMix()
+{
+    // После перехода скорость плавно возвращается к заданной, без скачка высоты
+    const double rate = player->playbackRate();
+    if (mixState != MixFading && std::abs(rate - userRate) > 1e-6) {
+        player->setPlaybackRate(std::abs(userRate - rate) <= mixRateStep ? userRate
+                                : rate + (userRate > rate ? mixRateStep : -mixRateStep));
+    }
+    if (currentId == TrackTable::InvalidId || player->playbackState() != QMediaPlayer::PlayingState) return;
+
+    const qint64 position = this->position();
+    switch (mixState) {
+    case MixIdle: {
+        // Длительность становится известна после загрузки источника
+        if (mixDeclined == currentId || pendingStartMs >= 0 || duration() <= 0) return;
+        const TrackId incoming = upcoming(1).value(0, TrackTable::InvalidId);
+        if (incoming == TrackTable::InvalidId) return;
+
+        // Стык соседних дорожек образа и так бесшовный - его не сводим
+        const VirtualTrack incomingRange = VirtualTrack::fromPath(table.path(incoming));
+        if (currentRange.endUs >= 0 && incomingRange.filePath == currentRange.filePath
+            && incomingRange.startUs == currentRange.endUs) {
+            mixDeclined = currentId;
+            return;
+        }
+
+        const Automix::Plan plan = Automix::plan(trackAnalyzer->tempo(currentId), duration(),
+                                                 trackAnalyzer->tempo(incoming),
+                                                 trackStatistics.at(incoming).durationMs);
+        if (!plan.isValid()) {
+            mixDeclined = currentId;
+            return;
+        }
+        if (position < plan.startMs - mixPreloadMs) return;
+        if (position > plan.startMs + plan.fadeMs / 2) {
+            // Перемотали за начало перехода - доиграем до конца без него
+            mixDeclined = currentId;
+            return;
+        }
+        mixPlan = plan;
+        armMix(incoming);
+        return;
+    }
+    case MixArmed:
+        // Очередь поменялась, пока входящий загружался
+        if (upcoming(1).value(0, TrackTable::InvalidId) != mixId) {
+            abortMix();
+            return;
+        }
+        if (!mixPositioned) {
+            const QMediaPlayer::MediaStatus status = mixPlayer->mediaStatus();
+            if (status != QMediaPlayer::LoadedMedia && status != QMediaPlayer::BufferedMedia) return;
+            mixPlayer->setPosition(mixRange.startMs() + mixPlan.incomingStartMs);
+            mixPositioned = true;
+        }
+        if (position >= mixPlan.startMs - mixTickMs / 2) startMix();
+        return;
+    case MixFading: {
+        const qint64 elapsed = position - mixPlan.startMs;
+        if (mixPlan.beatMatched && !mixCorrected && elapsed >= mixPhaseCheckMs) {
+            // Дека стартует с запаздыванием на такт таймера и больше: одна поправка,
+            // пока входящий ещё почти не слышен
+            const qint64 expected = mixRange.startMs() + mixPlan.incomingStartMs + qRound64(elapsed * mixPlan.rate);
+            if (qAbs(mixPlayer->position() - expected) > mixPhaseToleranceMs) mixPlayer->setPosition(expected);
+            mixCorrected = true;
+        }
+
+        // Равная мощность: сумма квадратов громкостей дек постоянна
+        const double progress = qBound(0.0, double(elapsed) / mixPlan.fadeMs, 1.0);
+        audioOutput->setVolume(float(userVolume * std::cos(progress * halfPi)));
+        mixOutput->setVolume(float(userVolume * std::sin(progress * halfPi)));
+        if (progress >= 1.0) completeMix();
+        return;
+    }
+    }
+}
+
+void PlayerEngine::setDeckSource(QMediaPlayer *deck, const QString &filePath)
+{
+    // Дека читает страницы общего отображения - тех же, что уже прочли теги и прогрев.
+    // Файлы с сетевых и съёмных дисков кэш не отображает: их сбой чтения стал бы SIGBUS.
+    // Такие, огромные и неоткрывшиеся файлы дека читает сама по URL
+    QIODevice *previous = deckDevices.take(deck);
+    deckFiles.insert(deck, filePath);
+    const QUrl url = filePath.isEmpty() ? QUrl() : QUrl::fromLocalFile(filePath);
+    const MappedFile mapped = filePath.isEmpty() ? MappedFile() : MappedFileCache::instance().open(filePath);
+    if (mapped.isValid()) {
+        QIODevice *device = mapped.createDevice(deck);
+        deckDevices.insert(deck, device);
+        deck->setSourceDevice(device, url);
+    } else {
+        deck->setSource(url);
+    }
+    // Прежнее устройство дека уже отпустила, но удаляем его после возврата в цикл событий
+    if (previous) previous->deleteLater();
+}
+
+void PlayerEngine::armMix(TrackId id)
+{
+    mixId = id;
+    mixState = MixArmed;
+    mixPositioned = false;
+    mixCorrected = false;
+    mixOutput->setVolume(0.0f);
+    mixRange = VirtualTrack::fromPath(table.path(id));
+    setDeckSource(mixPlayer, mixRange.filePath);
+    mixPlayer->setPlaybackRate(userRate * mixPlan.rate);
+    mixPlayer->pause();
+}
+
+void PlayerEngine::startMix()
+{
+    mixState = MixFading;
+    mixPlayer->play();
+}
+
+void PlayerEngine::completeMix()
+{
+    updatePlaybackStatistics();
+    finishListening(true);
+
+    std::swap(player, mixPlayer);
+    std::swap(audioOutput, mixOutput);
+    pendingStartMs = -1;
+    boundaryTimer->stop();
+    mixPlayer->stop();
+    setDeckSource(mixPlayer, QString());
+    mixOutput->setVolume(0.0f);
+    audioOutput->setVolume(userVolume);
+    mixState = MixIdle;
+    playbackMonitor->setPlayer(player);
+    emit mediaPlayerChanged(player);
+
+    // Дальше как при обычном переходе: курсор, очередь, статистика - без перезагрузки источника
+    mixHandover = true;
+    next();
+    mixHandover = false;
+    mixId = TrackTable::InvalidId;
+}
+
+void PlayerEngine::abortMix()
+{
+    if (mixState == MixIdle) return;
+    mixState = MixIdle;
+    mixId = TrackTable::InvalidId;
+    mixPlayer->stop();
+    setDeckSource(mixPlayer, QString());
+    mixOutput->setVolume(0.0f);
+    audioOutput->setVolume(userVolume);
+}
+
+void PlayerEngine::analyzeTracks(const QList<TrackId> &ids)
+{
+    for (TrackId id : ids) {
+        trackAnalyzer->analyze(id, trackStatistics.at(id).durationMs);
+    }
+}
+
+TrackId PlayerEngine::internTrack(const QString &filePath)
+{
+    // Коллекции тоже добавляют пути в таблицу, поэтому выравниваем по её размеру
+    const TrackId id = table.intern(filePath);
+    if (trackStatistics.size() < table.size()) {
+        trackStatistics.resize(table.size());
+        inLibrary.resize(table.size(), false);
+    }
+    return id;
+}
+
+bool PlayerEngine::contains(TrackId id) const
+{
+    return id < TrackId(inLibrary.size()) && inLibrary.at(id);
+}
+
+QList<TrackId> PlayerEngine::matching(const QString &text) const
+{
+    if (text.isEmpty()) return allTracks;
+
+    QList<TrackId> result;
+    for (TrackId id : allTracks) {
+        // У дорожек образа ищем и по названию, и по имени файла образа
+        if (table.fileName(id).contains(text, Qt::CaseInsensitive)
+            || (VirtualTrack::isVirtual(table.path(id)) && displayName(id).contains(text, Qt::CaseInsensitive))) {
+            result.append(id);
+        }
+    }
+    return result;
+}
+
+void PlayerEngine::schedulePrefetch()
+{
+    const int depth = prefetch->depth();
+    if (shuffleMode) {
+        // Без повторов: кроме текущего в контексте может быть меньше треков, чем глубина
+        const int wanted = qMin(depth, context.size() - 1);
+        while (shuffleAhead.size() < wanted) {
+            const int index = QRandomGenerator::global()->bounded(context.size());
+            if (index != context.cursor() && !shuffleAhead.contains(index)) shuffleAhead.append(index);
+        }
+    }
+
+    QList<Prefetcher::Request> requests;
+    const QList<TrackId> ids = upcoming(depth);
+    for (TrackId id : ids) {
+        // Прогрев читает начало файла; дорожка образа или глава начинается в его середине,
+        // и прогретая голова образа ей не поможет - такие треки не греем
+        const VirtualTrack range = VirtualTrack::fromPath(table.path(id));
+        if (!range.isWhole()) continue;
+        requests.append({range.filePath, trackStatistics.value(id).durationMs});
+    }
+    prefetch->prefetch(requests);
+}
+
+TrackId PlayerEngine::step(int delta)
+{
+    TrackId id;
+    do {
+        id = context.step(delta);
+    } while (id != TrackTable::InvalidId && isSkipped(id));
+    return id;
+}
+
+void PlayerEngine::setContext(const PlaybackContext &newContext)
+{
+    context = newContext;
+    playingQueued = false;
+    shuffleAhead.clear();
+}
+
+PlaybackContext::Kind PlayerEngine::libraryKind() const
+{
+    return filterText.isEmpty() ? PlaybackContext::Library : PlaybackContext::Filtered;
+}
+
+bool PlayerEngine::isLibraryContext() const
+{
+    return context.kind() == PlaybackContext::Library || context.kind() == PlaybackContext::Filtered;
+}
+
+void PlayerEngine::rebuildPlaylist()
+{
+    // Вид библиотеки следует за фильтром, курсор остаётся на том же треке;
+    // контекст коллекции не трогаем
+    const TrackId anchor = context.current();
+    playlist = matching(filterText);
+    if (isLibraryContext()) {
+        context = PlaybackContext(libraryKind(), filterText, playlist, playlist.indexOf(anchor));
+        shuffleAhead.clear();
+    }
+    currentTrackIndex = (!playingQueued && isLibraryContext()) ? context.cursor() : -1;
+    emit playlistChanged();
+}
@@ -0,0 +1,326 @@
+#ifndef PLAYERENGINE_H
+#define PLAYERENGINE_H
+
+#include <QObject>
+#include <QMediaPlayer>
+#include <QAudioOutput>
+#include <QStringList>
+#include <QDateTime>
+#include <QMap>
+#include <QSet>
+#include <QTimer>
+#include <QFutureWatcher>
+#include "tracktable.h"
+#include "playbackcontext.h"
+#include "playqueue.h"
+#include "automix.h"
+#include "virtualtrack.h"
+#include "fileoperations.h"
+#include "formatprobe.h"
+
+class MusicCollection;
+class PlaybackMonitor;
+class SmartCollections;
+class Prefetcher;
+class CollectionExporter;
+class ListeningHistory;
+class TrackAnalyzer;
+class PowerScheduler;
+
+// Ядро воспроизведения без виджетов: список треков, плейлист, очередь,
+// коллекции и статистика прослушиваний
+class PlayerEngine : public QObject
+{
+    Q_OBJECT
+public:
+    struct TrackStats {
+        int playCount = 0;
+        qint64 totalPlayTime = 0;
+        QDateTime lastPlayed;
+        QDateTime added;
+        qint64 durationMs = 0;
+        int skipCount = 0;
+    };
+
+    explicit PlayerEngine(QObject *parent = nullptr);
+    ~PlayerEngine();
+
+    QMediaPlayer *mediaPlayer() const { return player; }
+    MusicCollection *collections() const { return musicCollection; }
+    PlaybackMonitor *monitor() const { return playbackMonitor; }
+    SmartCollections *smartCollections() const { return smart; }
+    Prefetcher *prefetcher() const { return prefetch; }
+    CollectionExporter *exporter() const { return collectionExporter; }
+    ListeningHistory *listeningHistory() const { return history; }
+    TrackAnalyzer *analyzer() const { return trackAnalyzer; }
+    FileOperations *fileOperations() const { return fileOps; }
+    PowerScheduler *powerScheduler() const { return power; }
+    const TrackTable &trackTable() const { return table; }
+
+    QStringList tracks() const;
+    QStringList currentPlaylist() const;
+    QStringList queue() const;
+    const PlayQueue &playQueue() const { return upNext; }
+    // Что сделал с очередью текущий queueChanged - чтобы модель сдвинула строки,
+    // а не сбрасывала вид. Вне обработчиков сигнала и для прочих правок - Reset
+    struct QueueEdit {
+        enum Kind {
+            Reset,
+            HeadTaken,                  // сняты count первых элементов
+            Appended                    // count элементов добавлены в конец
+        };
+        Kind kind = Reset;
+        int count = 0;
+    };
+    QueueEdit lastQueueEdit() const { return queueEdit; }
+    QList<TrackId> playlistIds() const { return playlist; }
+    QList<TrackId> upcoming(int count) const;
+    const PlaybackContext &playbackContext() const { return context; }
+    PlaybackContext::Kind contextKind() const { return playingQueued ? PlaybackContext::Queue : context.kind(); }
+    // Строка текущего трека в currentPlaylist(), -1 если играет коллекция или очередь
+    int currentIndex() const;
+    QString currentFilePath() const;
+    bool isShuffle() const;
+    float playbackRate() const;
+    TrackStats trackStats(const QString &filePath) const;
+    TrackStats trackStats(TrackId id) const;
+    bool hasTrack(TrackId id) const { return contains(id); }
+    // Имя для списков: имя файла, у дорожки образа или главы - её название
+    QString displayName(TrackId id) const;
+    // Позиция и длительность текущего трека; у виртуального - от начала его отрезка в файле
+    qint64 position() const;
+    qint64 duration() const;
+
+    // Новые файлы проверяются по заголовкам параллельно, неиграбельные
+    // попадают в карантин и в библиотеку не добавляются. Листы CUE и файлы
+    // с главами раскрываются в виртуальные треки; папка с листом отдаёт его
+    // дорожки вместо целого образа. addTracks и loadFolder ждут конца проверки - для
+    // файлов, которые нужны сразу; из GUI библиотека пополняется через importTracks
+    int addTracks(const QStringList &filePaths);
+    int loadFolder(const QString &folderPath);
+    // То же в фоне: импорты выполняются по одному в порядке вызова, итог - importFinished.
+    // playFirst - по готовности начать с первого трека импорта
+    void importTracks(const QStringList &filePaths, bool playFirst = false);
+    void importFolder(const QString &folderPath, bool playFirst = false);
+    bool isImporting() const { return importing; }
+    QStringList search(const QString &text) const;
+    void setFilter(const QString &text);
+
+    QStringList quarantined() const;
+    QString quarantineReason(const QString &filePath) const;
+    int releaseFromQuarantine(const QString &filePath);
+
+    bool removeTrack(const QString &filePath);
+
+    // Операции с файлами идут в фоне через FileOperations: библиотека, коллекции, очередь
+    // и статистика обновляются разом, когда файл уже на месте, ошибка приходит сигналом
+    // fileOperationFailed. false - операцию нельзя поставить, причина в errorString.
+    // Дорожку образа или главу отдельно от файла не переименовать, не перенести и не удалить
+    bool renameTrack(const QString &filePath, const QString &newBaseName, QString *errorString = nullptr);
+    bool moveTrack(const QString &filePath, const QString &targetDir, QString *errorString = nullptr);
+    bool trashTrack(const QString &filePath, QString *errorString = nullptr);
+    bool retagTrack(const QString &filePath, const TrackTags &tags, QString *errorString = nullptr);
+    bool undoFileOperation();
+
+    void playTrack(int index);
+    void playFile(const QString &filePath);
+    bool playCollection(const QString &name, int index = 0);
+    void play();
+    void pause();
+    void stop();
+    void next();
+    void previous();
+    void seek(qint64 positionMs);
+    void enqueue(const QString &filePath);
+
+    // Очередь "далее": вставка, перенос и удаление диапазонов без копирования всей очереди
+    void enqueue(const QList<TrackId> &ids);
+    void playNext(const QString &filePath);
+    void playNext(const QList<TrackId> &ids);
+    bool moveQueued(int from, int count, int to);
+    void removeQueued(int from, int count);
+    void clearQueue();
+
+    // Радио: очередь заполняется похожими по звучанию треками и пополняется по мере
+    // прослушивания. Направление задаёт последний дослушанный трек, пропуски отодвигают
+    // похожих на пропущенные кандидатов. false, если трек ещё не проанализирован
+    bool startRadio(const QString &filePath);
+    void stopRadio();
+    bool isRadio() const { return radioActive; }
+
+    // Автомикс: соседние треки сводятся на второй деке - по долям, если темпы близки,
+    // иначе обычным кроссфейдом. Пауза, перемотка и ручное переключение отменяют переход
+    void setAutomix(bool enabled);
+    bool isAutomix() const { return automixEnabled; }
+
+    void setVolume(float volume);
+    void setPlaybackRate(float rate);
+    void setShuffle(bool enabled);
+
+    void saveTrackList() const;
+    void loadTrackList();
+    void saveStatistics() const;
+    void scheduleStatisticsSave();
+
+signals:
+    void currentTrackChanged(int index, const QString &filePath);
+    void tracksChanged();
+    void tracksAdded(const QList<TrackId> &ids);
+    void trackRemoved(const QString &filePath);
+    void trackRenamed(const QString &oldPath, const QString &newPath);
+    void trackTagsChanged(const QString &filePath);
+    void fileOperationFailed(const QString &filePath, const QString &error);
+    void trackStatsChanged(const QString &filePath);
+    void trackQuarantined(const QString &filePath, const QString &reason);
+    // found - сколько треков нашлось, включая уже известные; folderPath - у импорта папки
+    void importFinished(int added, int found, const QString &folderPath);
+    // Декодер не справился с треком; он остаётся в библиотеке и будет попробован снова
+    void trackFailed(const QString &filePath, const QString &reason);
+    void playlistChanged();
+    void queueChanged();
+    void radioChanged(bool active);
+    void automixChanged(bool enabled);
+    // После перехода звучит другая дека - подписки на позицию и состояние нужно перенести
+    void mediaPlayerChanged(QMediaPlayer *player);
+    // Позиция и длительность в смысле position()/duration()
+    void positionChanged(qint64 position);
+    void durationChanged(qint64 duration);
+
+private slots:
+    void handleMediaStatusChanged(QMediaPlayer::MediaStatus status);
+    void updatePlaybackStatistics();
+    void updateMix();
+    void handlePositionChanged(qint64 filePosition);
+    void handleDurationChanged();
+    void finishRange();
+    void handleFileOperation(const FileOperation &operation);
+
+private:
+    enum MixState {
+        MixIdle,
+        MixArmed,                       // входящий загружается на второй деке
+        MixFading
+    };
+
+    // Объявлена первой: коллекции получают указатель на неё при создании
+    TrackTable table;
+
+    QMediaPlayer *player;
+    QAudioOutput *audioOutput;
+    QMediaPlayer *mixPlayer;
+    QAudioOutput *mixOutput;
+    // Создаётся до остальных частей ядра: они ставят на него свои периодические задачи
+    PowerScheduler *power;
+    QHash<QMediaPlayer*, QIODevice*> deckDevices;   // отображённый файл, из которого читает дека
+    QHash<QMediaPlayer*, QString> deckFiles;        // какой файл открыт на деке
+    MusicCollection *musicCollection;
+    PlaybackMonitor *playbackMonitor;
+    SmartCollections *smart;
+    Prefetcher *prefetch;
+    CollectionExporter *collectionExporter;
+    ListeningHistory *history;
+    TrackAnalyzer *trackAnalyzer;
+    FileOperations *fileOps;
+
+    QList<TrackId> allTracks;
+    QList<bool> inLibrary;
+    QList<TrackId> playlist;
+    PlayQueue upNext;
+    QueueEdit queueEdit;
+    PlaybackContext context;
+    bool playingQueued = false;
+    QList<int> shuffleAhead;            // индексы в context
+    QString filterText;
+    TrackId currentId;
+    int currentTrackIndex;
+    bool shuffleMode;
+    // Отрезок текущего трека в файле деки; у обычного трека - весь файл
+    VirtualTrack currentRange;
+    qint64 pendingStartMs = -1;         // перемотать к началу отрезка, когда файл загрузится
+
+    // Индекс - идентификатор трека в table
+    QList<TrackStats> trackStatistics;
+    QHash<TrackId, QString> quarantine;             // заголовок не прошёл проверку - навсегда
+    QHash<TrackId, qint64> playbackFailures;        // сбой декодера в этой сессии: когда случился
+
+    struct ImportJob {
+        QStringList filePaths;
+        QString folderPath;             // вместо filePaths - содержимое папки
+        bool playFirst = false;
+    };
+    QList<ImportJob> importQueue;
+    bool importing = false;
+    bool importPlayFirst = false;
+    QString importPlayPath;
+    QString importFolderPath;
+    int importFound = 0;
+    QFutureWatcher<QStringList> importExpandWatcher;
+    QFutureWatcher<ProbeResult> importProbeWatcher;
+    QList<TrackId> importCandidates;
+    QStringList importCandidatePaths;
+    qint64 m_currentTrackStartTime = 0;
+
+    // Текущее прослушивание для истории: с какого момента и сколько реально играло
+    bool listening = false;
+    qint64 listenStartedAt = 0;
+    qint64 listenedMs = 0;
+
+    bool radioActive = false;
+    TrackId radioSeed = TrackTable::InvalidId;
+    TrackId radioAnchor = TrackTable::InvalidId;
+    QSet<TrackId> radioPlayed;          // недавно побывали в эфире - не повторяем
+    QList<TrackId> radioPlayedOrder;    // те же треки по порядку: старые выпадают из radioPlayed
+    QList<TrackId> radioSkipped;        // последние пропуски в этом эфире
+
+    bool automixEnabled = false;
+    QTimer *mixTimer;
+    QTimer *boundaryTimer;              // точный конец отрезка внутри файла
+    QTimer *statsSaveTimer;             // отложенная запись статистики
+    MixState mixState = MixIdle;
+    TrackId mixId = TrackTable::InvalidId;
+    TrackId mixDeclined = TrackTable::InvalidId;  // переход для этого трека уже не успеть
+    Automix::Plan mixPlan;
+    VirtualTrack mixRange;
+    bool mixPositioned = false;
+    bool mixCorrected = false;
+    bool mixHandover = false;
+    float userVolume = 0.7f;
+    float userRate = 1.0f;
+
+    void playRandomTrack();
+    void finishListening(bool completed);
+    QList<TrackId> radioPicks(int count);
+    void refillRadio();
+    void armMix(TrackId id);
+    void setDeckSource(QMediaPlayer *deck, const QString &filePath);
+    void startMix();
+    void completeMix();
+    void abortMix();
+    void analyzeTracks(const QList<TrackId> &ids);
+    TrackId internTrack(const QString &filePath);
+    QList<TrackId> filterCandidates(const QStringList &expanded, QStringList *candidatePaths);
+    int acceptProbes(const QList<TrackId> &candidates, const QStringList &candidatePaths,
+                     const QList<ProbeResult> &probes);
+    void startImport();
+    void handleImportExpanded();
+    void handleImportProbed();
+    void finishImport(int added);
+    bool contains(TrackId id) const;
+    bool isSkipped(TrackId id) const;
+    void notifyQueueChanged(QueueEdit::Kind kind, int count);
+    void removeTracks(const QList<TrackId> &ids);
+    QList<TrackId> tracksOfFile(const QString &filePath) const;
+    bool checkFileOperation(const QString &filePath, QString *errorString) const;
+    void relocateFile(const QString &oldFile, const QString &newFile);
+    void saveQuarantine() const;
+    QList<TrackId> matching(const QString &text) const;
+    void startSource(TrackId id);
+    void schedulePrefetch();
+    TrackId step(int delta);
+    void setContext(const PlaybackContext &newContext);
+    PlaybackContext::Kind libraryKind() const;
+    bool isLibraryContext() const;
+    void rebuildPlaylist();
+};
+
+#endif // PLAYERENGINE_H
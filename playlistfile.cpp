@@ -0,0 +1,175 @@
+#include "playlistfile.h"
+#include "virtualtrack.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QUrl>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+#include <QtConcurrent>
+
+PlaylistFile::Format PlaylistFile::formatForFile(const QString &fileName)
+{
+    const QString suffix = QFileInfo(fileName).suffix().toLower();
+    if (suffix == "m3u") return M3U;
+    if (suffix == "m3u8") return M3U8;
+    if (suffix == "pls") return PLS;
+    if (suffix == "xspf") return XSPF;
+    return Unknown;
+}
+
+QString PlaylistFile::fileDialogFilter()
+{
+    return QStringLiteral("Playlists (*.m3u *.m3u8 *.pls *.xspf)");
+}
+
+QStringList PlaylistFile::read(const QString &fileName, QString *errorString)
+{
+    const Format format = formatForFile(fileName);
+    if (format == Unknown) {
+        if (errorString) *errorString = "Unsupported playlist format";
+        return QStringList();
+    }
+
+    const QStringList entries = readEntries(fileName, format, errorString);
+    return resolveEntries(entries, QFileInfo(fileName).absolutePath());
+}
+
+QStringList PlaylistFile::readEntries(const QString &fileName, Format format, QString *errorString)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorString) *errorString = file.errorString();
+        return QStringList();
+    }
+
+    QStringList entries;
+
+    if (format == XSPF) {
+        QXmlStreamReader xml(&file);
+        while (!xml.atEnd()) {
+            if (xml.readNext() == QXmlStreamReader::StartElement && xml.name() == QLatin1String("location")) {
+                // location в XSPF - URI, относительные тоже закодированы
+                const QString location = xml.readElementText().trimmed();
+                entries.append(location.contains("://") ? location
+                                                        : QUrl::fromPercentEncoding(location.toUtf8()));
+            }
+        }
+        if (xml.hasError() && errorString) {
+            *errorString = xml.errorString();
+        }
+        return entries;
+    }
+
+    // M3U и PLS читаем построчно, не загружая файл целиком
+    while (!file.atEnd()) {
+        const QByteArray rawLine = file.readLine().trimmed();
+        if (rawLine.isEmpty()) continue;
+
+        const QString line = format == M3U ? QString::fromLocal8Bit(rawLine)
+                                           : QString::fromUtf8(rawLine);
+        if (format == PLS) {
+            if (line.startsWith("File", Qt::CaseInsensitive)) {
+                const int equals = line.indexOf('=');
+                if (equals > 0) entries.append(line.mid(equals + 1));
+            }
+        } else if (!line.startsWith('#')) {
+            entries.append(line);
+        }
+    }
+    return entries;
+}
+
+QStringList PlaylistFile::resolveEntries(const QStringList &entries, const QString &baseDir)
+{
+    const QDir base(baseDir);
+
+    // Проверка существования - самое дорогое на сетевых дисках, делаем параллельно
+    const QStringList resolved = QtConcurrent::blockingMapped<QStringList>(entries,
+        [base](const QString &entry) -> QString {
+            QString path = entry;
+            if (path.startsWith("file:", Qt::CaseInsensitive)) {
+                path = QUrl(path).toLocalFile();
+            } else if (path.contains("://")) {
+                return QString(); // потоковые URL не поддерживаются
+            }
+
+            // У дорожки образа проверяется сам образ, отрезок сохраняется как был
+            VirtualTrack range = VirtualTrack::fromPath(path);
+            path = range.filePath;
+            path.replace('\\', '/');
+            if (QDir::isRelativePath(path)) {
+                path = base.absoluteFilePath(path);
+            }
+            range.filePath = QDir::cleanPath(path);
+            return QFileInfo::exists(range.filePath) ? range.path() : QString();
+        });
+
+    QStringList tracks;
+    tracks.reserve(resolved.size());
+    for (const QString &path : resolved) {
+        if (!path.isEmpty()) tracks.append(path);
+    }
+    return tracks;
+}
+
+bool PlaylistFile::write(const QString &fileName, const QStringList &tracks, QString *errorString)
+{
+    const Format format = formatForFile(fileName);
+    if (format == Unknown) {
+        if (errorString) *errorString = "Unsupported playlist format";
+        return false;
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+
+    const QDir base(QFileInfo(fileName).absolutePath());
+    auto entryFor = [&base](const QString &track) {
+        const QString relative = base.relativeFilePath(track);
+        return relative.startsWith("..") ? track : relative;
+    };
+
+    if (format == XSPF) {
+        QXmlStreamWriter xml(&file);
+        xml.setAutoFormatting(true);
+        xml.writeStartDocument();
+        xml.writeStartElement("playlist");
+        xml.writeAttribute("version", "1");
+        xml.writeDefaultNamespace("http://xspf.org/ns/0/");
+        xml.writeStartElement("trackList");
+        for (const QString &track : tracks) {
+            xml.writeStartElement("track");
+            xml.writeTextElement("location", QUrl::fromLocalFile(track).toString(QUrl::FullyEncoded));
+            xml.writeTextElement("title", VirtualTrack::displayName(track));
+            xml.writeEndElement();
+        }
+        xml.writeEndElement();
+        xml.writeEndElement();
+        xml.writeEndDocument();
+    } else if (format == PLS) {
+        file.write("[playlist]\n");
+        for (int i = 0; i < tracks.size(); ++i) {
+            file.write(QString("File%1=%2\n").arg(i + 1).arg(entryFor(tracks.at(i))).toUtf8());
+            file.write(QString("Title%1=%2\n").arg(i + 1).arg(VirtualTrack::displayName(tracks.at(i))).toUtf8());
+        }
+        file.write(QString("NumberOfEntries=%1\nVersion=2\n").arg(tracks.size()).toUtf8());
+    } else {
+        file.write("#EXTM3U\n");
+        for (const QString &track : tracks) {
+            const QString lines = QString("#EXTINF:-1,%1\n%2\n")
+                                      .arg(VirtualTrack::displayName(track), entryFor(track));
+            file.write(format == M3U ? lines.toLocal8Bit() : lines.toUtf8());
+        }
+    }
+
+    if (!file.commit()) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+    return true;
+}
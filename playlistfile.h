@@ -0,0 +1,33 @@
+#ifndef PLAYLISTFILE_H
+#define PLAYLISTFILE_H
+
+#include <QString>
+#include <QStringList>
+
+// Чтение и запись плейлистов M3U/M3U8, PLS и XSPF.
+// Файлы читаются потоково, пути резолвятся параллельно.
+class PlaylistFile
+{
+public:
+    enum Format {
+        Unknown,
+        M3U,
+        M3U8,
+        PLS,
+        XSPF
+    };
+
+    static Format formatForFile(const QString &fileName);
+    static QString fileDialogFilter();
+
+    // Ждёт проверки всех путей - на сетевом диске это долго, вызывать вне GUI-потока
+    static QStringList read(const QString &fileName, QString *errorString = nullptr);
+    static bool write(const QString &fileName, const QStringList &tracks,
+                      QString *errorString = nullptr);
+
+private:
+    static QStringList readEntries(const QString &fileName, Format format, QString *errorString);
+    static QStringList resolveEntries(const QStringList &entries, const QString &baseDir);
+};
+
+#endif // PLAYLISTFILE_H
@@ -0,0 +1,249 @@
+#include "playqueue.h"
+
+TrackId PlayQueue::at(int index) const
+{
+    if (index < 0 || index >= total) return TrackTable::InvalidId;
+    int chunk = 0;
+    int offset = 0;
+    locate(index, &chunk, &offset);
+    return chunks.at(chunk).at(offset);
+}
+
+TrackId PlayQueue::takeFirst()
+{
+    if (total == 0) return TrackTable::InvalidId;
+
+    // Снятие с начала QList не сдвигает данные, поэтому next() - O(1)
+    const TrackId id = chunks.first().takeFirst();
+    --total;
+    if (chunks.first().isEmpty()) {
+        chunks.removeFirst();
+        rebuildTree();
+    } else {
+        adjust(0, -1);
+    }
+    return id;
+}
+
+void PlayQueue::insert(int index, TrackId id)
+{
+    index = qBound(0, index, total);
+    if (chunks.isEmpty()) {
+        chunks.append(QList<TrackId>{id});
+        total = 1;
+        rebuildTree();
+        return;
+    }
+
+    int chunk = 0;
+    int offset = 0;
+    locate(index, &chunk, &offset);
+    QList<TrackId> &target = chunks[chunk];
+    target.insert(offset, id);
+    ++total;
+
+    if (target.size() > chunkSize) {
+        // Переполненный блок делим пополам; перестройка дерева случается раз на chunkSize/2 вставок
+        chunks.insert(chunk + 1, target.mid(chunkSize / 2));
+        chunks[chunk].resize(chunkSize / 2);
+        rebuildTree();
+    } else {
+        adjust(chunk, 1);
+    }
+}
+
+void PlayQueue::insert(int index, const QList<TrackId> &ids)
+{
+    if (ids.isEmpty()) return;
+    if (ids.size() == 1) {
+        insert(index, ids.first());
+        return;
+    }
+
+    index = qBound(0, index, total);
+    int chunk = chunks.size();
+    int offset = 0;
+    if (!chunks.isEmpty()) locate(index, &chunk, &offset);
+
+    if (chunk < chunks.size() && chunks.at(chunk).size() + ids.size() <= chunkSize) {
+        QList<TrackId> &target = chunks[chunk];
+        target.insert(offset, ids.size(), TrackTable::InvalidId);
+        std::copy(ids.cbegin(), ids.cend(), target.begin() + offset);
+        total += ids.size();
+        adjust(chunk, ids.size());
+        return;
+    }
+
+    // Большая вставка: режем блок в точке вставки и кладём между половинами новые блоки
+    QList<QList<TrackId>> pieces;
+    QList<TrackId> tail;
+    if (chunk < chunks.size()) {
+        tail = chunks.at(chunk).mid(offset);
+        chunks[chunk].resize(offset);
+    }
+    for (int i = 0; i < ids.size(); i += chunkSize) {
+        pieces.append(ids.mid(i, chunkSize));
+    }
+    if (!tail.isEmpty()) pieces.append(tail);
+
+    int insertAt = chunk < chunks.size() ? chunk + 1 : chunks.size();
+    if (chunk < chunks.size() && chunks.at(chunk).isEmpty()) {
+        chunks.removeAt(chunk);
+        --insertAt;
+    }
+    for (int i = 0; i < pieces.size(); ++i) {
+        chunks.insert(insertAt + i, pieces.at(i));
+    }
+    total += ids.size();
+    rebuildTree();
+}
+
+void PlayQueue::removeRange(int from, int count)
+{
+    from = qBound(0, from, total);
+    count = qBound(0, count, total - from);
+    if (count == 0) return;
+
+    int chunk = 0;
+    int offset = 0;
+    locate(from, &chunk, &offset);
+    total -= count;
+
+    int left = count;
+    bool structural = false;
+    while (left > 0) {
+        QList<TrackId> &target = chunks[chunk];
+        const int removed = qMin(left, int(target.size()) - offset);
+        target.remove(offset, removed);
+        left -= removed;
+
+        if (target.isEmpty()) {
+            chunks.removeAt(chunk);
+            structural = true;
+        } else {
+            if (!structural) adjust(chunk, -removed);
+            ++chunk;
+        }
+        offset = 0;
+    }
+
+    // Сливаем соседей, если после удаления они вместе помещаются в блок
+    if (chunk > 0 && chunk < chunks.size()
+        && chunks.at(chunk - 1).size() + chunks.at(chunk).size() <= chunkSize / 2) {
+        chunks[chunk - 1].append(chunks.at(chunk));
+        chunks.removeAt(chunk);
+        structural = true;
+    }
+    if (structural) rebuildTree();
+}
+
+bool PlayQueue::move(int from, int count, int to)
+{
+    if (from < 0 || count <= 0 || from + count > total || to < 0 || to > total) return false;
+    if (to >= from && to <= from + count) return true;
+
+    const QList<TrackId> moved = mid(from, count);
+    removeRange(from, count);
+    insert(to > from ? to - count : to, moved);
+    return true;
+}
+
+int PlayQueue::removeAll(TrackId id)
+{
+    int removed = 0;
+    for (QList<TrackId> &chunk : chunks) {
+        removed += chunk.removeAll(id);
+    }
+    if (removed == 0) return 0;
+
+    total -= removed;
+    chunks.removeIf([](const QList<TrackId> &chunk) { return chunk.isEmpty(); });
+    rebuildTree();
+    return removed;
+}
+
+int PlayQueue::replaceAll(TrackId before, TrackId after)
+{
+    int replaced = 0;
+    for (QList<TrackId> &chunk : chunks) {
+        for (TrackId &id : chunk) {
+            if (id == before) {
+                id = after;
+                ++replaced;
+            }
+        }
+    }
+    return replaced;
+}
+
+void PlayQueue::clear()
+{
+    chunks.clear();
+    tree.clear();
+    total = 0;
+}
+
+QList<TrackId> PlayQueue::mid(int from, int count) const
+{
+    from = qBound(0, from, total);
+    if (count < 0 || count > total - from) count = total - from;
+
+    QList<TrackId> result;
+    if (count == 0) return result;
+    result.reserve(count);
+
+    int chunk = 0;
+    int offset = 0;
+    locate(from, &chunk, &offset);
+    while (result.size() < count) {
+        const QList<TrackId> &source = chunks.at(chunk);
+        const int take = qMin(count - int(result.size()), int(source.size()) - offset);
+        result.append(source.mid(offset, take));
+        ++chunk;
+        offset = 0;
+    }
+    return result;
+}
+
+void PlayQueue::locate(int index, int *chunk, int *offset) const
+{
+    if (index >= total) {
+        *chunk = chunks.size() - 1;
+        *offset = chunks.isEmpty() ? 0 : chunks.last().size();
+        return;
+    }
+
+    // Спуск по дереву Фенвика: ищем последний блок, целиком лежащий до index
+    const int count = chunks.size();
+    int step = 1;
+    while (step * 2 <= count) step *= 2;
+
+    int position = 0;
+    int remaining = index;
+    for (; step > 0; step /= 2) {
+        if (position + step <= count && tree.at(position + step) <= remaining) {
+            position += step;
+            remaining -= tree.at(position);
+        }
+    }
+    *chunk = position;
+    *offset = remaining;
+}
+
+void PlayQueue::adjust(int chunk, int delta)
+{
+    for (int i = chunk + 1; i < tree.size(); i += i & -i) {
+        tree[i] += delta;
+    }
+}
+
+void PlayQueue::rebuildTree()
+{
+    const int count = chunks.size();
+    tree.fill(0, count + 1);
+    for (int i = 1; i <= count; ++i) {
+        tree[i] += chunks.at(i - 1).size();
+        const int parent = i + (i & -i);
+        if (parent <= count) tree[parent] += tree.at(i);
+    }
+}
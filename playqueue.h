@@ -0,0 +1,49 @@
+#ifndef PLAYQUEUE_H
+#define PLAYQUEUE_H
+
+#include <QList>
+#include "tracktable.h"
+
+// Очередь "далее": последовательность идентификаторов, разбитая на блоки
+// до chunkSize элементов. Размеры блоков лежат в дереве Фенвика, поэтому поиск
+// позиции - O(log n), а вставка/удаление трогают один блок, а не весь список.
+// Очередь на миллион треков правится без заметных пауз.
+class PlayQueue
+{
+public:
+    static const int chunkSize = 1024;
+
+    int size() const { return total; }
+    bool isEmpty() const { return total == 0; }
+
+    TrackId at(int index) const;
+    TrackId takeFirst();
+
+    void insert(int index, TrackId id);
+    void insert(int index, const QList<TrackId> &ids);
+    void append(TrackId id) { insert(total, id); }
+    void append(const QList<TrackId> &ids) { insert(total, ids); }
+
+    void removeRange(int from, int count);
+    // Переносит count элементов с from так, чтобы они встали перед элементом to
+    // (to - позиция до переноса, как в QAbstractItemModel::moveRows)
+    bool move(int from, int count, int to);
+    int removeAll(TrackId id);
+    int replaceAll(TrackId before, TrackId after);
+    void clear();
+
+    QList<TrackId> mid(int from, int count = -1) const;
+    QList<TrackId> toList() const { return mid(0); }
+
+private:
+    QList<QList<TrackId>> chunks;
+    QList<int> tree;                    // Фенвик по размерам блоков, 1-based
+    int total = 0;
+
+    // Блок и смещение для позиции index в [0, total]
+    void locate(int index, int *chunk, int *offset) const;
+    void adjust(int chunk, int delta);
+    void rebuildTree();
+};
+
+#endif // PLAYQUEUE_H
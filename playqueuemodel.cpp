@@ -0,0 +1,99 @@
+#include "playqueuemodel.h"
+#include "playerengine.h"
+
+PlayQueueModel::PlayQueueModel(PlayerEngine *engine, QObject *parent)
+    : QAbstractListModel(parent),
+    engine(engine),
+    rows(engine->playQueue().size())
+{
+    connect(engine, &PlayerEngine::queueChanged, this, &PlayQueueModel::handleQueueChanged);
+}
+
+int PlayQueueModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : rows;
+}
+
+QVariant PlayQueueModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid()) return QVariant();
+
+    const TrackId id = engine->playQueue().at(index.row());
+    if (id == TrackTable::InvalidId) return QVariant();
+
+    switch (role) {
+    case Qt::DisplayRole:
+        return engine->displayName(id);
+    case Qt::ToolTipRole:
+        return engine->trackTable().path(id);
+    case Qt::UserRole:
+        return id;
+    default:
+        return QVariant();
+    }
+}
+
+Qt::ItemFlags PlayQueueModel::flags(const QModelIndex &index) const
+{
+    // Бросать можно только между строками, не на строку
+    if (!index.isValid()) return Qt::ItemIsDropEnabled;
+    return QAbstractListModel::flags(index) | Qt::ItemIsDragEnabled;
+}
+
+Qt::DropActions PlayQueueModel::supportedDropActions() const
+{
+    return Qt::MoveAction;
+}
+
+bool PlayQueueModel::moveRows(const QModelIndex &sourceParent, int sourceRow, int count,
+                              const QModelIndex &destinationParent, int destinationChild)
+{
+    if (sourceParent.isValid() || destinationParent.isValid()) return false;
+    if (!beginMoveRows(QModelIndex(), sourceRow, sourceRow + count - 1, QModelIndex(), destinationChild)) {
+        return false;
+    }
+
+    editing = true;
+    const bool moved = engine->moveQueued(sourceRow, count, destinationChild);
+    editing = false;
+    endMoveRows();
+    return moved;
+}
+
+bool PlayQueueModel::removeRows(int row, int count, const QModelIndex &parent)
+{
+    if (parent.isValid() || row < 0 || count <= 0 || row + count > rowCount()) return false;
+
+    beginRemoveRows(QModelIndex(), row, row + count - 1);
+    editing = true;
+    engine->removeQueued(row, count);
+    editing = false;
+    rows = engine->playQueue().size();
+    endRemoveRows();
+    return true;
+}
+
+void PlayQueueModel::handleQueueChanged()
+{
+    if (editing) return;
+
+    // Очередь к этому моменту уже изменена, поэтому до end*() rowCount() отдаёт прежнее
+    // число строк из rows. Переход к следующему и дописывание в конец сдвигают строки,
+    // не сбрасывая выделение и прокрутку; прочие правки сбрасывают вид целиком
+    const PlayerEngine::QueueEdit edit = engine->lastQueueEdit();
+    const int size = engine->playQueue().size();
+    if (edit.kind == PlayerEngine::QueueEdit::HeadTaken && edit.count > 0 && rows - edit.count == size) {
+        beginRemoveRows(QModelIndex(), 0, edit.count - 1);
+        rows = size;
+        endRemoveRows();
+    } else if (edit.kind == PlayerEngine::QueueEdit::Appended && edit.count > 0 && rows + edit.count == size) {
+        beginInsertRows(QModelIndex(), rows, size - 1);
+        rows = size;
+        endInsertRows();
+    } else {
+        // Вид с uniformItemSizes не обходит строки при сбросе, так что это дёшево
+        beginResetModel();
+        rows = size;
+        endResetModel();
+    }
+}
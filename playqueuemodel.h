@@ -0,0 +1,34 @@
+#ifndef PLAYQUEUEMODEL_H
+#define PLAYQUEUEMODEL_H
+
+#include <QAbstractListModel>
+
+class PlayerEngine;
+
+// Модель поверх очереди движка: строки не копируются, data() читает очередь напрямую,
+// поэтому вид на миллион треков открывается мгновенно. Перетаскивание идёт через moveRows.
+class PlayQueueModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    explicit PlayQueueModel(PlayerEngine *engine, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+    Qt::DropActions supportedDropActions() const override;
+
+    bool moveRows(const QModelIndex &sourceParent, int sourceRow, int count,
+                  const QModelIndex &destinationParent, int destinationChild) override;
+    bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex()) override;
+
+private slots:
+    void handleQueueChanged();
+
+private:
+    PlayerEngine *engine;
+    bool editing = false;               // правка идёт из модели, сигнал движка не сбрасывает вид
+    int rows = 0;                       // строки, о которых знает вид
+};
+
+#endif // PLAYQUEUEMODEL_H
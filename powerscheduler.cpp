@@ -0,0 +1,208 @@
+#include "powerscheduler.h"
+#include <QAbstractEventDispatcher>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+// Сроки дальше десяти секунд ставим на таймер с точностью до секунды: ОС объединяет такие
+// пробуждения с чужими. Задача может сработать на четверть интервала раньше срока
+static const qint64 veryCoarseDelayMs = 10000;
+static const int earlyRunDivisor = 4;
+
+static qint64 processCpuUs()
+{
+#ifdef Q_OS_UNIX
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return qint64(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+           + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#else
+    return 0;
+#endif
+}
+
+static qint64 processContextSwitches()
+{
+#ifdef Q_OS_UNIX
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+    return qint64(usage.ru_nvcsw) + usage.ru_nivcsw;
+#else
+    return -1;
+#endif
+}
+
+PowerScheduler::PowerScheduler(QObject *parent)
+    : QObject(parent),
+    timer(new QTimer(this))
+{
+    clock.start();
+    stateStartCpuUs = processCpuUs();
+
+    timer->setSingleShot(true);
+    timer->setTimerType(Qt::CoarseTimer);
+    connect(timer, &QTimer::timeout, this, &PowerScheduler::runDue);
+
+    // awake приходит каждый раз, когда цикл событий потока выходит из ожидания -
+    // по какой бы причине это ни случилось: таймер, сокет, звук или перерисовка
+    if (QAbstractEventDispatcher *dispatcher = QAbstractEventDispatcher::instance(thread())) {
+        connect(dispatcher, &QAbstractEventDispatcher::awake, this, [this]() { ++wakeups; });
+    }
+}
+
+int PowerScheduler::addTask(const QString &name, int intervalMs, RunWhen when, QObject *context,
+                            std::function<void()> callback)
+{
+    Task task;
+    task.name = name;
+    task.intervalMs = qMax(1, intervalMs);
+    task.when = when;
+    task.context = context;
+    task.callback = std::move(callback);
+
+    const int id = ++lastTaskId;
+    tasks.insert(id, task);
+    if (context) {
+        connect(context, &QObject::destroyed, this, [this, id]() { removeTask(id); });
+    }
+    reschedule();
+    return id;
+}
+
+void PowerScheduler::removeTask(int id)
+{
+    if (tasks.remove(id) > 0) reschedule();
+}
+
+void PowerScheduler::setTaskEnabled(int id, bool enabled)
+{
+    auto it = tasks.find(id);
+    if (it == tasks.end() || it->enabled == enabled) return;
+    it->enabled = enabled;
+    reschedule();
+}
+
+void PowerScheduler::setPlaying(bool value)
+{
+    if (value == playing) return;
+    changeState([this, value]() { playing = value; });
+}
+
+void PowerScheduler::setVisible(bool value)
+{
+    if (value == visible) return;
+    changeState([this, value]() { visible = value; });
+}
+
+PowerScheduler::State PowerScheduler::state() const
+{
+    if (playing) return visible ? Active : Background;
+    return visible ? Idle : Dormant;
+}
+
+PowerScheduler::Stats PowerScheduler::stats() const
+{
+    const qint64 now = clock.elapsed();
+    Stats result;
+    result.state = state();
+    result.stateMs = now - stateStartMs;
+    result.wakeups = wakeups;
+    result.ticks = ticks;
+    const qint64 sinceQuery = now - lastQueryMs;
+    if (sinceQuery > 0) result.wakeupsPerSecond = (wakeups - lastQueryWakeups) * 1000.0 / sinceQuery;
+    if (result.stateMs > 0) {
+        result.stateWakeupsPerSecond = (wakeups - stateStartWakeups) * 1000.0 / result.stateMs;
+        result.stateCpuPercent = (processCpuUs() - stateStartCpuUs) / 10.0 / result.stateMs;
+    }
+    result.contextSwitches = processContextSwitches();
+    result.tasks = tasks.size();
+    for (const Task &task : tasks) {
+        if (isRunnable(task)) ++result.runnableTasks;
+    }
+    lastQueryMs = now;
+    lastQueryWakeups = wakeups;
+    return result;
+}
+
+QString PowerScheduler::stateName(State state)
+{
+    switch (state) {
+    case Active: return "active";
+    case Background: return "background";
+    case Idle: return "idle";
+    case Dormant: return "dormant";
+    }
+    return QString();
+}
+
+bool PowerScheduler::isRunnable(const Task &task) const
+{
+    if (!task.enabled) return false;
+    switch (task.when) {
+    case Always: return true;
+    case WhilePlaying: return playing;
+    case WhileVisible: return visible;
+    case WhilePlayingVisible: return playing && visible;
+    }
+    return false;
+}
+
+void PowerScheduler::changeState(const std::function<void()> &change)
+{
+    const State previous = state();
+    change();
+    const State current = state();
+    if (current == previous) return;
+
+    stateStartMs = clock.elapsed();
+    stateStartWakeups = wakeups;
+    stateStartCpuUs = processCpuUs();
+    reschedule();
+    emit stateChanged(current);
+}
+
+void PowerScheduler::runDue()
+{
+    ++ticks;
+    dispatching = true;
+    // Задачи могут добавлять и снимать задачи - идём по снимку идентификаторов
+    const QList<int> ids = tasks.keys();
+    for (int id : ids) {
+        auto it = tasks.find(id);
+        if (it == tasks.end() || !isRunnable(*it)) continue;
+        const qint64 now = clock.elapsed();
+        if (it->dueMs < 0 || it->dueMs - now > it->intervalMs / earlyRunDivisor) continue;
+        // Следующий срок - от фактического запуска: задачи одного пробуждения так и идут вместе
+        it->dueMs = now + it->intervalMs;
+        const std::function<void()> callback = it->callback;
+        callback();
+    }
+    dispatching = false;
+    reschedule();
+}
+
+void PowerScheduler::reschedule()
+{
+    if (dispatching) return;
+
+    const qint64 now = clock.elapsed();
+    qint64 earliest = -1;
+    for (Task &task : tasks) {
+        if (!isRunnable(task)) {
+            // Вернувшаяся задача отсчитывает полный интервал, а не догоняет пропущенное
+            task.dueMs = -1;
+            continue;
+        }
+        if (task.dueMs < 0) task.dueMs = now + task.intervalMs;
+        if (earliest < 0 || task.dueMs < earliest) earliest = task.dueMs;
+    }
+
+    if (earliest < 0) {
+        timer->stop();
+        return;
+    }
+    const qint64 delay = qMax<qint64>(0, earliest - now);
+    timer->setTimerType(delay >= veryCoarseDelayMs ? Qt::VeryCoarseTimer : Qt::CoarseTimer);
+    timer->start(int(delay));
+}
@@ -0,0 +1,103 @@
+#ifndef POWERSCHEDULER_H
+#define POWERSCHEDULER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QTimer>
+#include <functional>
+
+// Периодическая работа всего приложения на одном грубом таймере. Каждая задача говорит,
+// когда она нужна: всегда, только во время воспроизведения или только пока окно на экране.
+// На паузе со свёрнутым окном ненужные задачи не просыпаются вовсе, а близкие по сроку
+// выполняются за одно пробуждение. Счётчик пробуждений цикла событий позволяет проверить,
+// что в простое процесс действительно спит.
+class PowerScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    enum State {
+        Active,                         // играет, окно на экране
+        Background,                     // играет, окна нет: свёрнуто, скрыто или headless
+        Idle,                           // пауза или остановка, окно на экране
+        Dormant                         // пауза или остановка, окна нет
+    };
+
+    enum RunWhen {
+        Always,
+        WhilePlaying,
+        WhileVisible,
+        WhilePlayingVisible
+    };
+
+    struct Stats {
+        State state = Dormant;
+        qint64 stateMs = 0;             // сколько в текущем состоянии
+        qint64 wakeups = 0;             // пробуждения цикла событий с запуска
+        qint64 ticks = 0;               // из них - срабатывания общего таймера
+        double wakeupsPerSecond = 0.0;  // с предыдущего запроса stats()
+        double stateWakeupsPerSecond = 0.0;
+        double stateCpuPercent = 0.0;   // процессорное время процесса в текущем состоянии
+        qint64 contextSwitches = -1;    // всех потоков процесса; -1 - ОС не сообщает
+        int tasks = 0;
+        int runnableTasks = 0;
+    };
+
+    explicit PowerScheduler(QObject *parent = nullptr);
+
+    // Задача живёт, пока жив context; интервал - не точный срок: задача может выполниться
+    // на четверть интервала раньше, чтобы попасть в одно пробуждение с соседними
+    int addTask(const QString &name, int intervalMs, RunWhen when, QObject *context,
+                std::function<void()> callback);
+    void removeTask(int id);
+    void setTaskEnabled(int id, bool enabled);
+
+    // Воспроизведение сообщает ядро, видимость окна - GUI; без GUI окна нет
+    void setPlaying(bool playing);
+    void setVisible(bool visible);
+    bool isPlaying() const { return playing; }
+    bool isVisible() const { return visible; }
+    State state() const;
+
+    // Частота пробуждений считается между соседними запросами
+    Stats stats() const;
+
+    static QString stateName(State state);
+
+signals:
+    void stateChanged(PowerScheduler::State state);
+
+private:
+    struct Task {
+        QString name;
+        int intervalMs = 0;
+        RunWhen when = Always;
+        QObject *context = nullptr;
+        std::function<void()> callback;
+        bool enabled = true;
+        qint64 dueMs = -1;              // -1 - срок назначится, когда задача станет нужна
+    };
+
+    QTimer *timer;
+    QElapsedTimer clock;
+    QMap<int, Task> tasks;
+    int lastTaskId = 0;
+    bool playing = false;
+    bool visible = false;
+    bool dispatching = false;
+
+    qint64 wakeups = 0;
+    qint64 ticks = 0;
+    qint64 stateStartMs = 0;
+    qint64 stateStartWakeups = 0;
+    qint64 stateStartCpuUs = 0;
+    mutable qint64 lastQueryMs = 0;
+    mutable qint64 lastQueryWakeups = 0;
+
+    bool isRunnable(const Task &task) const;
+    void changeState(const std::function<void()> &change);
+    void runDue();
+    void reschedule();
+};
+
+#endif // POWERSCHEDULER_H
@@ -0,0 +1,196 @@
+#include "prefetcher.h"
+#include "mappedfile.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const int leadSeconds = 15;
+static const qint64 minWarmBytes = 256 * 1024;
+static const qint64 maxWarmBytes = 16 * 1024 * 1024;
+static const qint64 defaultWarmBytes = 2 * 1024 * 1024;
+static const int maxWarmedEntries = 64;
+
+// Выше - диск (или кэш) быстрее, чем нужно для мгновенного старта, ниже - сеть или HDD
+static const double fastStorage = 200.0 * 1024 * 1024;
+static const double slowStorage = 10.0 * 1024 * 1024;
+
+Prefetcher::Prefetcher(QObject *parent)
+    : QObject(parent)
+{
+    // Один поток: параллельные чтения только мешают головке диска
+    pool.setMaxThreadCount(1);
+}
+
+Prefetcher::~Prefetcher()
+{
+    generation.fetchAndAddRelaxed(1);
+    pool.clear();
+    pool.waitForDone();
+}
+
+int Prefetcher::depth() const
+{
+    if (throughput <= 0) return 2;
+    if (throughput >= fastStorage) return 1;
+    if (throughput <= slowStorage) return maxDepth;
+
+    const double slowness = (fastStorage - throughput) / (fastStorage - slowStorage);
+    return 1 + qRound(slowness * (maxDepth - 1));
+}
+
+void Prefetcher::prefetch(const QList<Request> &requests)
+{
+    const int current = generation.fetchAndAddRelaxed(1) + 1;
+    pool.clear();
+    pending.clear();
+
+    for (const Request &request : requests) {
+        const QString filePath = request.filePath;
+        if (warmed.contains(filePath) || pending.contains(filePath)) continue;
+        pending.insert(filePath);
+
+        const qint64 durationMs = request.durationMs;
+        pool.start([this, filePath, durationMs, current]() {
+            // Пока задание ждало, очередь могла смениться
+            if (generation.loadRelaxed() != current) {
+                QMetaObject::invokeMethod(this, [this, filePath]() {
+                    handleWarmed(filePath, 0, 0, false);
+                }, Qt::QueuedConnection);
+                return;
+            }
+
+            QElapsedTimer timer;
+            timer.start();
+            const qint64 bytes = warm(filePath, warmBytes(filePath, durationMs));
+            const qint64 elapsedUs = timer.nsecsElapsed() / 1000;
+            QMetaObject::invokeMethod(this, [this, filePath, bytes, elapsedUs]() {
+                handleWarmed(filePath, bytes, elapsedUs, bytes > 0);
+            }, Qt::QueuedConnection);
+        });
+    }
+}
+
+void Prefetcher::trackStarted(const QString &filePath)
+{
+    if (filePath.isEmpty()) {
+        // Первый звук такого трека не должен записаться на счёт предыдущего
+        awaitingFirstAudio = false;
+        return;
+    }
+    lastStartWasHit = warmed.contains(filePath);
+    if (lastStartWasHit) {
+        ++hits;
+    } else {
+        ++misses;
+    }
+    awaitingFirstAudio = true;
+}
+
+void Prefetcher::recordFirstAudio(qint64 latencyUs)
+{
+    if (!awaitingFirstAudio) return;
+    awaitingFirstAudio = false;
+
+    if (lastStartWasHit) {
+        hitFirstAudioTotalUs += latencyUs;
+        ++hitFirstAudioCount;
+    } else {
+        missFirstAudioTotalUs += latencyUs;
+        ++missFirstAudioCount;
+    }
+}
+
+Prefetcher::Stats Prefetcher::stats() const
+{
+    Stats result;
+    result.hits = hits;
+    result.misses = misses;
+    result.depth = depth();
+    result.throughputMBps = throughput / (1024.0 * 1024.0);
+    result.bytesWarmed = bytesWarmed;
+    if (hitFirstAudioCount > 0) result.hitFirstAudioUs = hitFirstAudioTotalUs / hitFirstAudioCount;
+    if (missFirstAudioCount > 0) result.missFirstAudioUs = missFirstAudioTotalUs / missFirstAudioCount;
+
+    // Экономия - разница средних времён до звука, умноженная на число попаданий
+    if (result.hitFirstAudioUs >= 0 && result.missFirstAudioUs > result.hitFirstAudioUs) {
+        result.savedUs = (result.missFirstAudioUs - result.hitFirstAudioUs) * hitFirstAudioCount;
+    }
+    return result;
+}
+
+void Prefetcher::handleWarmed(const QString &filePath, qint64 bytes, qint64 elapsedUs, bool done)
+{
+    pending.remove(filePath);
+    if (!done) return;
+
+    bytesWarmed += bytes;
+    warmed.insert(filePath, ++warmCounter);
+    if (warmed.size() > maxWarmedEntries) {
+        // Вытесняем самый старый прогрев: его страницы ОС уже могла выбросить
+        auto oldest = warmed.begin();
+        for (auto it = warmed.begin(); it != warmed.end(); ++it) {
+            if (it.value() < oldest.value()) oldest = it;
+        }
+        warmed.erase(oldest);
+    }
+
+    if (elapsedUs > 0) {
+        const double sample = bytes * 1e6 / elapsedUs;
+        throughput = throughput <= 0 ? sample : throughput * 0.7 + sample * 0.3;
+    }
+}
+
+qint64 Prefetcher::warmBytes(const QString &filePath, qint64 durationMs)
+{
+    // Греем первые leadSeconds секунд звука, оценивая битрейт по размеру файла
+    const qint64 size = QFileInfo(filePath).size();
+    qint64 bytes = durationMs > 0 ? size * leadSeconds * 1000 / durationMs : defaultWarmBytes;
+    bytes = qBound(minWarmBytes, bytes, maxWarmBytes);
+    return qMin(bytes, size);
+}
+
+qint64 Prefetcher::warm(const QString &filePath, qint64 bytes)
+{
+    if (bytes <= 0) return 0;
+
+    // Отображение заводится заранее: дека при старте возьмёт его из общего кэша готовым
+    const MappedFile mapped = MappedFileCache::instance().open(filePath);
+
+#ifdef Q_OS_LINUX
+    // Подсказка только ставит чтение в очередь ядра - крупными запросами на весь объём.
+    // Скорость хранилища по ней не измерить: время ниже - время завершённого чтения
+    const int fd = ::open(QFile::encodeName(filePath).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, bytes, POSIX_FADV_WILLNEED);
+        ::close(fd);
+    }
+#endif
+
+    if (mapped.isValid()) {
+        // Касаемся каждой страницы: данные оседают в кэше ОС без копирования в буфер
+        bytes = qMin(bytes, mapped.size());
+        mapped.willNeed(0, bytes);
+        const uchar *data = mapped.data();
+        volatile uchar sink = 0;
+        for (qint64 offset = 0; offset < bytes; offset += 4096) sink ^= data[offset];
+        return bytes;
+    }
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) return 0;
+
+    // Один буфер на поток: данные не нужны, важен сам факт чтения в кэш ОС
+    static thread_local QByteArray buffer(256 * 1024, Qt::Uninitialized);
+    qint64 total = 0;
+    while (total < bytes) {
+        const qint64 chunk = file.read(buffer.data(), qMin<qint64>(buffer.size(), bytes - total));
+        if (chunk <= 0) break;
+        total += chunk;
+    }
+    return total;
+}
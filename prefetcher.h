@@ -0,0 +1,79 @@
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QHash>
+#include <QSet>
+#include <QThreadPool>
+
+// Прогрев начала следующих треков в кэше страниц ОС, пока играет текущий: страницы
+// читаются касанием отображения или через фиксированный буфер, на Linux перед этим -
+// posix_fadvise. Глубина упреждения подстраивается под скорость завершённых чтений.
+class Prefetcher : public QObject
+{
+    Q_OBJECT
+public:
+    struct Request {
+        QString filePath;
+        qint64 durationMs = 0;
+    };
+
+    struct Stats {
+        int hits = 0;
+        int misses = 0;
+        int depth = 0;
+        double throughputMBps = 0.0;
+        qint64 bytesWarmed = 0;
+        qint64 hitFirstAudioUs = -1;
+        qint64 missFirstAudioUs = -1;
+        qint64 savedUs = 0;
+
+        double hitRate() const { return hits + misses > 0 ? double(hits) / (hits + misses) : 0.0; }
+    };
+
+    explicit Prefetcher(QObject *parent = nullptr);
+    ~Prefetcher();
+
+    static const int maxDepth = 4;
+
+    // Сколько треков вперёд имеет смысл греть при текущей скорости диска
+    int depth() const;
+
+    // Заменяет очередь прогрева: незапущенные задания прошлого вызова отменяются
+    void prefetch(const QList<Request> &requests);
+
+    // Вызывается при старте трека, считает попадание или промах; пустой путь - трек,
+    // который не греется, в статистику не входит
+    void trackStarted(const QString &filePath);
+
+    Stats stats() const;
+
+public slots:
+    void recordFirstAudio(qint64 latencyUs);
+
+private:
+    QThreadPool pool;
+    QAtomicInt generation;
+
+    QSet<QString> pending;
+    QHash<QString, qint64> warmed;      // путь -> номер прогрева, для вытеснения старых
+    qint64 warmCounter = 0;
+
+    double throughput = 0.0;            // байт/с, скользящее среднее
+    qint64 bytesWarmed = 0;
+    int hits = 0;
+    int misses = 0;
+    bool lastStartWasHit = false;
+    bool awaitingFirstAudio = false;
+    qint64 hitFirstAudioTotalUs = 0;
+    qint64 missFirstAudioTotalUs = 0;
+    int hitFirstAudioCount = 0;
+    int missFirstAudioCount = 0;
+
+    void handleWarmed(const QString &filePath, qint64 bytes, qint64 elapsedUs, bool done);
+    static qint64 warmBytes(const QString &filePath, qint64 durationMs);
+    static qint64 warm(const QString &filePath, qint64 bytes);
+};
+
+#endif // PREFETCHER_H
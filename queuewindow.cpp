@@ -0,0 +1,90 @@
+#include "queuewindow.h"
+#include "playqueuemodel.h"
+#include "playerengine.h"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QPushButton>
+#include <QShortcut>
+#include <algorithm>
+
+QueueWindow::QueueWindow(PlayerEngine *engine, QWidget *parent)
+    : QDialog(parent),
+    engine(engine),
+    model(new PlayQueueModel(engine, this)),
+    view(new QListView(this)),
+    countLabel(new QLabel(this))
+{
+    setWindowTitle("Очередь");
+    setWindowFlags(windowFlags() | Qt::Tool);
+    resize(420, 520);
+
+    view->setModel(model);
+    // Одинаковая высота строк: вид не измеряет каждую из миллиона строк
+    view->setUniformItemSizes(true);
+    view->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    view->setDragDropMode(QAbstractItemView::InternalMove);
+    view->setDefaultDropAction(Qt::MoveAction);
+    view->setDragEnabled(true);
+    view->setDropIndicatorShown(true);
+
+    QPushButton *removeButton = new QPushButton("Удалить", this);
+    QPushButton *clearButton = new QPushButton("Очистить", this);
+    QPushButton *closeButton = new QPushButton("Закрыть", this);
+    connect(removeButton, &QPushButton::clicked, this, &QueueWindow::removeSelected);
+    connect(clearButton, &QPushButton::clicked, engine, &PlayerEngine::clearQueue);
+    connect(closeButton, &QPushButton::clicked, this, &QDialog::hide);
+    connect(new QShortcut(QKeySequence::Delete, view), &QShortcut::activated,
+            this, &QueueWindow::removeSelected);
+    connect(view, &QListView::doubleClicked, this, &QueueWindow::playRow);
+
+    connect(model, &QAbstractItemModel::modelReset, this, &QueueWindow::updateCount);
+    connect(model, &QAbstractItemModel::rowsRemoved, this, &QueueWindow::updateCount);
+    // Добавления в конец и выбранные наперёд треки модель вставляет строками, без сброса
+    connect(model, &QAbstractItemModel::rowsInserted, this, &QueueWindow::updateCount);
+
+    QHBoxLayout *buttons = new QHBoxLayout;
+    buttons->addWidget(countLabel);
+    buttons->addStretch();
+    buttons->addWidget(removeButton);
+    buttons->addWidget(clearButton);
+    buttons->addWidget(closeButton);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(view);
+    layout->addLayout(buttons);
+
+    updateCount();
+}
+
+void QueueWindow::removeSelected()
+{
+    QList<int> rows;
+    const QModelIndexList selected = view->selectionModel()->selectedRows();
+    for (const QModelIndex &index : selected) {
+        rows.append(index.row());
+    }
+    if (rows.isEmpty()) return;
+
+    // Удаляем непрерывными диапазонами с конца, чтобы номера строк не съезжали
+    std::sort(rows.begin(), rows.end());
+    int end = rows.size() - 1;
+    while (end >= 0) {
+        int start = end;
+        while (start > 0 && rows.at(start - 1) == rows.at(start) - 1) --start;
+        model->removeRows(rows.at(start), end - start + 1);
+        end = start - 1;
+    }
+}
+
+void QueueWindow::playRow(const QModelIndex &index)
+{
+    if (!index.isValid()) return;
+    // Выбранный трек встаёт в голову очереди, пропущенные перед ним остаются
+    engine->moveQueued(index.row(), 1, 0);
+    engine->next();
+}
+
+void QueueWindow::updateCount()
+{
+    countLabel->setText(QString("Треков: %1").arg(model->rowCount()));
+}
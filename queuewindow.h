@@ -0,0 +1,30 @@
+#ifndef QUEUEWINDOW_H
+#define QUEUEWINDOW_H
+
+#include <QDialog>
+#include <QLabel>
+#include <QListView>
+
+class PlayerEngine;
+class PlayQueueModel;
+
+// Окно очереди "далее": перетаскивание для перестановки, удаление выделенного
+class QueueWindow : public QDialog
+{
+    Q_OBJECT
+public:
+    explicit QueueWindow(PlayerEngine *engine, QWidget *parent = nullptr);
+
+private slots:
+    void removeSelected();
+    void playRow(const QModelIndex &index);
+    void updateCount();
+
+private:
+    PlayerEngine *engine;
+    PlayQueueModel *model;
+    QListView *view;
+    QLabel *countLabel;
+};
+
+#endif // QUEUEWINDOW_H
@@ -0,0 +1,275 @@
+#include "resampler.h"
+#include <QHash>
+#include <QMutex>
+#include <cmath>
+#include <numeric>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define RESAMPLER_SSE
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RESAMPLER_NEON
+#endif
+
+// Больше фаз - таблица перестаёт помещаться в кэш; для редких отношений
+// вроде 44100 -> 48001 фаза округляется до ближайшей из maxPhases
+static const int maxPhases = 1024;
+static const double pi = 3.14159265358979323846;
+
+namespace {
+
+struct TierParameters {
+    int taps;
+    double rolloff;     // доля полосы Найквиста, которую оставляем
+    double beta;        // параметр окна Кайзера
+};
+
+TierParameters tierParameters(Resampler::Quality quality)
+{
+    switch (quality) {
+    case Resampler::Fast: return {16, 0.85, 6.0};
+    case Resampler::Balanced: return {32, 0.91, 8.5};
+    case Resampler::Best: return {64, 0.945, 11.0};
+    }
+    return {32, 0.91, 8.5};
+}
+
+double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 64; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+// taps кратно 8: два вектора по 4 за итерацию
+inline float dot(const float *a, const float *b, int taps)
+{
+#if defined(RESAMPLER_SSE)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (int i = 0; i < taps; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    acc0 = _mm_add_ps(acc0, acc1);
+    __m128 shuffled = _mm_shuffle_ps(acc0, acc0, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(acc0, shuffled);
+    shuffled = _mm_movehl_ps(shuffled, sums);
+    sums = _mm_add_ss(sums, shuffled);
+    return _mm_cvtss_f32(sums);
+#elif defined(RESAMPLER_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (int i = 0; i < taps; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    acc0 = vaddq_f32(acc0, acc1);
+    const float32x2_t pair = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+    return vget_lane_f32(vpadd_f32(pair, pair), 0);
+#else
+    float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < taps; i += 4) {
+        acc[0] += a[i] * b[i];
+        acc[1] += a[i + 1] * b[i + 1];
+        acc[2] += a[i + 2] * b[i + 2];
+        acc[3] += a[i + 3] * b[i + 3];
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+#endif
+}
+
+float dotRuntime(const float *a, const float *b, int taps)
+{
+    return dot(a, b, taps);
+}
+
+// Длина известна компилятору: цикл разворачивается целиком
+template<int Taps>
+float dotFixed(const float *a, const float *b, int)
+{
+    return dot(a, b, Taps);
+}
+
+} // namespace
+
+Resampler::Resampler(int inputRate, int outputRate, int channels, Quality quality)
+    : inRate(inputRate),
+    outRate(outputRate),
+    channelCount(qMax(1, channels))
+{
+    // Без частоты нет и отношения: такой ресемплер ничего не выдаёт, см. isValid()
+    if (inRate <= 0 || outRate <= 0) {
+        upFactor = 0;
+        downFactor = 0;
+        tapCount = 0;
+        kernel = dotRuntime;
+        return;
+    }
+
+    const int divisor = std::gcd(inRate, outRate);
+    upFactor = outRate / divisor;
+    downFactor = inRate / divisor;
+
+    table = buildTable(upFactor, downFactor, quality);
+    tapCount = table->taps;
+
+    // Длины фильтров для 44.1k <-> 48k, 2x и 4x на всех уровнях качества
+    switch (tapCount) {
+    case 16: kernel = dotFixed<16>; break;
+    case 24: kernel = dotFixed<24>; break;
+    case 32: kernel = dotFixed<32>; break;
+    case 40: kernel = dotFixed<40>; break;
+    case 64: kernel = dotFixed<64>; break;
+    case 72: kernel = dotFixed<72>; break;
+    case 128: kernel = dotFixed<128>; break;
+    case 256: kernel = dotFixed<256>; break;
+    default: kernel = dotRuntime; break;
+    }
+
+    reset();
+}
+
+QString Resampler::qualityName(Quality quality)
+{
+    switch (quality) {
+    case Fast: return "fast";
+    case Balanced: return "balanced";
+    case Best: return "best";
+    }
+    return QString();
+}
+
+void Resampler::reset()
+{
+    if (!isValid()) return;
+    // Окно первого выхода начинается за taps/2 - 1 отсчётов до потока: дополняем тишиной
+    history = QList<QList<float>>(channelCount, QList<float>(tapCount / 2 - 1, 0.0f));
+    phase = 0;
+    start = 0;
+}
+
+void Resampler::process(const float *input, int frames, QList<float> &output)
+{
+    if (frames <= 0 || !isValid()) return;
+    if (isPassthrough()) {
+        output.append(QList<float>(input, input + qsizetype(frames) * channelCount));
+        return;
+    }
+
+    for (int channel = 0; channel < channelCount; ++channel) {
+        QList<float> &samples = history[channel];
+        const qsizetype offset = samples.size();
+        samples.resize(offset + frames);
+        float *target = samples.data() + offset;
+        for (int i = 0; i < frames; ++i) {
+            target[i] = input[qsizetype(i) * channelCount + channel];
+        }
+    }
+    produce(output);
+}
+
+void Resampler::flush(QList<float> &output)
+{
+    if (!isValid() || isPassthrough()) return;
+    const QList<float> silence(qsizetype(tapCount / 2) * channelCount, 0.0f);
+    process(silence.constData(), tapCount / 2, output);
+}
+
+void Resampler::produce(QList<float> &output)
+{
+    const qsizetype available = history.first().size();
+    if (start + tapCount <= available) {
+        const qsizetype expected = (available - start - tapCount) * upFactor / downFactor + 1;
+        output.reserve(output.size() + expected * channelCount);
+    }
+
+    const float *coefficients = table->coefficients.constData();
+    const int phases = table->phases;
+    while (true) {
+        // При урезанном числе фаз берём ближайшую хранимую; ближайшей может оказаться
+        // нулевая фаза следующего входного отсчёта - тогда и окно на отсчёт дальше
+        qint64 row = phase;
+        int window = start;
+        if (phases != upFactor) {
+            row = (phase * phases + upFactor / 2) / upFactor;
+            if (row == phases) {
+                row = 0;
+                ++window;
+            }
+        }
+        if (window + tapCount > available) break;
+
+        const float *filter = coefficients + row * tapCount;
+        for (int channel = 0; channel < channelCount; ++channel) {
+            output.append(kernel(filter, history.at(channel).constData() + window, tapCount));
+        }
+
+        phase += downFactor;
+        start += int(phase / upFactor);
+        phase %= upFactor;
+    }
+
+    // Отбрасываем отсчёты, которые больше не попадут ни в одно окно
+    const int consumed = int(qMin<qsizetype>(start, available));
+    if (consumed > 0) {
+        for (QList<float> &samples : history) {
+            samples.remove(0, consumed);
+        }
+        start -= consumed;
+    }
+}
+
+QSharedPointer<const Resampler::Table> Resampler::buildTable(int up, int down, Quality quality)
+{
+    static QMutex mutex;
+    static QHash<QString, QSharedPointer<const Table>> cache;
+
+    const QString key = QString("%1/%2/%3").arg(up).arg(down).arg(int(quality));
+    QMutexLocker locker(&mutex);
+    if (const auto cached = cache.value(key)) return cached;
+
+    const TierParameters tier = tierParameters(quality);
+    // При понижении частоты срез сдвигается вниз, а фильтр во столько же раз удлиняется
+    const double scale = qMin(1.0, double(up) / down);
+    const double cutoff = scale * tier.rolloff;
+
+    QSharedPointer<Table> result(new Table);
+    result->phases = qMin(up, maxPhases);
+    result->taps = (int(std::ceil(tier.taps / scale)) + 7) / 8 * 8;
+    result->coefficients.resize(qsizetype(result->phases) * result->taps);
+
+    const int taps = result->taps;
+    const double half = taps / 2.0;
+    const double windowNorm = besselI0(tier.beta);
+    for (int p = 0; p < result->phases; ++p) {
+        float *row = result->coefficients.data() + qsizetype(p) * taps;
+        double sum = 0.0;
+        for (int i = 0; i < taps; ++i) {
+            // Расстояние от точки выхода до i-го отсчёта окна
+            const double tau = double(p) / result->phases + half - 1 - i;
+            const double x = cutoff * tau;
+            const double sinc = std::abs(x) < 1e-9 ? 1.0 : std::sin(pi * x) / (pi * x);
+            const double position = tau / half;
+            const double window = std::abs(position) >= 1.0
+                                      ? 0.0
+                                      : besselI0(tier.beta * std::sqrt(1.0 - position * position)) / windowNorm;
+            const double value = cutoff * sinc * window;
+            row[i] = float(value);
+            sum += value;
+        }
+        // Единичное усиление на постоянном токе для каждой фазы
+        for (int i = 0; i < taps; ++i) {
+            row[i] = float(row[i] / sum);
+        }
+    }
+
+    cache.insert(key, result);
+    return result;
+}
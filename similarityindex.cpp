@@ -0,0 +1,579 @@
+#include "similarityindex.h"
+#include <QDataStream>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SIMILARITY_SSE
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SIMILARITY_NEON
+#endif
+
+static const quint32 fileMagic = 0x534d4958;   // "SMIX"
+static const quint32 fileVersion = 1;
+static const int defaultEf = 64;
+static const int maxLevel = 15;
+// Удалённые узлы остаются в графе проходными; когда их больше четверти, граф перестраивается
+static const int compactionDivisor = 4;
+static const int compactionMinNodes = 256;
+
+static_assert(SimilarityIndex::Dimensions % 8 == 0, "distance kernel works in blocks of 8 floats");
+
+namespace {
+
+// Отметки посещённых узлов с поколением: не чистим массив перед каждым поиском.
+// Свои у каждого потока, поэтому параллельные поиски под читающей блокировкой не мешают друг другу
+struct VisitedMarks {
+    QList<quint32> marks;
+    quint32 generation = 0;
+
+    void reset(qsizetype nodeCount)
+    {
+        if (marks.size() < nodeCount) marks.resize(nodeCount, 0);
+        if (++generation == 0) {
+            marks.fill(0);
+            generation = 1;
+        }
+    }
+
+    bool visit(quint32 node)
+    {
+        if (marks.at(node) == generation) return false;
+        marks[node] = generation;
+        return true;
+    }
+};
+
+VisitedMarks &visitedMarks()
+{
+    thread_local VisitedMarks visited;
+    return visited;
+}
+
+} // namespace
+
+SimilarityIndex::SimilarityIndex(int links, int efConstruction)
+    : maxLinks(links),
+    maxLinks0(links * 2),
+    efConstruction(efConstruction),
+    levelFactor(1.0 / std::log(double(links))),
+    random(0x5eed)
+{
+}
+
+float SimilarityIndex::squaredDistance(const float *a, const float *b)
+{
+#if defined(SIMILARITY_SSE)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (int i = 0; i < Dimensions; i += 8) {
+        const __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        const __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+    }
+    acc0 = _mm_add_ps(acc0, acc1);
+    __m128 shuffled = _mm_shuffle_ps(acc0, acc0, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(acc0, shuffled);
+    shuffled = _mm_movehl_ps(shuffled, sums);
+    sums = _mm_add_ss(sums, shuffled);
+    return _mm_cvtss_f32(sums);
+#elif defined(SIMILARITY_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (int i = 0; i < Dimensions; i += 8) {
+        const float32x4_t d0 = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+        const float32x4_t d1 = vsubq_f32(vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        acc0 = vmlaq_f32(acc0, d0, d0);
+        acc1 = vmlaq_f32(acc1, d1, d1);
+    }
+    acc0 = vaddq_f32(acc0, acc1);
+    const float32x2_t pair = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+    return vget_lane_f32(vpadd_f32(pair, pair), 0);
+#else
+    float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < Dimensions; i += 4) {
+        for (int j = 0; j < 4; ++j) {
+            const float d = a[i + j] - b[i + j];
+            acc[j] += d * d;
+        }
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+#endif
+}
+
+int SimilarityIndex::size() const
+{
+    QReadLocker locker(&lock);
+    return nodes.size();
+}
+
+bool SimilarityIndex::contains(TrackId id) const
+{
+    QReadLocker locker(&lock);
+    return nodes.contains(id);
+}
+
+bool SimilarityIndex::vector(TrackId id, float *out) const
+{
+    QReadLocker locker(&lock);
+    const auto it = nodes.constFind(id);
+    if (it == nodes.constEnd()) return false;
+    std::copy(at(it.value()), at(it.value()) + Dimensions, out);
+    return true;
+}
+
+float SimilarityIndex::distance(TrackId a, TrackId b) const
+{
+    QReadLocker locker(&lock);
+    const auto first = nodes.constFind(a);
+    const auto second = nodes.constFind(b);
+    if (first == nodes.constEnd() || second == nodes.constEnd()) return -1.0f;
+    return std::sqrt(squaredDistance(at(first.value()), at(second.value())));
+}
+
+quint32 *SimilarityIndex::links(quint32 node, int level)
+{
+    if (level == 0) return baseLinks.data() + qsizetype(node) * (maxLinks0 + 1);
+    return upperLinks[node].data() + qsizetype(level - 1) * (maxLinks + 1);
+}
+
+const quint32 *SimilarityIndex::links(quint32 node, int level) const
+{
+    if (level == 0) return baseLinks.constData() + qsizetype(node) * (maxLinks0 + 1);
+    return upperLinks.constFind(node).value().constData() + qsizetype(level - 1) * (maxLinks + 1);
+}
+
+int SimilarityIndex::randomLevel()
+{
+    // Геометрическое распределение: на каждом следующем уровне примерно в maxLinks раз меньше узлов
+    const double uniform = 1.0 - random.generateDouble();
+    return qMin(maxLevel, int(-std::log(uniform) * levelFactor));
+}
+
+quint32 SimilarityIndex::greedy(const float *query, quint32 entry, int fromLevel, int toLevel) const
+{
+    quint32 current = entry;
+    float best = squaredDistance(query, at(current));
+    for (int level = fromLevel; level >= toLevel; --level) {
+        bool improved = true;
+        while (improved) {
+            improved = false;
+            const quint32 *list = links(current, level);
+            for (quint32 i = 1; i <= list[0]; ++i) {
+                const float d = squaredDistance(query, at(list[i]));
+                if (d < best) {
+                    best = d;
+                    current = list[i];
+                    improved = true;
+                }
+            }
+        }
+    }
+    return current;
+}
+
+QList<SimilarityIndex::Candidate> SimilarityIndex::searchLayer(const float *query, quint32 entry,
+                                                               int ef, int level) const
+{
+    VisitedMarks &visited = visitedMarks();
+    visited.reset(labels.size());
+
+    // Кандидаты на расширение - ближайший сверху, найденные - дальний сверху
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> frontier;
+    std::priority_queue<Candidate> found;
+
+    const Candidate start{squaredDistance(query, at(entry)), entry};
+    visited.visit(entry);
+    frontier.push(start);
+    found.push(start);
+
+    while (!frontier.empty()) {
+        const Candidate nearest = frontier.top();
+        if (nearest.distance > found.top().distance && int(found.size()) >= ef) break;
+        frontier.pop();
+
+        const quint32 *list = links(nearest.node, level);
+        for (quint32 i = 1; i <= list[0]; ++i) {
+            const quint32 neighbour = list[i];
+            if (!visited.visit(neighbour)) continue;
+
+            const float d = squaredDistance(query, at(neighbour));
+            if (int(found.size()) < ef || d < found.top().distance) {
+                frontier.push({d, neighbour});
+                found.push({d, neighbour});
+                if (int(found.size()) > ef) found.pop();
+            }
+        }
+    }
+
+    QList<Candidate> result(qsizetype(found.size()));
+    for (qsizetype i = result.size() - 1; i >= 0; --i) {
+        result[i] = found.top();
+        found.pop();
+    }
+    return result;
+}
+
+QList<SimilarityIndex::Candidate> SimilarityIndex::selectNeighbours(const QList<Candidate> &sorted,
+                                                                    int count) const
+{
+    // Эвристика из статьи: кандидат берётся, только если он ближе к узлу, чем к уже взятым
+    // соседям - связи расходятся в разные стороны, и граф не распадается на кластеры
+    QList<Candidate> kept;
+    QList<Candidate> pruned;
+    for (const Candidate &candidate : sorted) {
+        if (kept.size() >= count) break;
+        bool diverse = true;
+        for (const Candidate &other : std::as_const(kept)) {
+            if (squaredDistance(at(candidate.node), at(other.node)) < candidate.distance) {
+                diverse = false;
+                break;
+            }
+        }
+        if (diverse) {
+            kept.append(candidate);
+        } else {
+            pruned.append(candidate);
+        }
+    }
+    // Свободные слоты добираем отброшенными: лишние связи дешевле потерянной полноты
+    for (const Candidate &candidate : std::as_const(pruned)) {
+        if (kept.size() >= count) break;
+        kept.append(candidate);
+    }
+    return kept;
+}
+
+void SimilarityIndex::addLink(quint32 node, quint32 neighbour, int level)
+{
+    quint32 *list = links(node, level);
+    const int limit = capacity(level);
+    if (int(list[0]) < limit) {
+        list[++list[0]] = neighbour;
+        return;
+    }
+
+    // Список полон - заново выбираем лучших среди старых соседей и нового
+    QList<Candidate> candidates;
+    candidates.reserve(limit + 1);
+    for (quint32 i = 1; i <= list[0]; ++i) {
+        candidates.append({squaredDistance(at(node), at(list[i])), list[i]});
+    }
+    candidates.append({squaredDistance(at(node), at(neighbour)), neighbour});
+    std::sort(candidates.begin(), candidates.end());
+
+    const QList<Candidate> kept = selectNeighbours(candidates, limit);
+    list[0] = quint32(kept.size());
+    for (int i = 0; i < kept.size(); ++i) {
+        list[i + 1] = kept.at(i).node;
+    }
+}
+
+void SimilarityIndex::insert(TrackId id, const float *vector)
+{
+    QWriteLocker locker(&lock);
+
+    ++modifications;
+    const auto existing = nodes.constFind(id);
+    if (existing != nodes.constEnd()) {
+        deleted[existing.value()] = 1;
+        ++deletedCount;
+        nodes.remove(id);
+    }
+
+    const quint32 node = quint32(labels.size());
+    const int level = randomLevel();
+    labels.append(id);
+    levels.append(quint8(level));
+    deleted.append(0);
+    vectors.append(QList<float>(vector, vector + Dimensions));
+    baseLinks.resize(baseLinks.size() + maxLinks0 + 1, 0);
+    if (level > 0) {
+        upperLinks.insert(node, QList<quint32>(qsizetype(level) * (maxLinks + 1), 0));
+    }
+    nodes.insert(id, node);
+
+    if (topLevel < 0) {
+        entryPoint = node;
+        topLevel = level;
+        return;
+    }
+
+    const float *query = at(node);
+    quint32 current = topLevel > level ? greedy(query, entryPoint, topLevel, level + 1) : entryPoint;
+    for (int l = qMin(level, topLevel); l >= 0; --l) {
+        const QList<Candidate> found = searchLayer(query, current, efConstruction, l);
+        const QList<Candidate> chosen = selectNeighbours(found, capacity(l));
+
+        quint32 *list = links(node, l);
+        list[0] = quint32(chosen.size());
+        for (int i = 0; i < chosen.size(); ++i) {
+            list[i + 1] = chosen.at(i).node;
+        }
+        for (const Candidate &neighbour : chosen) {
+            addLink(neighbour.node, node, l);
+        }
+        current = found.first().node;
+    }
+
+    if (level > topLevel) {
+        entryPoint = node;
+        topLevel = level;
+    }
+}
+
+bool SimilarityIndex::remove(TrackId id)
+{
+    QWriteLocker locker(&lock);
+    const auto it = nodes.constFind(id);
+    if (it == nodes.constEnd()) return false;
+    // Узел остаётся в графе: через него по-прежнему проходят пути к соседям
+    ++modifications;
+    deleted[it.value()] = 1;
+    ++deletedCount;
+    nodes.remove(id);
+    return true;
+}
+
+bool SimilarityIndex::relabel(TrackId from, TrackId to)
+{
+    QWriteLocker locker(&lock);
+    const auto it = nodes.constFind(from);
+    if (it == nodes.constEnd() || nodes.contains(to)) return false;
+    const quint32 node = it.value();
+    ++modifications;
+    nodes.remove(from);
+    nodes.insert(to, node);
+    labels[node] = to;
+    return true;
+}
+
+bool SimilarityIndex::needsCompaction() const
+{
+    QReadLocker locker(&lock);
+    return labels.size() >= compactionMinNodes && deletedCount * compactionDivisor > labels.size();
+}
+
+bool SimilarityIndex::compact()
+{
+    QList<TrackId> ids;
+    QList<float> live;
+    quint64 version = 0;
+    {
+        QReadLocker locker(&lock);
+        version = modifications;
+        ids.reserve(nodes.size());
+        live.reserve(qsizetype(nodes.size()) * Dimensions);
+        for (quint32 node = 0; node < quint32(labels.size()); ++node) {
+            if (deleted.at(node)) continue;
+            ids.append(labels.at(node));
+            live.append(QList<float>(at(node), at(node) + Dimensions));
+        }
+    }
+
+    // Новый граф строится без блокировки: поиск идёт по старому до самой подмены
+    SimilarityIndex rebuilt(maxLinks, efConstruction);
+    for (qsizetype i = 0; i < ids.size(); ++i) {
+        rebuilt.insert(ids.at(i), live.constData() + i * Dimensions);
+    }
+
+    QWriteLocker locker(&lock);
+    if (modifications != version) return false;
+    vectors = std::move(rebuilt.vectors);
+    labels = std::move(rebuilt.labels);
+    levels = std::move(rebuilt.levels);
+    deleted = std::move(rebuilt.deleted);
+    baseLinks = std::move(rebuilt.baseLinks);
+    upperLinks = std::move(rebuilt.upperLinks);
+    nodes = std::move(rebuilt.nodes);
+    entryPoint = rebuilt.entryPoint;
+    topLevel = rebuilt.topLevel;
+    deletedCount = 0;
+    ++modifications;
+    return true;
+}
+
+void SimilarityIndex::clear()
+{
+    QWriteLocker locker(&lock);
+    ++modifications;
+    vectors.clear();
+    labels.clear();
+    levels.clear();
+    deleted.clear();
+    baseLinks.clear();
+    upperLinks.clear();
+    nodes.clear();
+    entryPoint = 0;
+    topLevel = -1;
+    deletedCount = 0;
+}
+
+QList<SimilarityIndex::Neighbour> SimilarityIndex::search(const float *query, int k, int ef) const
+{
+    QReadLocker locker(&lock);
+    return searchLocked(query, k, ef);
+}
+
+QList<SimilarityIndex::Neighbour> SimilarityIndex::similar(TrackId id, int k, int ef) const
+{
+    QReadLocker locker(&lock);
+    const auto it = nodes.constFind(id);
+    if (it == nodes.constEnd()) return {};
+
+    // Сам трек найдётся первым - просим на одного больше и выбрасываем его
+    QList<Neighbour> result = searchLocked(at(it.value()), k + 1, ef);
+    result.removeIf([id](const Neighbour &neighbour) { return neighbour.id == id; });
+    if (result.size() > k) result.resize(k);
+    return result;
+}
+
+QList<SimilarityIndex::Neighbour> SimilarityIndex::searchLocked(const float *query, int k, int ef) const
+{
+    if (topLevel < 0 || k <= 0) return {};
+
+    // Удалённые узлы попадают в выдачу графа, поэтому расширяем её с запасом
+    const int width = qMax(qMax(ef > 0 ? ef : defaultEf, k), k + qMin(deletedCount, k));
+    const quint32 start = greedy(query, entryPoint, topLevel, 1);
+    const QList<Candidate> found = searchLayer(query, start, width, 0);
+
+    QList<Neighbour> result;
+    result.reserve(k);
+    for (const Candidate &candidate : found) {
+        if (deleted.at(candidate.node)) continue;
+        result.append({labels.at(candidate.node), std::sqrt(candidate.distance)});
+        if (result.size() >= k) break;
+    }
+    return result;
+}
+
+QList<SimilarityIndex::Neighbour> SimilarityIndex::exactSearch(const float *query, int k) const
+{
+    QReadLocker locker(&lock);
+    QList<Candidate> all;
+    all.reserve(nodes.size());
+    for (quint32 node = 0; node < quint32(labels.size()); ++node) {
+        if (!deleted.at(node)) all.append({squaredDistance(query, at(node)), node});
+    }
+    const qsizetype count = qMin<qsizetype>(k, all.size());
+    std::partial_sort(all.begin(), all.begin() + count, all.end());
+
+    QList<Neighbour> result;
+    result.reserve(count);
+    for (qsizetype i = 0; i < count; ++i) {
+        result.append({labels.at(all.at(i).node), std::sqrt(all.at(i).distance)});
+    }
+    return result;
+}
+
+void SimilarityIndex::save(QDataStream &out, const std::function<QString(TrackId)> &pathOf) const
+{
+    QReadLocker locker(&lock);
+    out << fileMagic << fileVersion << quint32(Dimensions) << qint32(maxLinks);
+
+    // Идентификаторы живут одну сессию - на диске узел помечен путём
+    QStringList paths;
+    paths.reserve(labels.size());
+    for (quint32 node = 0; node < quint32(labels.size()); ++node) {
+        paths.append(deleted.at(node) ? QString() : pathOf(labels.at(node)));
+    }
+    out << paths << vectors << levels << deleted << baseLinks << upperLinks
+        << entryPoint << qint32(topLevel);
+}
+
+bool SimilarityIndex::load(QDataStream &in, const std::function<TrackId(const QString &)> &idOf)
+{
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 dimensions = 0;
+    qint32 links = 0;
+    in >> magic >> version >> dimensions >> links;
+    if (magic != fileMagic || version != fileVersion || dimensions != quint32(Dimensions) || links != maxLinks) {
+        return false;
+    }
+
+    QStringList paths;
+    QList<float> storedVectors;
+    QList<quint8> storedLevels;
+    QList<quint8> storedDeleted;
+    QList<quint32> storedBase;
+    QHash<quint32, QList<quint32>> storedUpper;
+    quint32 storedEntry = 0;
+    qint32 storedTop = -1;
+    in >> paths >> storedVectors >> storedLevels >> storedDeleted >> storedBase >> storedUpper
+        >> storedEntry >> storedTop;
+
+    const qsizetype count = paths.size();
+    if (in.status() != QDataStream::Ok || storedVectors.size() != count * Dimensions
+        || storedLevels.size() != count || storedDeleted.size() != count
+        || storedBase.size() != count * (maxLinks0 + 1) || (count > 0 && storedEntry >= quint32(count))) {
+        return false;
+    }
+
+    // Испорченный файл не должен увести поиск за границы массивов: каждый сосед - существующий
+    // узел с нужным уровнем, у каждого узла выше нулевого уровня есть списки на все его уровни
+    if (count > 0 && (storedTop < 0 || storedTop > maxLevel || storedLevels.at(storedEntry) != storedTop)) {
+        return false;
+    }
+    auto validLinks = [&](const quint32 *list, int level) {
+        if (list[0] > quint32(capacity(level))) return false;
+        for (quint32 i = 1; i <= list[0]; ++i) {
+            if (list[i] >= quint32(count) || storedLevels.at(list[i]) < level) return false;
+        }
+        return true;
+    };
+    qsizetype upperNodes = 0;
+    for (qsizetype node = 0; node < count; ++node) {
+        const int level = storedLevels.at(node);
+        if (level > storedTop) return false;
+        if (!validLinks(storedBase.constData() + node * (maxLinks0 + 1), 0)) return false;
+        if (level == 0) continue;
+
+        const auto upper = storedUpper.constFind(quint32(node));
+        if (upper == storedUpper.constEnd() || upper.value().size() != qsizetype(level) * (maxLinks + 1)) {
+            return false;
+        }
+        for (int l = 1; l <= level; ++l) {
+            if (!validLinks(upper.value().constData() + qsizetype(l - 1) * (maxLinks + 1), l)) return false;
+        }
+        ++upperNodes;
+    }
+    // Лишние списки - у узлов нулевого уровня или несуществующих
+    if (storedUpper.size() != upperNodes) return false;
+
+    QWriteLocker locker(&lock);
+    ++modifications;
+    vectors = storedVectors;
+    levels = storedLevels;
+    deleted = storedDeleted;
+    baseLinks = storedBase;
+    upperLinks = storedUpper;
+    entryPoint = storedEntry;
+    topLevel = count > 0 ? storedTop : -1;
+    labels.fill(TrackTable::InvalidId, count);
+    nodes.clear();
+    deletedCount = 0;
+    for (qsizetype node = 0; node < count; ++node) {
+        if (deleted.at(node) || paths.at(node).isEmpty()) {
+            deleted[node] = 1;
+            ++deletedCount;
+            continue;
+        }
+        const TrackId id = idOf(paths.at(node));
+        labels[node] = id;
+        // Путь встречается дважды, если файл переименовали туда и обратно - живым считаем последний узел
+        const auto previous = nodes.constFind(id);
+        if (previous != nodes.constEnd()) {
+            deleted[previous.value()] = 1;
+            ++deletedCount;
+        }
+        nodes.insert(id, quint32(node));
+    }
+    return true;
+}
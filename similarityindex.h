@@ -0,0 +1,101 @@
+#ifndef SIMILARITYINDEX_H
+#define SIMILARITYINDEX_H
+
+#include <QHash>
+#include <QList>
+#include <QRandomGenerator>
+#include <QReadWriteLock>
+#include <functional>
+#include "audiofeatures.h"
+#include "tracktable.h"
+
+class QDataStream;
+
+// Приближённый поиск ближайших соседей по описателям треков (HNSW - иерархический граф
+// "малого мира"). Поиск спускается жадно по редким верхним уровням и расширяется на нижнем,
+// просматривая сотни узлов вместо всей библиотеки. Расстояние - квадрат евклидова на SSE/NEON.
+// Читатели и писатель разделены QReadWriteLock: поиск из потока интерфейса идёт параллельно
+// с фоновым анализом, вставка блокирует только на время правки графа.
+class SimilarityIndex
+{
+public:
+    static constexpr int Dimensions = AudioDescriptor::Dimensions;
+
+    struct Neighbour {
+        TrackId id;
+        float distance;
+    };
+
+    explicit SimilarityIndex(int links = 16, int efConstruction = 100);
+
+    int size() const;
+    bool contains(TrackId id) const;
+    bool vector(TrackId id, float *out) const;
+    // -1, если одного из треков нет в индексе
+    float distance(TrackId a, TrackId b) const;
+
+    // Повторная вставка того же трека заменяет его вектор
+    void insert(TrackId id, const float *vector);
+    bool remove(TrackId id);
+    bool relabel(TrackId from, TrackId to);
+    void clear();
+
+    // Удалённые узлы копятся в графе; когда их слишком много, граф стоит перестроить.
+    // compact() безопасен в любом потоке: граф строится заново без блокировки, а если индекс
+    // за это время изменился, результат отбрасывается и возвращается false
+    bool needsCompaction() const;
+    bool compact();
+
+    // По возрастанию расстояния; ef - ширина поиска, 0 - по умолчанию
+    QList<Neighbour> search(const float *query, int k, int ef = 0) const;
+    QList<Neighbour> similar(TrackId id, int k, int ef = 0) const;
+    // Полный перебор - эталон для проверки полноты поиска
+    QList<Neighbour> exactSearch(const float *query, int k) const;
+
+    void save(QDataStream &out, const std::function<QString(TrackId)> &pathOf) const;
+    bool load(QDataStream &in, const std::function<TrackId(const QString &)> &idOf);
+
+    static float squaredDistance(const float *a, const float *b);
+
+private:
+    struct Candidate {
+        float distance;
+        quint32 node;
+        bool operator<(const Candidate &other) const { return distance < other.distance; }
+        bool operator>(const Candidate &other) const { return distance > other.distance; }
+    };
+
+    int maxLinks;                       // на верхних уровнях
+    int maxLinks0;                      // на нижнем - вдвое больше, как в статье
+    int efConstruction;
+    double levelFactor;
+
+    // Узел - позиция в массивах; удалённые остаются в графе как проходные
+    QList<float> vectors;               // узел x Dimensions
+    QList<TrackId> labels;
+    QList<quint8> levels;
+    QList<quint8> deleted;
+    QList<quint32> baseLinks;           // узел x (maxLinks0 + 1): число, затем соседи
+    QHash<quint32, QList<quint32>> upperLinks;  // уровни 1..level по (maxLinks + 1)
+    QHash<TrackId, quint32> nodes;
+    quint32 entryPoint = 0;
+    int topLevel = -1;
+    int deletedCount = 0;
+    quint64 modifications = 0;          // растёт с каждой правкой, проверяется при подмене графа
+
+    mutable QReadWriteLock lock;
+    QRandomGenerator random;
+
+    const float *at(quint32 node) const { return vectors.constData() + qsizetype(node) * Dimensions; }
+    int capacity(int level) const { return level == 0 ? maxLinks0 : maxLinks; }
+    quint32 *links(quint32 node, int level);
+    const quint32 *links(quint32 node, int level) const;
+    int randomLevel();
+    quint32 greedy(const float *query, quint32 entry, int fromLevel, int toLevel) const;
+    QList<Candidate> searchLayer(const float *query, quint32 entry, int ef, int level) const;
+    QList<Candidate> selectNeighbours(const QList<Candidate> &sorted, int count) const;
+    void addLink(quint32 node, quint32 neighbour, int level);
+    QList<Neighbour> searchLocked(const float *query, int k, int ef) const;
+};
+
+#endif // SIMILARITYINDEX_H
@@ -0,0 +1,457 @@
+#include "smartcollections.h"
+#include "playerengine.h"
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QSettings>
+#include <QtConcurrent>
+#include <limits>
+
+static const int maxDeadlineWaitMs = 60 * 60 * 1000;
+
+SmartCollections::SmartCollections(PlayerEngine *engine, QObject *parent)
+    : QObject(parent),
+    engine(engine),
+    deadlineTimer(new QTimer(this))
+{
+    deadlineTimer->setSingleShot(true);
+    connect(deadlineTimer, &QTimer::timeout, this, &SmartCollections::evaluateDueTracks);
+    connect(&tagWatcher, &QFutureWatcher<QList<QPair<TrackId, TrackTags>>>::finished,
+            this, &SmartCollections::handleTagsRead);
+
+    connect(engine, &PlayerEngine::tracksAdded, this, &SmartCollections::handleTracksAdded);
+    connect(engine, &PlayerEngine::trackRemoved, this, &SmartCollections::handleTrackRemoved);
+    connect(engine, &PlayerEngine::trackRenamed, this, &SmartCollections::handleTrackRenamed);
+    connect(engine, &PlayerEngine::trackStatsChanged, this, &SmartCollections::handleStatsChanged);
+    connect(engine, &PlayerEngine::trackTagsChanged, this, &SmartCollections::handleTagsChanged);
+
+    load();
+}
+
+QString SmartCollections::syntaxHelp()
+{
+    return "Правила через \"and\": <поле> <оператор> <значение>\n"
+           "Поля: plays, lastplayed (дней назад), added (дней назад), artist, album, title, name\n"
+           "Операторы: > < = ~ (содержит)\n"
+           "Пример: plays > 10 and lastplayed > 30";
+}
+
+bool SmartCollections::parseRules(const QString &definition, QList<SmartRule> *rules, QString *errorString)
+{
+    static const QRegularExpression separator("\\s+and\\s+", QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression rulePattern("^\\s*(\\w+)\\s*([<>=~])\\s*(.+?)\\s*$");
+    static const QHash<QString, SmartRule::Field> fields = {
+        {"plays", SmartRule::PlayCount},
+        {"playcount", SmartRule::PlayCount},
+        {"lastplayed", SmartRule::DaysSincePlayed},
+        {"added", SmartRule::DaysSinceAdded},
+        {"artist", SmartRule::Artist},
+        {"album", SmartRule::Album},
+        {"title", SmartRule::Title},
+        {"name", SmartRule::FileName}
+    };
+
+    rules->clear();
+    const QStringList parts = definition.split(separator, Qt::SkipEmptyParts);
+    for (const QString &part : parts) {
+        const QRegularExpressionMatch match = rulePattern.match(part);
+        if (!match.hasMatch() || !fields.contains(match.captured(1).toLower())) {
+            if (errorString) *errorString = "Не удалось разобрать правило: " + part;
+            return false;
+        }
+
+        SmartRule rule;
+        rule.field = fields.value(match.captured(1).toLower());
+        rule.value = match.captured(3);
+
+        const QChar op = match.captured(2).at(0);
+        rule.op = op == '>' ? SmartRule::Greater
+                  : op == '<' ? SmartRule::Less
+                  : op == '=' ? SmartRule::Equals
+                              : SmartRule::Contains;
+
+        const bool numeric = rule.field == SmartRule::PlayCount ||
+                             rule.field == SmartRule::DaysSincePlayed ||
+                             rule.field == SmartRule::DaysSinceAdded;
+        bool isNumber = false;
+        rule.value.toInt(&isNumber);
+        if (numeric && (!isNumber || rule.op == SmartRule::Contains)) {
+            if (errorString) *errorString = "Ожидается число: " + part;
+            return false;
+        }
+        rules->append(rule);
+    }
+
+    if (rules->isEmpty()) {
+        if (errorString) *errorString = "Пустое правило";
+        return false;
+    }
+    return true;
+}
+
+QStringList SmartCollections::names() const
+{
+    return collections.keys();
+}
+
+bool SmartCollections::contains(const QString &name) const
+{
+    return collections.contains(name);
+}
+
+QString SmartCollections::definition(const QString &name) const
+{
+    return collections.value(name).definition;
+}
+
+QStringList SmartCollections::tracks(const QString &name) const
+{
+    return engine->trackTable().paths(collections.value(name).members);
+}
+
+QList<TrackId> SmartCollections::trackIds(const QString &name) const
+{
+    return collections.value(name).members;
+}
+
+bool SmartCollections::addCollection(const QString &name, const QString &definition, QString *errorString)
+{
+    QList<SmartRule> rules;
+    if (name.isEmpty() || !parseRules(definition, &rules, errorString)) {
+        return false;
+    }
+
+    Collection &collection = collections[name];
+    collection.definition = definition;
+    collection.rules = rules;
+    collection.members.clear();
+    collection.positions.clear();
+
+    save();
+    emit collectionsChanged();
+    evaluate(library.values(), name);
+    return true;
+}
+
+void SmartCollections::removeCollection(const QString &name)
+{
+    if (collections.remove(name) > 0) {
+        save();
+        emit collectionsChanged();
+    }
+}
+
+bool SmartCollections::cachedTags(TrackId id, TrackTags *tags) const
+{
+    const auto it = tagCache.constFind(id);
+    if (it == tagCache.constEnd()) return false;
+    *tags = it.value();
+    return true;
+}
+
+void SmartCollections::handleTracksAdded(const QList<TrackId> &ids)
+{
+    for (TrackId id : ids) {
+        library.insert(id);
+    }
+    evaluate(ids);
+}
+
+void SmartCollections::handleTrackRemoved(const QString &filePath)
+{
+    const TrackId id = engine->trackTable().find(filePath);
+    library.remove(id);
+    tagCache.remove(id);
+    clearDeadline(id);
+    for (auto it = collections.begin(); it != collections.end(); ++it) {
+        if (setMember(it.value(), id, false)) {
+            emit membershipChanged(it.key());
+        }
+    }
+}
+
+void SmartCollections::handleTrackRenamed(const QString &oldPath, const QString &newPath)
+{
+    const TrackId oldId = engine->trackTable().find(oldPath);
+    const TrackId newId = engine->trackTable().find(newPath);
+    library.remove(oldId);
+    library.insert(newId);
+    clearDeadline(oldId);
+    if (tagCache.contains(oldId)) {
+        tagCache.insert(newId, tagCache.take(oldId));
+    }
+    for (auto it = collections.begin(); it != collections.end(); ++it) {
+        if (setMember(it.value(), oldId, false)) {
+            emit membershipChanged(it.key());
+        }
+    }
+    evaluate({newId});
+}
+
+void SmartCollections::handleStatsChanged(const QString &filePath)
+{
+    const TrackId id = engine->trackTable().find(filePath);
+    if (library.contains(id)) {
+        evaluate({id});
+    }
+}
+
+void SmartCollections::handleTagsChanged(const QString &filePath)
+{
+    // Теги перечитаются в фоне, правила по ним пересчитаются по приходу
+    const TrackId id = engine->trackTable().find(filePath);
+    tagCache.remove(id);
+    if (library.contains(id)) {
+        evaluate({id});
+    }
+}
+
+void SmartCollections::handleTagsRead()
+{
+    const QList<QPair<TrackId, TrackTags>> results = tagWatcher.result();
+    QList<TrackId> ids;
+    ids.reserve(results.size());
+    for (const auto &result : results) {
+        tagCache.insert(result.first, result.second);
+        ids.append(result.first);
+    }
+    evaluate(ids);
+
+    if (!tagQueue.isEmpty()) {
+        requestTags(QList<TrackId>());
+    }
+}
+
+void SmartCollections::evaluateDueTracks()
+{
+    const QDateTime now = QDateTime::currentDateTime();
+    QSet<TrackId> due;
+    while (!deadlines.isEmpty() && deadlines.firstKey() <= now) {
+        auto first = deadlines.begin();
+        const TrackId id = first.value();
+        deadlines.erase(first);
+        deadlineOf.remove(id);
+        if (library.contains(id)) due.insert(id);
+    }
+    evaluate(due.values());
+    scheduleDeadlines();
+}
+
+bool SmartCollections::matches(const Collection &collection, TrackId id,
+                               const QDateTime &now, QDateTime *nextChange) const
+{
+    const PlayerEngine::TrackStats stats = engine->trackStats(id);
+    bool result = true;
+
+    for (const SmartRule &rule : collection.rules) {
+        bool ruleResult = false;
+
+        switch (rule.field) {
+        case SmartRule::PlayCount: {
+            const int expected = rule.value.toInt();
+            ruleResult = rule.op == SmartRule::Greater ? stats.playCount > expected
+                         : rule.op == SmartRule::Less ? stats.playCount < expected
+                                                      : stats.playCount == expected;
+            break;
+        }
+        case SmartRule::DaysSincePlayed:
+        case SmartRule::DaysSinceAdded: {
+            const QDateTime base = rule.field == SmartRule::DaysSincePlayed ? stats.lastPlayed : stats.added;
+            const int expected = rule.value.toInt();
+            // Никогда не игранный трек - "бесконечно давно"
+            const qint64 days = base.isValid() ? base.secsTo(now) / 86400 : std::numeric_limits<int>::max();
+            ruleResult = rule.op == SmartRule::Greater ? days > expected
+                         : rule.op == SmartRule::Less ? days < expected
+                                                      : days == expected;
+
+            // Когда ответ может поменяться сам по себе, без событий
+            if (base.isValid()) {
+                for (int offset : {expected, expected + 1}) {
+                    const QDateTime boundary = base.addDays(offset);
+                    if (boundary > now && (!nextChange->isValid() || boundary < *nextChange)) {
+                        *nextChange = boundary;
+                    }
+                }
+            }
+            break;
+        }
+        case SmartRule::Artist:
+        case SmartRule::Album:
+        case SmartRule::Title:
+        case SmartRule::FileName: {
+            QString text;
+            if (rule.field == SmartRule::FileName) {
+                text = QFileInfo(engine->trackTable().fileName(id)).completeBaseName();
+            } else {
+                const TrackTags tags = tagCache.value(id);
+                text = rule.field == SmartRule::Artist ? tags.artist
+                       : rule.field == SmartRule::Album ? tags.album
+                                                        : tags.title;
+            }
+            const int compare = text.compare(rule.value, Qt::CaseInsensitive);
+            ruleResult = rule.op == SmartRule::Contains ? text.contains(rule.value, Qt::CaseInsensitive)
+                         : rule.op == SmartRule::Greater ? compare > 0
+                         : rule.op == SmartRule::Less ? compare < 0
+                                                      : compare == 0;
+            break;
+        }
+        }
+
+        result = result && ruleResult;
+    }
+    return result;
+}
+
+bool SmartCollections::setMember(Collection &collection, TrackId id, bool member)
+{
+    const auto position = collection.positions.constFind(id);
+    const bool isMember = position != collection.positions.cend();
+    if (member == isMember) return false;
+
+    if (member) {
+        collection.positions.insert(id, collection.members.size());
+        collection.members.append(id);
+    } else {
+        // Удаление за O(1): на место удалённого ставим последний
+        const int index = *position;
+        collection.positions.erase(position);
+        const TrackId last = collection.members.takeLast();
+        if (index < collection.members.size()) {
+            collection.members[index] = last;
+            collection.positions.insert(last, index);
+        }
+    }
+    return true;
+}
+
+void SmartCollections::evaluate(const QList<TrackId> &ids, const QString &onlyCollection)
+{
+    if (ids.isEmpty() || collections.isEmpty()) return;
+
+    if (needsTags()) {
+        QList<TrackId> missing;
+        for (TrackId id : ids) {
+            if (!tagCache.contains(id)) missing.append(id);
+        }
+        requestTags(missing);
+    }
+
+    const QDateTime now = QDateTime::currentDateTime();
+    // У трека один срок - ближайший по всем проверенным коллекциям
+    QHash<TrackId, QDateTime> nextChanges;
+    for (auto it = collections.begin(); it != collections.end(); ++it) {
+        if (!onlyCollection.isEmpty() && it.key() != onlyCollection) continue;
+
+        bool changed = false;
+        for (TrackId id : ids) {
+            QDateTime nextChange;
+            const bool member = matches(it.value(), id, now, &nextChange);
+            changed = setMember(it.value(), id, member) || changed;
+            if (nextChange.isValid()) {
+                QDateTime &earliest = nextChanges[id];
+                if (!earliest.isValid() || nextChange < earliest) earliest = nextChange;
+            }
+        }
+        if (changed) {
+            emit membershipChanged(it.key());
+        }
+    }
+
+    for (TrackId id : ids) {
+        const QDateTime nextChange = nextChanges.value(id);
+        if (onlyCollection.isEmpty()) {
+            setDeadline(id, nextChange);
+        } else if (nextChange.isValid()) {
+            // Проверена одна коллекция: срок других оставляем, если он раньше.
+            // Лишнее срабатывание только перепроверит трек и назначит срок заново
+            const QDateTime current = deadlineOf.value(id);
+            if (!current.isValid() || nextChange < current) setDeadline(id, nextChange);
+        }
+    }
+    scheduleDeadlines();
+}
+
+void SmartCollections::setDeadline(TrackId id, const QDateTime &when)
+{
+    clearDeadline(id);
+    if (!when.isValid()) return;
+    deadlines.insert(when, id);
+    deadlineOf.insert(id, when);
+}
+
+void SmartCollections::clearDeadline(TrackId id)
+{
+    const auto it = deadlineOf.constFind(id);
+    if (it == deadlineOf.constEnd()) return;
+    deadlines.remove(it.value(), id);
+    deadlineOf.erase(it);
+}
+
+void SmartCollections::requestTags(const QList<TrackId> &ids)
+{
+    tagQueue.append(ids);
+    if (tagQueue.isEmpty() || tagWatcher.isRunning()) return;
+
+    // Таблица путей не потокобезопасна: пути разворачиваем здесь,
+    // теги читаем пачкой в фоне, результат перепроверяем в handleTagsRead()
+    const QList<TrackId> batch = tagQueue;
+    const QStringList filePaths = engine->trackTable().paths(batch);
+    tagQueue.clear();
+    tagWatcher.setFuture(QtConcurrent::run([batch, filePaths]() {
+        QList<QPair<TrackId, TrackTags>> results;
+        results.reserve(batch.size());
+        for (int i = 0; i < batch.size(); ++i) {
+            results.append({batch.at(i), TagReader::read(filePaths.at(i))});
+        }
+        return results;
+    }));
+}
+
+void SmartCollections::scheduleDeadlines()
+{
+    if (deadlines.isEmpty()) {
+        deadlineTimer->stop();
+        return;
+    }
+
+    const qint64 wait = QDateTime::currentDateTime().msecsTo(deadlines.firstKey());
+    deadlineTimer->start(int(qBound<qint64>(0, wait + 1000, maxDeadlineWaitMs)));
+}
+
+bool SmartCollections::needsTags() const
+{
+    for (const Collection &collection : collections) {
+        for (const SmartRule &rule : collection.rules) {
+            if (rule.usesTags()) return true;
+        }
+    }
+    return false;
+}
+
+void SmartCollections::save() const
+{
+    QSettings settings;
+    settings.remove("SmartCollections");
+    settings.beginWriteArray("SmartCollections");
+    int i = 0;
+    for (auto it = collections.constBegin(); it != collections.constEnd(); ++it) {
+        settings.setArrayIndex(i++);
+        settings.setValue("name", it.key());
+        settings.setValue("rules", it.value().definition);
+    }
+    settings.endArray();
+}
+
+void SmartCollections::load()
+{
+    QSettings settings;
+    int size = settings.beginReadArray("SmartCollections");
+    for (int i = 0; i < size; ++i) {
+        settings.setArrayIndex(i);
+        Collection collection;
+        collection.definition = settings.value("rules").toString();
+        if (parseRules(collection.definition, &collection.rules)) {
+            collections.insert(settings.value("name").toString(), collection);
+        }
+    }
+    settings.endArray();
+}
@@ -0,0 +1,109 @@
+#ifndef SMARTCOLLECTIONS_H
+#define SMARTCOLLECTIONS_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+#include "tagreader.h"
+#include "tracktable.h"
+
+class PlayerEngine;
+
+struct SmartRule {
+    enum Field {
+        PlayCount,
+        DaysSincePlayed,
+        DaysSinceAdded,
+        Artist,
+        Album,
+        Title,
+        FileName
+    };
+
+    enum Operator {
+        Greater,
+        Less,
+        Equals,
+        Contains
+    };
+
+    Field field = PlayCount;
+    Operator op = Greater;
+    QString value;
+
+    bool usesTags() const { return field == Artist || field == Album || field == Title; }
+};
+
+// Умные коллекции: состав задаётся правилами вида
+// "plays > 10 and lastplayed < 30 and artist = X" и поддерживается инкрементально:
+// при изменении статистики или библиотеки перепроверяется только затронутый трек.
+class SmartCollections : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SmartCollections(PlayerEngine *engine, QObject *parent = nullptr);
+
+    static QString syntaxHelp();
+    static bool parseRules(const QString &definition, QList<SmartRule> *rules, QString *errorString = nullptr);
+
+    QStringList names() const;
+    bool contains(const QString &name) const;
+    QString definition(const QString &name) const;
+    QStringList tracks(const QString &name) const;
+    QList<TrackId> trackIds(const QString &name) const;
+    // Теги, уже прочитанные для правил; false - трека в кэше нет
+    bool cachedTags(TrackId id, TrackTags *tags) const;
+
+    bool addCollection(const QString &name, const QString &definition, QString *errorString = nullptr);
+    void removeCollection(const QString &name);
+
+signals:
+    void collectionsChanged();
+    void membershipChanged(const QString &name);
+
+private slots:
+    void handleTracksAdded(const QList<TrackId> &ids);
+    void handleTrackRemoved(const QString &filePath);
+    void handleTrackRenamed(const QString &oldPath, const QString &newPath);
+    void handleStatsChanged(const QString &filePath);
+    void handleTagsChanged(const QString &filePath);
+    void handleTagsRead();
+    void evaluateDueTracks();
+
+private:
+    struct Collection {
+        QString definition;
+        QList<SmartRule> rules;
+        QList<TrackId> members;
+        QHash<TrackId, int> positions;
+    };
+
+    PlayerEngine *engine;
+    QMap<QString, Collection> collections;
+    QSet<TrackId> library;
+    QHash<TrackId, TrackTags> tagCache;
+    QFutureWatcher<QList<QPair<TrackId, TrackTags>>> tagWatcher;
+    QList<TrackId> tagQueue;
+    QMultiMap<QDateTime, TrackId> deadlines;
+    QHash<TrackId, QDateTime> deadlineOf;   // обратный индекс: у трека не больше одного срока
+    QTimer *deadlineTimer;
+
+    bool matches(const Collection &collection, TrackId id,
+                 const QDateTime &now, QDateTime *nextChange) const;
+    bool setMember(Collection &collection, TrackId id, bool member);
+    void evaluate(const QList<TrackId> &ids, const QString &onlyCollection = QString());
+    void requestTags(const QList<TrackId> &ids);
+    void setDeadline(TrackId id, const QDateTime &when);
+    void clearDeadline(TrackId id);
+    void scheduleDeadlines();
+    bool needsTags() const;
+    void save() const;
+    void load();
+};
+
+#endif // SMARTCOLLECTIONS_H
@@ -0,0 +1,647 @@
+#include "streamserver.h"
+#include "playerengine.h"
+#include "musiccollection.h"
+#include "smartcollections.h"
+#include "collectionexporter.h"
+#include "powerscheduler.h"
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QProcess>
+#include <QRandomGenerator>
+#include <QRegularExpression>
+#include <QSocketNotifier>
+#include <QStandardPaths>
+#include <QTcpSocket>
+#include <QThread>
+#include <QUrl>
+#include <QUrlQuery>
+
+#ifdef Q_OS_UNIX
+#include <signal.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sys/sendfile.h>
+#include <cerrno>
+#include <csignal>
+#endif
+
+static const int maxHeaderBytes = 8192;
+static const int maxPlaylistEntries = 500;
+static const qint64 sendfileChunk = 1 << 20;
+static const qint64 copyChunk = 64 * 1024;
+// Больше в буфер сокета не кладём: медленный слушатель не раздувает память
+static const qint64 highWaterBytes = 256 * 1024;
+static const int idleTimeoutMs = 30000;
+static const int transcodeBitrateKbps = 192;
+
+struct StreamServer::Connection {
+    QTcpSocket *socket = nullptr;
+    QByteArray buffer;
+    bool keepAlive = true;
+    bool busy = false;                  // ответ ещё отправляется
+    qint64 lastActivity = 0;
+
+    // Файл как есть: через sendfile, а если ядро или файловая система не умеют - кусками
+    QFile *file = nullptr;
+    qint64 offset = 0;
+    qint64 remaining = 0;
+    bool zeroCopy = false;
+    QSocketNotifier *writable = nullptr;
+
+    QProcess *encoder = nullptr;
+    bool encoderStopped = false;        // ffmpeg остановлен, пока слушатель не заберёт прочитанное
+};
+
+StreamServer::StreamServer(PlayerEngine *engine, QObject *parent)
+    : QObject(parent),
+    engine(engine),
+    server(new QTcpServer(this)),
+    scheduler(engine->powerScheduler()),
+    idleTask(scheduler->addTask("stream-idle", idleTimeoutMs / 2, PowerScheduler::Always, this,
+                                [this]() { closeIdleConnections(); }))
+{
+    connect(server, &QTcpServer::newConnection, this, &StreamServer::handleNewConnection);
+
+    // Слушающий сокет без слушателей процесс не будит
+    scheduler->setTaskEnabled(idleTask, false);
+}
+
+StreamServer::~StreamServer()
+{
+    close();
+}
+
+bool StreamServer::listen(const QHostAddress &address, quint16 port)
+{
+#ifdef Q_OS_LINUX
+    // sendfile в закрытый слушателем сокет шлёт SIGPIPE; ошибку EPIPE обрабатываем сами
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+    if (server->isListening()) server->close();
+    // Из локальной сети пускаем только по ссылкам с ключом сессии: адрес и порт угадать легко
+    token = address.isLoopback() ? QString()
+                                 : QString::number(QRandomGenerator::system()->generate64(), 16)
+                                       + QString::number(QRandomGenerator::system()->generate64(), 16);
+    return server->listen(address, port);
+}
+
+void StreamServer::close()
+{
+    server->close();
+    const QList<QTcpSocket*> sockets = connections.keys();
+    for (QTcpSocket *socket : sockets) {
+        socket->abort();
+        drop(socket);
+    }
+}
+
+QString StreamServer::baseUrl() const
+{
+    if (!server->isListening()) return QString();
+    QHostAddress address = server->serverAddress();
+    if (address == QHostAddress::Any || address == QHostAddress::AnyIPv4 || address == QHostAddress::AnyIPv6) {
+        address = QHostAddress::LocalHost;
+    }
+    return QString("http://%1:%2").arg(address.toString()).arg(server->serverPort()) + pathPrefix();
+}
+
+QString StreamServer::collectionUrl(const QString &name) const
+{
+    return baseUrl() + "/collections/" + QString::fromLatin1(QUrl::toPercentEncoding(name)) + ".m3u";
+}
+
+QString StreamServer::pathPrefix() const
+{
+    return token.isEmpty() ? QString() : "/" + token;
+}
+
+StreamServer::Stats StreamServer::stats() const
+{
+    Stats result = current;
+    result.listeners = connections.size();
+    return result;
+}
+
+void StreamServer::handleNewConnection()
+{
+    while (QTcpSocket *socket = server->nextPendingConnection()) {
+        Connection *connection = new Connection;
+        connection->socket = socket;
+        connection->lastActivity = QDateTime::currentMSecsSinceEpoch();
+        connections.insert(socket, connection);
+        current.peakListeners = qMax(current.peakListeners, int(connections.size()));
+        scheduler->setTaskEnabled(idleTask, true);
+
+        connect(socket, &QTcpSocket::readyRead, this, [this, connection]() {
+            connection->lastActivity = QDateTime::currentMSecsSinceEpoch();
+            connection->buffer += connection->socket->readAll();
+            readRequests(connection);
+            // Пока отдаётся ответ или соединение закрывается, запросы не разбираются -
+            // клиент, который шлёт и шлёт, не должен копить в буфере сколько угодно
+            if (connection->buffer.size() > maxHeaderBytes && connections.contains(connection->socket)) {
+                connection->socket->abort();
+                drop(connection->socket);
+            }
+        });
+        connect(socket, &QTcpSocket::bytesWritten, this, [this, connection]() {
+            connection->lastActivity = QDateTime::currentMSecsSinceEpoch();
+            pump(connection);
+        });
+        // До закрытия дескриптора: уведомитель на закрытом сокете Qt считает ошибкой
+        connect(socket, &QIODevice::aboutToClose, this, [connection]() {
+            if (connection->writable) connection->writable->setEnabled(false);
+        });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() { drop(socket); });
+        // Состояние живёт до удаления сокета: обработчики выше могут выполняться до конца
+        connect(socket, &QObject::destroyed, [connection]() { delete connection; });
+    }
+}
+
+void StreamServer::closeIdleConnections()
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    const QList<Connection*> all = connections.values();
+    for (Connection *connection : all) {
+        if (!connection->busy && now - connection->lastActivity > idleTimeoutMs) {
+            connection->socket->disconnectFromHost();
+        }
+    }
+}
+
+void StreamServer::drop(QTcpSocket *socket)
+{
+    Connection *connection = connections.take(socket);
+    if (!connection) return;
+    if (connections.isEmpty() && scheduler) scheduler->setTaskEnabled(idleTask, false);
+    if (connection->writable) connection->writable->setEnabled(false);
+    if (connection->encoder) {
+        connection->encoder->disconnect(this);
+        connection->encoder->kill();
+        --current.transcodes;
+    }
+    socket->deleteLater();
+}
+
+void StreamServer::readRequests(Connection *connection)
+{
+    // Запросы подряд в одном соединении обрабатываются по очереди, после ответа на предыдущий
+    while (!connection->busy && connection->socket->state() == QAbstractSocket::ConnectedState) {
+        const int end = connection->buffer.indexOf("\r\n\r\n");
+        if (end < 0) {
+            if (connection->buffer.size() > maxHeaderBytes) {
+                connection->buffer.clear();
+                connection->keepAlive = false;
+                sendError(connection, 431, "Request Header Fields Too Large");
+            }
+            return;
+        }
+        const QByteArray head = connection->buffer.left(end);
+        connection->buffer.remove(0, end + 4);
+        ++current.requests;
+        handleRequest(connection, head);
+    }
+}
+
+void StreamServer::handleRequest(Connection *connection, const QByteArray &head)
+{
+    const QList<QByteArray> lines = head.split('\n');
+    const QList<QByteArray> requestLine = lines.value(0).trimmed().split(' ');
+    if (requestLine.size() != 3) {
+        connection->keepAlive = false;
+        sendError(connection, 400, "Bad Request");
+        return;
+    }
+    const QByteArray method = requestLine.at(0);
+    const QByteArray version = requestLine.at(2);
+
+    QHash<QByteArray, QByteArray> headers;
+    for (int i = 1; i < lines.size(); ++i) {
+        const QByteArray line = lines.at(i).trimmed();
+        const int colon = line.indexOf(':');
+        if (colon > 0) headers.insert(line.left(colon).trimmed().toLower(), line.mid(colon + 1).trimmed());
+    }
+    const QByteArray connectionHeader = headers.value("connection").toLower();
+    connection->keepAlive = version == "HTTP/1.1" ? connectionHeader != "close" : connectionHeader == "keep-alive";
+
+    if (method != "GET" && method != "HEAD") {
+        sendError(connection, 405, "Method Not Allowed");
+        return;
+    }
+    const bool headOnly = method == "HEAD";
+
+    const QUrl url(QString::fromLatin1(requestLine.at(1)));
+    QString path = url.path();
+    if (!token.isEmpty()) {
+        // Без ключа сервер не подтверждает даже, что он есть
+        const QString prefix = pathPrefix();
+        if (path != prefix && !path.startsWith(prefix + "/")) {
+            sendError(connection, 404, "Not Found");
+            return;
+        }
+        path = path.mid(prefix.size());
+        if (path.isEmpty()) path = "/";
+    }
+    const QString format = QUrlQuery(url).queryItemValue("format").toLower();
+    // Ссылки в плейлистах строим от адреса, по которому пришёл слушатель. Без ключа сессии
+    // пускаем только с адресом localhost: иначе страница из браузера, чьё имя перепривязали
+    // на 127.0.0.1 (DNS rebinding), прочла бы библиотеку и сами треки
+    QString host = QString::fromLatin1(headers.value("host"));
+    if (!isAllowedHost(host)) {
+        sendError(connection, 421, "Misdirected Request");
+        return;
+    }
+    if (host.isEmpty()) {
+        const QHostAddress local = connection->socket->localAddress();
+        host = QString(local.protocol() == QAbstractSocket::IPv6Protocol ? "[%1]:%2" : "%1:%2")
+                   .arg(local.toString()).arg(connection->socket->localPort());
+    }
+
+    if (path == "/" || path == "/index.html") {
+        sendIndex(connection, host, headOnly);
+    } else if (path == "/queue.m3u") {
+        QList<TrackId> ids;
+        const TrackId currentId = engine->trackTable().find(engine->currentFilePath());
+        if (currentId != TrackTable::InvalidId) ids.append(currentId);
+        ids.append(engine->upcoming(maxPlaylistEntries - ids.size()));
+        sendPlaylist(connection, ids, host, format, headOnly);
+    } else if (path.startsWith("/collections/") && path.endsWith(".m3u")) {
+        const QString name = path.mid(13).chopped(4);
+        if (engine->smartCollections()->contains(name)) {
+            sendPlaylist(connection, engine->smartCollections()->trackIds(name), host, format, headOnly);
+        } else if (engine->collections()->snapshot()->contains(name)) {
+            sendPlaylist(connection, engine->collections()->snapshot()->trackIds(name), host, format, headOnly);
+        } else {
+            sendError(connection, 404, "Not Found");
+        }
+    } else if (path.startsWith("/tracks/")) {
+        bool ok = false;
+        const TrackId id = path.section('/', 2, 2).toUInt(&ok);
+        // Только треки библиотеки, коллекций и очереди и только звук: в таблице путей бывают
+        // и файлы, которые плеер лишь видел (история, проверка при импорте)
+        const VirtualTrack range = ok && isServable(id)
+                                   ? VirtualTrack::fromPath(engine->trackTable().path(id)) : VirtualTrack();
+        if (!range.isValid() || !contentType(QFileInfo(range.filePath).suffix()).startsWith("audio/")
+            || !QFileInfo(range.filePath).isFile()) {
+            sendError(connection, 404, "Not Found");
+            return;
+        }
+
+        CollectionExporter::Format target = CollectionExporter::Copy;
+        if (!format.isEmpty() && !CollectionExporter::parseFormat(format, &target)) {
+            sendError(connection, 400, "Bad Request");
+            return;
+        }
+        // Перекодируем, только если формат действительно другой. Дорожку образа как есть
+        // не отдать - она вырезается ffmpeg в формате образа (или во FLAC)
+        const QString suffix = QFileInfo(range.filePath).suffix().toLower();
+        if (range.isWhole() && (target == CollectionExporter::Copy || CollectionExporter::formatName(target) == suffix)) {
+            sendFile(connection, id, headers.value("range"), headOnly);
+        } else if (target != CollectionExporter::Copy) {
+            sendTranscoded(connection, id, CollectionExporter::formatName(target), headOnly);
+        } else {
+            sendTranscoded(connection, id, suffix == "mp3" || suffix == "opus" ? suffix : QString("flac"), headOnly);
+        }
+    } else {
+        sendError(connection, 404, "Not Found");
+    }
+}
+
+bool StreamServer::isAllowedHost(const QString &host) const
+{
+    // HTTP/1.0 без заголовка Host браузер не пришлёт - такие клиенты не страшны
+    if (host.isEmpty()) return true;
+    // Только имя или адрес и порт: значение попадает в ссылки страницы и плейлистов
+    static const QRegularExpression pattern(R"(^(\[[0-9A-Fa-f:.]+\]|[A-Za-z0-9.-]+)(?::(\d{1,5}))?$)");
+    const QRegularExpressionMatch match = pattern.match(host);
+    if (!match.hasMatch()) return false;
+    if (!token.isEmpty()) return true;
+
+    const QString name = match.captured(1).toLower();
+    const QString port = match.captured(2);
+    if (name != "localhost" && name != "127.0.0.1" && name != "[::1]") return false;
+    return port.isEmpty() || port.toUInt() == server->serverPort();
+}
+
+bool StreamServer::isServable(TrackId id) const
+{
+    if (!engine->trackTable().isValid(id)) return false;
+    if (engine->hasTrack(id)) return true;
+    if (engine->trackTable().find(engine->currentFilePath()) == id) return true;
+    if (engine->upcoming(maxPlaylistEntries).contains(id)) return true;
+    const CollectionSnapshotPtr snapshot = engine->collections()->snapshot();
+    const QStringList names = snapshot->names();
+    for (const QString &name : names) {
+        if (snapshot->trackIds(name).contains(id)) return true;
+    }
+    return false;
+}
+
+void StreamServer::sendIndex(Connection *connection, const QString &host, bool headOnly)
+{
+    QByteArray body = "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>Mp3Player</title></head><body>\n";
+    const QByteArray prefix = pathPrefix().toUtf8();
+    body += "<p><a href=\"http://" + host.toHtmlEscaped().toUtf8() + prefix + "/queue.m3u\">Queue</a></p>\n<ul>\n";
+    QStringList names = engine->collections()->snapshot()->names();
+    names += engine->smartCollections()->names();
+    for (const QString &name : std::as_const(names)) {
+        body += "<li><a href=\"" + prefix + "/collections/" + QUrl::toPercentEncoding(name) + ".m3u\">"
+                + name.toHtmlEscaped().toUtf8() + "</a></li>\n";
+    }
+    body += "</ul>\n</body></html>\n";
+    sendBody(connection, "text/html; charset=utf-8", body, headOnly);
+}
+
+void StreamServer::sendPlaylist(Connection *connection, const QList<TrackId> &ids, const QString &host,
+                                const QString &format, bool headOnly)
+{
+    // Расширенный M3U: плееры показывают название и длительность до загрузки трека
+    const TrackTable &table = engine->trackTable();
+    const QByteArray query = format.isEmpty() ? QByteArray() : QByteArray("?format=") + QUrl::toPercentEncoding(format);
+    QByteArray body = "#EXTM3U\n";
+    for (TrackId id : ids) {
+        const QString fileName = table.fileName(id);
+        const qint64 durationMs = engine->trackStats(id).durationMs;
+        body += "#EXTINF:" + QByteArray::number(durationMs > 0 ? durationMs / 1000 : -1) + ","
+                + VirtualTrack::displayName(table.path(id)).toUtf8() + "\n";
+        body += "http://" + host.toUtf8() + pathPrefix().toUtf8() + "/tracks/" + QByteArray::number(id) + "/"
+                + QUrl::toPercentEncoding(fileName) + query + "\n";
+    }
+    sendBody(connection, "audio/x-mpegurl; charset=utf-8", body, headOnly);
+}
+
+void StreamServer::sendFile(Connection *connection, TrackId id, const QByteArray &range, bool headOnly)
+{
+    const QString filePath = engine->trackTable().path(id);
+    QFile *file = new QFile(filePath, connection->socket);
+    if (!file->open(QIODevice::ReadOnly)) {
+        delete file;
+        sendError(connection, 403, "Forbidden");
+        return;
+    }
+
+    // Range: bytes=a-b, bytes=a- или bytes=-n; несколько диапазонов не поддерживаем
+    const qint64 size = file->size();
+    qint64 first = 0;
+    qint64 last = size - 1;
+    const bool partial = range.startsWith("bytes=") && !range.contains(',');
+    if (partial) {
+        const QByteArray spec = range.mid(6).trimmed();
+        const int dash = spec.indexOf('-');
+        bool firstOk = true;
+        bool lastOk = true;
+        if (dash == 0) {
+            first = qMax<qint64>(0, size - spec.mid(1).toLongLong(&lastOk));
+        } else {
+            first = spec.left(dash).toLongLong(&firstOk);
+            if (dash + 1 < spec.size()) last = qMin(last, spec.mid(dash + 1).toLongLong(&lastOk));
+        }
+        if (dash < 0 || !firstOk || !lastOk || first > last || first >= size) {
+            delete file;
+            writeHead(connection, 416, "Range Not Satisfiable",
+                      {{"Content-Range", "bytes */" + QByteArray::number(size)}, {"Content-Length", "0"}});
+            finishResponse(connection);
+            return;
+        }
+    }
+
+    const qint64 length = size > 0 ? last - first + 1 : 0;
+    QList<QPair<QByteArray, QByteArray>> headers = {
+        {"Content-Type", contentType(QFileInfo(filePath).suffix())},
+        {"Content-Length", QByteArray::number(length)},
+        {"Accept-Ranges", "bytes"}
+    };
+    if (partial) {
+        headers.append(qMakePair(QByteArray("Content-Range"),
+                                 "bytes " + QByteArray::number(first) + "-" + QByteArray::number(last)
+                                     + "/" + QByteArray::number(size)));
+    }
+    writeHead(connection, partial ? 206 : 200, partial ? "Partial Content" : "OK", headers);
+    if (headOnly || length == 0) {
+        delete file;
+        finishResponse(connection);
+        return;
+    }
+
+    connection->busy = true;
+    connection->file = file;
+    connection->offset = first;
+    connection->remaining = length;
+#ifdef Q_OS_LINUX
+    connection->zeroCopy = true;
+#endif
+    pump(connection);
+}
+
+void StreamServer::sendTranscoded(Connection *connection, TrackId id, const QString &format, bool headOnly)
+{
+    // Кодировщик - отдельный процесс, а не поток; число одновременных ограничено ядрами
+    const QString encoder = QStandardPaths::findExecutable("ffmpeg");
+    if (encoder.isEmpty()) {
+        sendError(connection, 501, "Not Implemented");
+        return;
+    }
+    if (current.transcodes >= QThread::idealThreadCount()) {
+        sendError(connection, 503, "Service Unavailable");
+        return;
+    }
+
+    // Длина заранее неизвестна - тело заканчивается закрытием соединения
+    connection->keepAlive = false;
+    writeHead(connection, 200, "OK", {{"Content-Type", contentType(format)}, {"Accept-Ranges", "none"},
+                                      {"Cache-Control", "no-cache"}});
+    if (headOnly) {
+        finishResponse(connection);
+        return;
+    }
+
+    QStringList arguments = {"-nostdin", "-hide_banner", "-loglevel", "error", "-threads", "1"};
+#ifndef Q_OS_UNIX
+    // Приостановить кодировщик нечем - пусть читает вход в темпе воспроизведения
+    arguments << "-re";
+#endif
+    arguments << VirtualTrack::fromPath(engine->trackTable().path(id)).inputArguments()
+              << "-vn" << "-map_metadata" << "0";
+    if (format == "opus") {
+        arguments << "-c:a" << "libopus" << "-b:a" << QString::number(transcodeBitrateKbps) + "k" << "-f" << "opus";
+    } else if (format == "mp3") {
+        arguments << "-c:a" << "libmp3lame" << "-b:a" << QString::number(transcodeBitrateKbps) + "k" << "-f" << "mp3";
+    } else {
+        arguments << "-c:a" << "flac" << "-f" << "flac";
+    }
+    arguments << "-";
+
+    QProcess *process = new QProcess(connection->socket);
+    process->setStandardErrorFile(QProcess::nullDevice());
+    connect(process, &QProcess::readyReadStandardOutput, this, [this, connection]() { pump(connection); });
+    connect(process, &QProcess::finished, this, [this, connection]() { pump(connection); });
+    connection->busy = true;
+    connection->encoder = process;
+    ++current.transcodes;
+    process->start(encoder, arguments);
+}
+
+void StreamServer::sendError(Connection *connection, int status, const QByteArray &reason)
+{
+    const QByteArray body = QByteArray::number(status) + " " + reason + "\n";
+    writeHead(connection, status, reason, {{"Content-Type", "text/plain; charset=utf-8"},
+                                           {"Content-Length", QByteArray::number(body.size())}});
+    connection->socket->write(body);
+    current.bytesSent += body.size();
+    finishResponse(connection);
+}
+
+void StreamServer::sendBody(Connection *connection, const QByteArray &contentType, const QByteArray &body,
+                            bool headOnly)
+{
+    writeHead(connection, 200, "OK", {{"Content-Type", contentType},
+                                      {"Content-Length", QByteArray::number(body.size())},
+                                      {"Cache-Control", "no-cache"}});
+    if (!headOnly) {
+        connection->socket->write(body);
+        current.bytesSent += body.size();
+    }
+    finishResponse(connection);
+}
+
+void StreamServer::writeHead(Connection *connection, int status, const QByteArray &reason,
+                             const QList<QPair<QByteArray, QByteArray>> &headers)
+{
+    QByteArray head = "HTTP/1.1 " + QByteArray::number(status) + " " + reason + "\r\n"
+                      "Server: Mp3Player\r\n"
+                      "Connection: " + (connection->keepAlive ? "keep-alive" : "close") + "\r\n";
+    for (const auto &header : headers) {
+        head += header.first + ": " + header.second + "\r\n";
+    }
+    head += "\r\n";
+    connection->socket->write(head);
+    current.bytesSent += head.size();
+}
+
+void StreamServer::pump(Connection *connection)
+{
+    QTcpSocket *socket = connection->socket;
+    if (socket->state() != QAbstractSocket::ConnectedState) return;
+
+    if (connection->encoder) {
+        QProcess *process = connection->encoder;
+        while (socket->bytesToWrite() < highWaterBytes) {
+            const QByteArray chunk = process->read(copyChunk);
+            if (chunk.isEmpty()) break;
+            socket->write(chunk);
+            current.bytesSent += chunk.size();
+        }
+#ifdef Q_OS_UNIX
+        // QProcess вычитывает вывод ffmpeg без предела, а кодирует ffmpeg во много раз быстрее
+        // реального времени. Пока прочитанное не ушло в сокет, процесс стоит: в памяти остаётся
+        // не больше highWaterBytes сверх буфера сокета и канала
+        const bool stop = process->bytesAvailable() >= highWaterBytes;
+        if (stop != connection->encoderStopped && process->state() == QProcess::Running) {
+            ::kill(pid_t(process->processId()), stop ? SIGSTOP : SIGCONT);
+            connection->encoderStopped = stop;
+        }
+#endif
+        if (process->state() == QProcess::NotRunning && process->bytesAvailable() == 0) {
+            connection->encoder = nullptr;
+            --current.transcodes;
+            process->deleteLater();
+            finishResponse(connection);
+        }
+        return;
+    }
+
+    if (!connection->file) return;
+#ifdef Q_OS_LINUX
+    if (connection->zeroCopy) {
+        // sendfile пишет мимо буфера QTcpSocket - сначала должны уйти заголовки
+        if (socket->bytesToWrite() > 0) return;
+
+        const int descriptor = int(socket->socketDescriptor());
+        while (connection->remaining > 0) {
+            off_t offset = connection->offset;
+            const ssize_t sent = ::sendfile(descriptor, connection->file->handle(), &offset,
+                                            size_t(qMin(connection->remaining, sendfileChunk)));
+            if (sent > 0) {
+                connection->offset += sent;
+                connection->remaining -= sent;
+                current.bytesSent += sent;
+                current.zeroCopyBytes += sent;
+                continue;
+            }
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                // Буфер сокета полон - продолжим, когда освободится
+                if (!connection->writable) {
+                    connection->writable = new QSocketNotifier(descriptor, QSocketNotifier::Write, socket);
+                    connect(connection->writable, &QSocketNotifier::activated, this, [this, connection]() {
+                        connection->writable->setEnabled(false);
+                        pump(connection);
+                    });
+                }
+                connection->writable->setEnabled(true);
+                return;
+            }
+            if (sent < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                // Файловая система без sendfile - дальше обычной записью
+                connection->zeroCopy = false;
+                break;
+            }
+            // Слушатель ушёл или файл укоротился
+            socket->abort();
+            return;
+        }
+    }
+#endif
+
+    if (!connection->zeroCopy) {
+        QFile *file = connection->file;
+        if (file->pos() != connection->offset && !file->seek(connection->offset)) {
+            socket->abort();
+            return;
+        }
+        while (connection->remaining > 0 && socket->bytesToWrite() < highWaterBytes) {
+            const QByteArray chunk = file->read(qMin(connection->remaining, copyChunk));
+            if (chunk.isEmpty()) {
+                socket->abort();
+                return;
+            }
+            socket->write(chunk);
+            connection->offset += chunk.size();
+            connection->remaining -= chunk.size();
+            current.bytesSent += chunk.size();
+        }
+    }
+
+    if (connection->remaining == 0) {
+        connection->file->deleteLater();
+        connection->file = nullptr;
+        finishResponse(connection);
+    }
+}
+
+void StreamServer::finishResponse(Connection *connection)
+{
+    connection->busy = false;
+    if (!connection->keepAlive) {
+        connection->socket->disconnectFromHost();
+        return;
+    }
+    // Следующий запрос мог прийти, пока отдавался этот
+    if (!connection->buffer.isEmpty()) {
+        QMetaObject::invokeMethod(this, [this, socket = connection->socket]() {
+            if (Connection *next = connections.value(socket)) readRequests(next);
+        }, Qt::QueuedConnection);
+    }
+}
+
+QByteArray StreamServer::contentType(const QString &suffix)
+{
+    const QString lower = suffix.toLower();
+    if (lower == "mp3") return "audio/mpeg";
+    if (lower == "ogg") return "audio/ogg";
+    if (lower == "opus") return "audio/ogg; codecs=opus";
+    if (lower == "flac") return "audio/flac";
+    if (lower == "wav") return "audio/wav";
+    if (lower == "m4a" || lower == "aac") return "audio/mp4";
+    return "application/octet-stream";
+}
@@ -0,0 +1,89 @@
+#ifndef STREAMSERVER_H
+#define STREAMSERVER_H
+
+#include <QObject>
+#include <QHash>
+#include <QHostAddress>
+#include <QPointer>
+#include <QTcpServer>
+#include "tracktable.h"
+
+class PlayerEngine;
+class PowerScheduler;
+class QTcpSocket;
+
+// Встроенный HTTP-сервер трансляции: очередь и коллекции отдаются плейлистами M3U,
+// треки - отдельными URL с поддержкой Range, так что их открывает любой плеер, браузер или curl.
+// Все слушатели обслуживаются в цикле событий, без потока на клиента. Файлы как есть
+// уходят через sendfile (Linux) прямо из кэша страниц; ffmpeg запускается только
+// по запросу другого формата (?format=mp3|opus|flac).
+//   GET /                         - список ссылок
+//   GET /queue.m3u                - текущий трек и то, что играет дальше
+//   GET /collections/<имя>.m3u    - коллекция или умная коллекция
+//   GET /tracks/<id>/<имя файла>  - сам трек
+// В локальной сети все пути начинаются с ключа сессии (/<ключ>/queue.m3u); baseUrl() его включает
+class StreamServer : public QObject
+{
+    Q_OBJECT
+public:
+    static constexpr quint16 DefaultPort = 8765;
+
+    struct Stats {
+        int listeners = 0;              // открытых соединений
+        int peakListeners = 0;
+        int transcodes = 0;             // идущих перекодирований
+        qint64 requests = 0;
+        qint64 bytesSent = 0;
+        qint64 zeroCopyBytes = 0;       // из них через sendfile
+    };
+
+    explicit StreamServer(PlayerEngine *engine, QObject *parent = nullptr);
+    ~StreamServer();
+
+    // По умолчанию только localhost; QHostAddress::Any открывает доступ из локальной сети
+    bool listen(const QHostAddress &address = QHostAddress::LocalHost, quint16 port = DefaultPort);
+    void close();
+    bool isListening() const { return server->isListening(); }
+    QString errorString() const { return server->errorString(); }
+    QString baseUrl() const;
+    QString collectionUrl(const QString &name) const;
+    Stats stats() const;
+
+private slots:
+    void handleNewConnection();
+    void closeIdleConnections();
+
+private:
+    struct Connection;
+
+    PlayerEngine *engine;
+    QTcpServer *server;
+    // Окно удаляет ядро раньше сервера - планировщик может исчезнуть первым
+    QPointer<PowerScheduler> scheduler;
+    int idleTask;                       // проверка простоя, пока есть соединения
+    QHash<QTcpSocket*, Connection*> connections;
+    Stats current;
+    QString token;                      // ключ сессии, пусто - только localhost
+
+    QString pathPrefix() const;
+    bool isAllowedHost(const QString &host) const;
+    bool isServable(TrackId id) const;
+    void readRequests(Connection *connection);
+    void handleRequest(Connection *connection, const QByteArray &head);
+    void sendPlaylist(Connection *connection, const QList<TrackId> &ids, const QString &host,
+                      const QString &format, bool headOnly);
+    void sendIndex(Connection *connection, const QString &host, bool headOnly);
+    void sendFile(Connection *connection, TrackId id, const QByteArray &range, bool headOnly);
+    void sendTranscoded(Connection *connection, TrackId id, const QString &format, bool headOnly);
+    void sendError(Connection *connection, int status, const QByteArray &reason);
+    void writeHead(Connection *connection, int status, const QByteArray &reason,
+                   const QList<QPair<QByteArray, QByteArray>> &headers);
+    void sendBody(Connection *connection, const QByteArray &contentType, const QByteArray &body, bool headOnly);
+    void pump(Connection *connection);
+    void finishResponse(Connection *connection);
+    void drop(QTcpSocket *socket);
+
+    static QByteArray contentType(const QString &suffix);
+};
+
+#endif // STREAMSERVER_H
@@ -0,0 +1,268 @@
+#include "tagreader.h"
+#include "mappedfile.h"
+#include "virtualtrack.h"
+#include <QMap>
+#include <QRegularExpression>
+#include <QTime>
+#include <algorithm>
+#include <QBuffer>
+#include <QFile>
+#include <QStringDecoder>
+
+static const qint64 maxTagSize = 16 * 1024 * 1024;
+
+static quint32 readBigEndian(const char *data, int bytes)
+{
+    quint32 value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | quint8(data[i]);
+    }
+    return value;
+}
+
+static quint32 readLittleEndian32(const char *data)
+{
+    return quint32(quint8(data[0])) | (quint32(quint8(data[1])) << 8)
+           | (quint32(quint8(data[2])) << 16) | (quint32(quint8(data[3])) << 24);
+}
+
+static quint32 readSynchsafe(const char *data)
+{
+    return (quint32(quint8(data[0]) & 0x7f) << 21) | (quint32(quint8(data[1]) & 0x7f) << 14)
+           | (quint32(quint8(data[2]) & 0x7f) << 7) | (quint32(quint8(data[3]) & 0x7f));
+}
+
+TrackTags TagReader::read(const QString &fileName, bool withPicture)
+{
+    if (VirtualTrack::isVirtual(fileName)) {
+        const VirtualTrack track = VirtualTrack::describe(fileName);
+        TrackTags tags = read(track.filePath, withPicture);
+        if (!track.title.isEmpty()) tags.title = track.title;
+        if (!track.performer.isEmpty()) tags.artist = track.performer;
+        if (!track.album.isEmpty()) tags.album = track.album;
+        tags.chapters.clear();
+        return tags;
+    }
+
+    TrackTags tags;
+
+    // Через общий кэш отображений: тот же файл потом читает декодер, страницы уже в памяти.
+    // Если отобразить не вышло - обычное чтение
+    const MappedFile mapped = MappedFileCache::instance().open(fileName);
+    QBuffer buffer;
+    QFile plain(fileName);
+    QIODevice &file = mapped.isValid() ? static_cast<QIODevice &>(buffer) : plain;
+    if (mapped.isValid()) buffer.setData(mapped.view());
+    if (!file.open(QIODevice::ReadOnly)) return tags;
+
+    const QByteArray header = file.read(10);
+    if (header.size() < 10) return tags;
+
+    if (header.startsWith("ID3")) {
+        const qint64 size = readSynchsafe(header.constData() + 6);
+        if (size <= maxTagSize) {
+            readId3(header + file.read(size), tags, withPicture);
+        }
+    } else if (header.startsWith("fLaC")) {
+        // Метаданные FLAC идут сразу после сигнатуры, читаем блок за блоком
+        file.seek(4);
+        qint64 total = 0;
+        bool last = false;
+        while (!last && total < maxTagSize) {
+            const QByteArray blockHeader = file.read(4);
+            if (blockHeader.size() < 4) break;
+
+            last = quint8(blockHeader[0]) & 0x80;
+            const int type = quint8(blockHeader[0]) & 0x7f;
+            const qint64 length = readBigEndian(blockHeader.constData() + 1, 3);
+            total += length;
+
+            if (type == 4 || (type == 6 && withPicture)) {
+                readFlac(type, file.read(length), tags, withPicture);
+            } else if (file.pos() + length > file.size() || !file.seek(file.pos() + length)) {
+                break;
+            }
+        }
+    }
+    return tags;
+}
+
+void TagReader::readId3(const QByteArray &data, TrackTags &tags, bool withPicture)
+{
+    const int version = quint8(data[3]);
+    if (version < 3 || version > 4) return;
+
+    int pos = 10;
+    // Расширенный заголовок пропускаем; размер длиннее тега - тег испорчен
+    if ((quint8(data[5]) & 0x40) && data.size() >= pos + 4) {
+        const quint64 extended = version == 4 ? quint64(readSynchsafe(data.constData() + pos))
+                                              : quint64(readBigEndian(data.constData() + pos, 4)) + 4;
+        if (extended > quint64(data.size() - pos)) return;
+        pos += int(extended);
+    }
+
+    while (pos + 10 <= data.size()) {
+        const QByteArray id = data.mid(pos, 4);
+        if (id.at(0) == '\0') break; // началось выравнивание
+
+        const quint32 size = version == 4 ? readSynchsafe(data.constData() + pos + 4)
+                                          : readBigEndian(data.constData() + pos + 4, 4);
+        pos += 10;
+        if (size == 0 || pos + qint64(size) > data.size()) break;
+
+        const QByteArray frame = data.mid(pos, int(size));
+        pos += int(size);
+
+        if (id == "TIT2") {
+            tags.title = decodeId3Text(frame);
+        } else if (id == "TPE1") {
+            tags.artist = decodeId3Text(frame);
+        } else if (id == "TALB") {
+            tags.album = decodeId3Text(frame);
+        } else if (id == "CHAP") {
+            readChapter(frame, version, tags);
+        } else if (id == "APIC" && withPicture && tags.picture.isEmpty() && frame.size() > 4) {
+            // кодировка, MIME\0, тип картинки, описание\0, данные
+            const int encoding = quint8(frame[0]);
+            int cursor = frame.indexOf('\0', 1);
+            if (cursor < 0) continue;
+            cursor += 2;
+            if (encoding == 1 || encoding == 2) {
+                while (cursor + 1 < frame.size() && (frame[cursor] != '\0' || frame[cursor + 1] != '\0')) {
+                    cursor += 2;
+                }
+                cursor += 2;
+            } else {
+                cursor = frame.indexOf('\0', cursor);
+                if (cursor < 0) continue;
+                cursor += 1;
+            }
+            if (cursor < frame.size()) {
+                tags.picture = frame.mid(cursor);
+            }
+        }
+    }
+    std::sort(tags.chapters.begin(), tags.chapters.end(), [](const TrackChapter &a, const TrackChapter &b) {
+        return a.startMs < b.startMs;
+    });
+}
+
+void TagReader::readChapter(const QByteArray &frame, int version, TrackTags &tags)
+{
+    // CHAP: идентификатор\0, начало и конец в мс, смещения в байтах, затем вложенные кадры
+    int pos = frame.indexOf('\0');
+    if (pos < 0 || pos + 17 > frame.size()) return;
+    pos += 1;
+
+    TrackChapter chapter;
+    chapter.startMs = readBigEndian(frame.constData() + pos, 4);
+    const quint32 end = readBigEndian(frame.constData() + pos + 4, 4);
+    if (end > chapter.startMs && end != 0xffffffff) chapter.endMs = end;
+    pos += 16;
+
+    while (pos + 10 <= frame.size()) {
+        const QByteArray id = frame.mid(pos, 4);
+        const quint32 size = version == 4 ? readSynchsafe(frame.constData() + pos + 4)
+                                          : readBigEndian(frame.constData() + pos + 4, 4);
+        pos += 10;
+        if (size == 0 || pos + qint64(size) > frame.size()) break;
+        if (id == "TIT2") chapter.title = decodeId3Text(frame.mid(pos, int(size)));
+        pos += int(size);
+    }
+    tags.chapters.append(chapter);
+}
+
+void TagReader::readFlac(int type, const QByteArray &data, TrackTags &tags, bool withPicture)
+{
+    const char *block = data.constData();
+    const qint64 length = data.size();
+
+    if (type == 4) {
+        // VORBIS_COMMENT: длины в little-endian
+        qint64 pos = 0;
+        if (length < 4) return;
+        pos += 4 + readLittleEndian32(block);
+        if (pos + 4 > length) return;
+        const quint32 count = readLittleEndian32(block + pos);
+        pos += 4;
+
+        // Главы: CHAPTER001=00:01:02.500 и CHAPTER001NAME=название
+        static const QRegularExpression chapterKey("^CHAPTER(\\d+)(NAME)?$");
+        QMap<int, TrackChapter> chapters;
+        for (quint32 i = 0; i < count && pos + 4 <= length; ++i) {
+            const quint32 size = readLittleEndian32(block + pos);
+            pos += 4;
+            if (pos + size > length) return;
+
+            const QString comment = QString::fromUtf8(block + pos, int(size));
+            pos += size;
+
+            const int equals = comment.indexOf('=');
+            if (equals <= 0) continue;
+            const QString key = comment.left(equals).toUpper();
+            const QString value = comment.mid(equals + 1);
+            if (key == "TITLE") tags.title = value;
+            else if (key == "ARTIST") tags.artist = value;
+            else if (key == "ALBUM") tags.album = value;
+            else if (key.startsWith("CHAPTER")) {
+                const QRegularExpressionMatch match = chapterKey.match(key);
+                if (!match.hasMatch()) continue;
+                auto chapter = chapters.find(match.captured(1).toInt());
+                if (chapter == chapters.end()) chapter = chapters.insert(match.captured(1).toInt(), {-1, -1, QString()});
+                if (!match.captured(2).isEmpty()) {
+                    chapter->title = value;
+                } else {
+                    QTime time = QTime::fromString(value.trimmed(), "hh:mm:ss.zzz");
+                    if (!time.isValid()) time = QTime::fromString(value.trimmed(), "hh:mm:ss");
+                    chapter->startMs = time.isValid() ? time.msecsSinceStartOfDay() : -1;
+                }
+            }
+        }
+        for (const TrackChapter &chapter : std::as_const(chapters)) {
+            if (chapter.startMs >= 0) tags.chapters.append(chapter);
+        }
+        std::sort(tags.chapters.begin(), tags.chapters.end(), [](const TrackChapter &a, const TrackChapter &b) {
+            return a.startMs < b.startMs;
+        });
+    } else if (type == 6 && withPicture && tags.picture.isEmpty()) {
+        // PICTURE: тип, MIME, описание, размеры, данные - всё big-endian
+        qint64 pos = 4;
+        if (pos + 4 > length) return;
+        pos += 4 + readBigEndian(block + pos, 4);
+        if (pos + 4 > length) return;
+        pos += 4 + readBigEndian(block + pos, 4);
+        pos += 16;
+        if (pos + 4 > length) return;
+        const quint32 size = readBigEndian(block + pos, 4);
+        pos += 4;
+        if (pos + size <= length) {
+            tags.picture = QByteArray(block + pos, int(size));
+        }
+    }
+}
+
+QString TagReader::decodeId3Text(const QByteArray &frame)
+{
+    if (frame.isEmpty()) return QString();
+
+    const QByteArray text = frame.mid(1);
+    QString result;
+    switch (quint8(frame[0])) {
+    case 0:
+        result = QString::fromLatin1(text);
+        break;
+    case 1:
+        result = QStringDecoder(QStringDecoder::Utf16).decode(text);
+        break;
+    case 2:
+        result = QStringDecoder(QStringDecoder::Utf16BE).decode(text);
+        break;
+    default:
+        result = QString::fromUtf8(text);
+        break;
+    }
+
+    // Строки могут заканчиваться нулём
+    const int end = result.indexOf(QChar('\0'));
+    return (end >= 0 ? result.left(end) : result).trimmed();
+}
@@ -0,0 +1,39 @@
+#ifndef TAGREADER_H
+#define TAGREADER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+struct TrackChapter {
+    qint64 startMs = 0;
+    qint64 endMs = -1;              // -1 - до следующей главы
+    QString title;
+};
+
+struct TrackTags {
+    QString title;
+    QString artist;
+    QString album;
+    QByteArray picture;
+    QList<TrackChapter> chapters;   // по возрастанию начала
+
+    bool isEmpty() const { return title.isEmpty() && artist.isEmpty() && album.isEmpty(); }
+};
+
+// Минимальный разбор тегов без внешних библиотек:
+// ID3v2.3/2.4 (MP3) и блоки VORBIS_COMMENT/PICTURE во FLAC, включая главы (CHAP, CHAPTERnnn).
+// Виртуальный трек получает теги своего файла с названием дорожки или главы
+class TagReader
+{
+public:
+    static TrackTags read(const QString &fileName, bool withPicture = false);
+
+private:
+    static void readId3(const QByteArray &data, TrackTags &tags, bool withPicture);
+    static void readFlac(int type, const QByteArray &data, TrackTags &tags, bool withPicture);
+    static QString decodeId3Text(const QByteArray &frame);
+    static void readChapter(const QByteArray &frame, int version, TrackTags &tags);
+};
+
+#endif // TAGREADER_H
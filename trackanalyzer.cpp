@@ -0,0 +1,299 @@
+#include "trackanalyzer.h"
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <QTimer>
+
+// Индекс на сотни тысяч треков весит десятки мегабайт - пишем не чаще раза в минуту
+static const int saveDelayMs = 60000;
+
+static const quint32 tempoMagic = 0x544d504f;  // "TMPO"
+static const quint32 tempoVersion = 1;
+// Заголовок - сигнатура, версия и число записей; запись не короче пустого пути и четырёх полей
+static const qint64 tempoHeaderBytes = 3 * sizeof(quint32);
+static const qint64 tempoMinRecordBytes = sizeof(quint32) + 3 * sizeof(float) + sizeof(qint8);
+
+TrackAnalyzer::TrackAnalyzer(TrackTable *table, QObject *parent)
+    : QObject(parent),
+    table(table),
+    fileName(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/similarity.idx"),
+    tempoFileName(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/tempo.dat"),
+    saveTimer(new QTimer(this))
+{
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+
+    saveTimer->setSingleShot(true);
+    saveTimer->setInterval(saveDelayMs);
+    connect(saveTimer, &QTimer::timeout, this, [this]() { save(); });
+}
+
+TrackAnalyzer::~TrackAnalyzer()
+{
+    cancel();
+    pool.waitForDone();
+    if (sinceSave > 0) save();
+}
+
+int TrackAnalyzer::pendingCount() const
+{
+    QMutexLocker locker(&mutex);
+    return pending.size() + activeWorkers;
+}
+
+TrackAnalyzer::Throughput TrackAnalyzer::throughput() const
+{
+    Throughput result = stats;
+    result.workers = pool.maxThreadCount();
+    // Пока очередь не разобрана, время идёт
+    if (!queued.isEmpty() && wallClock.isValid()) result.wallSeconds = wallClock.elapsed() / 1000.0;
+    return result;
+}
+
+void TrackAnalyzer::analyze(TrackId id, qint64 durationMs)
+{
+    if (!AudioFeatures::isAvailable() || !table->isValid(id)) return;
+    if (queued.contains(id) || failed.contains(id)) return;
+    if (similarity.contains(id) && tempos.contains(id)) return;
+
+    // Новая волна анализа - заново считаем пропускную способность
+    if (queued.isEmpty()) {
+        stats = Throughput();
+        wallClock.start();
+    }
+    queued.insert(id);
+    {
+        QMutexLocker locker(&mutex);
+        pending.append({id, table->path(id), durationMs});
+    }
+    cancelled.storeRelaxed(0);
+    startWorkers();
+}
+
+void TrackAnalyzer::forget(TrackId id)
+{
+    // Задание в работе вернётся, но без записи в queued результат будет отброшен
+    queued.remove(id);
+    failed.remove(id);
+    tempos.remove(id);
+    if (similarity.remove(id)) {
+        ++sinceSave;
+        scheduleCompaction();
+    }
+}
+
+bool TrackAnalyzer::relabel(TrackId from, TrackId to)
+{
+    queued.remove(from);
+    failed.remove(from);
+    if (!similarity.relabel(from, to)) {
+        tempos.remove(from);
+        return false;
+    }
+    if (tempos.contains(from)) tempos.insert(to, tempos.take(from));
+    ++sinceSave;
+    return true;
+}
+
+void TrackAnalyzer::cancel()
+{
+    cancelled.storeRelaxed(1);
+    QMutexLocker locker(&mutex);
+    for (const Job &job : std::as_const(pending)) {
+        queued.remove(job.id);
+    }
+    pending.clear();
+}
+
+void TrackAnalyzer::scheduleCompaction()
+{
+    if (!similarity.needsCompaction() || !compacting.testAndSetRelaxed(0, 1)) return;
+    // Перестройка графа - секунды на большой библиотеке; поиск тем временем идёт по старому.
+    // Если индекс успел измениться, попытка отбрасывается - следующее удаление запустит новую
+    pool.start([this]() {
+        const bool compacted = similarity.compact();
+        compacting.storeRelaxed(0);
+        if (!compacted) return;
+        QMetaObject::invokeMethod(this, [this]() {
+            ++sinceSave;
+            if (!saveTimer->isActive()) saveTimer->start();
+        }, Qt::QueuedConnection);
+    });
+}
+
+void TrackAnalyzer::startWorkers()
+{
+    // Рабочих не больше, чем потоков пула; каждый разбирает общую очередь до конца
+    QMutexLocker locker(&mutex);
+    while (activeWorkers < pool.maxThreadCount() && activeWorkers < pending.size()) {
+        ++activeWorkers;
+        pool.start([this]() { runWorker(); });
+    }
+}
+
+void TrackAnalyzer::runWorker()
+{
+    for (;;) {
+        Job job;
+        {
+            QMutexLocker locker(&mutex);
+            if (pending.isEmpty() || cancelled.loadRelaxed()) {
+                --activeWorkers;
+                return;
+            }
+            job = pending.takeFirst();
+        }
+
+        Result result;
+        QElapsedTimer timer;
+        timer.start();
+        result.descriptor = AudioFeatures::analyze(job.path, job.durationMs, cancelled, &result.error);
+        result.busyMs = timer.elapsed();
+        QMetaObject::invokeMethod(this, [this, job, result]() {
+            handleAnalyzed(job, result);
+        }, Qt::QueuedConnection);
+    }
+}
+
+void TrackAnalyzer::handleAnalyzed(const Job &job, const Result &result)
+{
+    // Трек успели удалить или переименовать, пока он анализировался
+    if (!queued.remove(job.id)) return;
+
+    const AudioDescriptor &descriptor = result.descriptor;
+    const QString &error = result.error;
+    if (error != "cancelled") {
+        ++stats.tracks;
+        stats.audioSeconds += descriptor.seconds;
+        stats.busySeconds += result.busyMs / 1000.0;
+        stats.wallSeconds = wallClock.elapsed() / 1000.0;
+    }
+
+    if (descriptor.valid) {
+        similarity.insert(job.id, descriptor.values);
+        tempos.insert(job.id, descriptor.tempo);
+        ++sinceSave;
+        if (!saveTimer->isActive()) saveTimer->start();
+    } else if (error != "cancelled") {
+        failed.insert(job.id);
+        qWarning() << "Cannot analyze" << job.path << ":" << error;
+    }
+
+    const int left = pendingCount();
+    emit progressChanged(similarity.size(), left);
+    if (left == 0 && queued.isEmpty()) {
+        if (sinceSave > 0) {
+            saveTimer->stop();
+            save();
+        }
+        emit finished();
+    }
+}
+
+bool TrackAnalyzer::save(QString *errorString)
+{
+    QDir().mkpath(QFileInfo(fileName).path());
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    similarity.save(out, [this](TrackId id) { return table->path(id); });
+    if (out.status() != QDataStream::Ok || !file.commit()) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+    if (!saveTempos(errorString)) return false;
+    sinceSave = 0;
+    return true;
+}
+
+bool TrackAnalyzer::saveTempos(QString *errorString)
+{
+    QSaveFile file(tempoFileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    out << tempoMagic << tempoVersion << quint32(tempos.size());
+    for (auto it = tempos.cbegin(); it != tempos.cend(); ++it) {
+        const TrackTempo &tempo = it.value();
+        out << table->path(it.key()) << tempo.bpm << tempo.beatOffsetMs << qint8(tempo.key) << tempo.keyStrength;
+    }
+    if (out.status() != QDataStream::Ok || !file.commit()) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void TrackAnalyzer::load()
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) return;
+
+    QDataStream in(&file);
+    in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    if (!similarity.load(in, [this](const QString &path) { return table->intern(path); })) {
+        // Старый или битый формат - пересчитаем в фоне
+        qWarning() << "Ignoring unreadable similarity index" << fileName;
+        similarity.clear();
+    }
+    loadTempos();
+    sinceSave = 0;
+    scheduleCompaction();
+}
+
+void TrackAnalyzer::loadTempos()
+{
+    tempos.clear();
+    QFile file(tempoFileName);
+    if (!file.open(QIODevice::ReadOnly)) return;
+
+    QDataStream in(&file);
+    in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 count = 0;
+    in >> magic >> version >> count;
+    if (magic != tempoMagic || version != tempoVersion) {
+        qWarning() << "Ignoring unreadable tempo cache" << tempoFileName;
+        return;
+    }
+
+    // Число записей из файла не должно заказать память больше, чем файл может вместить
+    if (count > quint64(qMax<qint64>(0, file.size() - tempoHeaderBytes)) / tempoMinRecordBytes) {
+        qWarning() << "Ignoring truncated tempo cache" << tempoFileName;
+        return;
+    }
+
+    QHash<TrackId, TrackTempo> loaded;
+    loaded.reserve(count);
+    for (quint32 i = 0; i < count; ++i) {
+        QString path;
+        TrackTempo tempo;
+        qint8 key = -1;
+        in >> path >> tempo.bpm >> tempo.beatOffsetMs >> key >> tempo.keyStrength;
+        if (in.status() != QDataStream::Ok) {
+            // Битый кэш целиком пересчитается в фоне
+            qWarning() << "Ignoring unreadable tempo cache" << tempoFileName;
+            return;
+        }
+        tempo.key = key;
+        const TrackId id = table->intern(path);
+        // Без описателя в индексе трек всё равно будет проанализирован заново
+        if (similarity.contains(id)) loaded.insert(id, tempo);
+    }
+    tempos = std::move(loaded);
+}
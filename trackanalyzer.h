@@ -0,0 +1,99 @@
+#ifndef TRACKANALYZER_H
+#define TRACKANALYZER_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QSet>
+#include <QThreadPool>
+#include "similarityindex.h"
+
+class QTimer;
+
+// Фоновый анализ звучания: описатели треков считаются в пуле потоков (половина ядер,
+// чтобы не мешать воспроизведению) и складываются в индекс похожих треков.
+// Заодно определяются темп, сетка долей и тональность для автомикса (tempo.dat рядом с индексом).
+// Индекс хранится в AppDataLocation/similarity.idx и при запуске не пересчитывается.
+class TrackAnalyzer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TrackAnalyzer(TrackTable *table, QObject *parent = nullptr);
+    ~TrackAnalyzer();
+
+    const SimilarityIndex &index() const { return similarity; }
+    bool isIndexed(TrackId id) const { return similarity.contains(id); }
+    int indexedCount() const { return similarity.size(); }
+    int pendingCount() const;
+    int failedCount() const { return failed.size(); }
+    // Невалидный, если трек ещё не проанализирован или темп не определился
+    TrackTempo tempo(TrackId id) const { return tempos.value(id); }
+
+    // Пропускная способность с последнего запуска очереди
+    struct Throughput {
+        int tracks = 0;
+        int workers = 0;
+        double audioSeconds = 0;
+        double busySeconds = 0;         // суммарно по потокам
+        double wallSeconds = 0;
+        double tracksPerSecond() const { return wallSeconds > 0 ? tracks / wallSeconds : 0.0; }
+    };
+    Throughput throughput() const;
+
+    // Уже проанализированные и повторно поставленные треки пропускаются
+    void analyze(TrackId id, qint64 durationMs);
+    void forget(TrackId id);
+    // false, если у старого идентификатора ещё нет описателя
+    bool relabel(TrackId from, TrackId to);
+    void cancel();
+
+    bool save(QString *errorString = nullptr);
+    void load();
+
+signals:
+    void progressChanged(int indexed, int pending);
+    void finished();
+
+private:
+    struct Job {
+        TrackId id;
+        QString path;
+        qint64 durationMs;
+    };
+    struct Result {
+        AudioDescriptor descriptor;
+        QString error;
+        qint64 busyMs = 0;
+    };
+
+    TrackTable *table;
+    QString fileName;
+    QString tempoFileName;
+    SimilarityIndex similarity;
+    QHash<TrackId, TrackTempo> tempos;
+
+    QThreadPool pool;
+    mutable QMutex mutex;
+    QList<Job> pending;                 // под mutex
+    int activeWorkers = 0;              // под mutex
+    QAtomicInt cancelled;
+    QAtomicInt compacting;
+
+    QSet<TrackId> queued;               // поставлены и ещё не вернулись
+    QSet<TrackId> failed;
+    int sinceSave = 0;
+    QTimer *saveTimer;
+
+    Throughput stats;
+    QElapsedTimer wallClock;
+
+    void startWorkers();
+    void runWorker();
+    void handleAnalyzed(const Job &job, const Result &result);
+    void scheduleCompaction();
+    bool saveTempos(QString *errorString);
+    void loadTempos();
+};
+
+#endif // TRACKANALYZER_H
@@ -0,0 +1,145 @@
+#include "tracktable.h"
+
+static const int initialCapacity = 1024;
+
+TrackTable::TrackTable()
+{
+    buckets.fill(InvalidId, initialCapacity);
+}
+
+TrackId TrackTable::intern(const QString &filePath)
+{
+    QString directory;
+    QByteArray name;
+    split(filePath, &directory, &name);
+
+    auto dir = directoryIds.constFind(directory);
+    quint32 directoryId;
+    if (dir == directoryIds.cend()) {
+        directoryId = quint32(directories.size());
+        directories.append(directory);
+        directoryIds.insert(directory, directoryId);
+    } else {
+        directoryId = *dir;
+    }
+
+    int slot = findSlot(directoryId, name);
+    if (buckets.at(slot) != InvalidId) {
+        return buckets.at(slot);
+    }
+
+    const TrackId id = TrackId(entries.size());
+    entries.append({directoryId, quint32(names.size()), quint32(name.size())});
+    names.append(name);
+
+    // Держим заполнение не выше половины
+    if (entries.size() * 2 > buckets.size()) {
+        rehash(buckets.size() * 2);
+        slot = findSlot(directoryId, name);
+    }
+    buckets[slot] = id;
+    return id;
+}
+
+QList<TrackId> TrackTable::intern(const QStringList &filePaths)
+{
+    QList<TrackId> ids;
+    ids.reserve(filePaths.size());
+    for (const QString &filePath : filePaths) {
+        ids.append(intern(filePath));
+    }
+    return ids;
+}
+
+TrackId TrackTable::find(const QString &filePath) const
+{
+    QString directory;
+    QByteArray name;
+    split(filePath, &directory, &name);
+
+    auto dir = directoryIds.constFind(directory);
+    if (dir == directoryIds.cend()) return InvalidId;
+    return buckets.at(findSlot(*dir, name));
+}
+
+QString TrackTable::path(TrackId id) const
+{
+    if (!isValid(id)) return QString();
+    const Entry &entry = entries.at(id);
+    return directories.at(entry.directory) + QString::fromUtf8(nameView(entry));
+}
+
+QStringList TrackTable::paths(const QList<TrackId> &ids) const
+{
+    QStringList result;
+    result.reserve(ids.size());
+    for (TrackId id : ids) {
+        result.append(path(id));
+    }
+    return result;
+}
+
+QString TrackTable::fileName(TrackId id) const
+{
+    if (!isValid(id)) return QString();
+    return QString::fromUtf8(nameView(entries.at(id)));
+}
+
+qint64 TrackTable::memoryUsage() const
+{
+    qint64 bytes = names.capacity()
+                   + entries.capacity() * qint64(sizeof(Entry))
+                   + buckets.capacity() * qint64(sizeof(TrackId));
+    for (const QString &directory : directories) {
+        // Строка хранится один раз, ключ хэша делит с ней данные
+        bytes += directory.capacity() * qint64(sizeof(QChar)) + 2 * qint64(sizeof(QString));
+    }
+    return bytes;
+}
+
+void TrackTable::split(const QString &filePath, QString *directory, QByteArray *name)
+{
+    const int slash = filePath.lastIndexOf('/');
+    *directory = filePath.left(slash + 1);
+    *name = filePath.mid(slash + 1).toUtf8();
+}
+
+size_t TrackTable::hash(quint32 directory, QByteArrayView name)
+{
+    return qHash(name, directory);
+}
+
+QByteArrayView TrackTable::nameView(const Entry &entry) const
+{
+    return QByteArrayView(names.constData() + entry.nameOffset, entry.nameLength);
+}
+
+int TrackTable::findSlot(quint32 directory, const QByteArray &name) const
+{
+    const int mask = buckets.size() - 1;
+    int slot = int(hash(directory, name) & size_t(mask));
+    while (true) {
+        const TrackId id = buckets.at(slot);
+        if (id == InvalidId) return slot;
+
+        const Entry &entry = entries.at(id);
+        if (entry.directory == directory && nameView(entry) == QByteArrayView(name)) {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+void TrackTable::rehash(int capacity)
+{
+    buckets.fill(InvalidId, capacity);
+    const int mask = capacity - 1;
+    for (TrackId id = 0; id < TrackId(entries.size()); ++id) {
+        const Entry &entry = entries.at(id);
+        int slot = int(hash(entry.directory, nameView(entry)) & size_t(mask));
+        while (buckets.at(slot) != InvalidId) {
+            slot = (slot + 1) & mask;
+        }
+        buckets[slot] = id;
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef TRACKTABLE_H
+#define TRACKTABLE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QStringList>
+#include <limits>
+
+using TrackId = quint32;
+
+// Компактная таблица путей: каждый путь хранится один раз как
+// (общий префикс-папка, имя файла в UTF-8 в общем буфере), остальной код
+// ссылается на треки 32-битными идентификаторами.
+// Идентификаторы не переиспользуются, поэтому остаются валидными всё время жизни таблицы.
+class TrackTable
+{
+public:
+    static constexpr TrackId InvalidId = std::numeric_limits<TrackId>::max();
+
+    TrackTable();
+
+    TrackId intern(const QString &filePath);
+    QList<TrackId> intern(const QStringList &filePaths);
+    TrackId find(const QString &filePath) const;
+
+    QString path(TrackId id) const;
+    QStringList paths(const QList<TrackId> &ids) const;
+    QString fileName(TrackId id) const;
+    bool isValid(TrackId id) const { return id < TrackId(entries.size()); }
+    int size() const { return entries.size(); }
+
+    // Оценка занятой памяти в байтах (без накладных расходов аллокатора)
+    qint64 memoryUsage() const;
+
+private:
+    struct Entry {
+        quint32 directory;
+        quint32 nameOffset;
+        quint32 nameLength;
+    };
+
+    QStringList directories;
+    QHash<QString, quint32> directoryIds;
+    QByteArray names;
+    QList<Entry> entries;
+
+    // Открытая адресация по (папка, имя): в слотах только идентификаторы
+    QList<TrackId> buckets;
+
+    static void split(const QString &filePath, QString *directory, QByteArray *name);
+    static size_t hash(quint32 directory, QByteArrayView name);
+    QByteArrayView nameView(const Entry &entry) const;
+    int findSlot(quint32 directory, const QByteArray &name) const;
+    void rehash(int capacity);
+};
+
+#endif // TRACKTABLE_H
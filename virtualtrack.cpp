@@ -0,0 +1,325 @@
+#include "virtualtrack.h"
+#include "tagreader.h"
+#include <QCache>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QRegularExpression>
+#include <QStringDecoder>
+#include <QTime>
+
+static const qint64 maxCueSize = 1024 * 1024;
+static const int maxDescribed = 4096;
+static const int maxSheetDirectories = 256;
+// Чаще листы папки не перепроверяем: имя спрашивают на каждой перерисовке списка
+static const qint64 sheetRecheckMs = 2000;
+// Путь хранит шесть знаков секунд: начало сверяется с листом с запасом на округление
+static const qint64 matchToleranceUs = 1000;
+
+static const QRegularExpression &fragmentPattern()
+{
+    static const QRegularExpression pattern(R"(#t=(\d+(?:\.\d{1,6})?),(\d+(?:\.\d{1,6})?)?$)");
+    return pattern;
+}
+
+// Целочисленно, без double: один и тот же отрезок всегда даёт один и тот же путь
+static QString secondsText(qint64 us)
+{
+    return QString("%1.%2").arg(us / 1000000).arg(us % 1000000, 6, 10, QChar('0'));
+}
+
+static qint64 parseSeconds(const QString &text)
+{
+    const QString whole = text.section('.', 0, 0);
+    const QString fraction = text.section('.', 1, 1).leftJustified(6, '0');
+    return whole.toLongLong() * 1000000 + fraction.toLongLong();
+}
+
+qint64 VirtualTrack::durationMs(qint64 fileDurationMs) const
+{
+    if (endUs >= 0) return (endUs - startUs) / 1000;
+    return qMax<qint64>(0, fileDurationMs - startMs());
+}
+
+QString VirtualTrack::path() const
+{
+    if (isWhole()) return filePath;
+    return filePath + "#t=" + secondsText(startUs) + "," + (endUs < 0 ? QString() : secondsText(endUs));
+}
+
+QStringList VirtualTrack::inputArguments() const
+{
+    // -ss до -i ищет по контейнеру; при перекодировании ffmpeg дорезает до точного сэмпла
+    QStringList arguments;
+    if (startUs > 0) arguments << "-ss" << secondsText(startUs);
+    if (endUs >= 0) arguments << "-t" << secondsText(endUs - startUs);
+    arguments << "-i" << filePath;
+    return arguments;
+}
+
+VirtualTrack VirtualTrack::fromPath(const QString &path)
+{
+    VirtualTrack track;
+    const QRegularExpressionMatch match = path.contains("#t=") ? fragmentPattern().match(path)
+                                                               : QRegularExpressionMatch();
+    if (!match.hasMatch()) {
+        track.filePath = path;
+        return track;
+    }
+    track.filePath = path.left(match.capturedStart());
+    track.startUs = parseSeconds(match.captured(1));
+    track.endUs = match.captured(2).isEmpty() ? -1 : parseSeconds(match.captured(2));
+    return track;
+}
+
+bool VirtualTrack::isVirtual(const QString &path)
+{
+    return path.contains("#t=") && fragmentPattern().match(path).hasMatch();
+}
+
+VirtualTrack VirtualTrack::describe(const QString &path)
+{
+    VirtualTrack track = fromPath(path);
+    if (track.isWhole()) return track;
+
+    // Списки спрашивают имя на каждой перерисовке - ответы запоминаем, а листы папки разбираем
+    // один раз на все её дорожки. Оба кэша вытесняют давно не спрошенное, а не сбрасываются целиком.
+    // Лист правят на месте (исправляют названия) - поэтому сверяем время и размер самих листов,
+    // а ответ годен, пока не разобрано новое поколение листов его папки
+    struct SheetFile {
+        QString name;
+        QDateTime modified;
+        qint64 size;
+        bool operator==(const SheetFile &other) const
+        {
+            return name == other.name && modified == other.modified && size == other.size;
+        }
+    };
+    struct DirectorySheets {
+        QList<SheetFile> files;
+        QList<VirtualTrack> tracks;     // дорожки всех листов папки по порядку имён листов
+        qint64 checkedMs;
+        quint64 generation;
+    };
+    struct Described {
+        VirtualTrack track;
+        quint64 generation;             // по какому разбору листов получен
+    };
+    static QMutex mutex;
+    static QCache<QString, Described> described(maxDescribed);
+    static QCache<QString, DirectorySheets> sheets(maxSheetDirectories);
+    static quint64 lastGeneration = 0;
+
+    const QFileInfo info(track.filePath);
+    const QString directoryPath = info.absolutePath();
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    {
+        QMutexLocker locker(&mutex);
+        const DirectorySheets *checked = sheets.object(directoryPath);
+        const Described *cached = described.object(path);
+        if (checked && cached && now - checked->checkedMs < sheetRecheckMs
+            && cached->generation == checked->generation) {
+            return cached->track;
+        }
+    }
+
+    const auto matches = [&](const QList<VirtualTrack> &candidates) {
+        for (const VirtualTrack &candidate : candidates) {
+            if (qAbs(candidate.startUs - track.startUs) <= matchToleranceUs
+                && QFileInfo(candidate.filePath).absoluteFilePath() == info.absoluteFilePath()) {
+                track.number = candidate.number;
+                track.title = candidate.title;
+                track.performer = candidate.performer;
+                track.album = candidate.album;
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Сначала листы CUE в папке файла, затем главы в тегах самого файла
+    const QDir directory(directoryPath);
+    QList<SheetFile> files;
+    for (const QFileInfo &cue : directory.entryInfoList({"*.cue"}, QDir::Files, QDir::Name)) {
+        files.append({cue.fileName(), cue.lastModified(), cue.size()});
+    }
+    QList<VirtualTrack> sheetTracks;
+    quint64 generation = 0;
+    bool parsed = false;
+    {
+        QMutexLocker locker(&mutex);
+        DirectorySheets *checked = sheets.object(directoryPath);
+        if (checked && checked->files == files) {
+            checked->checkedMs = now;
+            const Described *cached = described.object(path);
+            if (cached && cached->generation == checked->generation) return cached->track;
+            sheetTracks = checked->tracks;
+            generation = checked->generation;
+            parsed = true;
+        }
+    }
+    if (!parsed) {
+        // Читаем вне блокировки: другие потоки тем временем берут готовые ответы
+        for (const SheetFile &file : std::as_const(files)) {
+            sheetTracks += CueSheet::read(directory.filePath(file.name));
+        }
+        QMutexLocker locker(&mutex);
+        generation = ++lastGeneration;
+        sheets.insert(directoryPath, new DirectorySheets{files, sheetTracks, now, generation});
+    }
+    if (!matches(sheetTracks)) matches(CueSheet::chapters(track.filePath));
+
+    QMutexLocker locker(&mutex);
+    described.insert(path, new Described{track, generation});
+    return track;
+}
+
+QString VirtualTrack::displayName(const QString &path)
+{
+    const VirtualTrack track = describe(path);
+    if (track.isWhole()) return QFileInfo(track.filePath).completeBaseName();
+    if (!track.title.isEmpty()) {
+        return track.number > 0 ? QString("%1. %2").arg(track.number, 2, 10, QChar('0')).arg(track.title)
+                                : track.title;
+    }
+    const QTime start = QTime(0, 0).addMSecs(int(track.startMs()));
+    return QString("%1 [%2]").arg(QFileInfo(track.filePath).completeBaseName(),
+                                  start.toString(start.hour() > 0 ? "h:mm:ss" : "m:ss"));
+}
+
+// "Имя с пробелами.flac" WAVE или Имя.flac WAVE - тип файла в конце строки FILE не нужен
+static QString unquote(const QString &text, bool dropType = false)
+{
+    if (text.startsWith('"')) {
+        const int end = text.indexOf('"', 1);
+        return end > 0 ? text.mid(1, end - 1) : text.mid(1);
+    }
+    if (dropType && text.contains(' ')) return text.section(' ', 0, -2);
+    return text;
+}
+
+// Листы часто ссылаются на образ до сжатия ("CDImage.wav" при лежащем рядом .flac)
+static QString resolveFile(const QDir &base, const QString &name)
+{
+    const QString path = base.absoluteFilePath(name);
+    if (QFile::exists(path)) return path;
+    const QFileInfo info(path);
+    for (const char *suffix : {"flac", "wav", "mp3", "ogg"}) {
+        const QString candidate = info.absolutePath() + "/" + info.completeBaseName() + "." + suffix;
+        if (QFile::exists(candidate)) return candidate;
+    }
+    return path;
+}
+
+QList<VirtualTrack> CueSheet::read(const QString &cuePath, QString *errorString)
+{
+    QFile file(cuePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorString) *errorString = file.errorString();
+        return {};
+    }
+    const QByteArray data = file.read(maxCueSize);
+
+    // Листы из Windows часто в cp1251: если это не UTF-8, пробуем её, затем Latin-1
+    QStringDecoder utf8(QStringDecoder::Utf8);
+    QString text = utf8.decode(data);
+    if (utf8.hasError()) {
+        QStringDecoder cp1251("windows-1251");
+        text = cp1251.isValid() ? QString(cp1251.decode(data)) : QString::fromLatin1(data);
+    }
+
+    // INDEX 01 мм:сс:кк - кадры CD по 1/75 секунды, 588 сэмплов при 44.1 кГц
+    static const QRegularExpression indexLine(R"(^01\s+(\d+):(\d{1,2}):(\d{1,2})$)");
+    const QDir base = QFileInfo(cuePath).absoluteDir();
+    QString albumTitle;
+    QString albumPerformer;
+    QString currentFile;
+    QList<VirtualTrack> tracks;
+    int current = -1;
+    for (const QString &rawLine : text.split('\n')) {
+        const QString line = rawLine.simplified();
+        const QString keyword = line.section(' ', 0, 0).toUpper();
+        const QString rest = line.section(' ', 1).trimmed();
+
+        if (keyword == "FILE") {
+            currentFile = resolveFile(base, unquote(rest, true));
+            current = -1;
+        } else if (keyword == "TRACK") {
+            // Дорожки данных на смешанных дисках не звучат
+            current = -1;
+            if (currentFile.isEmpty() || rest.section(' ', 1, 1).toUpper() != "AUDIO") continue;
+            VirtualTrack track;
+            track.filePath = currentFile;
+            track.number = rest.section(' ', 0, 0).toInt();
+            track.startUs = -1;
+            track.performer = albumPerformer;
+            track.album = albumTitle;
+            tracks.append(track);
+            current = tracks.size() - 1;
+        } else if (keyword == "TITLE") {
+            (current >= 0 ? tracks[current].title : albumTitle) = unquote(rest);
+        } else if (keyword == "PERFORMER") {
+            (current >= 0 ? tracks[current].performer : albumPerformer) = unquote(rest);
+        } else if (keyword == "INDEX" && current >= 0) {
+            const QRegularExpressionMatch match = indexLine.match(rest);
+            if (!match.hasMatch()) continue;
+            const qint64 frames = (match.captured(1).toLongLong() * 60 + match.captured(2).toLongLong()) * 75
+                                  + match.captured(3).toLongLong();
+            tracks[current].startUs = (frames * 1000000 + 37) / 75;
+        }
+    }
+
+    // Без INDEX 01 дорожку не сыграть; конец - начало следующей дорожки того же файла,
+    // так что пауза перед дорожкой (INDEX 00) достаётся предыдущей и стык остаётся бесшовным
+    tracks.removeIf([](const VirtualTrack &track) { return track.startUs < 0; });
+    for (int i = 0; i < tracks.size(); ++i) {
+        const bool sameFile = i + 1 < tracks.size() && tracks.at(i + 1).filePath == tracks.at(i).filePath;
+        const qint64 end = sameFile ? tracks.at(i + 1).startUs : -1;
+        tracks[i].endUs = end > tracks.at(i).startUs ? end : -1;
+    }
+    if (tracks.isEmpty() && errorString) *errorString = "no audio tracks in cue sheet";
+    return tracks;
+}
+
+QList<VirtualTrack> CueSheet::chapters(const QString &filePath)
+{
+    const TrackTags tags = TagReader::read(filePath);
+    if (tags.chapters.size() < 2) return {};
+
+    QList<VirtualTrack> parts;
+    for (int i = 0; i < tags.chapters.size(); ++i) {
+        const TrackChapter &chapter = tags.chapters.at(i);
+        VirtualTrack part;
+        part.filePath = filePath;
+        part.number = i + 1;
+        // Вступление до первой главы относим к ней, чтобы ничего не потерялось
+        part.startUs = i == 0 ? 0 : chapter.startMs * 1000;
+        part.endUs = i + 1 < tags.chapters.size() ? tags.chapters.at(i + 1).startMs * 1000 : -1;
+        part.title = chapter.title;
+        part.performer = tags.artist;
+        // У подкастов и аудиокниг название файла - это название выпуска или книги
+        part.album = tags.title.isEmpty() ? tags.album : tags.title;
+        if (part.endUs >= 0 && part.endUs <= part.startUs) continue;
+        parts.append(part);
+    }
+    return parts.size() >= 2 ? parts : QList<VirtualTrack>();
+}
+
+QStringList CueSheet::expand(const QString &path)
+{
+    if (VirtualTrack::isVirtual(path)) return {path};
+
+    const QList<VirtualTrack> parts = path.endsWith(".cue", Qt::CaseInsensitive) ? read(path) : chapters(path);
+    if (parts.isEmpty()) {
+        // Лист без дорожек ничего не добавляет; обычный файл остаётся собой
+        return path.endsWith(".cue", Qt::CaseInsensitive) ? QStringList() : QStringList{path};
+    }
+    QStringList paths;
+    paths.reserve(parts.size());
+    for (const VirtualTrack &part : parts) {
+        paths.append(part.path());
+    }
+    return paths;
+}
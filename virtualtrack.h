@@ -0,0 +1,56 @@
+#ifndef VIRTUALTRACK_H
+#define VIRTUALTRACK_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+// Виртуальный трек - отрезок внутри файла: дорожка образа диска по листу CUE или глава
+// подкаста и аудиокниги. В таблице треков, коллекциях и очереди он живёт обычным путём
+// с фрагментом "<файл>#t=<начало>,<конец>" (секунды, как в Media Fragments URI),
+// поэтому остальной код обращается с ним как с любым треком.
+// Границы хранятся в микросекундах - это точнее сэмпла на любой частоте до 96 кГц.
+struct VirtualTrack
+{
+    QString filePath;               // сам аудиофайл
+    qint64 startUs = 0;
+    qint64 endUs = -1;              // -1 - до конца файла
+    int number = 0;                 // номер дорожки или главы
+    QString title;
+    QString performer;
+    QString album;
+
+    bool isValid() const { return !filePath.isEmpty(); }
+    bool isWhole() const { return startUs == 0 && endUs < 0; }
+    qint64 startMs() const { return startUs / 1000; }
+    qint64 endMs() const { return endUs < 0 ? -1 : endUs / 1000; }
+    // Длина отрезка; для отрезка до конца файла нужна длительность файла
+    qint64 durationMs(qint64 fileDurationMs) const;
+
+    // Путь для таблицы треков; у целого файла - просто путь к файлу
+    QString path() const;
+    // -ss/-t/-i для ffmpeg: декодируется только отрезок
+    QStringList inputArguments() const;
+
+    // Обычный путь даёт отрезок на весь файл
+    static VirtualTrack fromPath(const QString &path);
+    static bool isVirtual(const QString &path);
+    // Отрезок с названием, исполнителем и альбомом из листа CUE рядом с файлом или из глав в тегах
+    static VirtualTrack describe(const QString &path);
+    // Имя для списков: название дорожки, без него - имя файла и время начала
+    static QString displayName(const QString &path);
+};
+
+// Листы CUE (образ диска одним файлом или по файлу на дорожку) и главы в тегах
+class CueSheet
+{
+public:
+    // Дорожки листа; пути к файлам разрешаются относительно папки листа
+    static QList<VirtualTrack> read(const QString &cuePath, QString *errorString = nullptr);
+    // Главы из ID3 CHAP или Vorbis CHAPTERnnn; пусто, если глав меньше двух
+    static QList<VirtualTrack> chapters(const QString &filePath);
+    // Для импорта: лист - в его дорожки, файл с главами - в главы, остальное как есть
+    static QStringList expand(const QString &path);
+};
+
+#endif // VIRTUALTRACK_H